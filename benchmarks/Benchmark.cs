@@ -0,0 +1,26 @@
+﻿//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Benchmarks {
+    /// <summary>
+    ///   A suite of benchmark (or load test) cases, run by name from the command line.
+    /// </summary>
+    /// <remarks>
+    ///   A suite's settings are its public, settable properties; each one can be set with a switch of the same
+    ///   name (eg, <c>--corpus-size=1048576</c> sets <c>CorpusSize</c>). Time spans are given in seconds, and
+    ///   lists separated by commas.
+    /// </remarks>
+    public abstract class Benchmark {
+        /// <summary>
+        ///   Runs all the cases, adding each result to the report as it completes.
+        /// </summary>
+        public abstract void Run(BenchmarkReport report);
+    }
+}
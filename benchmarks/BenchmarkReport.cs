@@ -0,0 +1,70 @@
+﻿//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Benchmarks {
+    using System;
+    using System.Globalization;
+    using System.IO;
+    using System.Linq;
+
+    /// <summary>
+    ///   Writes the results of the suites as tab-separated lines, each suite under '#' lines that say what was run,
+    ///   when, on what machine and with what settings.
+    /// </summary>
+    /// <remarks>
+    ///   Every suite reports the same way, so results from different releases (or machines) can be compared with
+    ///   any diff or spreadsheet tool. Times are written in milliseconds, and fractions with the invariant culture.
+    /// </remarks>
+    public class BenchmarkReport {
+        private readonly TextWriter _output;
+
+        public BenchmarkReport(TextWriter output) {
+            _output = output;
+        }
+
+        /// <summary>
+        ///   Starts the results of a suite: its title and the time, the machine and the suite's settings, and the
+        ///   names of the columns.
+        /// </summary>
+        public void Begin(string title, string settings, params string[] columns) {
+            _output.WriteLine("# CoApp {0} {1:u}", title, DateTime.Now);
+            _output.WriteLine("# processors {0}, clr {1}, os {2}, {3}-bit{4}", Environment.ProcessorCount, Environment.Version,
+                Environment.OSVersion, IntPtr.Size*8, string.IsNullOrEmpty(settings) ? string.Empty : ", " + settings);
+            _output.WriteLine("# " + string.Join("\t", columns));
+            _output.Flush();
+        }
+
+        /// <summary>
+        ///   Writes one result, a value for each column.
+        /// </summary>
+        public void Add(params object[] values) {
+            _output.WriteLine(string.Join("\t", values.Select(Format)));
+            _output.Flush();
+        }
+
+        /// <summary>
+        ///   Writes a line that isn't a result (a note, or a failure), as a comment.
+        /// </summary>
+        public void Note(string format, params object[] args) {
+            _output.WriteLine("# " + string.Format(CultureInfo.InvariantCulture, format, args));
+            _output.Flush();
+        }
+
+        private static string Format(object value) {
+            if (value is TimeSpan) {
+                return ((TimeSpan)value).TotalMilliseconds.ToString("0.###", CultureInfo.InvariantCulture);
+            }
+            if (value is double) {
+                return ((double)value).ToString("0.####", CultureInfo.InvariantCulture);
+            }
+            return Convert.ToString(value, CultureInfo.InvariantCulture);
+        }
+    }
+}
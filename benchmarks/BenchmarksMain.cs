@@ -0,0 +1,207 @@
+﻿//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Benchmarks {
+    using System;
+    using System.Collections.Generic;
+    using System.Globalization;
+    using System.IO;
+    using System.Linq;
+    using Toolkit.Exceptions;
+    using Toolkit.Extensions;
+
+    internal class BenchmarksMain {
+        private const string help =
+            @"
+Usage:
+-------
+
+CoApp.Benchmarks [options] <suite> [<suite>...]
+
+    Runs benchmark suites, and writes the results as tab-separated lines.
+
+    Suites:
+    -------
+    compression                 DEFLATE, GZip, CRC-32, the parallel streams,
+                                small streams, zip pack/unpack and cab
+                                unpack, on generated corpora
+    compression-round-trip      checks compressed data inflates back to its
+                                input: the parallel deflate stream at many
+                                sizes, full flushes, and exact-size buffers
+    directory-walk              finding files in a large generated tree,
+                                the parallel walker against a sequential
+                                walk (and checks they agree)
+    engine-load                 many sessions with a running engine at once,
+                                sending find-packages and install-package
+                                (pretend) requests; latency percentiles
+    http-server                 many clients downloading a large file from
+                                the HTTP server at once, whole and in ranges
+    messages                    parsing, encoding and reading engine
+                                messages, and the bytes each allocates
+    msi-reader                  checks the managed MSI reader reads the
+                                same properties as the Windows Installer
+                                API, from real MSIs (Windows only)
+    property-sheet-cache        checks property sheets reloaded thru the
+                                cache as they're edited match parsing
+                                them from scratch
+    protocol                    the engine's response pipe, one write per
+                                message against framed batches
+    sgml                        the SGML reader, reading and scraping a
+                                large generated HTML page
+
+    Options:
+    --------
+    --help                      this help
+    --load-config=<file>        loads configuration from <file>
+    --output=<file>             writes the results to <file> (rather than
+                                the console)
+
+    --<setting>=<value>         sets a setting of the suites being run
+                                (eg, --minimum-time=5 --corpora=text,zeros);
+                                times are in seconds, lists separated by
+                                commas. See each suite for its settings.
+";
+
+        private static readonly Dictionary<string, Func<Benchmark>> Suites = new Dictionary<string, Func<Benchmark>> {
+            {"compression", () => new CompressionBenchmark()},
+            {"compression-round-trip", () => new CompressionRoundTrip()},
+            {"directory-walk", () => new DirectoryWalkBenchmark()},
+            {"engine-load", () => new EngineLoadTest()},
+            {"http-server", () => new HttpServerLoadTest()},
+            {"messages", () => new MessageBenchmark()},
+            {"msi-reader", () => new MsiReaderCheck()},
+            {"property-sheet-cache", () => new PropertySheetCacheCheck()},
+            {"protocol", () => new ProtocolBenchmark()},
+            {"sgml", () => new SgmlBenchmark()},
+        };
+
+        private static int Main(string[] args) {
+            try {
+                return new BenchmarksMain().main(args);
+            }
+            catch (ConsoleException failure) {
+                return Fail("\r\n{0}\r\n", failure.Message);
+            }
+            catch (Exception failure) {
+                return Fail("\r\n{0}\r\n{1}", failure.Message, failure.StackTrace);
+            }
+        }
+
+        private int main(IEnumerable<string> args) {
+            var options = args.Switches();
+            var parameters = args.Parameters().ToArray();
+            string output = null;
+            var settings = new Dictionary<string, string>();
+
+            foreach (var arg in options.Keys) {
+                var argumentParameters = options[arg];
+                switch (arg) {
+                    case "load-config":
+                        break;
+
+                    case "output":
+                        output = argumentParameters.LastOrDefault();
+                        break;
+
+                    case "help":
+                        return Help();
+
+                    default:
+                        settings[arg] = argumentParameters.LastOrDefault();
+                        break;
+                }
+            }
+
+            if (!parameters.Any()) {
+                return Help();
+            }
+
+            var unknown = parameters.FirstOrDefault(each => !Suites.ContainsKey(each.ToLower()));
+            if (unknown != null) {
+                throw new ConsoleException("Unknown suite '{0}'. Use --help for the list.", unknown);
+            }
+            var suites = parameters.Select(each => Suites[each.ToLower()]()).ToArray();
+
+            foreach (var setting in settings) {
+                var applied = suites.Count(suite => Apply(suite, setting.Key, setting.Value));
+                if (applied == 0) {
+                    throw new ConsoleException("None of the suites has a setting '--{0}'.", setting.Key);
+                }
+            }
+
+            var writer = output == null ? Console.Out : new StreamWriter(output);
+            try {
+                var report = new BenchmarkReport(writer);
+                foreach (var suite in suites) {
+                    suite.Run(report);
+                }
+            }
+            finally {
+                if (output != null) {
+                    writer.Close();
+                }
+            }
+            return 0;
+        }
+
+        /// <summary>
+        ///   Sets the property of a suite named by a switch (eg, 'corpus-size' sets CorpusSize), if it has one.
+        /// </summary>
+        private static bool Apply(Benchmark suite, string name, string value) {
+            var property = suite.GetType().GetProperties().FirstOrDefault(each =>
+                each.CanWrite && each.Name.Equals(name.Replace("-", string.Empty), StringComparison.OrdinalIgnoreCase));
+            if (property == null) {
+                return false;
+            }
+
+            try {
+                var type = property.PropertyType;
+                object converted;
+                if (type == typeof (TimeSpan)) {
+                    converted = TimeSpan.FromSeconds(double.Parse(value, CultureInfo.InvariantCulture));
+                }
+                else if (type == typeof (string[])) {
+                    converted = value.Split(new[] {','}, StringSplitOptions.RemoveEmptyEntries);
+                }
+                else if (type.IsEnum) {
+                    converted = Enum.Parse(type, value, true);
+                }
+                else {
+                    converted = Convert.ChangeType(value, type, CultureInfo.InvariantCulture);
+                }
+                property.SetValue(suite, converted, null);
+            }
+            catch (FormatException) {
+                throw new ConsoleException("'{0}' isn't a valid value for '--{1}'.", value, name);
+            }
+            catch (OverflowException) {
+                throw new ConsoleException("'{0}' isn't a valid value for '--{1}'.", value, name);
+            }
+            catch (ArgumentException) {
+                throw new ConsoleException("'{0}' isn't a valid value for '--{1}'.", value, name);
+            }
+            return true;
+        }
+
+        #region fail/help
+
+        public static int Fail(string text, params object[] par) {
+            Console.WriteLine("Error:{0}", text.format(par));
+            return 1;
+        }
+
+        private static int Help() {
+            help.Print();
+            return 0;
+        }
+
+        #endregion
+    }
+}
@@ -0,0 +1,496 @@
+﻿//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+extern alias engine;
+
+namespace CoApp.Benchmarks {
+    using System;
+    using System.Collections.Generic;
+    using System.Globalization;
+    using System.IO;
+    using System.Linq;
+    using Ionic.Crc;
+    using Ionic.Zlib;
+    using engine::Microsoft.Deployment.Compression;
+    using engine::Microsoft.Deployment.Compression.Cab;
+    using engine::Microsoft.Deployment.Compression.Zip;
+    using CompressionLevel = Ionic.Zlib.CompressionLevel;
+
+    /// <summary>
+    ///   Measures the throughput, parallel scaling and allocation rate of the compression code on a fixed corpus.
+    /// </summary>
+    /// <remarks>
+    ///   <para>
+    ///     The corpus is generated from a fixed seed, so every run (on any machine or OS) compresses exactly the same
+    ///     bytes, and the compressed sizes only change when the compressor does. There are four kinds of data: "text"
+    ///     (words and punctuation), "binary" (records of small, slowly changing integers, like tables in an
+    ///     executable), "random" (incompressible) and "zeros".
+    ///   </para>
+    ///   <para>
+    ///     The cases are DEFLATE compress and decompress at each level, the ParallelDeflateOutputStream and
+    ///     ParallelInflateInputStream at 1 to <see cref = "MaxParallelism" />, CRC-32, GZipStream streaming, and the
+    ///     engine's zip pack and unpack, and cab unpack (on Windows, which has the cabinet library), with the time each of
+    ///     the cabinet's folders took noted after each run.
+    ///   </para>
+    ///   <para>
+    ///     The "crc32" cases run over the whole corpus in one call, and in blocks of 16 bytes to 1MB (one CRC, a call
+    ///     per block), the way the streams feed it whatever size they were written or read in.
+    ///   </para>
+    ///   <para>
+    ///     The "small-deflate" and "small-inflate" cases compress and decompress a single 4KB piece of the corpus per
+    ///     iteration, with a DeflateStream and with CompressBuffer/UncompressBuffer, into buffers made beforehand: what
+    ///     they allocate is what it costs to set up and tear down one stream (or codec), which is most of the cost of a
+    ///     small one.
+    ///   </para>
+    /// </remarks>
+    public class CompressionBenchmark : Benchmark {
+        private const int StreamChunkSize = 64*1024;
+        private const int SmallStreamSize = 4*1024;
+
+        // what streams hand the CRC, from a few bytes at a time up to a big read.
+        private static readonly int[] CrcBlockSizes = {16, 64, 256, 1024, 4*1024, 16*1024, 64*1024, 256*1024, 1024*1024};
+
+        private static readonly string[] Words = {
+            "the", "package", "of", "and", "to", "install", "a", "in", "feed", "is", "for", "version", "that", "with",
+            "file", "on", "as", "by", "manifest", "library", "be", "this", "from", "are", "or", "dependency", "it",
+            "an", "at", "which", "binary", "shared", "not", "publisher", "have", "has", "all", "but", "were",
+            "architecture", "when", "there", "can", "been", "one", "would", "their", "if", "will", "assembly",
+        };
+
+        // (the enum has several names for some levels; these are one of each.)
+        private static readonly CompressionLevel[] Levels = {
+            CompressionLevel.Level0, CompressionLevel.Fastest, CompressionLevel.Level1, CompressionLevel.Level2,
+            CompressionLevel.Level3, CompressionLevel.Level4, CompressionLevel.Level5, CompressionLevel.Level6,
+            CompressionLevel.Level7, CompressionLevel.Level8, CompressionLevel.Level9,
+        };
+
+        private readonly Dictionary<string, byte[]> _corpus = new Dictionary<string, byte[]>();
+        private BenchmarkReport _report;
+
+        /// <summary>
+        ///   Creates a benchmark with the default settings: a 4MB corpus of each kind, at least a second and three
+        ///   iterations per case, and up to one degree of parallelism per processor.
+        /// </summary>
+        public CompressionBenchmark() {
+            CorpusSize = 4*1024*1024;
+            Corpora = new[] {"text", "binary", "random", "zeros"};
+            MinimumTime = TimeSpan.FromSeconds(1);
+            MinimumIterations = 3;
+            MaxParallelism = Environment.ProcessorCount;
+        }
+
+        /// <summary>
+        ///   The size of each kind of corpus.
+        /// </summary>
+        public int CorpusSize { get; set; }
+
+        /// <summary>
+        ///   The kinds of corpus to run the cases on.
+        /// </summary>
+        public string[] Corpora { get; set; }
+
+        /// <summary>
+        ///   The least time to spend timing each case.
+        /// </summary>
+        public TimeSpan MinimumTime { get; set; }
+
+        /// <summary>
+        ///   The least number of timed iterations of each case.
+        /// </summary>
+        public int MinimumIterations { get; set; }
+
+        /// <summary>
+        ///   The highest degree of parallelism to try.
+        /// </summary>
+        public int MaxParallelism { get; set; }
+
+        /// <summary>
+        ///   Generates a corpus of the given kind. The same kind and size always produce the same bytes.
+        /// </summary>
+        public static byte[] CreateCorpus(string kind, int size) {
+            var data = new byte[size];
+            // xorshift, rather than System.Random, whose sequence isn't promised to stay the same from one framework to the next.
+            uint x = 2463534242;
+            Func<uint> next = () => {
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+                return x;
+            };
+
+            switch (kind) {
+                case "text":
+                    for (int i = 0, n = 0; i < size; n++) {
+                        var word = Words[(int)(next()%(n%8 == 0 ? Words.Length : 16))];
+                        for (var j = 0; j < word.Length && i < size; j++) {
+                            data[i++] = (byte)word[j];
+                        }
+                        if (i < size) {
+                            data[i++] = (byte)(n%12 == 11 ? '.' : n%97 == 96 ? '\n' : ' ');
+                        }
+                    }
+                    break;
+
+                case "binary":
+                    // 16-byte records: a counter, a slowly drifting value, flags and some noise.
+                    uint counter = 0, drift = 0x10000;
+                    for (var i = 0; i + 16 <= size; i += 16) {
+                        var r = next();
+                        drift += r%16;
+                        Array.Copy(BitConverter.GetBytes(counter++), 0, data, i, 4);
+                        Array.Copy(BitConverter.GetBytes(drift), 0, data, i + 4, 4);
+                        Array.Copy(BitConverter.GetBytes(r%4 == 0 ? 0x80000000u : 0x00000001u), 0, data, i + 8, 4);
+                        Array.Copy(BitConverter.GetBytes(r >> 20), 0, data, i + 12, 4);
+                    }
+                    break;
+
+                case "random":
+                    for (var i = 0; i < size; i++) {
+                        data[i] = (byte)(next() >> 24);
+                    }
+                    break;
+
+                case "zeros":
+                    break;
+
+                default:
+                    throw new ArgumentException(string.Format("Unknown corpus kind '{0}'", kind), "kind");
+            }
+            return data;
+        }
+
+        public override void Run(BenchmarkReport report) {
+            _report = report;
+            report.Begin("compression benchmark", string.Format(CultureInfo.InvariantCulture, "corpus {0} bytes", CorpusSize),
+                "group", "name", "corpus", "parallelism", "iterations", "uncompressed-bytes", "compressed-bytes", "ratio",
+                "mean-ms", "min-ms", "MB/s", "alloc-bytes", "gen0");
+
+            foreach (var kind in Corpora) {
+                var data = Corpus(kind);
+
+                foreach (var level in Levels) {
+                    var l = level;
+                    var compressed = Deflate(data, l);
+                    var name = l == CompressionLevel.Fastest ? "Fastest" : "Level" + (int)l;
+                    Measure("deflate", name, kind, 1, data.Length, () => Deflate(data, l).Length);
+                    Measure("inflate", name, kind, 1, data.Length, () => {
+                        Inflate(compressed);
+                        return compressed.Length;
+                    });
+                }
+
+                var small = new byte[SmallStreamSize];
+                Array.Copy(data, small, small.Length);
+                var smallOutput = new MemoryStream(2*SmallStreamSize);
+                var smallCompressed = new byte[2*SmallStreamSize + 64];
+                var smallLength = DeflateStream.CompressBuffer(small, 0, small.Length, smallCompressed, 0, smallCompressed.Length, CompressionLevel.Default);
+                var smallInflated = new byte[SmallStreamSize];
+                Measure("small-deflate", "stream", kind, 1, small.Length, () => SmallDeflate(small, smallOutput));
+                Measure("small-inflate", "stream", kind, 1, small.Length, () => {
+                    SmallInflate(smallCompressed, smallLength, smallInflated);
+                    return smallLength;
+                });
+                Measure("small-deflate", "buffer", kind, 1, small.Length,
+                    () => DeflateStream.CompressBuffer(small, 0, small.Length, smallCompressed, 0, smallCompressed.Length, CompressionLevel.Default));
+                Measure("small-inflate", "buffer", kind, 1, small.Length, () => {
+                    DeflateStream.UncompressBuffer(smallCompressed, 0, smallLength, smallInflated, 0, smallInflated.Length);
+                    return smallLength;
+                });
+
+                Measure("crc32", "SlurpBlock", kind, 1, data.Length, () => {
+                    new CRC32().SlurpBlock(data, 0, data.Length);
+                    return 0;
+                });
+                foreach (var size in CrcBlockSizes.Where(each => each <= data.Length)) {
+                    var s = size;
+                    Measure("crc32", "SlurpBlock-" + s, kind, 1, data.Length, () => {
+                        var crc = new CRC32();
+                        for (var offset = 0; offset < data.Length; offset += s) {
+                            crc.SlurpBlock(data, offset, Math.Min(s, data.Length - offset));
+                        }
+                        return 0;
+                    });
+                }
+
+                Measure("gzip", "compress", kind, 1, data.Length, () => GZip(data).Length);
+                var gzipped = GZip(data);
+                Measure("gunzip", "decompress", kind, 1, data.Length, () => {
+                    GUnzip(gzipped);
+                    return gzipped.Length;
+                });
+
+                foreach (var parallelism in ParallelismSteps()) {
+                    var p = parallelism;
+                    DeflateBlockIndex index;
+                    Measure("parallel-deflate", "Default", kind, p, data.Length, () => ParallelDeflate(data, p, out index).Length);
+                    var blocks = ParallelDeflate(data, p, out index);
+                    Measure("parallel-inflate", "Default", kind, p, data.Length, () => {
+                        ParallelInflate(blocks, index, p);
+                        return blocks.Length;
+                    });
+                }
+            }
+
+            var files = ZipCorpus();
+            var total = files.Sum(each => (long)each.Value.Length);
+            foreach (var parallelism in ParallelismSteps()) {
+                var p = parallelism;
+                Measure("zip-pack", "Normal", "mixed", p, total, () => ZipPack(files, p).Length);
+                var archive = ZipPack(files, p);
+                Measure("zip-unpack", "Normal", "mixed", p, total, () => {
+                    ZipUnpack(archive, p);
+                    return archive.Length;
+                });
+            }
+
+            if (Environment.OSVersion.Platform != PlatformID.Win32NT) {
+                _report.Note("cab-unpack needs the Windows cabinet library; skipped");
+                return;
+            }
+            var cabinet = CabPack(files);
+            foreach (var parallelism in ParallelismSteps()) {
+                var p = parallelism;
+                IList<CabFolderStatistics> folders = null;
+                Measure("cab-unpack", "Normal", "mixed", p, total, () => {
+                    folders = CabUnpack(cabinet, p);
+                    return cabinet.Length;
+                });
+                foreach (var folder in folders) {
+                    _report.Note("cab-unpack at {0}: {1}", p, folder);
+                }
+            }
+        }
+
+        private byte[] Corpus(string kind) {
+            byte[] data;
+            if (!_corpus.TryGetValue(kind, out data)) {
+                data = CreateCorpus(kind, CorpusSize);
+                _corpus.Add(kind, data);
+            }
+            return data;
+        }
+
+        // 1, 2, 4 ... and MaxParallelism itself.
+        private IEnumerable<int> ParallelismSteps() {
+            var p = 1;
+            for (; p < MaxParallelism; p *= 2) {
+                yield return p;
+            }
+            yield return Math.Max(1, MaxParallelism);
+        }
+
+        // the operation returns the compressed size, or 0 where nothing is compressed.
+        private void Measure(string group, string name, string corpus, int parallelism, long uncompressedBytes, Func<long> operation) {
+            var m = Measurement.Of(operation, MinimumTime, MinimumIterations);
+            _report.Add(group, name, corpus, parallelism, m.Iterations, uncompressedBytes, m.Result,
+                uncompressedBytes > 0 ? (double)m.Result/uncompressedBytes : 0, m.Mean, m.Min, m.MegabytesPerSecond(uncompressedBytes),
+                m.AllocatedBytes, m.Gen0Collections);
+        }
+
+        private static byte[] Deflate(byte[] data, CompressionLevel level) {
+            using (var output = new MemoryStream()) {
+                using (var deflater = new DeflateStream(output, CompressionMode.Compress, level, true)) {
+                    deflater.Write(data, 0, data.Length);
+                }
+                return output.ToArray();
+            }
+        }
+
+        private static void Inflate(byte[] compressed) {
+            var buffer = new byte[StreamChunkSize];
+            using (var inflater = new DeflateStream(new MemoryStream(compressed, false), CompressionMode.Decompress)) {
+                while (inflater.Read(buffer, 0, buffer.Length) > 0) {
+                }
+            }
+        }
+
+        // one small stream into an output that's already big enough, so all that's allocated is the stream's own.
+        private static long SmallDeflate(byte[] data, MemoryStream output) {
+            output.SetLength(0);
+            using (var deflater = new DeflateStream(output, CompressionMode.Compress, CompressionLevel.Default, true)) {
+                deflater.Write(data, 0, data.Length);
+            }
+            return output.Length;
+        }
+
+        private static void SmallInflate(byte[] compressed, int length, byte[] buffer) {
+            using (var inflater = new DeflateStream(new MemoryStream(compressed, 0, length, false), CompressionMode.Decompress)) {
+                while (inflater.Read(buffer, 0, buffer.Length) > 0) {
+                }
+            }
+        }
+
+        // GZipStream the way a download would be: written and read a chunk at a time.
+        private static byte[] GZip(byte[] data) {
+            using (var output = new MemoryStream()) {
+                using (var gzip = new GZipStream(output, CompressionMode.Compress, CompressionLevel.Default, true)) {
+                    for (var offset = 0; offset < data.Length; offset += StreamChunkSize) {
+                        gzip.Write(data, offset, Math.Min(StreamChunkSize, data.Length - offset));
+                    }
+                }
+                return output.ToArray();
+            }
+        }
+
+        private static void GUnzip(byte[] compressed) {
+            var buffer = new byte[StreamChunkSize];
+            using (var gunzip = new GZipStream(new MemoryStream(compressed, false), CompressionMode.Decompress)) {
+                while (gunzip.Read(buffer, 0, buffer.Length) > 0) {
+                }
+            }
+        }
+
+        // The stream takes at least four buffer pairs, and has no setting for its number of threads; buffer pairs
+        // bound how many buffers are being compressed at once, so they stand in for the parallelism.
+        private static byte[] ParallelDeflate(byte[] data, int parallelism, out DeflateBlockIndex index) {
+            using (var output = new MemoryStream()) {
+                using (var deflater = new ParallelDeflateOutputStream(output, CompressionLevel.Default, CompressionStrategy.Default, true)) {
+                    deflater.MaxBufferPairs = Math.Max(4, parallelism);
+                    deflater.Write(data, 0, data.Length);
+                    deflater.Close();
+                    index = deflater.BlockIndex;
+                }
+                return output.ToArray();
+            }
+        }
+
+        private static void ParallelInflate(byte[] compressed, DeflateBlockIndex index, int parallelism) {
+            var buffer = new byte[StreamChunkSize];
+            using (var inflater = new ParallelInflateInputStream(new MemoryStream(compressed, false), index)) {
+                inflater.MaxBlocksInFlight = parallelism;
+                while (inflater.Read(buffer, 0, buffer.Length) > 0) {
+                }
+            }
+        }
+
+        // files of 1KB to 256KB, cut from each kind of corpus in turn.
+        private List<KeyValuePair<string, byte[]>> ZipCorpus() {
+            var sizes = new[] {1024, 16*1024, 64*1024, 256*1024};
+            var offsets = new Dictionary<string, int>();
+            var files = new List<KeyValuePair<string, byte[]>>();
+            long total = 0;
+            for (var i = 0; total < CorpusSize; i++) {
+                var kind = Corpora[i%Corpora.Length];
+                var data = Corpus(kind);
+                int offset;
+                offsets.TryGetValue(kind, out offset);
+                var size = Math.Min(sizes[i%sizes.Length], data.Length);
+                if (offset + size > data.Length) {
+                    offset = 0;
+                }
+
+                var file = new byte[size];
+                Array.Copy(data, offset, file, 0, size);
+                offsets[kind] = offset + size;
+                files.Add(new KeyValuePair<string, byte[]>(string.Format(CultureInfo.InvariantCulture, "{0}\\{1:D4}.dat", kind, i), file));
+                total += size;
+            }
+            return files;
+        }
+
+        private static byte[] ZipPack(List<KeyValuePair<string, byte[]>> files, int parallelism) {
+            var context = new MemoryPackStreamContext(files);
+            using (var zip = new ZipEngine()) {
+                zip.MaxDegreeOfParallelism = parallelism;
+                zip.Pack(context, files.Select(each => each.Key));
+            }
+            return context.Archive.ToArray();
+        }
+
+        private static void ZipUnpack(byte[] archive, int parallelism) {
+            using (var zip = new ZipEngine()) {
+                zip.MaxDegreeOfParallelism = parallelism;
+                zip.Unpack(new MemoryUnpackStreamContext(archive), null);
+            }
+        }
+
+        // 1MB folders, so that there are several to unpack at once.
+        private static byte[] CabPack(List<KeyValuePair<string, byte[]>> files) {
+            var context = new MemoryPackStreamContext(files) {
+                MaxFolderSize = 1024*1024
+            };
+            using (var cab = new CabEngine()) {
+                cab.Pack(context, files.Select(each => each.Key));
+            }
+            return context.Archive.ToArray();
+        }
+
+        // returns the time each folder took (only when they were unpacked in parallel).
+        private static IList<CabFolderStatistics> CabUnpack(byte[] archive, int parallelism) {
+            using (var cab = new CabEngine()) {
+                cab.MaxDegreeOfParallelism = parallelism;
+                cab.Unpack(new MemoryUnpackStreamContext(archive), null);
+                return cab.FolderStatistics;
+            }
+        }
+
+        private class MemoryPackStreamContext : IPackStreamContext {
+            private readonly Dictionary<string, byte[]> _files;
+            internal readonly MemoryStream Archive = new MemoryStream();
+            internal long MaxFolderSize;
+
+            internal MemoryPackStreamContext(IEnumerable<KeyValuePair<string, byte[]>> files) {
+                _files = files.ToDictionary(each => each.Key, each => each.Value);
+            }
+
+            public string GetArchiveName(int archiveNumber) {
+                return "benchmark.zip";
+            }
+
+            public Stream OpenArchiveWriteStream(int archiveNumber, string archiveName, bool truncate, CompressionEngine compressionEngine) {
+                if (truncate) {
+                    Archive.SetLength(0);
+                }
+                return Archive;
+            }
+
+            public void CloseArchiveWriteStream(int archiveNumber, string archiveName, Stream stream) {
+            }
+
+            public Stream OpenFileReadStream(string path, out FileAttributes attributes, out DateTime lastWriteTime) {
+                attributes = FileAttributes.Normal;
+                lastWriteTime = new DateTime(2011, 1, 1);
+                return new MemoryStream(_files[path], false);
+            }
+
+            public void CloseFileReadStream(string path, Stream stream) {
+                stream.Close();
+            }
+
+            public object GetOption(string optionName, object[] parameters) {
+                return optionName == "maxFolderSize" && MaxFolderSize > 0 ? (object)MaxFolderSize : null;
+            }
+        }
+
+        private class MemoryUnpackStreamContext : IUnpackStreamContext {
+            private readonly byte[] _archive;
+
+            internal MemoryUnpackStreamContext(byte[] archive) {
+                _archive = archive;
+            }
+
+            public Stream OpenArchiveReadStream(int archiveNumber, string archiveName, CompressionEngine compressionEngine) {
+                return new MemoryStream(_archive, false);
+            }
+
+            public void CloseArchiveReadStream(int archiveNumber, string archiveName, Stream stream) {
+                stream.Close();
+            }
+
+            public Stream OpenFileWriteStream(string path, long fileSize, DateTime lastWriteTime) {
+                return new MemoryStream((int)fileSize);
+            }
+
+            public void CloseFileWriteStream(string path, Stream stream, FileAttributes attributes, DateTime lastWriteTime) {
+                stream.Close();
+            }
+        }
+    }
+}
@@ -0,0 +1,259 @@
+﻿//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Benchmarks {
+    using System;
+    using System.Globalization;
+    using System.IO;
+    using System.Linq;
+    using Ionic.Zlib;
+    using Toolkit.Exceptions;
+
+    /// <summary>
+    ///   Checks that what the ParallelDeflateOutputStream writes inflates back to what was written to it, with the
+    ///   DeflateStream and with the ParallelInflateInputStream, at the sizes where buffers fill exactly and where they
+    ///   don't; that what the DeflateStream writes after a full flush inflates on its own, at every level; and that
+    ///   CompressBuffer and UncompressBuffer fill an output that's exactly big enough, and fail on one a byte short.
+    /// </summary>
+    /// <remarks>
+    ///   The stream compresses its buffers on pool threads, so a mistake in how it waits for them is timing-dependent;
+    ///   each size is round-tripped <see cref = "Repeats" /> times. The full flush cases write the same data twice, with
+    ///   a full flush in between, so that anything that still remembers the first copy will match against it. Any round
+    ///   trip that fails fails the run.
+    /// </remarks>
+    public class CompressionRoundTrip : Benchmark {
+        /// <summary>
+        ///   Creates a check with the default settings: the stream's default buffer size, and 20 round trips per size.
+        /// </summary>
+        public CompressionRoundTrip() {
+            BufferSize = 64*1024;
+            Repeats = 20;
+            Corpora = new[] {"text", "random"};
+        }
+
+        /// <summary>
+        ///   The stream's buffer size; the sizes round-tripped are around multiples of it.
+        /// </summary>
+        public int BufferSize { get; set; }
+
+        /// <summary>
+        ///   The number of times each size is round-tripped.
+        /// </summary>
+        public int Repeats { get; set; }
+
+        /// <summary>
+        ///   The kinds of data to round-trip (see <see cref = "CompressionBenchmark.CreateCorpus" />).
+        /// </summary>
+        public string[] Corpora { get; set; }
+
+        public override void Run(BenchmarkReport report) {
+            report.Begin("compression round trip", string.Format(CultureInfo.InvariantCulture, "buffer {0} bytes", BufferSize),
+                "case", "corpus", "level", "size", "repeats", "compressed-bytes", "failures");
+
+            // (not 0: the stream sets itself up on the first write, and the zip engine doesn't use it for empty files.)
+            var sizes = new[] {
+                10, BufferSize - 1, BufferSize, BufferSize + 1, 4*BufferSize, 16*BufferSize, 16*BufferSize + 5, 48*BufferSize
+            };
+            var failures = 0;
+            foreach (var kind in Corpora) {
+                var corpus = CompressionBenchmark.CreateCorpus(kind, sizes[sizes.Length - 1]);
+                foreach (var size in sizes) {
+                    var data = new byte[size];
+                    Array.Copy(corpus, data, size);
+
+                    long compressedBytes = 0;
+                    var failed = 0;
+                    for (var i = 0; i < Repeats; i++) {
+                        DeflateBlockIndex index;
+                        var compressed = Deflate(data, out index);
+                        compressedBytes = compressed.Length;
+                        // the parallel reader follows the index, which should cover the whole of the output.
+                        var input = new MemoryStream(compressed, false);
+                        if (!Same(data, Read(new DeflateStream(new MemoryStream(compressed, false), CompressionMode.Decompress))) ||
+                            !Same(data, Read(new ParallelInflateInputStream(input, index, true))) ||
+                            input.Position != compressed.Length || index.CompressedLength != compressed.Length) {
+                            failed++;
+                        }
+                    }
+                    report.Add("parallel-deflate", kind, CompressionLevel.Default, size, Repeats, compressedBytes, failed);
+                    failures += failed;
+                }
+
+                foreach (var level in new[] {CompressionLevel.Fastest, CompressionLevel.BestSpeed, CompressionLevel.Default}) {
+                    foreach (var size in new[] {1000, 20000, 4*BufferSize}) {
+                        var data = new byte[size];
+                        Array.Copy(corpus, data, size);
+
+                        byte[] tail;
+                        var whole = DeflateWithFullFlush(data, level, out tail);
+                        var twice = new byte[2*size];
+                        Array.Copy(data, twice, size);
+                        Array.Copy(data, 0, twice, size, size);
+
+                        var failed = 0;
+                        if (!Same(twice, Inflate(whole)) || !Same(data, Inflate(tail))) {
+                            failed++;
+                        }
+                        report.Add("full-flush", kind, level, size, 1, tail.Length, failed);
+                        failures += failed;
+                    }
+
+                    foreach (var zlib in new[] {false, true}) {
+                        foreach (var size in new[] {1, 100, 4096, BufferSize + 1}) {
+                            var data = new byte[size];
+                            Array.Copy(corpus, data, size);
+
+                            int compressedBytes;
+                            var failed = FitsExactly(data, level, zlib, out compressedBytes);
+                            report.Add(zlib ? "zlib-buffer" : "deflate-buffer", kind, level, size, 1, compressedBytes, failed);
+                            failures += failed;
+                        }
+                    }
+                }
+            }
+
+            if (failures > 0) {
+                throw new ConsoleException("{0} round trips failed.", failures);
+            }
+        }
+
+        private byte[] Deflate(byte[] data, out DeflateBlockIndex index) {
+            using (var output = new MemoryStream()) {
+                using (var deflater = new ParallelDeflateOutputStream(output, CompressionLevel.Default, CompressionStrategy.Default, true)) {
+                    deflater.BufferSize = BufferSize;
+                    deflater.Write(data, 0, data.Length);
+                    deflater.Close();
+                    index = deflater.BlockIndex;
+                }
+                return output.ToArray();
+            }
+        }
+
+        /// <summary>
+        ///   Deflates the data, a full flush, and the data again; returns all of it, and (in <paramref name = "tail" />) what
+        ///   came after the flush.
+        /// </summary>
+        private static byte[] DeflateWithFullFlush(byte[] data, CompressionLevel level, out byte[] tail) {
+            using (var output = new MemoryStream()) {
+                long flushed;
+                using (var deflater = new DeflateStream(output, CompressionMode.Compress, level, true)) {
+                    deflater.FlushMode = FlushType.Full;
+                    deflater.Write(data, 0, data.Length);
+                    flushed = output.Length;
+                    deflater.FlushMode = FlushType.None;
+                    deflater.Write(data, 0, data.Length);
+                }
+                var whole = output.ToArray();
+                tail = new byte[whole.Length - flushed];
+                Array.Copy(whole, flushed, tail, 0, tail.Length);
+                return whole;
+            }
+        }
+
+        /// <summary>
+        ///   Inflates raw deflate data; null if it can't be.
+        /// </summary>
+        private static byte[] Inflate(byte[] compressed) {
+            try {
+                return Read(new DeflateStream(new MemoryStream(compressed, false), CompressionMode.Decompress));
+            }
+            catch (ZlibException) {
+                return null;
+            }
+        }
+
+        /// <summary>
+        ///   Compresses the data with CompressBuffer into plenty of room, then into exactly as much as that took and into a
+        ///   byte less; and uncompresses it with UncompressBuffer the same three ways. Returns the number of those that went
+        ///   wrong.
+        /// </summary>
+        private static int FitsExactly(byte[] data, CompressionLevel level, bool zlib, out int compressedBytes) {
+            // (the ranges start part way into the buffers, to catch anything that forgets the offsets.)
+            const int offset = 3;
+            var input = new byte[offset + data.Length];
+            Array.Copy(data, 0, input, offset, data.Length);
+
+            var ample = new byte[offset + 2*data.Length + 64];
+            compressedBytes = CompressBuffer(zlib, input, offset, data.Length, ample, offset, ample.Length - offset, level);
+            if (compressedBytes < 0) {
+                return 1;
+            }
+
+            var failed = 0;
+            var exact = new byte[offset + compressedBytes];
+            if (CompressBuffer(zlib, input, offset, data.Length, exact, offset, compressedBytes, level) != compressedBytes ||
+                !Same(ample.Skip(offset).Take(compressedBytes).ToArray(), exact.Skip(offset).ToArray())) {
+                failed++;
+            }
+            if (CompressBuffer(zlib, input, offset, data.Length, exact, offset, compressedBytes - 1, level) != -1) {
+                failed++;
+            }
+
+            var inflated = new byte[offset + data.Length + 64];
+            if (UncompressBuffer(zlib, ample, offset, compressedBytes, inflated, offset, inflated.Length - offset) != data.Length ||
+                !Same(data, inflated.Skip(offset).Take(data.Length).ToArray())) {
+                failed++;
+            }
+            Array.Clear(inflated, 0, inflated.Length);
+            if (UncompressBuffer(zlib, ample, offset, compressedBytes, inflated, offset, data.Length) != data.Length ||
+                !Same(data, inflated.Skip(offset).Take(data.Length).ToArray())) {
+                failed++;
+            }
+            if (UncompressBuffer(zlib, ample, offset, compressedBytes, inflated, offset, data.Length - 1) != -1) {
+                failed++;
+            }
+            return failed;
+        }
+
+        private static int CompressBuffer(bool zlib, byte[] input, int inputOffset, int inputCount, byte[] output, int outputOffset,
+            int outputCount, CompressionLevel level) {
+            return zlib
+                ? ZlibStream.CompressBuffer(input, inputOffset, inputCount, output, outputOffset, outputCount, level)
+                : DeflateStream.CompressBuffer(input, inputOffset, inputCount, output, outputOffset, outputCount, level);
+        }
+
+        private static int UncompressBuffer(bool zlib, byte[] input, int inputOffset, int inputCount, byte[] output, int outputOffset,
+            int outputCount) {
+            try {
+                return zlib
+                    ? ZlibStream.UncompressBuffer(input, inputOffset, inputCount, output, outputOffset, outputCount)
+                    : DeflateStream.UncompressBuffer(input, inputOffset, inputCount, output, outputOffset, outputCount);
+            }
+            catch (ZlibException) {
+                return -2;
+            }
+        }
+
+        private static byte[] Read(Stream stream) {
+            using (var output = new MemoryStream()) {
+                using (stream) {
+                    var buffer = new byte[16*1024];
+                    int read;
+                    while ((read = stream.Read(buffer, 0, buffer.Length)) > 0) {
+                        output.Write(buffer, 0, read);
+                    }
+                }
+                return output.ToArray();
+            }
+        }
+
+        private static bool Same(byte[] expected, byte[] actual) {
+            if (actual == null || expected.Length != actual.Length) {
+                return false;
+            }
+            for (var i = 0; i < expected.Length; i++) {
+                if (expected[i] != actual[i]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+}
@@ -0,0 +1,221 @@
+﻿//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Benchmarks {
+    using System;
+    using System.Collections.Generic;
+    using System.Globalization;
+    using System.IO;
+    using System.Linq;
+    using Toolkit.Exceptions;
+    using Toolkit.Extensions;
+
+    /// <summary>
+    ///   Times finding files in a large generated tree: the parallel directory walker (DirectoryEnumerateFilesSmarter and
+    ///   FindFilesSmarter) against the plain recursive walk it replaced, and checks they find the same files, in the same
+    ///   order.
+    /// </summary>
+    /// <remarks>
+    ///   <para>
+    ///     The tree has <see cref = "FilesPerDirectory" /> files in each directory, and <see cref = "Subdirectories" />
+    ///     subdirectories in each one that has any, filled breadth first until there are <see cref = "Files" /> files.
+    ///     Every tenth file is a package ('Package-n.MSI', in upper case, so the masks have to match it regardless of
+    ///     case); the rest are '.dll's.
+    ///   </para>
+    ///   <para>
+    ///     Each case is run once before it's timed, so the directories are in the OS's cache: what's measured is the
+    ///     walking, not the disk. Making a million files takes a while; with <see cref = "Keep" />, the tree is left in
+    ///     place, and the next run with the same shape and <see cref = "Root" /> uses it again.
+    ///   </para>
+    ///   <para>
+    ///     The masks are built with the platform's directory separator. FindFilesSmarter only understands Windows paths,
+    ///     so it's only timed on Windows. A case that finds no files at all fails the run, as does one that doesn't find
+    ///     the same files as the sequential walk.
+    ///   </para>
+    /// </remarks>
+    public class DirectoryWalkBenchmark : Benchmark {
+        private BenchmarkReport _report;
+        private int _failures;
+
+        /// <summary>
+        ///   Creates a benchmark with the default settings: a million files, 100 to a directory and 10 subdirectories to a
+        ///   directory, in the temp directory; for at least a second and three iterations per case.
+        /// </summary>
+        public DirectoryWalkBenchmark() {
+            Root = Path.GetTempPath();
+            Files = 1000000;
+            FilesPerDirectory = 100;
+            Subdirectories = 10;
+            MinimumTime = TimeSpan.FromSeconds(1);
+            MinimumIterations = 3;
+        }
+
+        /// <summary>
+        ///   The directory the tree is made in.
+        /// </summary>
+        public string Root { get; set; }
+
+        /// <summary>
+        ///   The number of files in the tree.
+        /// </summary>
+        public int Files { get; set; }
+
+        /// <summary>
+        ///   The number of files in each directory.
+        /// </summary>
+        public int FilesPerDirectory { get; set; }
+
+        /// <summary>
+        ///   The number of subdirectories in each directory that has any.
+        /// </summary>
+        public int Subdirectories { get; set; }
+
+        /// <summary>
+        ///   Whether to leave the tree in place afterwards (to use again).
+        /// </summary>
+        public bool Keep { get; set; }
+
+        /// <summary>
+        ///   The least time to spend timing each case.
+        /// </summary>
+        public TimeSpan MinimumTime { get; set; }
+
+        /// <summary>
+        ///   The least number of timed iterations of each case.
+        /// </summary>
+        public int MinimumIterations { get; set; }
+
+        public override void Run(BenchmarkReport report) {
+            _report = report;
+            var tree = Path.Combine(Root, string.Format(CultureInfo.InvariantCulture, "coapp-walk-{0}-{1}-{2}", Files, FilesPerDirectory, Subdirectories));
+            report.Begin("directory walk benchmark", string.Format(CultureInfo.InvariantCulture, "{0} files, {1} to a directory, {2} subdirectories to a directory",
+                Files, FilesPerDirectory, Subdirectories), "case", "mask", "files", "iterations", "mean-ms", "min-ms", "files/s", "same-as-sequential");
+
+            _failures = 0;
+            try {
+                Generate(tree);
+
+                var packages = "**" + Path.DirectorySeparatorChar + "*.msi";
+                var sequentialPackages = Measure("sequential", packages, null, () => SequentialWalk(tree, packages));
+                var sequentialAll = Measure("sequential", "(all)", null, () => SequentialWalk(tree, null));
+
+                Measure("walker", packages, sequentialPackages, () => tree.DirectoryEnumerateFilesSmarter(packages, SearchOption.AllDirectories));
+                Measure("walker", "(all)", sequentialAll, () => tree.DirectoryEnumerateFilesSmarter(SearchOption.AllDirectories));
+                if (Path.DirectorySeparatorChar == '\\') {
+                    Measure("find-files-smarter", packages, sequentialPackages, () => Path.Combine(tree, packages).FindFilesSmarter());
+                }
+                else {
+                    report.Note("find-files-smarter only understands Windows paths; skipped");
+                }
+
+                // what a caller that only wants one file waits for.
+                Measure("walker-first", packages, null, () => tree.DirectoryEnumerateFilesSmarter(packages, SearchOption.AllDirectories).Take(1));
+            }
+            finally {
+                if (!Keep) {
+                    Directory.Delete(tree, true);
+                }
+            }
+
+            if (_failures > 0) {
+                throw new ConsoleException("{0} cases found no files, or not the same files as the sequential walk.", _failures);
+            }
+        }
+
+        /// <summary>
+        ///   Times a walk; if <paramref name = "expected" /> is given, reports whether the walk found the same files in the
+        ///   same order. Either that, or finding nothing, counts as a failure. Returns what the walk found.
+        /// </summary>
+        private List<string> Measure(string name, string mask, List<string> expected, Func<IEnumerable<string>> walk) {
+            var found = walk().ToList();
+            if (found.Count == 0 || (expected != null && !found.SequenceEqual(expected))) {
+                _failures++;
+            }
+            Measurement.Settle();
+            var m = Measurement.Of(() => walk().Count(), MinimumTime, MinimumIterations);
+            _report.Add(name, mask, found.Count, m.Iterations, m.Mean, m.Min, m.Mean.Ticks > 0 ? found.Count/m.Mean.TotalSeconds : 0,
+                expected == null ? "-" : found.SequenceEqual(expected) ? "yes" : "no");
+            return found;
+        }
+
+        /// <summary>
+        ///   Finds files the way DirectoryEnumerateFilesSmarter did before the walker: a directory's files, then each of its
+        ///   subdirectories in turn, on one thread, matching every file against the mask.
+        /// </summary>
+        private static IEnumerable<string> SequentialWalk(string path, string mask) {
+            var files = SequentialWalk(path);
+            if (mask == null) {
+                return files;
+            }
+            var root = path.ToLower();
+            mask = mask.ToLower();
+            return files.Where(file => file.ToLower().NewIsWildcardMatch(mask, true, root));
+        }
+
+        private static IEnumerable<string> SequentialWalk(string path) {
+            var files = Enumerable.Empty<string>();
+            try {
+                files = Directory.EnumerateFiles(path);
+            }
+            catch {
+            }
+            foreach (var file in files) {
+                yield return file;
+            }
+
+            var directories = Enumerable.Empty<string>();
+            try {
+                directories = Directory.EnumerateDirectories(path);
+            }
+            catch {
+            }
+            foreach (var directory in directories) {
+                foreach (var file in SequentialWalk(directory)) {
+                    yield return file;
+                }
+            }
+        }
+
+        /// <summary>
+        ///   Makes the tree, unless a complete one of the same shape is already there.
+        /// </summary>
+        private void Generate(string tree) {
+            var complete = Path.Combine(tree, "complete");
+            if (File.Exists(complete)) {
+                _report.Note("using the tree already in {0}", tree);
+                return;
+            }
+            if (Directory.Exists(tree)) {
+                Directory.Delete(tree, true);
+            }
+
+            var directories = new Queue<string>();
+            directories.Enqueue(tree);
+            var made = 0;
+            while (made < Files) {
+                var directory = directories.Dequeue();
+                Directory.CreateDirectory(directory);
+                for (var i = 0; i < FilesPerDirectory && made < Files; i++, made++) {
+                    var name = made%10 == 0
+                        ? string.Format(CultureInfo.InvariantCulture, "Package-{0}.MSI", made)
+                        : string.Format(CultureInfo.InvariantCulture, "library-{0}.dll", made);
+                    File.Create(Path.Combine(directory, name)).Close();
+                }
+                for (var i = 0; i < Subdirectories; i++) {
+                    directories.Enqueue(Path.Combine(directory, string.Format(CultureInfo.InvariantCulture, "Folder-{0}", i)));
+                }
+            }
+
+            // (the marker's the last file made, and isn't a package, so it doesn't change what the masks find.)
+            File.Create(complete).Close();
+            _report.Note("made {0} files in {1}", made, tree);
+        }
+    }
+}
@@ -0,0 +1,363 @@
+﻿//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Benchmarks {
+    using System;
+    using System.Collections.Generic;
+    using System.Diagnostics;
+    using System.Globalization;
+    using System.IO;
+    using System.IO.Pipes;
+    using System.Linq;
+    using System.Security.Principal;
+    using System.Threading.Tasks;
+    using Toolkit.Exceptions;
+    using Toolkit.Extensions;
+    using Toolkit.Pipes;
+
+    /// <summary>
+    ///   Puts a running engine under load: many clients, each in its own session, sending a mix of find-packages and
+    ///   install-package (pretend) requests, one after another, as fast as the engine answers them.
+    /// </summary>
+    /// <remarks>
+    ///   <para>
+    ///     The engine has to be running already (as the service, or interactively); the clients connect to its pipe
+    ///     the way the client library does, and speak its protocol directly, so the client library's own overhead isn't
+    ///     in the figures. A request's latency is the time from sending it to receiving its task-complete.
+    ///   </para>
+    ///   <para>
+    ///     install-package requests are for <see cref = "PackageName" />; if that isn't set, it's the first package a
+    ///     find-packages turns up, and if there are none, only find-packages requests are sent. Nothing is installed:
+    ///     the requests are all pretend.
+    ///   </para>
+    ///   <para>
+    ///     A request fails if the engine answers it with an error, or the session is dropped before it completes. The
+    ///     latencies are of every request that completed, failed or not.
+    ///   </para>
+    /// </remarks>
+    public class EngineLoadTest : Benchmark {
+        private const int ReadBufferSize = 2*1024*1024;
+
+        private static readonly string[] FailureResponses = new[] {
+            "unexpected-failure", "message-argument-error", "operation-cancelled", "operation-requires-permission", "unknown-command",
+            "unknown-package", "failed-package-install", "restarting", "shutting-down",
+        };
+
+        private static readonly string[] Kinds = new[] {"start-session", "find-packages", "install-package"};
+
+        private BenchmarkReport _report;
+        private Dictionary<string, Latencies> _latencies;
+        private Dictionary<string, int> _failures;
+
+        /// <summary>
+        ///   Creates a load test with the default settings: 16 clients, 50 requests each, a quarter of them install-package.
+        /// </summary>
+        public EngineLoadTest() {
+            PipeName = "CoAppInstaller";
+            Clients = 16;
+            Requests = 50;
+            InstallShare = 0.25;
+            MaxResults = 20;
+            Framing = true;
+            ConnectTimeout = TimeSpan.FromSeconds(30);
+            Timeout = TimeSpan.FromMinutes(10);
+        }
+
+        /// <summary>
+        ///   The engine's pipe.
+        /// </summary>
+        public string PipeName { get; set; }
+
+        /// <summary>
+        ///   The number of clients sending requests at once.
+        /// </summary>
+        public int Clients { get; set; }
+
+        /// <summary>
+        ///   The number of requests each client sends.
+        /// </summary>
+        public int Requests { get; set; }
+
+        /// <summary>
+        ///   The share (0 to 1) of the requests that are install-package; the rest are find-packages.
+        /// </summary>
+        public double InstallShare { get; set; }
+
+        /// <summary>
+        ///   The package the install-package requests are for (a canonical name).
+        /// </summary>
+        public string PackageName { get; set; }
+
+        /// <summary>
+        ///   The name find-packages requests look for (any package, if not set).
+        /// </summary>
+        public string FindName { get; set; }
+
+        /// <summary>
+        ///   The max-results of find-packages requests (no limit, if 0).
+        /// </summary>
+        public int MaxResults { get; set; }
+
+        /// <summary>
+        ///   Whether the sessions ask for framed batches of responses, as the current client library does.
+        /// </summary>
+        public bool Framing { get; set; }
+
+        /// <summary>
+        ///   How long a client waits to connect to the engine.
+        /// </summary>
+        public TimeSpan ConnectTimeout { get; set; }
+
+        /// <summary>
+        ///   How long the whole run may take; sessions still going then are dropped, and their requests fail.
+        /// </summary>
+        public TimeSpan Timeout { get; set; }
+
+        public override void Run(BenchmarkReport report) {
+            _report = report;
+            report.Begin("engine load test", string.Format(CultureInfo.InvariantCulture, "{0} clients, {1} requests each, {2:0.##} install-package",
+                Clients, Requests, InstallShare), "request", "clients", "count", "failures", "mean-ms", "p50-ms", "p99-ms", "max-ms", "requests/s");
+
+            var installShare = InstallShare;
+            var packageName = PackageName;
+            if (installShare > 0 && string.IsNullOrEmpty(packageName)) {
+                packageName = FindAPackage();
+                if (packageName == null) {
+                    report.Note("the engine found no packages to install; sending only find-packages.");
+                    installShare = 0;
+                }
+                else {
+                    report.Note("install-package requests are for {0}", packageName);
+                }
+            }
+
+            _latencies = Kinds.ToDictionary(each => each, each => new Latencies());
+            _failures = Kinds.ToDictionary(each => each, each => 0);
+
+            var sessions = Enumerable.Range(0, Clients).Select(each => new Session(this, each)).ToArray();
+            var elapsed = Stopwatch.StartNew();
+            var clients = sessions.Select((session, client) => Task.Factory.StartNew(() => {
+                var start = Stopwatch.StartNew();
+                if (!session.Start()) {
+                    Failed("start-session");
+                    return;
+                }
+                _latencies["start-session"].Add(start.Elapsed);
+
+                for (var i = 0; i < Requests; i++) {
+                    // install-package requests are spread evenly through each client's requests.
+                    var n = client*Requests + i;
+                    var install = Math.Floor((n + 1)*installShare) > Math.Floor(n*installShare);
+                    var request = install
+                        ? new UrlEncodedMessage("install-package") {
+                            {"canonical-name", packageName},
+                            {"pretend", true},
+                        }
+                        : new UrlEncodedMessage("find-packages") {
+                            {"name", FindName},
+                            {"max-results", MaxResults > 0 ? (int?)MaxResults : null},
+                        };
+                    if (!session.Send(request, true, null)) {
+                        return;
+                    }
+                }
+            }, TaskCreationOptions.LongRunning)).ToArray();
+
+            var finished = clients.Select(each => each.ContinueWith(antecedent => antecedent.Exception)).ToArray();
+            if (!Task.WaitAll(finished, Timeout)) {
+                report.Note("the run took longer than {0}; the sessions still going were dropped.", Timeout);
+            }
+            elapsed.Stop();
+            foreach (var session in sessions) {
+                session.Close();
+            }
+            // (anything that went wrong other than a dropped session is a bug here, not a failed request.)
+            Task.WaitAll(clients);
+
+            var all = new Latencies();
+            foreach (var request in Kinds) {
+                Add(request, _latencies[request], _failures[request], elapsed.Elapsed);
+                if (request != "start-session") {
+                    all.Add(_latencies[request]);
+                }
+            }
+            Add("all", all, _failures["find-packages"] + _failures["install-package"], elapsed.Elapsed);
+
+            if (_failures["start-session"] == Clients) {
+                throw new ConsoleException("No session could be started; is the engine running, on pipe '{0}'?", PipeName);
+            }
+        }
+
+        private void Add(string request, Latencies latencies, int failures, TimeSpan elapsed) {
+            _report.Add(request, Clients, latencies.Count, failures, latencies.Mean, latencies.Percentile(50), latencies.Percentile(99),
+                latencies.Percentile(100), elapsed.Ticks > 0 ? latencies.Count/elapsed.TotalSeconds : 0);
+        }
+
+        private void Failed(string request) {
+            lock (_failures) {
+                _failures[request]++;
+            }
+        }
+
+        /// <summary>
+        ///   Asks the engine for any package at all, and returns its canonical name (or null, if there are none).
+        /// </summary>
+        private string FindAPackage() {
+            var session = new Session(this, -1);
+            try {
+                string found = null;
+                if (session.Start()) {
+                    session.Send(new UrlEncodedMessage("find-packages") {
+                        {"name", FindName},
+                        {"max-results", 1},
+                    }, false, response => {
+                        if (found == null && response.Command == "found-package") {
+                            found = response["canonical-name"];
+                        }
+                    });
+                }
+                return found;
+            }
+            finally {
+                session.Close();
+            }
+        }
+
+        /// <summary>
+        ///   One client's session with the engine: it sends a request, and reads responses until the request is complete.
+        /// </summary>
+        private class Session {
+            private readonly EngineLoadTest _test;
+            private readonly string _id;
+            private readonly byte[] _buffer = new byte[ReadBufferSize];
+            private readonly Queue<UrlEncodedMessage> _received = new Queue<UrlEncodedMessage>();
+            private NamedPipeClientStream _pipe;
+            private int _rqid;
+
+            internal Session(EngineLoadTest test, int client) {
+                _test = test;
+                _id = string.Format(CultureInfo.InvariantCulture, "{0}/load-test-{1}", Process.GetCurrentProcess().Id, client);
+            }
+
+            /// <summary>
+            ///   Connects, and starts a session; returns false if it can't.
+            /// </summary>
+            internal bool Start() {
+                try {
+                    _pipe = new NamedPipeClientStream(".", _test.PipeName, PipeDirection.InOut, PipeOptions.Asynchronous, TokenImpersonationLevel.Impersonation);
+                    _pipe.Connect((int)_test.ConnectTimeout.TotalMilliseconds);
+                    _pipe.ReadMode = PipeTransmissionMode.Message;
+
+                    Write(new UrlEncodedMessage("start-session") {
+                        {"client", "coapp-load-test"},
+                        {"id", _id},
+                        {"rqid", _id},
+                        {"framing", _test.Framing ? FramedMessages.BinaryFraming : null},
+                    });
+                    while (true) {
+                        var response = Read();
+                        if (response.Command == "session-started") {
+                            return true;
+                        }
+                        if (FailureResponses.Contains(response.Command)) {
+                            return false;
+                        }
+                    }
+                }
+                catch (IOException) {
+                    return false;
+                }
+                catch (TimeoutException) {
+                    return false;
+                }
+                catch (ObjectDisposedException) {
+                    return false;
+                }
+                catch (InvalidOperationException) {
+                    return false;
+                }
+                catch (UnauthorizedAccessException) {
+                    return false;
+                }
+            }
+
+            /// <summary>
+            ///   Sends a request, and waits for its task-complete (recording how long that took, if <paramref name = "timed" />);
+            ///   returns false if the session has been dropped.
+            /// </summary>
+            internal bool Send(UrlEncodedMessage request, bool timed, Action<UrlEncodedMessage> onResponse) {
+                var rqid = (++_rqid).ToString(CultureInfo.InvariantCulture);
+                request.Add("rqid", rqid);
+                var failed = false;
+                var dropped = false;
+                var elapsed = Stopwatch.StartNew();
+                try {
+                    Write(request);
+                    while (true) {
+                        var response = Read();
+                        if (response.Command == "task-complete" && response["rqid"] == rqid) {
+                            break;
+                        }
+                        if (FailureResponses.Contains(response.Command)) {
+                            failed = true;
+                        }
+                        if (onResponse != null) {
+                            onResponse(response);
+                        }
+                    }
+                }
+                catch (IOException) {
+                    dropped = true;
+                }
+                catch (ObjectDisposedException) {
+                    dropped = true;
+                }
+                catch (InvalidOperationException) {
+                    dropped = true;
+                }
+
+                if (timed) {
+                    if (!dropped) {
+                        _test._latencies[request.Command].Add(elapsed.Elapsed);
+                    }
+                    if (failed || dropped) {
+                        _test.Failed(request.Command);
+                    }
+                }
+                return !dropped;
+            }
+
+            internal void Close() {
+                var pipe = _pipe;
+                if (pipe != null) {
+                    pipe.Close();
+                }
+            }
+
+            private void Write(UrlEncodedMessage message) {
+                var bytes = message.ToString().ToByteArray();
+                _pipe.Write(bytes, 0, bytes.Length);
+            }
+
+            private UrlEncodedMessage Read() {
+                while (_received.Count == 0) {
+                    var read = _pipe.Read(_buffer, 0, _buffer.Length);
+                    if (read <= 0) {
+                        throw new IOException("The engine closed the session.");
+                    }
+                    foreach (var message in FramedMessages.ReadMessages(_buffer, read)) {
+                        _received.Enqueue(message);
+                    }
+                }
+                return _received.Dequeue();
+            }
+        }
+    }
+}
@@ -0,0 +1,228 @@
+﻿//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Benchmarks {
+    using System;
+    using System.Diagnostics;
+    using System.Globalization;
+    using System.IO;
+    using System.Linq;
+    using System.Net;
+    using System.Threading;
+    using System.Threading.Tasks;
+    using Toolkit.Network;
+
+    /// <summary>
+    ///   Puts an <see cref = "HttpServer" /> under load: many clients downloading one large file at once, whole, in
+    ///   ranged segments, and resumed part way through.
+    /// </summary>
+    /// <remarks>
+    ///   <para>
+    ///     The server is started on <see cref = "Port" /> of localhost (so the process needs whatever rights
+    ///     HttpListener needs for that), serving a file of <see cref = "FileSize" /> bytes written to a temporary
+    ///     directory. Every byte of every response is checked against what was asked for; a response that's short,
+    ///     long, misplaced, or a 200 where a 206 was wanted counts as a failure.
+    ///   </para>
+    ///   <para>
+    ///     The allocation figures are for the whole process, clients included, but the clients' share doesn't grow
+    ///     with the size of the file; a server that loads the file to send it shows up as the file size per request.
+    ///   </para>
+    /// </remarks>
+    public class HttpServerLoadTest : Benchmark {
+        private const string FileName = "loadtest.msi";
+        private BenchmarkReport _report;
+
+        /// <summary>
+        ///   Creates a load test with the default settings: a 64MB file, 16 clients, 4 segments per segmented download, on port 8088.
+        /// </summary>
+        public HttpServerLoadTest() {
+            Port = 8088;
+            FileSize = 64*1024*1024;
+            Clients = 16;
+            Segments = 4;
+        }
+
+        /// <summary>
+        ///   The port to serve on.
+        /// </summary>
+        public int Port { get; set; }
+
+        /// <summary>
+        ///   The size of the file that's downloaded.
+        /// </summary>
+        public long FileSize { get; set; }
+
+        /// <summary>
+        ///   The number of clients downloading at once.
+        /// </summary>
+        public int Clients { get; set; }
+
+        /// <summary>
+        ///   The number of ranges each client splits a segmented download into (each one fetched at the same time, on its own connection).
+        /// </summary>
+        public int Segments { get; set; }
+
+        /// <summary>
+        ///   If set, the server's <see cref = "HttpServer.MaxConnections" />; otherwise, its default.
+        /// </summary>
+        public int MaxConnections { get; set; }
+
+        /// <summary>
+        ///   If set, the server's <see cref = "HttpServer.PendingAccepts" />; otherwise, its default.
+        /// </summary>
+        public int PendingAccepts { get; set; }
+
+        public override void Run(BenchmarkReport report) {
+            _report = report;
+            report.Begin("HTTP server load test", string.Format(CultureInfo.InvariantCulture, "file {0} bytes", FileSize),
+                "name", "clients", "requests", "failures", "bytes", "elapsed-ms", "MB/s", "alloc-bytes", "gen2");
+
+            var directory = Path.Combine(Path.GetTempPath(), "coapp-httpserver-" + Guid.NewGuid().ToString("N"));
+            Directory.CreateDirectory(directory);
+            var server = new HttpServer("localhost", Port);
+            try {
+                WriteFile(Path.Combine(directory, FileName), FileSize);
+                server.AddVirtualDir("feed", directory);
+                if (MaxConnections > 0) {
+                    server.MaxConnections = MaxConnections;
+                }
+                if (PendingAccepts > 0) {
+                    server.PendingAccepts = PendingAccepts;
+                }
+                server.Start();
+
+                var uri = new Uri(string.Format(CultureInfo.InvariantCulture, "http://localhost:{0}/feed/{1}", Port, FileName));
+                ServicePointManager.FindServicePoint(uri).ConnectionLimit = Math.Max(Clients*Segments, 2);
+
+                // everything whole.
+                Measure("whole", client => new[] { Download(uri, 0, FileSize, false) });
+
+                // everything in segments, all at once.
+                Measure("segmented", client => {
+                    var size = (FileSize + Segments - 1)/Segments;
+                    var segments = Enumerable.Range(0, Segments)
+                        .Select(i => Task.Factory.StartNew(() => Download(uri, i*size, Math.Min(size, FileSize - i*size), true), TaskCreationOptions.LongRunning))
+                        .ToArray();
+                    Task.WaitAll(segments);
+                    return segments.Select(each => each.Result).ToArray();
+                });
+
+                // a download that was cut off part way (a different part for each client), and then resumed.
+                Measure("resumed", client => {
+                    var first = FileSize*(client + 1)/(Clients + 1);
+                    return new[] { Download(uri, 0, first, true), Download(uri, first, FileSize - first, true) };
+                });
+
+                // the tail of the file ("bytes=-n"), as a client checking for a trailer would.
+                Measure("suffix", client => new[] { Download(uri, -1, Math.Min(FileSize, 64*1024), true) });
+            }
+            finally {
+                server.Stop();
+                Directory.Delete(directory, true);
+            }
+        }
+
+        private void Measure(string name, Func<int, long[]> client) {
+            Measurement.Settle();
+
+            var allocatedBefore = Measurement.TotalAllocatedBytes;
+            var collectionsBefore = GC.CollectionCount(2);
+            var stopwatch = Stopwatch.StartNew();
+            var clients = Enumerable.Range(0, Clients)
+                .Select(i => Task.Factory.StartNew(() => client(i), TaskCreationOptions.LongRunning))
+                .ToArray();
+            Task.WaitAll(clients);
+            stopwatch.Stop();
+
+            // a download's result is the bytes received, or -1 where it failed.
+            var downloads = clients.SelectMany(each => each.Result).ToArray();
+            var bytes = downloads.Where(each => each > 0).Sum();
+            _report.Add(name, Clients, downloads.Length, downloads.Count(each => each < 0), bytes, stopwatch.Elapsed,
+                bytes/stopwatch.Elapsed.TotalSeconds/(1024*1024), Measurement.TotalAllocatedBytes - allocatedBefore, GC.CollectionCount(2) - collectionsBefore);
+        }
+
+        /// <summary>
+        ///   Downloads <paramref name = "count" /> bytes from <paramref name = "offset" /> (or, with an offset of -1, the
+        ///   last <paramref name = "count" /> bytes), and checks them. Returns the bytes received, or -1 if anything was wrong.
+        /// </summary>
+        private static long Download(Uri uri, long offset, long count, bool ranged) {
+            try {
+                var request = (HttpWebRequest)WebRequest.Create(uri);
+                request.KeepAlive = true;
+                request.Timeout = Timeout.Infinite;
+                request.ReadWriteTimeout = 5*60*1000;
+                if (ranged) {
+                    if (offset < 0) {
+                        request.AddRange(-count);
+                    }
+                    else {
+                        request.AddRange(offset, offset + count - 1);
+                    }
+                }
+
+                using (var response = (HttpWebResponse)request.GetResponse()) {
+                    if (response.StatusCode != (ranged ? HttpStatusCode.PartialContent : HttpStatusCode.OK) || response.ContentLength != count) {
+                        return -1;
+                    }
+                    if (offset < 0) {
+                        // the suffix starts wherever the Content-Range says the file ends, less the count.
+                        var range = response.Headers["Content-Range"] ?? string.Empty;
+                        long length;
+                        if (!long.TryParse(range.Substring(range.LastIndexOf('/') + 1), NumberStyles.None, CultureInfo.InvariantCulture, out length)) {
+                            return -1;
+                        }
+                        offset = length - count;
+                    }
+
+                    var buffer = new byte[64*1024];
+                    var position = offset;
+                    using (var stream = response.GetResponseStream()) {
+                        int read;
+                        while ((read = stream.Read(buffer, 0, buffer.Length)) > 0) {
+                            for (var i = 0; i < read; i++) {
+                                if (buffer[i] != ByteAt(position + i)) {
+                                    return -1;
+                                }
+                            }
+                            position += read;
+                        }
+                    }
+                    return position - offset == count ? count : -1;
+                }
+            }
+            catch (WebException) {
+                return -1;
+            }
+            catch (IOException) {
+                return -1;
+            }
+        }
+
+        /// <summary>
+        ///   The content of the file, which depends on the higher bytes of the offset as well as the lowest, so bytes from the wrong place don't pass for the right ones.
+        /// </summary>
+        private static byte ByteAt(long offset) {
+            return (byte)(offset ^ (offset >> 8) ^ (offset >> 16) ^ (offset >> 24));
+        }
+
+        private static void WriteFile(string path, long size) {
+            var buffer = new byte[64*1024];
+            using (var file = new FileStream(path, FileMode.Create, FileAccess.Write, FileShare.None, buffer.Length)) {
+                for (var offset = 0L; offset < size; offset += buffer.Length) {
+                    var count = (int)Math.Min(buffer.Length, size - offset);
+                    for (var i = 0; i < count; i++) {
+                        buffer[i] = ByteAt(offset + i);
+                    }
+                    file.Write(buffer, 0, count);
+                }
+            }
+        }
+    }
+}
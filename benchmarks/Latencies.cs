@@ -0,0 +1,82 @@
+﻿//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Benchmarks {
+    using System;
+    using System.Collections.Generic;
+    using System.Linq;
+
+    /// <summary>
+    ///   The latencies of many requests, collected from any number of threads, and summarized as percentiles.
+    /// </summary>
+    public class Latencies {
+        private readonly List<TimeSpan> _samples = new List<TimeSpan>();
+
+        /// <summary>
+        ///   Records the latency of one request.
+        /// </summary>
+        public void Add(TimeSpan latency) {
+            lock (_samples) {
+                _samples.Add(latency);
+            }
+        }
+
+        /// <summary>
+        ///   Records every latency of another collection.
+        /// </summary>
+        public void Add(Latencies latencies) {
+            var samples = latencies.Samples();
+            lock (_samples) {
+                _samples.AddRange(samples);
+            }
+        }
+
+        /// <summary>
+        ///   The number of latencies recorded.
+        /// </summary>
+        public int Count {
+            get {
+                lock (_samples) {
+                    return _samples.Count;
+                }
+            }
+        }
+
+        /// <summary>
+        ///   The mean latency (zero if there are none).
+        /// </summary>
+        public TimeSpan Mean {
+            get {
+                var samples = Samples();
+                return samples.Length == 0 ? TimeSpan.Zero : TimeSpan.FromTicks(samples.Sum(each => each.Ticks)/samples.Length);
+            }
+        }
+
+        /// <summary>
+        ///   The latency that <paramref name = "percent" /> percent of the requests took no longer than (by nearest rank;
+        ///   zero if there are none). 100 is the slowest.
+        /// </summary>
+        public TimeSpan Percentile(double percent) {
+            var samples = Samples();
+            if (samples.Length == 0) {
+                return TimeSpan.Zero;
+            }
+            Array.Sort(samples);
+            var rank = (int)Math.Ceiling(percent/100*samples.Length);
+            return samples[Math.Min(Math.Max(rank, 1), samples.Length) - 1];
+        }
+
+        private TimeSpan[] Samples() {
+            lock (_samples) {
+                return _samples.ToArray();
+            }
+        }
+    }
+}
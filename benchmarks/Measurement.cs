@@ -0,0 +1,113 @@
+﻿//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Benchmarks {
+    using System;
+    using System.Diagnostics;
+
+    /// <summary>
+    ///   The timing of an operation that's been run repeatedly: once to warm up, then for at least a minimum time
+    ///   and number of iterations.
+    /// </summary>
+    public class Measurement {
+        /// <summary>
+        ///   The number of timed iterations.
+        /// </summary>
+        public int Iterations { get; private set; }
+
+        /// <summary>
+        ///   The mean time of an iteration.
+        /// </summary>
+        public TimeSpan Mean { get; private set; }
+
+        /// <summary>
+        ///   The quickest iteration.
+        /// </summary>
+        public TimeSpan Min { get; private set; }
+
+        /// <summary>
+        ///   The bytes allocated per iteration, on all threads.
+        /// </summary>
+        public long AllocatedBytes { get; private set; }
+
+        /// <summary>
+        ///   The gen 0 collections per iteration.
+        /// </summary>
+        public double Gen0Collections { get; private set; }
+
+        /// <summary>
+        ///   What the operation returned when it was warmed up (eg, the size of what it produced).
+        /// </summary>
+        public long Result { get; private set; }
+
+        /// <summary>
+        ///   The throughput, in megabytes per second by the mean time, of an operation that handles
+        ///   <paramref name = "bytes" /> bytes.
+        /// </summary>
+        public double MegabytesPerSecond(long bytes) {
+            return Mean.Ticks > 0 ? bytes/Mean.TotalSeconds/(1024*1024) : 0;
+        }
+
+        /// <summary>
+        ///   The bytes allocated by the whole process so far, on all threads.
+        /// </summary>
+        public static long TotalAllocatedBytes {
+            get {
+                AppDomain.MonitoringIsEnabled = true;
+                return AppDomain.CurrentDomain.MonitoringTotalAllocatedMemorySize;
+            }
+        }
+
+        /// <summary>
+        ///   Collects everything that can be, so garbage left by one case isn't collected (and timed) in the next.
+        /// </summary>
+        public static void Settle() {
+            GC.Collect();
+            GC.WaitForPendingFinalizers();
+            GC.Collect();
+        }
+
+        /// <summary>
+        ///   Runs an operation once to warm up, then repeatedly for at least <paramref name = "minimumTime" /> and
+        ///   <paramref name = "minimumIterations" />, and returns its timing.
+        /// </summary>
+        public static Measurement Of(Func<long> operation, TimeSpan minimumTime, int minimumIterations) {
+            // (monitoring is turned on first, so it's on for the pool threads the warm up starts too.)
+            AppDomain.MonitoringIsEnabled = true;
+            var result = operation();
+            Settle();
+
+            var allocatedBefore = TotalAllocatedBytes;
+            var collectionsBefore = GC.CollectionCount(0);
+            var total = Stopwatch.StartNew();
+            var min = TimeSpan.MaxValue;
+            var iterations = 0;
+            while (iterations < minimumIterations || total.Elapsed < minimumTime) {
+                var one = Stopwatch.StartNew();
+                operation();
+                one.Stop();
+                if (one.Elapsed < min) {
+                    min = one.Elapsed;
+                }
+                iterations++;
+            }
+            total.Stop();
+
+            return new Measurement {
+                Iterations = iterations,
+                Mean = TimeSpan.FromTicks(total.Elapsed.Ticks/iterations),
+                Min = min,
+                AllocatedBytes = (TotalAllocatedBytes - allocatedBefore)/iterations,
+                Gen0Collections = (double)(GC.CollectionCount(0) - collectionsBefore)/iterations,
+                Result = result,
+            };
+        }
+    }
+}
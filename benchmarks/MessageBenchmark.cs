@@ -0,0 +1,146 @@
+﻿//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Benchmarks {
+    using System;
+    using System.Globalization;
+    using System.Linq;
+    using System.Text;
+    using Toolkit.Extensions;
+    using Toolkit.Pipes;
+
+    /// <summary>
+    ///   Times what the engine's session and the client's message loop do to every message, and counts the bytes
+    ///   each allocates per message: parsing (from the received bytes, and from a string), encoding, and reading
+    ///   values back out.
+    /// </summary>
+    /// <remarks>
+    ///   The messages are the protocol benchmark's found-package responses. "split-parse" is the parser the message
+    ///   had before the single-pass one (Split, Select, Split, ToDictionary and a UrlDecode per token), kept here to
+    ///   compare against.
+    /// </remarks>
+    public class MessageBenchmark : Benchmark {
+        private static readonly char[] Query = new[] {'?'};
+        private static readonly char[] Separator = new[] {'&'};
+        private static readonly char[] Equal = new[] {'='};
+
+        private BenchmarkReport _report;
+
+        /// <summary>
+        ///   Creates a benchmark with the default settings: 1000 distinct messages, for at least a second and ten
+        ///   iterations per case.
+        /// </summary>
+        public MessageBenchmark() {
+            Messages = 1000;
+            MinimumTime = TimeSpan.FromSeconds(1);
+            MinimumIterations = 10;
+        }
+
+        /// <summary>
+        ///   The number of messages handled by each iteration.
+        /// </summary>
+        public int Messages { get; set; }
+
+        /// <summary>
+        ///   The least time to spend timing each case.
+        /// </summary>
+        public TimeSpan MinimumTime { get; set; }
+
+        /// <summary>
+        ///   The least number of timed iterations of each case.
+        /// </summary>
+        public int MinimumIterations { get; set; }
+
+        public override void Run(BenchmarkReport report) {
+            _report = report;
+            report.Begin("message benchmark", string.Format(CultureInfo.InvariantCulture, "{0} messages", Messages),
+                "case", "messages", "iterations", "mean-ms", "min-ms", "ns/message", "alloc-bytes/message", "gen0");
+
+            var messages = Enumerable.Range(0, Messages).Select(ProtocolBenchmark.FoundPackage).ToArray();
+            var strings = messages.Select(each => each.ToString()).ToArray();
+            var encoded = strings.Select(each => Encoding.UTF8.GetBytes(each)).ToArray();
+
+            Measure("parse-bytes", () => {
+                long total = 0;
+                foreach (var bytes in encoded) {
+                    total += new UrlEncodedMessage(bytes, 0, bytes.Length).Command.Length;
+                }
+                return total;
+            });
+
+            Measure("parse-string", () => {
+                long total = 0;
+                foreach (var text in strings) {
+                    total += new UrlEncodedMessage(text).Command.Length;
+                }
+                return total;
+            });
+
+            Measure("split-parse", () => {
+                long total = 0;
+                foreach (var text in strings) {
+                    var parts = text.Split(Query, StringSplitOptions.RemoveEmptyEntries);
+                    var command = (parts.FirstOrDefault() ?? "").UrlDecode().ToLower();
+                    var data = (parts.Skip(1).FirstOrDefault() ?? "").Split(Separator, StringSplitOptions.RemoveEmptyEntries).Select(
+                        p => p.Split(Equal, StringSplitOptions.RemoveEmptyEntries)).ToDictionary(
+                            s => s[0].UrlDecode(),
+                            s => s.Length > 1 ? s[1].UrlDecode() : String.Empty);
+                    total += command.Length + data.Count;
+                }
+                return total;
+            });
+
+            var buffer = new byte[4096];
+            Measure("encode", () => {
+                long total = 0;
+                foreach (var message in messages) {
+                    total += message.Encode(ref buffer, 0);
+                }
+                return total;
+            });
+
+            Measure("to-string", () => {
+                long total = 0;
+                foreach (var message in messages) {
+                    total += message.ToString().Length;
+                }
+                return total;
+            });
+
+            // what a client does with a found-package response.
+            Measure("typed-access", () => {
+                long total = 0;
+                foreach (var message in messages) {
+                    string name = message["name"];
+                    bool? installed = message["installed"];
+                    bool? blocked = message["blocked"];
+                    int? rqid = message["rqid"];
+                    total += name.Length + (installed == true ? 1 : 0) + (blocked == true ? 1 : 0) + (rqid ?? 0);
+                }
+                return total;
+            });
+
+            Measure("collections", () => {
+                long total = 0;
+                foreach (var message in messages) {
+                    total += message.GetCollection("remote-locations").Count() + message.GetCollection("dependencies").Count();
+                }
+                return total;
+            });
+        }
+
+        private void Measure(string name, Func<long> operation) {
+            Measurement.Settle();
+            var m = Measurement.Of(operation, MinimumTime, MinimumIterations);
+            _report.Add(name, Messages, m.Iterations, m.Mean, m.Min, (double)m.Mean.Ticks*100/Messages,
+                (double)m.AllocatedBytes/Messages, m.Gen0Collections);
+        }
+    }
+}
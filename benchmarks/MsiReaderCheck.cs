@@ -0,0 +1,198 @@
+﻿//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+extern alias engine;
+
+namespace CoApp.Benchmarks {
+    using System;
+    using System.Collections.Generic;
+    using System.Diagnostics;
+    using System.Globalization;
+    using System.IO;
+    using System.Linq;
+    using Toolkit.Exceptions;
+    using engine::CoApp.Toolkit.PackageFormatHandlers;
+    using engine::Microsoft.Deployment.WindowsInstaller;
+
+    /// <summary>
+    ///   Checks that the managed MSI reader reads the same Property table as the Windows Installer API, from real MSIs
+    ///   (by default, the ones Windows keeps for the installed products), and times the two.
+    /// </summary>
+    /// <remarks>
+    ///   <para>
+    ///     Every file in <see cref = "Folder" /> (up to <see cref = "MaxFiles" /> of them) is read both ways. A file the
+    ///     API reads, but the managed reader can't (or reads differently), fails the run; so does one the managed reader
+    ///     reads, but the API won't open. A file neither can read isn't an MSI, and is only counted.
+    ///   </para>
+    ///   <para>
+    ///     The Windows Installer API is only on Windows; anywhere else, there's nothing to compare with, and the check is
+    ///     skipped. A run that finds no MSIs to compare fails.
+    ///   </para>
+    /// </remarks>
+    public class MsiReaderCheck : Benchmark {
+        private const int MaxNotes = 10;
+
+        private BenchmarkReport _report;
+        private int _notes;
+
+        /// <summary>
+        ///   Creates a check with the default settings: up to 500 MSIs from the Windows Installer's own folder.
+        /// </summary>
+        public MsiReaderCheck() {
+            Folder = Path.Combine(Environment.GetFolderPath(Environment.SpecialFolder.Windows), "Installer");
+            MaxFiles = 500;
+        }
+
+        /// <summary>
+        ///   The folder the MSIs are read from.
+        /// </summary>
+        public string Folder { get; set; }
+
+        /// <summary>
+        ///   The most files to read.
+        /// </summary>
+        public int MaxFiles { get; set; }
+
+        public override void Run(BenchmarkReport report) {
+            _report = report;
+            _notes = 0;
+            report.Begin("msi reader check", string.Format(CultureInfo.InvariantCulture, "up to {0} files in {1}", MaxFiles, Folder),
+                "case", "files", "properties", "managed-ms", "api-ms");
+
+            if (Path.DirectorySeparatorChar != '\\') {
+                report.Note("the Windows Installer API is only on Windows; skipped");
+                return;
+            }
+
+            string[] files;
+            try {
+                files = Directory.EnumerateFiles(Folder, "*.msi").Take(MaxFiles).ToArray();
+            }
+            catch (Exception e) {
+                throw new ConsoleException("Can't list the MSIs in '{0}' ({1}).", Folder, e.Message);
+            }
+
+            var same = new Outcome("same");
+            var different = new Outcome("different");
+            var managedFailed = new Outcome("managed-failed");
+            var apiFailed = new Outcome("api-failed");
+            var neither = new Outcome("not-msi");
+
+            foreach (var file in files) {
+                var managedTime = Stopwatch.StartNew();
+                var managed = ReadManaged(file);
+                managedTime.Stop();
+
+                var apiTime = Stopwatch.StartNew();
+                var api = ReadWithApi(file);
+                apiTime.Stop();
+
+                Outcome outcome;
+                if (api == null) {
+                    outcome = managed == null ? neither : apiFailed;
+                }
+                else if (managed == null) {
+                    outcome = managedFailed;
+                    Note(file, "the managed reader couldn't read it");
+                }
+                else {
+                    var mismatch = FirstMismatch(managed, api);
+                    outcome = mismatch == null ? same : different;
+                    if (mismatch != null) {
+                        Note(file, mismatch);
+                    }
+                }
+                if (outcome == apiFailed) {
+                    Note(file, "the managed reader read it, but the API can't open it");
+                }
+
+                outcome.Files++;
+                outcome.Properties += api != null ? api.Count : managed != null ? managed.Count : 0;
+                outcome.Managed += managedTime.Elapsed;
+                outcome.Api += apiTime.Elapsed;
+            }
+
+            foreach (var outcome in new[] {same, different, managedFailed, apiFailed, neither}) {
+                report.Add(outcome.Name, outcome.Files, outcome.Properties, outcome.Managed, outcome.Api);
+            }
+
+            var failures = different.Files + managedFailed.Files + apiFailed.Files;
+            if (failures > 0) {
+                throw new ConsoleException("{0} of {1} files weren't read the same by the managed reader and the Windows Installer API.", failures, files.Length);
+            }
+            if (same.Files == 0) {
+                throw new ConsoleException("There were no MSIs in '{0}' to compare.", Folder);
+            }
+        }
+
+        private static Dictionary<string, string> ReadManaged(string file) {
+            try {
+                return MsiDatabaseReader.GetProperties(file);
+            }
+            catch {
+                return null;
+            }
+        }
+
+        private static Dictionary<string, string> ReadWithApi(string file) {
+            try {
+                using (var database = new Database(file, DatabaseOpenMode.ReadOnly)) {
+                    using (var view = database.OpenView("SELECT Property, Value FROM Property")) {
+                        view.Execute();
+
+                        var result = new Dictionary<string, string>();
+                        foreach (var each in view) {
+                            result.Add(each["Property"].ToString(), each["Value"].ToString());
+                        }
+                        return result;
+                    }
+                }
+            }
+            catch (InstallerException) {
+                return null;
+            }
+        }
+
+        /// <summary>
+        ///   Describes the first property that isn't the same in both; null if they're all the same.
+        /// </summary>
+        private static string FirstMismatch(Dictionary<string, string> managed, Dictionary<string, string> api) {
+            foreach (var property in api) {
+                string value;
+                if (!managed.TryGetValue(property.Key, out value)) {
+                    return string.Format(CultureInfo.InvariantCulture, "the managed reader didn't find '{0}'", property.Key);
+                }
+                if (value != property.Value) {
+                    return string.Format(CultureInfo.InvariantCulture, "'{0}' is '{1}', rather than '{2}'", property.Key, value, property.Value);
+                }
+            }
+            var extra = managed.Keys.FirstOrDefault(each => !api.ContainsKey(each));
+            return extra == null ? null : string.Format(CultureInfo.InvariantCulture, "the managed reader found '{0}', which isn't there", extra);
+        }
+
+        private void Note(string file, string what) {
+            if (++_notes <= MaxNotes) {
+                _report.Note("{0}: {1}", file, what);
+            }
+        }
+
+        private class Outcome {
+            internal readonly string Name;
+            internal int Files;
+            internal long Properties;
+            internal TimeSpan Managed;
+            internal TimeSpan Api;
+
+            internal Outcome(string name) {
+                Name = name;
+            }
+        }
+    }
+}
@@ -0,0 +1,189 @@
+﻿//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Benchmarks {
+    using System;
+    using System.Globalization;
+    using System.Linq;
+    using System.Text;
+    using Toolkit.Exceptions;
+    using Toolkit.Scripting.Languages.PropertySheet;
+
+    /// <summary>
+    ///   Checks that a property sheet loaded thru the property sheet cache is the same as one parsed from scratch, as the
+    ///   sheet is edited and reloaded over and over: the same rules, properties and values, from the same rows and
+    ///   columns (or the same error).
+    /// </summary>
+    /// <remarks>
+    ///   The "edits" case makes <see cref = "Edits" /> random edits (inserting, deleting and replacing bits of property
+    ///   sheet syntax, line breaks included) to a sheet, reloading it after each one, so the cache re-parses only the part
+    ///   that changed. Half the time, an edit that breaks the sheet is undone before the next one, so that most of the
+    ///   reloads are of sheets that parse. The other cases are particular sequences of sheets that have gone wrong before. The cache is only
+    ///   kept in memory while this runs. Any reload that doesn't match fails the run.
+    /// </remarks>
+    public class PropertySheetCacheCheck : Benchmark {
+        private const string Filename = "cache-check.propertysheet";
+
+        private static readonly string[] Fragments = new[] {
+            "foo", "p0", "v3", "a", ":", ";", ",", "=", "{", "}", "{ a, \"b\", c1 }", "\"b\"", "\n", "\r\n", "\n\n", "\t", " ", "  ",
+            "// note\n", "/* x */", "bar.baz", "#id", ".class", "[x86]", "rule { p: v; }\n",
+        };
+
+        private static readonly string Sheet =
+            "// a property sheet\n" +
+            "e{p:{};p:{};\n}\n" +
+            "foo\n\n{\tp0: { a, \"b\", c1 };\n\np2:\n\nv4; p0:\tv3;  }\n" +
+            "bar[x86].baz#id {\r\n    label: \"text\";\r\n    list: { one, two,\r\n        three };\r\n    named: { first = one, second = \"two\" };\r\n}\r\n" +
+            "\n/* between */\nqux {\n    x : y;\n}\n";
+
+        private BenchmarkReport _report;
+        private int _failures;
+
+        /// <summary>
+        ///   Creates a check with the default settings: 2000 random edits.
+        /// </summary>
+        public PropertySheetCacheCheck() {
+            Edits = 2000;
+            Seed = 1;
+        }
+
+        /// <summary>
+        ///   The number of random edits (and reloads).
+        /// </summary>
+        public int Edits { get; set; }
+
+        /// <summary>
+        ///   The seed of the random edits (the same seed makes the same edits).
+        /// </summary>
+        public int Seed { get; set; }
+
+        public override void Run(BenchmarkReport report) {
+            _report = report;
+            _failures = 0;
+            report.Begin("property sheet cache check", string.Format(CultureInfo.InvariantCulture, "{0} random edits, seed {1}", Edits, Seed),
+                "case", "reloads", "errors", "failures");
+
+            var enabled = PropertySheetCache.Enabled;
+            var cacheFolder = PropertySheetCache.CacheFolder;
+            PropertySheetCache.CacheFolder = null;
+            try {
+                // an identifier right before a line break used to be counted as two rows by the tokenizer, but as one by the cache.
+                Check("identifier-line-break",
+                    "e{p:{};p:{};\n}\nfoo\n\n{\tp0: { a, \"b\", c1 };\n\np2:\n\nv4; p0:\tv3;  }\n",
+                    "oo\n{p:{};\n}\nfoo\n\n{\tp0: { a, \"b\", c1 };\n\np2:\n\nv4; p0:\tv3;  }\n");
+
+                Check("crlf", Sheet.Replace("\n", "\r\n"), Sheet.Replace("\n", "\r\n").Replace("qux", "quux\r\n"), Sheet.Replace("\n", "\r\n"));
+
+                var random = new Random(Seed);
+                var text = Sheet;
+                var lastGood = Sheet;
+                var sheets = new string[Edits + 1];
+                sheets[0] = text;
+                for (var i = 1; i <= Edits; i++) {
+                    text = Edit(random, text);
+                    sheets[i] = text;
+                    if (!Describe(text, false).StartsWith("error")) {
+                        lastGood = text;
+                    }
+                    else if (random.Next(2) == 0) {
+                        text = lastGood;
+                    }
+                }
+                Check("edits", sheets);
+            }
+            finally {
+                PropertySheetCache.Enabled = enabled;
+                PropertySheetCache.CacheFolder = cacheFolder;
+                PropertySheetCache.Clear();
+            }
+
+            if (_failures > 0) {
+                throw new ConsoleException("{0} reloads thru the cache didn't match parsing from scratch.", _failures);
+            }
+        }
+
+        /// <summary>
+        ///   Loads each sheet in turn thru the cache (as edits of the same file), and compares it with parsing it from scratch.
+        /// </summary>
+        private void Check(string name, params string[] sheets) {
+            PropertySheetCache.Clear();
+            var errors = 0;
+            var failures = 0;
+            foreach (var text in sheets) {
+                var uncached = Describe(text, false);
+                var cached = Describe(text, true);
+                if (uncached.StartsWith("error")) {
+                    errors++;
+                }
+                if (cached != uncached) {
+                    failures++;
+                    if (failures == 1) {
+                        _report.Note("{0}: the first mismatch was loading {1}", name, Quote(text));
+                        _report.Note("{0}: from scratch: {1}", name, Quote(uncached));
+                        _report.Note("{0}: thru the cache: {1}", name, Quote(cached));
+                    }
+                }
+            }
+            _report.Add(name, sheets.Length, errors, failures);
+            _failures += failures;
+        }
+
+        /// <summary>
+        ///   Parses a sheet, and describes everything in it (with where it came from), or the error parsing it.
+        /// </summary>
+        private static string Describe(string text, bool cached) {
+            PropertySheetCache.Enabled = cached;
+            PropertySheet sheet;
+            try {
+                sheet = PropertySheet.Parse(text, Filename);
+            }
+            catch (Exception e) {
+                return "error " + e.GetType().Name + ": " + e.Message;
+            }
+
+            var result = new StringBuilder();
+            foreach (var rule in sheet.Rules) {
+                result.AppendFormat("{0} {1}\n", rule.FullSelector, Where(rule.SourceLocation));
+                foreach (var propertyName in rule.PropertyNames) {
+                    var property = rule[propertyName];
+                    result.AppendFormat("  {0} {1}\n", propertyName, Where(property.SourceLocation));
+                    foreach (var label in property.Labels) {
+                        var value = property[label];
+                        result.AppendFormat("    [{0}] {1} = {2}\n", label, Where(value.SourceLocation), string.Join("|", value.ToArray()));
+                    }
+                }
+            }
+            return result.ToString();
+        }
+
+        private static string Where(SourceLocation location) {
+            return location == null ? "@?" : string.Format(CultureInfo.InvariantCulture, "@{0},{1}", location.Row, location.Column);
+        }
+
+        private static string Edit(Random random, string text) {
+            var offset = random.Next(text.Length + 1);
+            var length = Math.Min(random.Next(1, 9), text.Length - offset);
+            var fragment = Fragments[random.Next(Fragments.Length)];
+            switch (random.Next(3)) {
+                case 0:
+                    return text.Insert(offset, fragment);
+                case 1:
+                    // (never leave it empty; there'd be nothing left to edit.)
+                    return text.Length - length > 0 ? text.Remove(offset, length) : text;
+                default:
+                    return text.Remove(offset, length).Insert(offset, fragment);
+            }
+        }
+
+        private static string Quote(string text) {
+            return text.Replace("\\", "\\\\").Replace("\r", "\\r").Replace("\n", "\\n").Replace("\t", "\\t");
+        }
+    }
+}
@@ -0,0 +1,262 @@
+﻿//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Benchmarks {
+    using System;
+    using System.Collections.Concurrent;
+    using System.Collections.Generic;
+    using System.Globalization;
+    using System.IO;
+    using System.IO.Pipes;
+    using System.Linq;
+    using System.Threading.Tasks;
+    using Toolkit.Pipes;
+
+    /// <summary>
+    ///   Compares the throughput of the two ways the engine sends responses down the pipe: one pipe write per
+    ///   message ("legacy"), and framed batches of messages ("framed").
+    /// </summary>
+    /// <remarks>
+    ///   <para>
+    ///     Each iteration sends <see cref = "Messages" /> found-package responses (the bulk of a find-packages answer)
+    ///     the way the engine's session does, and reads them the way the client's message loop does: into a 2MB
+    ///     buffer, one pipe read at a time, parsed with <see cref = "FramedMessages.ReadMessages" />. An iteration
+    ///     ends when the last message has been parsed.
+    ///   </para>
+    ///   <para>
+    ///     The "pipe" transport is a named pipe in message mode, as the engine uses. Where message mode isn't
+    ///     supported (Mono and .NET on Unix), the "loopback" transport is used instead: an in-process stream that keeps
+    ///     writes apart the same way, so only the protocol's own costs (encoding, writes issued, parsing) are measured.
+    ///   </para>
+    /// </remarks>
+    public class ProtocolBenchmark : Benchmark {
+        private const int ReadBufferSize = 2*1024*1024;
+
+        private BenchmarkReport _report;
+
+        /// <summary>
+        ///   Creates a benchmark with the default settings: 10000 messages, over a named pipe, for at least a second
+        ///   and three iterations per case.
+        /// </summary>
+        public ProtocolBenchmark() {
+            Messages = 10000;
+            Transport = "pipe";
+            MinimumTime = TimeSpan.FromSeconds(1);
+            MinimumIterations = 3;
+        }
+
+        /// <summary>
+        ///   The number of messages sent by each iteration.
+        /// </summary>
+        public int Messages { get; set; }
+
+        /// <summary>
+        ///   "pipe" or "loopback".
+        /// </summary>
+        public string Transport { get; set; }
+
+        /// <summary>
+        ///   The least time to spend timing each case.
+        /// </summary>
+        public TimeSpan MinimumTime { get; set; }
+
+        /// <summary>
+        ///   The least number of timed iterations of each case.
+        /// </summary>
+        public int MinimumIterations { get; set; }
+
+        public override void Run(BenchmarkReport report) {
+            _report = report;
+            report.Begin("engine protocol benchmark", string.Format(CultureInfo.InvariantCulture, "{0} messages", Messages),
+                "protocol", "transport", "messages", "iterations", "wire-bytes", "writes", "mean-ms", "min-ms", "messages/s", "MB/s",
+                "alloc-bytes", "gen0");
+
+            var messages = Enumerable.Range(0, Messages).Select(FoundPackage).ToArray();
+
+            Measure("legacy", messages, (pipe, onFailure) => {
+                foreach (var message in messages) {
+                    AsyncPipeExtensions.WriteLineAsync(pipe, message.ToString()).ContinueWith(antecedent => onFailure(), TaskContinuationOptions.OnlyOnFaulted);
+                }
+            });
+
+            Measure("framed", messages, (pipe, onFailure) => {
+                using (var writer = new FramedMessageWriter(pipe, unsent => onFailure())) {
+                    foreach (var message in messages) {
+                        writer.Write(message);
+                    }
+                    writer.Flush();
+                }
+            });
+        }
+
+        private void Measure(string protocol, UrlEncodedMessage[] messages, Action<Stream, Action> send) {
+            Stream server, client;
+            var transport = Connect(out server, out client);
+            try {
+                long wireBytes = 0, writes = 0;
+                var failed = false;
+                var m = Measurement.Of(() => {
+                    var reader = Task.Factory.StartNew(() => Receive(client, messages.Length), TaskCreationOptions.LongRunning);
+                    send(server, () => failed = true);
+                    if (!reader.Wait(TimeSpan.FromMinutes(1)) || failed) {
+                        throw new IOException(string.Format("The {0} protocol lost messages.", protocol));
+                    }
+                    wireBytes = reader.Result.Key;
+                    writes = reader.Result.Value;
+                    return wireBytes;
+                }, MinimumTime, MinimumIterations);
+
+                _report.Add(protocol, transport, messages.Length, m.Iterations, wireBytes, writes, m.Mean, m.Min,
+                    messages.Length/m.Mean.TotalSeconds, m.MegabytesPerSecond(wireBytes), m.AllocatedBytes, m.Gen0Collections);
+            }
+            finally {
+                server.Close();
+                client.Close();
+            }
+        }
+
+        /// <summary>
+        ///   Reads and parses messages until <paramref name = "count" /> have arrived; returns the bytes and the reads it took.
+        /// </summary>
+        private static KeyValuePair<long, long> Receive(Stream pipe, int count) {
+            var buffer = new byte[ReadBufferSize];
+            long bytes = 0, reads = 0;
+            var received = 0;
+            while (received < count) {
+                var read = pipe.Read(buffer, 0, buffer.Length);
+                if (read <= 0) {
+                    throw new EndOfStreamException();
+                }
+                bytes += read;
+                reads++;
+                received += FramedMessages.ReadMessages(buffer, read).Count();
+            }
+            return new KeyValuePair<long, long>(bytes, reads);
+        }
+
+        private string Connect(out Stream server, out Stream client) {
+            if (Transport == "pipe") {
+                var name = "CoAppBenchmark-" + Guid.NewGuid().ToString("N");
+                NamedPipeServerStream serverPipe;
+                try {
+                    serverPipe = new NamedPipeServerStream(name, PipeDirection.Out, 1, PipeTransmissionMode.Message, PipeOptions.Asynchronous,
+                        ReadBufferSize, ReadBufferSize);
+                }
+                catch (PlatformNotSupportedException) {
+                    _report.Note("message mode pipes aren't supported here; using the loopback transport.");
+                    Transport = "loopback";
+                    return Connect(out server, out client);
+                }
+                var clientPipe = new NamedPipeClientStream(".", name, PipeDirection.In, PipeOptions.Asynchronous);
+                var connected = Task.Factory.FromAsync(serverPipe.BeginWaitForConnection, serverPipe.EndWaitForConnection, null);
+                clientPipe.Connect();
+                clientPipe.ReadMode = PipeTransmissionMode.Message;
+                connected.Wait();
+                server = serverPipe;
+                client = clientPipe;
+                return Transport;
+            }
+
+            var loopback = new LoopbackStream();
+            server = loopback;
+            client = loopback;
+            return Transport;
+        }
+
+        /// <summary>
+        ///   A found-package response, as the session sends it for a package that's on a feed but not installed.
+        /// </summary>
+        internal static UrlEncodedMessage FoundPackage(int i) {
+            var name = string.Format(CultureInfo.InvariantCulture, "package-{0}", i);
+            var version = string.Format(CultureInfo.InvariantCulture, "1.{0}.{1}.{2}", i%7, i%100, i);
+            var canonicalName = string.Format(CultureInfo.InvariantCulture, "{0}-{1}-x86-1e373a58e25250cb", name, version);
+            var message = new UrlEncodedMessage("found-package") {
+                {"canonical-name", canonicalName},
+                {"local-location", string.Format(CultureInfo.InvariantCulture, @"C:\ProgramData\.cache\packages\{0}.msi", canonicalName)},
+                {"name", name},
+                {"version", version},
+                {"arch", "x86"},
+                {"public-key-token", "1e373a58e25250cb"},
+                {"product-code", new Guid(i, 0, 0, new byte[8]).ToString()},
+                {"installed", "False"},
+                {"blocked", "False"},
+                {"required", "False"},
+                {"client-required", "False"},
+                {"active", "False"},
+                {"dependent", "False"},
+                {"rqid", "42"},
+            };
+            message.AddCollection("remote-locations", new[] {string.Format(CultureInfo.InvariantCulture, "http://coapp.org/repository/{0}.msi", canonicalName)});
+            message.AddCollection("dependencies", Enumerable.Range(0, i%4).Select(each => string.Format(CultureInfo.InvariantCulture, "package-{0}-1.0.0.{0}-x86-1e373a58e25250cb", each)));
+            return message;
+        }
+
+        /// <summary>
+        ///   An in-process stream that hands back each write as one read, the way a message mode pipe does.
+        /// </summary>
+        private class LoopbackStream : Stream {
+            private readonly BlockingCollection<byte[]> _writes = new BlockingCollection<byte[]>();
+            private byte[] _current;
+            private int _currentOffset;
+
+            public override int Read(byte[] buffer, int offset, int count) {
+                if (_current == null) {
+                    _current = _writes.Take();
+                    _currentOffset = 0;
+                }
+                var n = Math.Min(count, _current.Length - _currentOffset);
+                Buffer.BlockCopy(_current, _currentOffset, buffer, offset, n);
+                _currentOffset += n;
+                if (_currentOffset == _current.Length) {
+                    _current = null;
+                }
+                return n;
+            }
+
+            public override void Write(byte[] buffer, int offset, int count) {
+                var copy = new byte[count];
+                Buffer.BlockCopy(buffer, offset, copy, 0, count);
+                _writes.Add(copy);
+            }
+
+            public override bool CanRead {
+                get { return true; }
+            }
+
+            public override bool CanSeek {
+                get { return false; }
+            }
+
+            public override bool CanWrite {
+                get { return true; }
+            }
+
+            public override void Flush() {
+            }
+
+            public override long Length {
+                get { throw new NotSupportedException(); }
+            }
+
+            public override long Position {
+                get { throw new NotSupportedException(); }
+                set { throw new NotSupportedException(); }
+            }
+
+            public override long Seek(long offset, SeekOrigin origin) {
+                throw new NotSupportedException();
+            }
+
+            public override void SetLength(long value) {
+                throw new NotSupportedException();
+            }
+        }
+    }
+}
@@ -0,0 +1,232 @@
+﻿//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Benchmarks {
+    using System;
+    using System.Globalization;
+    using System.IO;
+    using System.Text;
+    using System.Xml;
+    using Toolkit.Text.Sgml;
+
+    /// <summary>
+    ///   Measures the throughput and allocation rate of the <see cref = "SgmlReader" /> on a large HTML page.
+    /// </summary>
+    /// <remarks>
+    ///   <para>
+    ///     The page is generated from a fixed seed, so every run reads exactly the same document: a vendor's download
+    ///     page, with a script and a stylesheet in the head, and then section after section of prose and tables of
+    ///     download links, with the usual untidiness (upper case tags, unquoted attribute values, entities).
+    ///   </para>
+    ///   <para>
+    ///     The cases read the page the ways a scraper can: every node and attribute value as a string
+    ///     ("read-strings"), every attribute value as characters instead ("read-segments"), just the links, skipping
+    ///     what doesn't matter ("scrape-links"), and skipping every section as a whole ("skip"). Each case is run
+    ///     for at least <see cref = "MinimumTime" /> and <see cref = "MinimumIterations" />.
+    ///   </para>
+    /// </remarks>
+    public class SgmlBenchmark : Benchmark {
+        private static readonly string[] Words = {
+            "the", "package", "of", "and", "to", "install", "a", "in", "download", "is", "for", "version", "that", "with",
+            "file", "on", "as", "by", "release", "library", "be", "this", "from", "are", "or", "update", "it", "an",
+        };
+
+        private string _page;
+        private BenchmarkReport _report;
+
+        /// <summary>
+        ///   Creates a benchmark with the default settings: an 8MB page, and at least a second and three iterations per case.
+        /// </summary>
+        public SgmlBenchmark() {
+            PageSize = 8*1024*1024;
+            MinimumTime = TimeSpan.FromSeconds(1);
+            MinimumIterations = 3;
+        }
+
+        /// <summary>
+        ///   The least size of the page, in characters.
+        /// </summary>
+        public int PageSize { get; set; }
+
+        /// <summary>
+        ///   The least time to spend timing each case.
+        /// </summary>
+        public TimeSpan MinimumTime { get; set; }
+
+        /// <summary>
+        ///   The least number of timed iterations of each case.
+        /// </summary>
+        public int MinimumIterations { get; set; }
+
+        /// <summary>
+        ///   Generates a page of at least the given size. The same size always produces the same page.
+        /// </summary>
+        public static string CreatePage(int size) {
+            var sb = new StringBuilder(size + 4096);
+            // xorshift, rather than System.Random, whose sequence isn't promised
+            // to stay the same from one framework to the next.
+            uint x = 2463534242;
+            Func<int, int> next = n => {
+                x ^= x << 13;
+                x ^= x >> 17;
+                x ^= x << 5;
+                return (int) (x%(uint) n);
+            };
+
+            sb.Append("<!DOCTYPE html>\r\n<html>\r\n<head>\r\n<title>Downloads</title>\r\n");
+            sb.Append("<meta http-equiv=\"Content-Type\" content=\"text/html; charset=utf-8\"/>\r\n");
+            sb.Append("<script type=\"text/javascript\">\r\nvar mirrors = 3;\r\nif (mirrors < 4 && mirrors > 0) { document.write('<b>' + mirrors + '</b>'); }\r\n</script>\r\n");
+            sb.Append("<style type=\"text/css\">\r\ntd { padding: 2px; } a.download { font-weight: bold; }\r\n</style>\r\n</head>\r\n<body>\r\n");
+            sb.Append("<div id=\"nav\" class=\"nav\"><ul><li><a href=\"/\">Home</a></li><li><a href=\"/products\">Products</a></li><li><a href=\"/support\">Support</a></li></ul></div>\r\n");
+
+            for(var product = 0; sb.Length < size; product++) {
+                var version = string.Format(CultureInfo.InvariantCulture, "{0}.{1}.{2}", 1 + next(9), next(20), next(1000));
+                sb.AppendFormat(CultureInfo.InvariantCulture, "<div class=\"product\" id=\"product-{0}\">\r\n<h2>Product {0} &mdash; version {1}</h2>\r\n<p>", product, version);
+                for(int i = 0, n = 20 + next(60); i < n; i++) {
+                    sb.Append(Words[next(Words.Length)]);
+                    sb.Append(i%11 == 10 ? ". " : i%17 == 16 ? " &amp; " : " ");
+                }
+                sb.Append("</p>\r\n<!-- downloads for this release -->\r\n");
+                sb.Append(product%3 == 0 ? "<TABLE CLASS=downloads>\r\n" : "<table class=\"downloads\" cellpadding=\"2\">\r\n");
+                sb.Append("<tr><th>File</th><th>Size</th><th>Date</th></tr>\r\n");
+                for(int i = 0, n = 3 + next(8); i < n; i++) {
+                    var arch = i%3 == 0 ? "x86" : i%3 == 1 ? "x64" : "any";
+                    var file = string.Format(CultureInfo.InvariantCulture, "product-{0}-{1}-{2}.{3}", product, version, arch, i%4 == 3 ? "zip" : "msi");
+                    if(product%3 == 0) {
+                        sb.AppendFormat(CultureInfo.InvariantCulture, "<TR><TD><A HREF=http://download.example.com/files/{0} CLASS=download>{0}</A></TD><TD>{1}.{2}&nbsp;MB</TD><TD>2011-{3:00}-{4:00}</TD></TR>\r\n",
+                            file, next(200), next(10), 1 + next(12), 1 + next(28));
+                    }
+                    else {
+                        sb.AppendFormat(CultureInfo.InvariantCulture, "<tr>\r\n  <td><a href=\"http://download.example.com/files/{0}?mirror={1}&amp;ref=page\" class=\"download\" title=\"Download {0}\">{0}</a></td>\r\n  <td>{2}.{3}&nbsp;MB</td>\r\n  <td>2011-{4:00}-{5:00}</td>\r\n</tr>\r\n",
+                            file, next(3), next(200), next(10), 1 + next(12), 1 + next(28));
+                    }
+                }
+                sb.Append(product%3 == 0 ? "</TABLE>\r\n" : "</table>\r\n");
+                sb.Append("<p class=\"notes\">See the <a href=\"/notes\">release notes</a> for what's changed.<br/>Checksums are on the <a href='/sums'>checksum page</a>.</p>\r\n</div>\r\n");
+            }
+
+            sb.Append("<div id=\"footer\">&copy; 2011 Example</div>\r\n</body>\r\n</html>\r\n");
+            return sb.ToString();
+        }
+
+        public override void Run(BenchmarkReport report) {
+            _report = report;
+            report.Begin("SGML reader benchmark", string.Format(CultureInfo.InvariantCulture, "page {0} characters", Page.Length),
+                "name", "iterations", "characters", "count", "mean-ms", "min-ms", "MB/s", "alloc-bytes", "gen0");
+            Measure("read-strings", ReadStrings);
+            Measure("read-segments", ReadSegments);
+            Measure("scrape-links", ScrapeLinks);
+            Measure("skip", SkipSections);
+        }
+
+        private string Page {
+            get { return _page ?? (_page = CreatePage(PageSize)); }
+        }
+
+        private SgmlReader CreateReader() {
+            return new SgmlReader {
+                WhitespaceHandling = WhitespaceHandling.None,
+                CaseFolding = CaseFolding.ToLower,
+                InputStream = new StringReader(Page)
+            };
+        }
+
+        // every node's value, and every attribute's, as a string.
+        private long ReadStrings() {
+            long count = 0;
+            using(var reader = CreateReader()) {
+                while(reader.Read()) {
+                    count++;
+                    var value = reader.Value;
+                    for(var i = 0; i < reader.AttributeCount; i++) {
+                        value = reader.GetAttribute(i);
+                    }
+                }
+            }
+            return count;
+        }
+
+        // every attribute's value as characters, and no strings.
+        private long ReadSegments() {
+            long count = 0;
+            using(var reader = CreateReader()) {
+                while(reader.Read()) {
+                    count++;
+                    for(var i = 0; i < reader.AttributeCount; i++) {
+                        count += reader.GetAttributeSegment(i).Count > 0 ? 0 : 1;
+                    }
+                }
+            }
+            return count;
+        }
+
+        // the links to installers, skipping the prose, the head, and the navigation.
+        private long ScrapeLinks() {
+            long count = 0;
+            using(var reader = CreateReader()) {
+                var more = reader.Read();
+                while(more) {
+                    if(reader.NodeType == XmlNodeType.Element) {
+                        switch(reader.Name) {
+                            case "head":
+                            case "p":
+                            case "ul":
+                                reader.Skip();
+                                continue;
+                            case "a":
+                                ArraySegment<char> href;
+                                if(reader.TryGetAttributeSegment("href", out href) && EndsWith(href, ".msi")) {
+                                    count++;
+                                }
+                                break;
+                        }
+                    }
+                    more = reader.Read();
+                }
+            }
+            return count;
+        }
+
+        // every section of the body, skipped whole.
+        private long SkipSections() {
+            long count = 0;
+            using(var reader = CreateReader()) {
+                while(reader.Read() && !(reader.NodeType == XmlNodeType.Element && reader.Name == "body")) {
+                }
+                reader.Read();
+                while(!reader.EOF && reader.Depth > 1) {
+                    if(reader.NodeType == XmlNodeType.Element) {
+                        count++;
+                    }
+                    reader.Skip();
+                }
+            }
+            return count;
+        }
+
+        private static bool EndsWith(ArraySegment<char> value, string suffix) {
+            if(value.Count < suffix.Length) {
+                return false;
+            }
+            for(int i = 0, start = value.Offset + value.Count - suffix.Length; i < suffix.Length; i++) {
+                if(value.Array[start + i] != suffix[i]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // the operation returns what it counted in the page (nodes read, links found, subtrees skipped), to check one run against another.
+        private void Measure(string name, Func<long> operation) {
+            var m = Measurement.Of(operation, MinimumTime, MinimumIterations);
+            _report.Add(name, m.Iterations, Page.Length, m.Result, m.Mean, m.Min, m.MegabytesPerSecond(Page.Length), m.AllocatedBytes, m.Gen0Collections);
+        }
+    }
+}
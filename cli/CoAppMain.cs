@@ -298,8 +298,10 @@ namespace CoApp.CLI {
                     case "list":
                     case "list-package":
                     case "list-packages":
+                        // terse output doesn't need the whole list up front, so print each package as soon as the engine finds it.
                         task =
-                            _pm.GetPackages(parameters, _minVersion, _maxVersion, _dependencies, _installed, _active, _required, _blocked, _latest, _location,_forceScan,  messages: _messages).ContinueWith(antecedent => ListPackages(antecedent.Result));
+                            _pm.GetPackages(parameters, _minVersion, _maxVersion, _dependencies, _installed, _active, _required, _blocked, _latest, _location,_forceScan,  
+                                messages: _terse ? new PackageManagerMessages { PackageInformation = PrintPackage }.Extend(_messages) : _messages).ContinueWith(antecedent => ListPackages(antecedent.Result));
                         break;
 
                     case "-i":
@@ -730,11 +732,13 @@ namespace CoApp.CLI {
         /// </summary>
         /// <param name="parameters">The parameters.</param>
         /// <remarks></remarks>
+        private void PrintPackage(Package package) {
+            Console.WriteLine("{0} # Installed:{1}", package.CanonicalName, package.IsInstalled);
+        }
+
         private void ListPackages(IEnumerable<Package> packages) {
             if (_terse) {
-                foreach (var package in packages) {
-                    Console.WriteLine("{0} # Installed:{1}", package.CanonicalName, package.IsInstalled);
-                }
+                // already printed as they came in.
             }
             else if (packages.Any()) {
                 (from pkg in packages
@@ -27,6 +27,7 @@
 
 
 using System;
+using System.Collections.Generic;
 using Interop = System.Runtime.InteropServices;
 
 namespace Ionic.Crc
@@ -145,23 +146,98 @@ namespace Ionic.Crc
             if (block == null)
                 throw new Exception("The data buffer must not be null.");
 
-            // bzip algorithm
-            for (int i = 0; i < count; i++)
+            if (this.reverseBits)
             {
-                int x = offset + i;
-                byte b = block[x];
-                if (this.reverseBits)
+                // bzip algorithm
+                for (int i = 0; i < count; i++)
                 {
+                    int x = offset + i;
+                    byte b = block[x];
                     UInt32 temp = (_register >> 24) ^ b;
                     _register = (_register << 8) ^ crc32Table[temp];
                 }
-                else
+            }
+            else
+            {
+                _register = UpdateRegister(crc32Tables, _register, block, offset, count);
+            }
+            _TotalBytesRead += count;
+        }
+
+
+        /// <summary>
+        ///   Computes the (GZIP/PKZIP) CRC32 of a block of bytes.
+        /// </summary>
+        /// <param name="block">block of bytes</param>
+        /// <param name="offset">starting point in the block</param>
+        /// <param name="count">how many bytes within the block to use</param>
+        /// <returns>the CRC32 of the bytes</returns>
+        public static Int32 Compute(byte[] block, int offset, int count)
+        {
+            if (block == null)
+                throw new Exception("The data buffer must not be null.");
+
+            return unchecked((Int32)(~UpdateRegister(StandardTables, 0xFFFFFFFFU, block, offset, count)));
+        }
+
+
+        /// <summary>
+        ///   Continues a (GZIP/PKZIP) CRC32 over a block of bytes.
+        /// </summary>
+        /// <remarks>
+        ///   Unlike the CRC "remainder register", the value passed in and returned
+        ///   here is a finished CRC (0 for no bytes at all), so it can be
+        ///   kept by callers that don't hold on to a CRC32 instance.
+        /// </remarks>
+        /// <param name="crc">the CRC of the bytes so far</param>
+        /// <param name="block">block of bytes</param>
+        /// <param name="offset">starting point in the block</param>
+        /// <param name="count">how many bytes within the block to use</param>
+        /// <returns>the CRC32 of the bytes so far, followed by the block</returns>
+        internal static UInt32 Update(UInt32 crc, byte[] block, int offset, int count)
+        {
+            return ~UpdateRegister(StandardTables, ~crc, block, offset, count);
+        }
+
+
+        /// <summary>
+        ///   Runs bytes through the CRC register, sixteen at a time.
+        /// </summary>
+        /// <remarks>
+        ///   <para>
+        ///     This is "slicing-by-16": table[k] holds the CRC of a byte followed
+        ///     by k zero bytes, so sixteen bytes can be folded into the register
+        ///     with sixteen independent lookups, instead of one byte per
+        ///     dependent lookup. Whatever doesn't fill a slice is done a byte at
+        ///     a time.
+        ///   </para>
+        /// </remarks>
+        private static UInt32 UpdateRegister(UInt32[][] tables, UInt32 register, byte[] block, int offset, int count)
+        {
+            unchecked
+            {
+                UInt32[] t0 = tables[0], t1 = tables[1], t2 = tables[2], t3 = tables[3];
+                UInt32[] t4 = tables[4], t5 = tables[5], t6 = tables[6], t7 = tables[7];
+                UInt32[] t8 = tables[8], t9 = tables[9], t10 = tables[10], t11 = tables[11];
+                UInt32[] t12 = tables[12], t13 = tables[13], t14 = tables[14], t15 = tables[15];
+
+                while (count >= 16)
                 {
-                    UInt32 temp = (_register & 0x000000FF) ^ b;
-                    _register = (_register >> 8) ^ crc32Table[temp];
+                    UInt32 a = register ^ (UInt32)(block[offset] | block[offset + 1] << 8 | block[offset + 2] << 16 | block[offset + 3] << 24);
+                    register = t15[a & 0xFF] ^ t14[(a >> 8) & 0xFF] ^ t13[(a >> 16) & 0xFF] ^ t12[a >> 24]
+                        ^ t11[block[offset + 4]] ^ t10[block[offset + 5]] ^ t9[block[offset + 6]] ^ t8[block[offset + 7]]
+                        ^ t7[block[offset + 8]] ^ t6[block[offset + 9]] ^ t5[block[offset + 10]] ^ t4[block[offset + 11]]
+                        ^ t3[block[offset + 12]] ^ t2[block[offset + 13]] ^ t1[block[offset + 14]] ^ t0[block[offset + 15]];
+                    offset += 16;
+                    count -= 16;
                 }
+
+                while (count-- > 0)
+                {
+                    register = (register >> 8) ^ t0[(register ^ block[offset++]) & 0xFF];
+                }
+                return register;
             }
-            _TotalBytesRead += count;
         }
 
 
@@ -250,6 +326,14 @@ namespace Ionic.Crc
 
         private void GenerateLookupTable()
         {
+            if (dwPolynomial == StandardPolynomial && !reverseBits && StandardTables != null)
+            {
+                // (almost everyone wants this one; no need to build it each time.)
+                crc32Tables = StandardTables;
+                crc32Table = crc32Tables[0];
+                return;
+            }
+
             crc32Table = new UInt32[256];
             unchecked
             {
@@ -296,30 +380,134 @@ namespace Ionic.Crc
             Console.WriteLine("};");
             Console.WriteLine();
 #endif
+            if (!reverseBits)
+                crc32Tables = BuildSlicingTables(crc32Table);
+        }
+
+
+        private static UInt32[][] BuildStandardTables()
+        {
+            // (StandardTables is still null while this runs, so this instance builds its own.)
+            return new CRC32().crc32Tables;
+        }
+
+
+        /// <summary>
+        ///   Builds the slicing tables from the byte table: table[k][n] is the
+        ///   CRC of byte n followed by k zero bytes.
+        /// </summary>
+        private static UInt32[][] BuildSlicingTables(UInt32[] table)
+        {
+            var tables = new UInt32[16][];
+            tables[0] = table;
+            for (int k = 1; k < tables.Length; k++)
+            {
+                tables[k] = new UInt32[256];
+                for (int n = 0; n < 256; n++)
+                {
+                    UInt32 previous = tables[k - 1][n];
+                    tables[k][n] = (previous >> 8) ^ table[previous & 0xFF];
+                }
+            }
+            return tables;
         }
 
 
-        private uint gf2_matrix_times(uint[] matrix, uint vec)
+        /// <summary>
+        ///   Multiplies two polynomials modulo the CRC polynomial (both in the
+        ///   reflected form, where the top bit is x^0).
+        /// </summary>
+        private static uint MultiplyModP(uint a, uint b, uint polynomial)
         {
-            uint sum = 0;
-            int i=0;
-            while (vec != 0)
+            uint m = 1U << 31;
+            uint p = 0;
+            while (true)
             {
-                if ((vec & 0x01)== 0x01)
-                    sum ^= matrix[i];
-                vec >>= 1;
-                i++;
+                if ((a & m) != 0)
+                {
+                    p ^= b;
+                    if ((a & (m - 1)) == 0)
+                        break;
+                }
+                m >>= 1;
+                b = (b & 1) != 0 ? (b >> 1) ^ polynomial : b >> 1;
             }
-            return sum;
+            return p;
         }
 
-        private void gf2_matrix_square(uint[] square, uint[] mat)
+
+        /// <summary>
+        ///   Gets x^(2^k) modulo the CRC polynomial, for k = 0..31.
+        /// </summary>
+        private static uint[] GetPowersOfTwo(uint polynomial)
         {
-            for (int i = 0; i < 32; i++)
-                square[i] = gf2_matrix_times(mat, mat[i]);
+            uint[] powers;
+            lock (_powersOfTwo)
+            {
+                if (_powersOfTwo.TryGetValue(polynomial, out powers))
+                    return powers;
+            }
+
+            powers = new uint[32];
+            uint p = 1U << 30;  // x^1
+            powers[0] = p;
+            for (int n = 1; n < 32; n++)
+                powers[n] = p = MultiplyModP(p, p, polynomial);
+
+            lock (_powersOfTwo)
+            {
+                _powersOfTwo[polynomial] = powers;
+            }
+            return powers;
         }
 
 
+        /// <summary>
+        ///   Combines two finished CRCs: given the CRC of A, and the CRC of B
+        ///   (which is lengthB bytes long), returns the CRC of A followed by B.
+        /// </summary>
+        /// <remarks>
+        ///   Appending lengthB bytes to A multiplies its CRC by x^(8*lengthB);
+        ///   that power is built from precomputed x^(2^k), so this takes time
+        ///   proportional to the number of bits in lengthB, not to lengthB.
+        /// </remarks>
+        private static uint Combine(uint crcA, uint crcB, long lengthB, uint polynomial)
+        {
+            if (lengthB <= 0)
+                return crcA ^ crcB;
+
+            uint[] powers = GetPowersOfTwo(polynomial);
+            uint xn = 1U << 31;  // x^0
+            int k = 3;           // (lengthB is in bytes; x^(8*n) = x^(n * 2^3))
+            ulong n = (ulong)lengthB;
+            while (n != 0)
+            {
+                if ((n & 1) != 0)
+                    xn = MultiplyModP(powers[k & 31], xn, polynomial);
+                n >>= 1;
+                k++;
+            }
+            return MultiplyModP(xn, crcA, polynomial) ^ crcB;
+        }
+
+
+        /// <summary>
+        ///   Combines two (GZIP/PKZIP) CRC32 values: given the CRC of a block A
+        ///   and the CRC of a block B, returns the CRC of A followed by B.
+        /// </summary>
+        /// <remarks>
+        ///   This lets parallel compressors checksum their blocks independently,
+        ///   and put the whole-stream CRC together afterwards.
+        /// </remarks>
+        /// <param name="crcA">the CRC of the first block</param>
+        /// <param name="crcB">the CRC of the second block</param>
+        /// <param name="lengthB">the length of the second block</param>
+        /// <returns>the CRC of both blocks</returns>
+        public static Int32 Combine(Int32 crcA, Int32 crcB, Int64 lengthB)
+        {
+            return unchecked((Int32)Combine((uint)crcA, (uint)crcB, lengthB, StandardPolynomial));
+        }
+
 
         /// <summary>
         ///   Combines the given CRC32 value with the current running total.
@@ -334,60 +522,10 @@ namespace Ionic.Crc
         /// <param name="length">the length of data the CRC value was calculated on</param>
         public void Combine(int crc, int length)
         {
-            uint[] even = new uint[32];     // even-power-of-two zeros operator
-            uint[] odd = new uint[32];      // odd-power-of-two zeros operator
-
             if (length == 0)
                 return;
 
-            uint crc1= ~_register;
-            uint crc2= (uint) crc;
-
-            // put operator for one zero bit in odd
-            odd[0] = this.dwPolynomial;  // the CRC-32 polynomial
-            uint row = 1;
-            for (int i = 1; i < 32; i++)
-            {
-                odd[i] = row;
-                row <<= 1;
-            }
-
-            // put operator for two zero bits in even
-            gf2_matrix_square(even, odd);
-
-            // put operator for four zero bits in odd
-            gf2_matrix_square(odd, even);
-
-            uint len2 = (uint) length;
-
-            // apply len2 zeros to crc1 (first square will put the operator for one
-            // zero byte, eight zero bits, in even)
-            do {
-                // apply zeros operator for this bit of len2
-                gf2_matrix_square(even, odd);
-
-                if ((len2 & 1)== 1)
-                    crc1 = gf2_matrix_times(even, crc1);
-                len2 >>= 1;
-
-                if (len2 == 0)
-                    break;
-
-                // another iteration of the loop with odd and even swapped
-                gf2_matrix_square(odd, even);
-                if ((len2 & 1)==1)
-                    crc1 = gf2_matrix_times(odd, crc1);
-                len2 >>= 1;
-
-
-            } while (len2 != 0);
-
-            crc1 ^= crc2;
-
-            _register= ~crc1;
-
-            //return (int) crc1;
-            return;
+            _register = ~Combine(~_register, (uint)crc, length, this.dwPolynomial);
         }
 
 
@@ -468,6 +606,10 @@ namespace Ionic.Crc
         }
 
         // private member vars
+        private const UInt32 StandardPolynomial = 0xEDB88320U;
+        private static readonly UInt32[][] StandardTables = BuildStandardTables();
+        private static readonly Dictionary<uint, uint[]> _powersOfTwo = new Dictionary<uint, uint[]>();
+        private UInt32[][] crc32Tables;
         private UInt32 dwPolynomial;
         private Int64 _TotalBytesRead;
         private bool reverseBits;
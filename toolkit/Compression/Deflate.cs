@@ -84,7 +84,8 @@ namespace Ionic.Zlib
     {
         Store,
         Fast,
-        Slow
+        Slow,
+        Quick
     }
 
     internal sealed class DeflateManager
@@ -144,6 +145,9 @@ namespace Ionic.Zlib
                     new Config(8, 32, 128, 256, DeflateFlavor.Slow),
                     new Config(32, 128, 258, 1024, DeflateFlavor.Slow),
                     new Config(32, 258, 258, 4096, DeflateFlavor.Slow),
+
+                    // Fastest: DeflateQuick doesn't use any of the tuning values.
+                    new Config(0, 0, 0, 0, DeflateFlavor.Quick),
                 };
             }
 
@@ -193,6 +197,11 @@ namespace Ionic.Zlib
 
         private static readonly int MIN_LOOKAHEAD = (MAX_MATCH + MIN_MATCH + 1);
 
+        // DeflateQuick hashes four bytes at a time into a table of this many bits,
+        // and after each run of this many missed probes, steps over one more byte.
+        private static readonly int QUICK_HASH_BITS = 16;
+        private static readonly int QUICK_SKIP_SHIFT = 5;
+
         private static readonly int HEAP_SIZE = (2 * InternalConstants.L_CODES + 1);
 
         private static readonly int END_BLOCK = 256;
@@ -232,6 +241,10 @@ namespace Ionic.Zlib
 
         internal short[] head;  // Heads of the hash chains or NIL.
 
+        // For DeflateQuick: the last window position seen with each hash, or
+        // NIL. There are no chains. (Allocated only when it's used.)
+        internal int[] quick_head;
+
         internal int ins_h;     // hash index of string to be inserted
         internal int hash_size; // number of elements in hash table
         internal int hash_bits; // log2(hash_size)
@@ -351,6 +364,8 @@ namespace Ionic.Zlib
             // clear the hash - workitem 9063
             Array.Clear(head, 0, hash_size);
             //for (int i = 0; i < hash_size; i++) head[i] = 0;
+            if (quick_head != null)
+                Array.Clear(quick_head, 0, quick_head.Length);
 
             config = Config.Lookup(compressionLevel);
             SetDeflater();
@@ -725,7 +740,7 @@ namespace Ionic.Zlib
                 dyn_dtree[Tree.DistanceCode(dist) * 2]++;
             }
 
-            if ((last_lit & 0x1fff) == 0 && (int)compressionLevel > 2)
+            if ((last_lit & 0x1fff) == 0 && (int)compressionLevel > 2 && config.Flavor != DeflateFlavor.Quick)
             {
                 // Compute an upper bound for the compressed length
                 int out_length = last_lit << 3;
@@ -749,7 +764,28 @@ namespace Ionic.Zlib
 
 
 
-        // Send the block data compressed using the given Huffman trees
+        // _tr_tally for a literal, small enough to be inlined into DeflateQuick.
+        private bool _tr_tally_literal(int c)
+        {
+            int ix = _distanceOffset + last_lit * 2;
+            pending[ix] = 0;
+            pending[ix + 1] = 0;
+            pending[_lengthOffset + last_lit] = unchecked((byte)c);
+            last_lit++;
+            dyn_ltree[c * 2]++;
+            return last_lit >= lit_bufsize - 1;
+        }
+
+
+
+        // Send the block data compressed using the given Huffman trees.
+        //
+        // This is where most of the time goes when compressing quickly, so
+        // rather than calling send_code/send_bits (and spilling the 16-bit
+        // bi_buf) for every code, the codes are gathered in a 64-bit local
+        // and written to pending four bytes at a time. Nothing is written
+        // sooner than it would have been, so pending still can't overrun the
+        // symbol buffers it shares an array with.
         internal void send_compressed_block(short[] ltree, short[] dtree)
         {
             int distance; // distance of matched string
@@ -758,19 +794,26 @@ namespace Ionic.Zlib
             int code;     // the code to send
             int extra;    // number of extra bits to send
 
+            byte[] buf = pending;
+            int bufCount = pendingCount;
+            ulong bits = (ulong)(bi_buf & 0xffff) & ((1UL << bi_valid) - 1);
+            int bitCount = bi_valid;
+
             if (last_lit != 0)
             {
                 do
                 {
                     int ix = _distanceOffset + lx * 2;
-                    distance = ((pending[ix] << 8) & 0xff00) |
-                        (pending[ix + 1] & 0xff);
-                    lc = (pending[_lengthOffset + lx]) & 0xff;
+                    distance = ((buf[ix] << 8) & 0xff00) |
+                        (buf[ix + 1] & 0xff);
+                    lc = (buf[_lengthOffset + lx]) & 0xff;
                     lx++;
 
                     if (distance == 0)
                     {
-                        send_code(lc, ltree); // send a literal byte
+                        // send a literal byte
+                        bits |= (ulong)(ltree[lc * 2] & 0xffff) << bitCount;
+                        bitCount += ltree[lc * 2 + 1];
                     }
                     else
                     {
@@ -779,34 +822,71 @@ namespace Ionic.Zlib
                         code = Tree.LengthCode[lc];
 
                         // send the length code
-                        send_code(code + InternalConstants.LITERALS + 1, ltree);
+                        int c2 = (code + InternalConstants.LITERALS + 1) * 2;
+                        bits |= (ulong)(ltree[c2] & 0xffff) << bitCount;
+                        bitCount += ltree[c2 + 1];
                         extra = Tree.ExtraLengthBits[code];
                         if (extra != 0)
                         {
                             // send the extra length bits
                             lc -= Tree.LengthBase[code];
-                            send_bits(lc, extra);
+                            bits |= (ulong)lc << bitCount;
+                            bitCount += extra;
                         }
+
+                        // (at most 20 bits so far; make room for up to 28 more.)
+                        if (bitCount >= 32)
+                        {
+                            buf[bufCount++] = (byte)bits;
+                            buf[bufCount++] = (byte)(bits >> 8);
+                            buf[bufCount++] = (byte)(bits >> 16);
+                            buf[bufCount++] = (byte)(bits >> 24);
+                            bits >>= 32;
+                            bitCount -= 32;
+                        }
+
                         distance--; // dist is now the match distance - 1
                         code = Tree.DistanceCode(distance);
 
                         // send the distance code
-                        send_code(code, dtree);
+                        bits |= (ulong)(dtree[code * 2] & 0xffff) << bitCount;
+                        bitCount += dtree[code * 2 + 1];
 
                         extra = Tree.ExtraDistanceBits[code];
                         if (extra != 0)
                         {
                             // send the extra distance bits
                             distance -= Tree.DistanceBase[code];
-                            send_bits(distance, extra);
+                            bits |= (ulong)distance << bitCount;
+                            bitCount += extra;
                         }
                     }
 
-                    // Check that the overlay between pending and d_buf+l_buf is ok:
+                    if (bitCount >= 32)
+                    {
+                        buf[bufCount++] = (byte)bits;
+                        buf[bufCount++] = (byte)(bits >> 8);
+                        buf[bufCount++] = (byte)(bits >> 16);
+                        buf[bufCount++] = (byte)(bits >> 24);
+                        bits >>= 32;
+                        bitCount -= 32;
+                    }
                 }
                 while (lx < last_lit);
             }
 
+            // hand what's left (under 32 bits) back to bi_buf, which holds 16.
+            if (bitCount > 16)
+            {
+                buf[bufCount++] = (byte)bits;
+                buf[bufCount++] = (byte)(bits >> 8);
+                bits >>= 16;
+                bitCount -= 16;
+            }
+            pendingCount = bufCount;
+            bi_buf = unchecked((short)bits);
+            bi_valid = bitCount;
+
             send_code(END_BLOCK, ltree);
             last_eob_len = ltree[END_BLOCK * 2 + 1];
         }
@@ -1112,6 +1192,15 @@ namespace Ionic.Zlib
                         // its value will never be used.
                     }
                     while (--n != 0);
+
+                    if (quick_head != null)
+                    {
+                        for (p = 0; p < quick_head.Length; p++)
+                        {
+                            m = quick_head[p];
+                            quick_head[p] = (m >= w_size) ? (m - w_size) : 0;
+                        }
+                    }
                     more += w_size;
                 }
 
@@ -1420,6 +1509,123 @@ namespace Ionic.Zlib
         }
 
 
+        // A faster, and less thorough, variant of DeflateFast, used for
+        // CompressionLevel.Fastest. Each position is hashed on its next four
+        // bytes into a single-entry table (no hash chains), and the one
+        // candidate found there is the only match tried. Of the positions
+        // inside a match, only one near its end is inserted in the table.
+        // While the probes keep missing, ie on data that doesn't compress,
+        // it steps further ahead each time, emitting the bytes it steps over
+        // as literals without hashing them.
+        internal BlockState DeflateQuick(FlushType flush)
+        {
+            bool bflush; // set if current block must be flushed
+            int misses = 0; // probes missed since the last match
+
+            while (true)
+            {
+                // Make sure that we always have enough lookahead, except
+                // at the end of the input file.
+                if (lookahead < MIN_LOOKAHEAD)
+                {
+                    _fillWindow();
+                    if (lookahead < MIN_LOOKAHEAD && flush == FlushType.None)
+                    {
+                        return BlockState.NeedMore;
+                    }
+                    if (lookahead == 0)
+                        break; // flush the current block
+                }
+
+                int candidate = 0;
+                int length = 0;
+                if (lookahead >= 4 && compressionStrategy != CompressionStrategy.HuffmanOnly)
+                {
+                    int h = QuickHash(strstart);
+                    candidate = quick_head[h];
+                    quick_head[h] = strstart;
+
+                    // (as in DeflateFast, window index 0 is never matched.)
+                    if (candidate != 0 && strstart - candidate <= w_size - MIN_LOOKAHEAD)
+                        length = QuickMatchLength(candidate);
+                }
+
+                if (length >= MIN_MATCH)
+                {
+                    bflush = _tr_tally(strstart - candidate, length - MIN_MATCH);
+                    lookahead -= length;
+                    strstart += length;
+                    misses = 0;
+
+                    // (the end of a match is a good place to look for the next one.)
+                    if (lookahead >= 4)
+                        quick_head[QuickHash(strstart - 2)] = strstart - 2;
+                }
+                else
+                {
+                    // No match: output a literal byte, or a few of them.
+                    int step = 1 + (misses++ >> QUICK_SKIP_SHIFT);
+                    do
+                    {
+                        bflush = _tr_tally_literal(window[strstart] & 0xff);
+                        lookahead--;
+                        strstart++;
+                    }
+                    while (--step != 0 && lookahead > 0 && !bflush);
+                }
+
+                if (bflush)
+                {
+                    flush_block_only(false);
+                    if (_codec.AvailableBytesOut == 0)
+                        return BlockState.NeedMore;
+                }
+            }
+
+            flush_block_only(flush == FlushType.Finish);
+            if (_codec.AvailableBytesOut == 0)
+            {
+                if (flush == FlushType.Finish)
+                    return BlockState.FinishStarted;
+                else
+                    return BlockState.NeedMore;
+            }
+            return flush == FlushType.Finish ? BlockState.FinishDone : BlockState.BlockDone;
+        }
+
+        private int QuickHash(int position)
+        {
+            uint key = (uint)((window[position] & 0xff)
+                              | ((window[position + 1] & 0xff) << 8)
+                              | ((window[position + 2] & 0xff) << 16)
+                              | ((window[position + 3] & 0xff) << 24));
+            return (int)(unchecked(key * 2654435761U) >> (32 - QUICK_HASH_BITS));
+        }
+
+        // The length of the match between the strings at candidate and
+        // strstart, or 0 if it's shorter than four bytes (which is all
+        // the hash promises, and it might not even deliver that).
+        private int QuickMatchLength(int candidate)
+        {
+            int scan = strstart;
+            if (window[candidate] != window[scan] ||
+                window[candidate + 1] != window[scan + 1] ||
+                window[candidate + 2] != window[scan + 2] ||
+                window[candidate + 3] != window[scan + 3])
+                return 0;
+
+            int limit = scan + Math.Min(MAX_MATCH, lookahead);
+            scan += 4;
+            candidate += 4;
+            while (scan < limit && window[scan] == window[candidate])
+            {
+                scan++;
+                candidate++;
+            }
+            return scan - strstart;
+        }
+
+
         internal int longest_match(int cur_match)
         {
             int chain_length = config.MaxChainLength; // max hash chain length
@@ -1555,9 +1761,9 @@ namespace Ionic.Zlib
             hash_mask = hash_size - 1;
             hash_shift = ((hash_bits + MIN_MATCH - 1) / MIN_MATCH);
 
-            window = new byte[w_size * 2];
-            prev = new short[w_size];
-            head = new short[hash_size];
+            window = ZlibBufferPool<byte>.Rent(w_size * 2);
+            prev = ZlibBufferPool<short>.Rent(w_size);
+            head = ZlibBufferPool<short>.Rent(hash_size);
 
             // for memLevel==8, this will be 16384, 16k
             lit_bufsize = 1 << (memLevel + 6);
@@ -1566,7 +1772,7 @@ namespace Ionic.Zlib
             // the output distance codes, and the output length codes (aka tree).
             // orig comment: This works just fine since the average
             // output size for (length,distance) codes is <= 24 bits.
-            pending = new byte[lit_bufsize * 4];
+            pending = ZlibBufferPool<byte>.Rent(lit_bufsize * 4);
             _distanceOffset = lit_bufsize;
             _lengthOffset = (1 + 2) * lit_bufsize;
 
@@ -1611,9 +1817,15 @@ namespace Ionic.Zlib
                 return ZlibConstants.Z_STREAM_ERROR;
             }
             // Deallocate in reverse order of allocations:
+            ZlibBufferPool<byte>.Return(pending);
             pending = null;
+            ZlibBufferPool<short>.Return(head);
             head = null;
+            ZlibBufferPool<int>.Return(quick_head);
+            quick_head = null;
+            ZlibBufferPool<short>.Return(prev);
             prev = null;
+            ZlibBufferPool<byte>.Return(window);
             window = null;
             // free
             // dstate=null;
@@ -1634,6 +1846,11 @@ namespace Ionic.Zlib
                 case DeflateFlavor.Slow:
                     DeflateFunction = DeflateSlow;
                     break;
+                case DeflateFlavor.Quick:
+                    if (quick_head == null)
+                        quick_head = ZlibBufferPool<int>.Rent(1 << QUICK_HASH_BITS);
+                    DeflateFunction = DeflateQuick;
+                    break;
             }
         }
 
@@ -1728,7 +1945,7 @@ namespace Ionic.Zlib
             if (status == INIT_STATE)
             {
                 int header = (Z_DEFLATED + ((w_bits - 8) << 4)) << 8;
-                int level_flags = (((int)compressionLevel - 1) & 0xff) >> 1;
+                int level_flags = (config.Flavor == DeflateFlavor.Quick) ? 0 : (((int)compressionLevel - 1) & 0xff) >> 1;
 
                 if (level_flags > 3)
                     level_flags = 3;
@@ -1837,9 +2054,12 @@ namespace Ionic.Zlib
                         // as a special marker by inflate_sync().
                         if (flush == FlushType.Full)
                         {
-                            // clear hash (forget the history)
-                            for (int i = 0; i < hash_size; i++)
-                                head[i] = 0;
+                            // clear hash (forget the history); the quick strategy's
+                            // table too, or it would still match against data from
+                            // before the flush.
+                            Array.Clear(head, 0, hash_size);
+                            if (quick_head != null)
+                                Array.Clear(quick_head, 0, quick_head.Length);
                         }
                     }
                     _codec.flush_pending();
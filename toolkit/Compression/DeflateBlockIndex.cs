@@ -0,0 +1,153 @@
+//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+using System;
+using System.Collections.Generic;
+using System.IO;
+
+namespace Ionic.Zlib
+{
+    /// <summary>
+    ///   One independently compressed block of a stream written by the
+    ///   <see cref="ParallelDeflateOutputStream"/>.
+    /// </summary>
+    public class DeflateBlock
+    {
+        /// <summary>
+        ///   The number of compressed bytes in the block (ending with its sync flush).
+        /// </summary>
+        public int CompressedLength { get; internal set; }
+
+        /// <summary>
+        ///   The number of bytes the block inflates to.
+        /// </summary>
+        public int UncompressedLength { get; internal set; }
+
+        /// <summary>
+        ///   The CRC32 of the uncompressed bytes of the block.
+        /// </summary>
+        public int Crc32 { get; internal set; }
+    }
+
+    /// <summary>
+    ///   The block boundaries of a stream written by the
+    ///   <see cref="ParallelDeflateOutputStream"/>.
+    /// </summary>
+    ///
+    /// <remarks>
+    /// <para>
+    ///   The parallel compressor deflates each of its buffers from a fresh
+    ///   state and ends it with a sync flush, so every block starts on a byte
+    ///   boundary and never refers back to an earlier one. Knowing where they
+    ///   are (which is what this records) is enough to inflate them all at
+    ///   once; see <see cref="ParallelInflateInputStream"/>. The last block
+    ///   is the compressor's final (empty) block, which inflates to nothing;
+    ///   with it, the blocks cover every byte of the compressed stream.
+    /// </para>
+    ///
+    /// <para>
+    ///   The index isn't part of the deflate stream; whoever writes the stream
+    ///   has to keep it somewhere (<see cref="Save"/> and <see cref="Load"/>
+    ///   give it a compact binary form).
+    /// </para>
+    /// </remarks>
+    public class DeflateBlockIndex
+    {
+        private const int Signature = 0x58494450;  // "PDIX"
+        private const int FormatVersion = 1;
+
+        private readonly List<DeflateBlock> _blocks = new List<DeflateBlock>();
+
+        /// <summary>
+        ///   The blocks, in stream order.
+        /// </summary>
+        public IList<DeflateBlock> Blocks
+        {
+            get { return _blocks.AsReadOnly(); }
+        }
+
+        /// <summary>
+        ///   The total of the compressed lengths of the blocks.
+        /// </summary>
+        public Int64 CompressedLength { get; private set; }
+
+        /// <summary>
+        ///   The total of the uncompressed lengths of the blocks.
+        /// </summary>
+        public Int64 UncompressedLength { get; private set; }
+
+        /// <summary>
+        ///   The CRC32 of all of the uncompressed data.
+        /// </summary>
+        public int Crc32 { get; private set; }
+
+        internal void Add(int compressedLength, int uncompressedLength, int crc32)
+        {
+            _blocks.Add(new DeflateBlock
+                {
+                    CompressedLength = compressedLength,
+                    UncompressedLength = uncompressedLength,
+                    Crc32 = crc32
+                });
+            CompressedLength += compressedLength;
+            UncompressedLength += uncompressedLength;
+            Crc32 = Ionic.Crc.CRC32.Combine(Crc32, crc32, uncompressedLength);
+        }
+
+        /// <summary>
+        ///   Writes the index to a stream.
+        /// </summary>
+        /// <param name="stream">The stream to write the index to.</param>
+        public void Save(Stream stream)
+        {
+            var writer = new BinaryWriter(stream);
+            writer.Write(Signature);
+            writer.Write(FormatVersion);
+            writer.Write(_blocks.Count);
+            foreach (var block in _blocks)
+            {
+                writer.Write(block.CompressedLength);
+                writer.Write(block.UncompressedLength);
+                writer.Write(block.Crc32);
+            }
+            writer.Flush();
+        }
+
+        /// <summary>
+        ///   Reads an index written by <see cref="Save"/>.
+        /// </summary>
+        /// <param name="stream">The stream to read the index from.</param>
+        /// <returns>the index</returns>
+        public static DeflateBlockIndex Load(Stream stream)
+        {
+            var reader = new BinaryReader(stream);
+            if (reader.ReadInt32() != Signature)
+                throw new ZlibException("Not a deflate block index.");
+            if (reader.ReadInt32() != FormatVersion)
+                throw new ZlibException("Unsupported deflate block index version.");
+
+            var count = reader.ReadInt32();
+            if (count < 0)
+                throw new ZlibException("Bad deflate block index.");
+
+            var index = new DeflateBlockIndex();
+            for (int i = 0; i < count; i++)
+            {
+                int compressedLength = reader.ReadInt32();
+                int uncompressedLength = reader.ReadInt32();
+                int crc32 = reader.ReadInt32();
+                if (compressedLength < 0 || uncompressedLength < 0)
+                    throw new ZlibException("Bad deflate block index.");
+                index.Add(compressedLength, uncompressedLength, crc32);
+            }
+            return index;
+        }
+    }
+}
@@ -119,8 +119,8 @@ namespace Ionic.Zlib
         internal InflateBlocks(ZlibCodec codec, System.Object checkfn, int w)
         {
             _codec = codec;
-            hufts = new int[MANY * 3];
-            window = new byte[w];
+            hufts = ZlibBufferPool<int>.Rent(MANY * 3);
+            window = ZlibBufferPool<byte>.Rent(w);
             end = w;
             this.checkfn = checkfn;
             mode = InflateBlockMode.TYPE;
@@ -656,7 +656,9 @@ namespace Ionic.Zlib
         internal void Free()
         {
             Reset();
+            ZlibBufferPool<byte>.Return(window);
             window = null;
+            ZlibBufferPool<int>.Return(hufts);
             hufts = null;
         }
 
@@ -49,16 +49,29 @@ namespace Ionic.Zlib
                         CompressionStrategy strategy,
                         int ix)
         {
-            this.buffer= new byte[size];
+            this.buffer= ZlibBufferPool<byte>.Rent(size);
             // alloc 5 bytes overhead for every block (margin of safety= 2)
             int n = size + ((size / 32768)+1) * 5 * 2;
-            this.compressed = new byte[n];
+            this.compressed = ZlibBufferPool<byte>.Rent(n);
             this.compressor = new ZlibCodec();
             this.compressor.InitializeDeflate(compressLevel, false);
             this.compressor.OutputBuffer = this.compressed;
             this.compressor.InputBuffer = this.buffer;
             this.index = ix;
         }
+
+        /// <summary>
+        ///   Gives the buffers (and the compressor's) back to the pool. The
+        ///   work item can't be used after this.
+        /// </summary>
+        public void Release()
+        {
+            this.compressor.EndDeflate();
+            ZlibBufferPool<byte>.Return(this.buffer);
+            ZlibBufferPool<byte>.Return(this.compressed);
+            this.buffer = null;
+            this.compressed = null;
+        }
     }
 
     /// <summary>
@@ -122,6 +135,7 @@ namespace Ionic.Zlib
         private int                         _latestCompressed;
         private int                         _Crc32;
         private Ionic.Crc.CRC32             _runningCrc;
+        private DeflateBlockIndex           _blockIndex = new DeflateBlockIndex();
         private object                      _latestLock = new object();
         private System.Collections.Generic.Queue<int>     _toWrite;
         private System.Collections.Generic.Queue<int>     _toFill;
@@ -474,6 +488,24 @@ namespace Ionic.Zlib
         public Int64 BytesProcessed { get { return _totalBytesProcessed; } }
 
 
+        /// <summary>
+        /// Where the independently compressed blocks are in the output.
+        /// </summary>
+        /// <remarks>
+        /// <para>
+        ///   Each buffer is compressed from scratch and ends with a sync flush,
+        ///   so given this index, a <see cref="ParallelInflateInputStream"/> can
+        ///   decompress the blocks in parallel too. The index isn't written into
+        ///   the output; save it alongside (see <see cref="DeflateBlockIndex.Save"/>)
+        ///   if the data is going to be read back that way.
+        /// </para>
+        /// <para>
+        ///   This value is meaningful only after a call to Close().
+        /// </para>
+        /// </remarks>
+        public DeflateBlockIndex BlockIndex { get { return _blockIndex; } }
+
+
         private void _InitializePoolOfWorkItems()
         {
             _toWrite = new Queue<int>();
@@ -674,6 +706,11 @@ namespace Ionic.Zlib
 
                 _outStream.Write(buffer, 0, buffer.Length - compressor.AvailableBytesOut);
 
+                // the final (empty) block is indexed too, so the index covers
+                // every byte of the output, and a reader that follows it ends
+                // up at the end of the deflate stream.
+                _blockIndex.Add(buffer.Length - compressor.AvailableBytesOut, 0, 0);
+
                 TraceOutput(TraceBits.EmitDone,
                             "Emit     done     flush");
             }
@@ -782,7 +819,6 @@ namespace Ionic.Zlib
         {
             TraceOutput(TraceBits.Lifecycle, "Dispose  {0:X8}", this.GetHashCode());
             Close();
-            _pool = null;
             Dispose(true);
         }
 
@@ -794,6 +830,14 @@ namespace Ionic.Zlib
         /// </param>
         protected override void Dispose(bool disposing)
         {
+            // the work items are only idle once the stream has been closed;
+            // if it hasn't been, leave them to the GC.
+            if (disposing && _isClosed && _pool != null)
+            {
+                foreach (var workitem in _pool)
+                    workitem.Release();
+            }
+            _pool = null;
             base.Dispose(disposing);
         }
 
@@ -857,6 +901,7 @@ namespace Ionic.Zlib
             _firstWriteDone = false;
             _totalBytesProcessed = 0L;
             _runningCrc = new Ionic.Crc.CRC32();
+            _blockIndex = new DeflateBlockIndex();
             _isClosed= false;
             _currentlyFilling = -1;
             _lastFilled = -1;
@@ -880,7 +925,7 @@ namespace Ionic.Zlib
 
             if (emitting) return;
             emitting = true;
-            if (doAll || mustWait)
+            if (mustWait || (doAll && !_AllWritten()))
                 _newlyCompressedBlob.WaitOne();
 
             do
@@ -946,6 +991,7 @@ namespace Ionic.Zlib
 
                             _outStream.Write(workitem.compressed, 0, workitem.compressedBytesAvailable);
                             _runningCrc.Combine(workitem.crc, workitem.inputBytesAvailable);
+                            _blockIndex.Add(workitem.compressedBytesAvailable, workitem.inputBytesAvailable, workitem.crc);
                             _totalBytesProcessed += workitem.inputBytesAvailable;
                             workitem.inputBytesAvailable = 0;
 
@@ -968,12 +1014,27 @@ namespace Ionic.Zlib
 
                 } while (nextToWrite >= 0);
 
-            } while (doAll && (_lastWritten != _latestCompressed));
+                // nothing ready yet; wait for a compressor, rather than spin.
+                if (doAll && !_AllWritten())
+                    _newlyCompressedBlob.WaitOne(200);
+
+            } while (doAll && !_AllWritten());
 
             emitting = false;
         }
 
 
+        // Whether every buffer that's been filled has been written out (or a
+        // compressor has failed, in which case no more will be). This used to
+        // compare against the latest buffer compressed so far, which let Close
+        // return while the last full buffers were still being compressed, and
+        // drop them.
+        private bool _AllWritten()
+        {
+            return _lastWritten == _lastFilled || _pendingException != null;
+        }
+
+
 
 #if OLD
         private void _PerpetualWriterMethod(object state)
@@ -1155,16 +1216,14 @@ namespace Ionic.Zlib
             try
             {
                 int myItem = workitem.index;
-                Ionic.Crc.CRC32 crc = new Ionic.Crc.CRC32();
-
-                // calc CRC on the buffer
-                crc.SlurpBlock(workitem.buffer, 0, workitem.inputBytesAvailable);
+                // calc CRC on the buffer (the blocks are put together with CRC32.Combine as they're written)
+                int crc = Ionic.Crc.CRC32.Compute(workitem.buffer, 0, workitem.inputBytesAvailable);
 
                 // deflate it
                 DeflateOneSegment(workitem);
 
                 // update status
-                workitem.crc = crc.Crc32Result;
+                workitem.crc = crc;
                 TraceOutput(TraceBits.Compress,
                             "Compress          wi({0}) ord({1}) len({2})",
                             workitem.index,
@@ -1188,7 +1247,7 @@ namespace Ionic.Zlib
                 lock(_eLock)
                 {
                     // expose the exception to the main thread
-                    if (_pendingException!=null)
+                    if (_pendingException == null)
                         _pendingException = exc1;
                 }
             }
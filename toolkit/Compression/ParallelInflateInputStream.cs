@@ -0,0 +1,324 @@
+//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Threading.Tasks;
+
+namespace Ionic.Zlib
+{
+    /// <summary>
+    ///   A stream that decompresses the output of a
+    ///   <see cref="ParallelDeflateOutputStream"/>, inflating several blocks at
+    ///   once on multiple threads.
+    /// </summary>
+    ///
+    /// <remarks>
+    /// <para>
+    ///   This needs the <see cref="DeflateBlockIndex"/> that the compressor
+    ///   recorded. The compressed blocks are read from the captive stream in
+    ///   order, handed to the thread pool to inflate, and the results given
+    ///   back in order; at most <see cref="MaxBlocksInFlight"/> blocks are
+    ///   read ahead. Each block is checked against its CRC as it's inflated.
+    /// </para>
+    ///
+    /// <para>
+    ///   Without an index (ie, for a stream that didn't come from the parallel
+    ///   compressor) this just reads thru a plain <see cref="DeflateStream"/>.
+    /// </para>
+    /// </remarks>
+    public class ParallelInflateInputStream : System.IO.Stream
+    {
+        private readonly System.IO.Stream _stream;
+        private readonly DeflateBlockIndex _index;
+        private readonly bool _leaveOpen;
+        private readonly DeflateStream _serial;
+        private readonly Queue<Task<byte[]>> _inFlight = new Queue<Task<byte[]>>();
+        private int _nextBlockToRead;
+        private byte[] _current;
+        private int _currentOffset;
+        private Int64 _position;
+        private bool _isClosed;
+
+        [ThreadStatic]
+        private static ZlibCodec _decompressor;
+
+        /// <summary>
+        ///   Create a ParallelInflateInputStream.
+        /// </summary>
+        /// <param name="stream">The stream from which to read compressed data.</param>
+        /// <param name="index">The block index recorded by the compressor; may be null.</param>
+        public ParallelInflateInputStream(System.IO.Stream stream, DeflateBlockIndex index)
+            : this(stream, index, false)
+        {
+        }
+
+        /// <summary>
+        ///   Create a ParallelInflateInputStream, and specify whether to leave the
+        ///   captive stream open when it is closed.
+        /// </summary>
+        /// <param name="stream">The stream from which to read compressed data.</param>
+        /// <param name="index">The block index recorded by the compressor; may be null.</param>
+        /// <param name="leaveOpen">
+        ///    true if the application would like the stream to remain open after inflation.
+        /// </param>
+        public ParallelInflateInputStream(System.IO.Stream stream, DeflateBlockIndex index, bool leaveOpen)
+        {
+            _stream = stream;
+            _index = index;
+            _leaveOpen = leaveOpen;
+            MaxBlocksInFlight = 4 * Environment.ProcessorCount;
+
+            if (index == null)
+                _serial = new DeflateStream(stream, CompressionMode.Decompress, leaveOpen);
+        }
+
+        /// <summary>
+        ///   The most blocks to read ahead and inflate at once.
+        /// </summary>
+        /// <remarks>
+        ///   Each one holds its compressed and uncompressed data in memory until
+        ///   it is read. The default is four per CPU core.
+        /// </remarks>
+        public int MaxBlocksInFlight { get; set; }
+
+        /// <summary>
+        ///   Read data from the stream.
+        /// </summary>
+        /// <param name="buffer">The buffer into which the decompressed data should be placed.</param>
+        /// <param name="offset">the offset within that data array to put the first byte read.</param>
+        /// <param name="count">the number of bytes to read.</param>
+        /// <returns>the number of bytes actually read</returns>
+        public override int Read(byte[] buffer, int offset, int count)
+        {
+            if (_isClosed)
+                throw new ObjectDisposedException("ParallelInflateInputStream");
+
+            if (_serial != null)
+            {
+                int n = _serial.Read(buffer, offset, count);
+                _position += n;
+                return n;
+            }
+
+            int total = 0;
+            while (count > 0)
+            {
+                if (_current == null || _currentOffset == _current.Length)
+                {
+                    _current = NextBlock();
+                    _currentOffset = 0;
+                    if (_current == null)
+                        break;
+                    continue;
+                }
+
+                int n = Math.Min(count, _current.Length - _currentOffset);
+                Buffer.BlockCopy(_current, _currentOffset, buffer, offset, n);
+                _currentOffset += n;
+                offset += n;
+                count -= n;
+                total += n;
+            }
+
+            _position += total;
+            return total;
+        }
+
+        /// <summary>
+        ///   Gets the next block's worth of inflated data (null at the end),
+        ///   keeping the pipeline of blocks being inflated full.
+        /// </summary>
+        private byte[] NextBlock()
+        {
+            var blocks = _index.Blocks;
+            while (_inFlight.Count < Math.Max(1, MaxBlocksInFlight) && _nextBlockToRead < blocks.Count)
+            {
+                var block = blocks[_nextBlockToRead++];
+                var compressed = new byte[block.CompressedLength];
+                ReadFully(compressed);
+                _inFlight.Enqueue(Task.Factory.StartNew(() => InflateBlock(block, compressed)));
+            }
+
+            if (_inFlight.Count == 0)
+                return null;
+
+            var next = _inFlight.Dequeue();
+            try
+            {
+                return next.Result;
+            }
+            catch (AggregateException e)
+            {
+                throw e.InnerException;
+            }
+        }
+
+        private void ReadFully(byte[] buffer)
+        {
+            int offset = 0;
+            while (offset < buffer.Length)
+            {
+                int n = _stream.Read(buffer, offset, buffer.Length - offset);
+                if (n <= 0)
+                    throw new ZlibException("The compressed stream is shorter than its block index says.");
+                offset += n;
+            }
+        }
+
+        private static byte[] InflateBlock(DeflateBlock block, byte[] compressed)
+        {
+            var output = new byte[block.UncompressedLength];
+
+            // the blocks don't refer back to each other, so a codec can be reused for any of them.
+            var z = _decompressor;
+            if (z == null)
+            {
+                _decompressor = z = new ZlibCodec();
+                z.InitializeInflate(false);
+            }
+            else
+            {
+                z.ResetInflate();
+            }
+
+            z.InputBuffer = compressed;
+            z.NextIn = 0;
+            z.AvailableBytesIn = compressed.Length;
+            z.OutputBuffer = output;
+            z.NextOut = 0;
+            z.AvailableBytesOut = output.Length;
+
+            while (z.AvailableBytesIn > 0)
+            {
+                int rc = z.Inflate(FlushType.None);
+                if (rc == ZlibConstants.Z_BUF_ERROR)
+                    break;
+                if (rc != ZlibConstants.Z_OK && rc != ZlibConstants.Z_STREAM_END)
+                    throw new ZlibException(String.Format("inflating:  rc={0}  msg={1}", rc, z.Message));
+                if (rc == ZlibConstants.Z_STREAM_END)
+                    break;
+            }
+
+            if (z.AvailableBytesOut != 0 || z.AvailableBytesIn != 0)
+                throw new ZlibException("A compressed block doesn't match its block index.");
+
+            int crc = Ionic.Crc.CRC32.Compute(output, 0, output.Length);
+            if (crc != block.Crc32)
+                throw new ZlibException(String.Format("Bad CRC32 in block. (actual({0:X8})!=expected({1:X8}))", crc, block.Crc32));
+
+            return output;
+        }
+
+        /// <summary>
+        /// Close the stream.
+        /// </summary>
+        public override void Close()
+        {
+            if (_isClosed)
+                return;
+            _isClosed = true;
+
+            // (anything still being inflated just finishes and is dropped.)
+            _inFlight.Clear();
+            _current = null;
+
+            if (_serial != null)
+                _serial.Close();
+            else if (!_leaveOpen)
+                _stream.Close();
+        }
+
+        /// <summary>
+        /// Indicates whether the stream supports Seek operations.
+        /// </summary>
+        /// <remarks>
+        /// Always returns false.
+        /// </remarks>
+        public override bool CanSeek
+        {
+            get { return false; }
+        }
+
+        /// <summary>
+        /// Indicates whether the stream supports Read operations.
+        /// </summary>
+        public override bool CanRead
+        {
+            get { return !_isClosed && _stream.CanRead; }
+        }
+
+        /// <summary>
+        /// Indicates whether the stream supports Write operations.
+        /// </summary>
+        /// <remarks>
+        /// Always returns false.
+        /// </remarks>
+        public override bool CanWrite
+        {
+            get { return false; }
+        }
+
+        /// <summary>
+        /// The uncompressed length of the stream, if the block index is known.
+        /// </summary>
+        public override long Length
+        {
+            get
+            {
+                if (_index == null)
+                    throw new NotSupportedException();
+                return _index.UncompressedLength;
+            }
+        }
+
+        /// <summary>
+        /// The number of uncompressed bytes read so far. Setting this property
+        /// always throws a NotSupportedException.
+        /// </summary>
+        public override long Position
+        {
+            get { return _position; }
+            set { throw new NotSupportedException(); }
+        }
+
+        /// <summary>
+        /// Flush the stream; does nothing.
+        /// </summary>
+        public override void Flush()
+        {
+        }
+
+        /// <summary>
+        /// This method always throws a NotSupportedException.
+        /// </summary>
+        public override long Seek(long offset, System.IO.SeekOrigin origin)
+        {
+            throw new NotSupportedException();
+        }
+
+        /// <summary>
+        /// This method always throws a NotSupportedException.
+        /// </summary>
+        public override void SetLength(long value)
+        {
+            throw new NotSupportedException();
+        }
+
+        /// <summary>
+        /// This method always throws a NotSupportedException.
+        /// </summary>
+        public override void Write(byte[] buffer, int offset, int count)
+        {
+            throw new NotSupportedException();
+        }
+    }
+}
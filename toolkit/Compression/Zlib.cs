@@ -212,6 +212,15 @@ namespace Ionic.Zlib
         /// A synonym for BestCompression.
         /// </summary>
         Level9 = 9,
+
+        /// <summary>
+        /// Faster than BestSpeed, for data that has to be compressed quickly
+        /// more than it has to be compressed well (repackaging build output,
+        /// for instance). It looks for a match in only one place at each
+        /// position, and skips quickly over data that doesn't compress. The
+        /// output is still a standard deflate stream.
+        /// </summary>
+        Fastest = 10,
     }
 
     /// <summary>
@@ -117,7 +117,7 @@ namespace Ionic.Zlib
             get
             {
                 if (_workingBuffer == null)
-                    _workingBuffer = new byte[_bufferSize];
+                    _workingBuffer = ZlibBufferPool<byte>.Rent(_bufferSize);
                 return _workingBuffer;
             }
         }
@@ -285,7 +285,8 @@ namespace Ionic.Zlib
 
         private void end()
         {
-            if (z == null)
+            // (not z, which would create a codec just to end it.)
+            if (_z == null)
                 return;
             if (_wantCompress)
             {
@@ -309,6 +310,8 @@ namespace Ionic.Zlib
             finally
             {
                 end();
+                ZlibBufferPool<byte>.Return(_workingBuffer);
+                _workingBuffer = null;
                 if (!_leaveOpen) _stream.Close();
                 _stream = null;
             }
@@ -621,6 +624,135 @@ namespace Ionic.Zlib
             }
         }
 
+
+        // Compresses straight from one caller's buffer into another, with no
+        // stream and no intermediate copies. Returns the number of bytes
+        // written, or -1 if they didn't fit in the output.
+        internal static int CompressBuffer(byte[] input, int inputOffset, int inputCount,
+                                           byte[] output, int outputOffset, int outputCount,
+                                           CompressionLevel level, bool wantRfc1950Header)
+        {
+            CheckRange(input, inputOffset, inputCount, "input");
+            CheckRange(output, outputOffset, outputCount, "output");
+
+            var z = new ZlibCodec();
+            z.InitializeDeflate(level, wantRfc1950Header);
+            try
+            {
+                z.InputBuffer = input;
+                z.NextIn = inputOffset;
+                z.AvailableBytesIn = inputCount;
+                z.OutputBuffer = output;
+                z.NextOut = outputOffset;
+                z.AvailableBytesOut = outputCount;
+
+                while (true)
+                {
+                    // (Deflate throws if it's given no room at all.)
+                    if (z.AvailableBytesOut == 0)
+                        return FinishedIn(z, outputOffset, true);
+
+                    int rc = z.Deflate(FlushType.Finish);
+                    if (rc == ZlibConstants.Z_STREAM_END)
+                        return z.NextOut - outputOffset;
+                    if (rc != ZlibConstants.Z_OK)
+                        throw new ZlibException("deflating: " + z.Message);
+                }
+            }
+            finally
+            {
+                z.EndDeflate();
+            }
+        }
+
+
+        // Decompresses straight from one caller's buffer into another. Returns
+        // the number of bytes produced, or -1 if they didn't fit in the output.
+        internal static int UncompressBuffer(byte[] input, int inputOffset, int inputCount,
+                                             byte[] output, int outputOffset, int outputCount,
+                                             bool expectRfc1950Header)
+        {
+            CheckRange(input, inputOffset, inputCount, "input");
+            CheckRange(output, outputOffset, outputCount, "output");
+
+            var z = new ZlibCodec();
+            z.InitializeInflate(expectRfc1950Header);
+            try
+            {
+                z.InputBuffer = input;
+                z.NextIn = inputOffset;
+                z.AvailableBytesIn = inputCount;
+                z.OutputBuffer = output;
+                z.NextOut = outputOffset;
+                z.AvailableBytesOut = outputCount;
+
+                bool padded = false;
+                while (true)
+                {
+                    int nextIn = z.NextIn;
+                    int nextOut = z.NextOut;
+
+                    int rc = z.Inflate(FlushType.None);
+                    if (rc == ZlibConstants.Z_STREAM_END)
+                        return z.NextOut - outputOffset;
+                    if (rc != ZlibConstants.Z_OK && rc != ZlibConstants.Z_BUF_ERROR)
+                        throw new ZlibException(String.Format("inflating: rc={0} {1}", rc, z.Message));
+
+                    // stuck: either the output is full, or the input ran out
+                    // before the end of the compressed data.
+                    if (z.NextIn == nextIn && z.NextOut == nextOut)
+                    {
+                        // Like zlib 1.1, the inflater looks up codes a whole
+                        // table's width of bits at a time, so it can need a
+                        // dummy byte after raw deflate data to see its last
+                        // end-of-block code. (The streams don't notice: they
+                        // stop when the input does.)
+                        if (z.AvailableBytesIn == 0 && !padded)
+                        {
+                            padded = true;
+                            z.InputBuffer = new byte[1];
+                            z.NextIn = 0;
+                            z.AvailableBytesIn = 1;
+                            continue;
+                        }
+                        if (z.AvailableBytesOut == 0)
+                            return FinishedIn(z, outputOffset, false);
+                        throw new ZlibException("Bad state (the compressed data is truncated)");
+                    }
+                }
+            }
+            finally
+            {
+                z.EndInflate();
+            }
+        }
+
+
+        // The output is full, but it may have been exactly enough: the codec
+        // only says it's finished on a call after the one that filled it (the
+        // end of the data can take no bytes at all to write). Makes that call,
+        // with a byte of room to spare; if it's finished without using it, the
+        // output fit.
+        private static int FinishedIn(ZlibCodec z, int outputOffset, bool deflating)
+        {
+            int written = z.NextOut - outputOffset;
+            z.OutputBuffer = new byte[1];
+            z.NextOut = 0;
+            z.AvailableBytesOut = 1;
+
+            int rc = deflating ? z.Deflate(FlushType.Finish) : z.Inflate(FlushType.None);
+            return rc == ZlibConstants.Z_STREAM_END && z.NextOut == 0 ? written : -1;
+        }
+
+
+        private static void CheckRange(byte[] buffer, int offset, int count, string name)
+        {
+            if (buffer == null)
+                throw new ArgumentNullException(name);
+            if (offset < 0 || count < 0 || offset > buffer.Length - count)
+                throw new ArgumentOutOfRangeException(name + "Offset");
+        }
+
     }
 
 
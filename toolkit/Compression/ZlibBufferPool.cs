@@ -0,0 +1,78 @@
+//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+using System;
+using System.Collections.Concurrent;
+
+namespace Ionic.Zlib
+{
+    /// <summary>
+    ///   A pool of the working arrays of the codecs and streams (windows, hash
+    ///   chains, pending buffers, I/O buffers), shared by all of them.
+    /// </summary>
+    ///
+    /// <remarks>
+    /// <para>
+    ///   A deflate stream needs a quarter of a megabyte or so of arrays; without
+    ///   the pool, every short-lived stream (one per zip entry, say) leaves all
+    ///   of that for the GC. Arrays are pooled by exact length, since only a
+    ///   handful of different lengths are ever used, and at most
+    ///   <see cref="MaxArraysPerLength"/> of any one length are kept.
+    /// </para>
+    ///
+    /// <para>
+    ///   A rented array is always cleared, so it's exactly what a new one would
+    ///   be. That matters: deflate can compare window bytes beyond the ones it
+    ///   has filled, and the output must not depend on what was there before.
+    /// </para>
+    ///
+    /// <para>
+    ///   An array must not be used after it's returned (it will end up being
+    ///   shared with another stream); the codecs and streams return theirs when
+    ///   they are ended or closed, and drop their references at the same time.
+    /// </para>
+    /// </remarks>
+    internal static class ZlibBufferPool<T>
+    {
+        private static readonly int MaxArraysPerLength = 4 * Environment.ProcessorCount + 4;
+
+        private static readonly ConcurrentDictionary<int, ConcurrentStack<T[]>> _pools =
+            new ConcurrentDictionary<int, ConcurrentStack<T[]>>();
+
+        /// <summary>
+        ///   Gets a cleared array of exactly the given length.
+        /// </summary>
+        public static T[] Rent(int length)
+        {
+            ConcurrentStack<T[]> pool;
+            T[] array;
+            if (_pools.TryGetValue(length, out pool) && pool.TryPop(out array))
+            {
+                Array.Clear(array, 0, array.Length);
+                return array;
+            }
+            return new T[length];
+        }
+
+        /// <summary>
+        ///   Gives an array back to the pool. Does nothing with null.
+        /// </summary>
+        public static void Return(T[] array)
+        {
+            if (array == null)
+                return;
+
+            var pool = _pools.GetOrAdd(array.Length, length => new ConcurrentStack<T[]>());
+            // (the count is only approximate, with other threads at it; that's fine.)
+            if (pool.Count < MaxArraysPerLength)
+                pool.Push(array);
+        }
+    }
+}
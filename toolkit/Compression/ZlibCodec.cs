@@ -377,6 +377,21 @@ namespace Ionic.Zlib
             return ret;
         }
 
+        /// <summary>
+        /// Reset a codec for another inflation session.
+        /// </summary>
+        /// <remarks>
+        /// Call this to reuse a codec (and its window) for an unrelated stream, or for
+        /// a block that doesn't refer back to what came before it; it's cheaper than
+        /// calling InitializeInflate() again.
+        /// </remarks>
+        public void ResetInflate()
+        {
+            if (istate == null)
+                throw new ZlibException("No Inflate State!");
+            istate.Reset();
+        }
+
         /// <summary>
         /// I don't know what this does!
         /// </summary>
@@ -600,7 +615,9 @@ namespace Ionic.Zlib
             if (dstate == null)
                 throw new ZlibException("No Deflate State!");
             // TODO: dinoch Tue, 03 Nov 2009  15:39 (test this)
-            //int ret = dstate.End();
+            // (End is called to give back the working arrays; its result isn't
+            // returned, since ending part way thru a stream is fine here.)
+            dstate.End();
             dstate = null;
             return ZlibConstants.Z_OK; //ret;
         }
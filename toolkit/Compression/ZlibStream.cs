@@ -719,6 +719,68 @@ namespace Ionic.Zlib
             }
         }
 
+
+        /// <summary>
+        ///   Compress a range of a byte array into a range of another using ZLIB,
+        ///   without creating a stream or any intermediate buffers.
+        /// </summary>
+        ///
+        /// <remarks>
+        ///   Uncompress it with <see cref="ZlibStream.UncompressBuffer(byte[], int, int, byte[], int, int)"/>.
+        ///   The output is the same as <see cref="ZlibStream.CompressBuffer(byte[])"/> produces
+        ///   at the same level.
+        /// </remarks>
+        ///
+        /// <param name="input">The buffer holding the data to compress.</param>
+        /// <param name="inputOffset">Where the data starts in <paramref name="input"/>.</param>
+        /// <param name="inputCount">The number of bytes to compress.</param>
+        /// <param name="output">The buffer to write the compressed data into.</param>
+        /// <param name="outputOffset">Where to start writing in <paramref name="output"/>.</param>
+        /// <param name="outputCount">The room available in <paramref name="output"/>.</param>
+        /// <param name="level">The compression level to use.</param>
+        ///
+        /// <returns>
+        ///   The number of compressed bytes written, or -1 if they didn't fit in
+        ///   <paramref name="outputCount"/> bytes.
+        /// </returns>
+        public static int CompressBuffer(byte[] input, int inputOffset, int inputCount,
+                                         byte[] output, int outputOffset, int outputCount,
+                                         CompressionLevel level)
+        {
+            return ZlibBaseStream.CompressBuffer(input, inputOffset, inputCount,
+                                                 output, outputOffset, outputCount,
+                                                 level, true);
+        }
+
+
+        /// <summary>
+        ///   Uncompress a range of a ZLIB'd byte array into a range of another,
+        ///   without creating a stream or any intermediate buffers.
+        /// </summary>
+        ///
+        /// <param name="input">The buffer holding the compressed data.</param>
+        /// <param name="inputOffset">Where the compressed data starts in <paramref name="input"/>.</param>
+        /// <param name="inputCount">The number of compressed bytes.</param>
+        /// <param name="output">The buffer to write the uncompressed data into.</param>
+        /// <param name="outputOffset">Where to start writing in <paramref name="output"/>.</param>
+        /// <param name="outputCount">The room available in <paramref name="output"/>.</param>
+        ///
+        /// <returns>
+        ///   The number of uncompressed bytes written, or -1 if they didn't fit in
+        ///   <paramref name="outputCount"/> bytes.
+        /// </returns>
+        ///
+        /// <exception cref="ZlibException">
+        ///   The compressed data is corrupt or truncated.
+        /// </exception>
+        public static int UncompressBuffer(byte[] input, int inputOffset, int inputCount,
+                                           byte[] output, int outputOffset, int outputCount)
+        {
+            return ZlibBaseStream.UncompressBuffer(input, inputOffset, inputCount,
+                                                   output, outputOffset, outputCount,
+                                                   true);
+        }
+
     }
 
 
@@ -0,0 +1,336 @@
+//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Toolkit.Engine {
+    using System;
+    using System.Collections.Concurrent;
+    using System.Collections.Generic;
+    using System.IO;
+    using System.Linq;
+    using System.Threading.Tasks;
+    using Extensions;
+    using Logging;
+    using Model;
+    using Shell;
+    using Win32;
+
+    /// <summary>
+    /// A single filesystem change that package composition wants in place.
+    /// </summary>
+    /// <remarks></remarks>
+    internal class CompositionStep {
+        /// <summary>
+        /// One of FileCopy, FileRewrite, SymlinkFolder, SymlinkFile or Shortcut.
+        /// </summary>
+        internal CompositionAction Action;
+
+        /// <summary>
+        /// The file, link or shortcut that gets created.
+        /// </summary>
+        internal string Path;
+
+        /// <summary>
+        /// The file or folder that it comes from (or points to).
+        /// For rewrites, a temporary file holding the rewritten text; it's deleted when the plan is disposed.
+        /// </summary>
+        internal string Target;
+    }
+
+    /// <summary>
+    /// The set of files, links and shortcuts a package composition should produce.
+    ///
+    /// Rather than blindly re-creating everything, the plan compares each step against what's already on disk,
+    /// and only applies the steps that would change something. Steps are applied a phase at a time (copies and rewrites,
+    /// then folder links, then file links, then shortcuts), with the steps in each phase running in parallel.
+    /// Every change is journaled first, so if anything fails the whole composition is put back the way it was.
+    /// </summary>
+    /// <remarks></remarks>
+    internal class CompositionPlan : IDisposable {
+        private static readonly CompositionAction[][] Phases = new[] {
+            new[] {CompositionAction.FileCopy, CompositionAction.FileRewrite},
+            new[] {CompositionAction.SymlinkFolder},
+            new[] {CompositionAction.SymlinkFile},
+            new[] {CompositionAction.Shortcut},
+        };
+
+        private readonly List<CompositionStep> _steps = new List<CompositionStep>();
+
+        internal void Add(CompositionAction action, string path, string target) {
+            _steps.Add(new CompositionStep {Action = action, Path = path, Target = target});
+        }
+
+        /// <summary>
+        /// Gets the steps that would actually change something on disk.
+        /// </summary>
+        /// <param name="makeCurrent">if set, links and shortcuts that point somewhere else are retargeted; otherwise existing ones are left alone.</param>
+        /// <returns></returns>
+        /// <remarks>
+        /// When more than one step creates the same path, the last one wins (same as applying them in order).
+        /// </remarks>
+        internal IEnumerable<CompositionStep> GetChanges(bool makeCurrent) {
+            var steps = _steps.GroupBy(each => each.Path, StringComparer.CurrentCultureIgnoreCase).Select(each => each.Last()).ToArray();
+            return steps.AsParallel().AsOrdered().Where(each => IsChange(each, makeCurrent)).ToArray();
+        }
+
+        /// <summary>
+        /// Applies the changes.
+        /// </summary>
+        /// <param name="makeCurrent">if set, links and shortcuts that point somewhere else are retargeted.</param>
+        /// <returns>the number of steps that were applied</returns>
+        /// <remarks></remarks>
+        internal int Apply(bool makeCurrent) {
+            var changes = GetChanges(makeCurrent).ToArray();
+            Logger.Message("Package composition: {0} of {1} steps need changes", changes.Length, _steps.Count);
+            if (changes.Length == 0) {
+                return 0;
+            }
+
+            var journal = new CompositionJournal();
+            try {
+                foreach (var phase in Phases) {
+                    var actions = phase;
+                    var batch = changes.Where(each => actions.Contains(each.Action)).ToArray();
+                    if (batch.Length > 0) {
+                        Parallel.ForEach(batch, step => ApplyStep(step, journal));
+                    }
+                }
+            }
+            catch (AggregateException ae) {
+                journal.Rollback();
+                throw ae.Flatten().InnerExceptions.First();
+            }
+            catch {
+                journal.Rollback();
+                throw;
+            }
+
+            journal.Commit();
+            return changes.Length;
+        }
+
+        /// <summary>
+        /// Deletes the temporary files holding the rewritten text, whether or not the plan was applied.
+        /// </summary>
+        /// <remarks></remarks>
+        public void Dispose() {
+            foreach (var step in _steps.Where(each => each.Action == CompositionAction.FileRewrite)) {
+                step.Target.TryHardToDelete();
+            }
+        }
+
+        private static bool IsChange(CompositionStep step, bool makeCurrent) {
+            try {
+                switch (step.Action) {
+                    case CompositionAction.FileCopy:
+                        if (File.Exists(step.Path)) {
+                            var source = new FileInfo(step.Target);
+                            var destination = new FileInfo(step.Path);
+                            return source.Length != destination.Length || source.LastWriteTimeUtc != destination.LastWriteTimeUtc;
+                        }
+                        return true;
+
+                    case CompositionAction.FileRewrite:
+                        return !File.Exists(step.Path) || !HasSameContents(step.Path, step.Target);
+
+                    case CompositionAction.SymlinkFolder:
+                        if (Directory.Exists(step.Path)) {
+                            return makeCurrent && !IsLinkTo(step.Path, step.Target);
+                        }
+                        return true;
+
+                    case CompositionAction.SymlinkFile:
+                        if (File.Exists(step.Path)) {
+                            return makeCurrent && !IsLinkTo(step.Path, step.Target);
+                        }
+                        return true;
+
+                    case CompositionAction.Shortcut:
+                        if (File.Exists(step.Path)) {
+                            return makeCurrent && !ShellLink.PointsTo(step.Path, step.Target);
+                        }
+                        return true;
+                }
+            }
+            catch (Exception e) {
+                // if we can't tell, assume it needs doing.
+                Logger.Warning(e);
+            }
+            return true;
+        }
+
+        private static bool HasSameContents(string file, string otherFile) {
+            using (var stream = new FileStream(file, FileMode.Open, FileAccess.Read, FileShare.Read)) {
+                using (var otherStream = new FileStream(otherFile, FileMode.Open, FileAccess.Read, FileShare.Read)) {
+                    if (stream.Length != otherStream.Length) {
+                        return false;
+                    }
+
+                    var buffer = new byte[32768];
+                    var otherBuffer = new byte[32768];
+                    int count;
+                    while ((count = stream.Read(buffer, 0, buffer.Length)) > 0) {
+                        var otherCount = 0;
+                        while (otherCount < count) {
+                            var read = otherStream.Read(otherBuffer, otherCount, count - otherCount);
+                            if (read == 0) {
+                                return false;
+                            }
+                            otherCount += read;
+                        }
+                        for (var i = 0; i < count; i++) {
+                            if (buffer[i] != otherBuffer[i]) {
+                                return false;
+                            }
+                        }
+                    }
+                    return true;
+                }
+            }
+        }
+
+        private static bool IsLinkTo(string link, string target) {
+            return Symlink.IsSymlink(link) &&
+                Symlink.GetActualPath(link).GetFullPath().TrimEnd('\\').Equals(target.GetFullPath().TrimEnd('\\'), StringComparison.CurrentCultureIgnoreCase);
+        }
+
+        private static void ApplyStep(CompositionStep step, CompositionJournal journal) {
+            switch (step.Action) {
+                case CompositionAction.FileCopy:
+                    journal.RecordFile(step.Path);
+                    File.Copy(step.Target, step.Path, true);
+                    break;
+
+                case CompositionAction.FileRewrite:
+                    journal.RecordFile(step.Path);
+                    File.Copy(step.Target, step.Path, true);
+                    break;
+
+                case CompositionAction.SymlinkFolder:
+                    try {
+                        Logger.Message("Creating Directory Symlink [{0}] => [{1}]", step.Path, step.Target);
+                        journal.RecordLink(step.Path, true);
+                        Symlink.MakeDirectoryLink(step.Path, step.Target);
+                    }
+                    catch (Exception) {
+                        Logger.Error("Warning: Directory Symlink Link Failed. [{0}] => [{1}]", step.Path, step.Target);
+                    }
+                    break;
+
+                case CompositionAction.SymlinkFile:
+                    var folder = Path.GetDirectoryName(step.Path);
+                    if (!Directory.Exists(folder)) {
+                        Directory.CreateDirectory(folder);
+                    }
+
+                    try {
+                        Logger.Message("Creating file Symlink [{0}] => [{1}]", step.Path, step.Target);
+                        journal.RecordLink(step.Path, false);
+                        Symlink.MakeFileLink(step.Path, step.Target);
+                    }
+                    catch (Exception) {
+                        Logger.Error("Warning: File Symlink Link Failed. [{0}] => [{1}]", step.Path, step.Target);
+                    }
+                    break;
+
+                case CompositionAction.Shortcut:
+                    var shortcutFolder = Path.GetDirectoryName(step.Path);
+                    if (!Directory.Exists(shortcutFolder)) {
+                        Logger.Message("Creating Shortcut [{0}] => [{1}]", step.Path, step.Target);
+                        Directory.CreateDirectory(shortcutFolder);
+                    }
+
+                    journal.RecordFile(step.Path);
+                    ShellLink.CreateShortcut(step.Path, step.Target);
+                    break;
+            }
+        }
+    }
+
+    /// <summary>
+    /// Remembers how to undo each change a composition makes.
+    /// </summary>
+    /// <remarks>
+    /// Files that get overwritten are copied aside first (to temporary files that are cleaned up at reboot if we never get to them);
+    /// links only need to remember where they used to point.
+    /// </remarks>
+    internal class CompositionJournal {
+        private readonly ConcurrentStack<Action> _undo = new ConcurrentStack<Action>();
+        private readonly ConcurrentBag<string> _backups = new ConcurrentBag<string>();
+
+        /// <summary>
+        /// Records the current state of a file that's about to be created or overwritten.
+        /// </summary>
+        /// <param name="path">The path.</param>
+        internal void RecordFile(string path) {
+            if (!File.Exists(path)) {
+                _undo.Push(() => path.TryHardToDelete());
+                return;
+            }
+
+            var backup = path.GenerateTemporaryFilename();
+            File.Copy(path, backup, true);
+            _backups.Add(backup);
+            _undo.Push(() => File.Copy(backup, path, true));
+        }
+
+        /// <summary>
+        /// Records the current state of a symlink that's about to be created or retargeted.
+        /// </summary>
+        /// <param name="path">The link path.</param>
+        /// <param name="isFolder">if set, it's a folder link.</param>
+        internal void RecordLink(string path, bool isFolder) {
+            var exists = isFolder ? Directory.Exists(path) : File.Exists(path);
+            if (!exists) {
+                _undo.Push(() => Symlink.DeleteSymlink(path));
+                return;
+            }
+
+            if (!Symlink.IsSymlink(path)) {
+                // it's a real file or folder; making the link will fail without touching it.
+                return;
+            }
+
+            var previousTarget = Symlink.GetActualPath(path);
+            if (isFolder) {
+                _undo.Push(() => Symlink.MakeDirectoryLink(path, previousTarget));
+            }
+            else {
+                _undo.Push(() => Symlink.MakeFileLink(path, previousTarget));
+            }
+        }
+
+        /// <summary>
+        /// Undoes every recorded change, newest first.
+        /// </summary>
+        internal void Rollback() {
+            Action undo;
+            while (_undo.TryPop(out undo)) {
+                try {
+                    undo();
+                }
+                catch (Exception e) {
+                    Logger.Error(e);
+                }
+            }
+            Commit();
+        }
+
+        /// <summary>
+        /// Keeps the changes, and drops the backups.
+        /// </summary>
+        internal void Commit() {
+            _undo.Clear();
+            string backup;
+            while (_backups.TryTake(out backup)) {
+                backup.TryHardToDelete();
+            }
+        }
+    }
+}
@@ -155,6 +155,10 @@ namespace CoApp.Toolkit.Engine {
         /// </summary>
         internal const int BufferSize = 8192;
         /// <summary>
+        /// The number of connections we keep waiting to be accepted, so that a burst of clients doesn't queue up behind a single listener.
+        /// </summary>
+        private static readonly int ListenerPoolSize = Math.Max(4, Environment.ProcessorCount);
+        /// <summary>
         /// 
         /// </summary>
         private static readonly Lazy<EngineService> _instance = new Lazy<EngineService>(() => new EngineService());
@@ -222,6 +226,11 @@ namespace CoApp.Toolkit.Engine {
             // make sure coapp is properly set up.
             Task.Factory.StartNew(() => {
                 try {
+                    var logFile = PackageManagerSettings.CoAppSettings["#LogFile"].StringValue;
+                    if (!string.IsNullOrEmpty(logFile)) {
+                        Logger.AddSink(new RollingFileLogSink(logFile));
+                    }
+
                     Logger.Warning("CoApp Startup Beginning------------------------------------------");
 
                     // this ensures that composition rules are run for toolkit.
@@ -235,6 +244,7 @@ namespace CoApp.Toolkit.Engine {
 
                     Signals.EngineStartupStatus = 100;
                     Signals.Available = true;
+                    EngineStatistics.StartSnapshots();
                     Logger.Warning("CoApp Startup Finished------------------------------------------");
                 } catch (Exception e ) {
                     Logger.Error(e);
@@ -247,13 +257,13 @@ namespace CoApp.Toolkit.Engine {
                 _pipeSecurity.AddAccessRule(new PipeAccessRule(new SecurityIdentifier(WellKnownSidType.WorldSid,null ), PipeAccessRights.ReadWrite, AccessControlType.Allow));
                 _pipeSecurity.AddAccessRule(new PipeAccessRule(WindowsIdentity.GetCurrent().Owner, PipeAccessRights.FullControl, AccessControlType.Allow));
 
-                // start a few listeners by default--each listener will also spawn a new empty one.
-                StartListener();
-                StartListener();
+                // start a pool of listeners--each time one gets a connection, the pool gets topped back up.
+                FillListenerPool();
             }, _cancellationTokenSource.Token).AutoManage();
             
             _engineService = _engineService.ContinueWith(antecedent => {
                 RequestStop();
+                EngineStatistics.StopSnapshots();
                 // ensure the sessions are all getting closed.
                 Session.CancelAll();
                 _engineService = null;
@@ -263,13 +273,33 @@ namespace CoApp.Toolkit.Engine {
 
 
         private int listenerCount;
+        private int _waitingListeners;
+
+        /// <summary>
+        /// Starts listeners until there are <see cref="ListenerPoolSize"/> waiting for a connection.
+        /// </summary>
+        /// <remarks></remarks>
+        private void FillListenerPool() {
+            while (!_cancellationTokenSource.Token.IsCancellationRequested && IsRunning) {
+                if (Interlocked.Increment(ref _waitingListeners) > ListenerPoolSize) {
+                    Interlocked.Decrement(ref _waitingListeners);
+                    return;
+                }
+                if (!StartListener()) {
+                    Interlocked.Decrement(ref _waitingListeners);
+                    return;
+                }
+            }
+        }
+
         /// <summary>
         /// Starts the listener.
         /// </summary>
+        /// <returns>true if the listener is waiting for a connection.</returns>
         /// <remarks></remarks>
-        private void StartListener() {
+        private bool StartListener() {
             if (_cancellationTokenSource.Token.IsCancellationRequested) {
-                return;
+                return false;
             }
 
             try {
@@ -280,22 +310,23 @@ namespace CoApp.Toolkit.Engine {
                     var listenTask = Task.Factory.FromAsync(serverPipe.BeginWaitForConnection, serverPipe.EndWaitForConnection, serverPipe);
 
                     listenTask.ContinueWith(t => {
+                        Interlocked.Decrement(ref _waitingListeners);
+
                         if (t.IsCanceled || _cancellationTokenSource.Token.IsCancellationRequested) {
                             return;
                         }
 
-                        StartListener(); // spawn next one!
+                        FillListenerPool(); // replace this one!
 
                         if (serverPipe.IsConnected) {
                             var serverInput = new byte[BufferSize];
 
                             serverPipe.ReadAsync(serverInput, 0, serverInput.Length).AutoManage().ContinueWith(antecedent => {
-                                var rawMessage = Encoding.UTF8.GetString(serverInput, 0, antecedent.Result);
-                                if (string.IsNullOrEmpty(rawMessage)) {
+                                if (antecedent.Result <= 0) {
                                     return;
                                 }
 
-                                var requestMessage = new UrlEncodedMessage(rawMessage);
+                                var requestMessage = new UrlEncodedMessage(serverInput, 0, antecedent.Result);
 
                                 // first command must be "startsession"
                                 if (!requestMessage.Command.Equals("start-session", StringComparison.CurrentCultureIgnoreCase)) {
@@ -320,11 +351,14 @@ namespace CoApp.Toolkit.Engine {
                                 }
                                 var isAsync = (bool?) requestMessage["async"];
 
+                                // clients that understand framed batches of responses ask for them here.
+                                var binaryFraming = FramedMessages.BinaryFraming.Equals(requestMessage["framing"], StringComparison.CurrentCultureIgnoreCase);
+
                                 if (isAsync.HasValue && isAsync.Value == false) {
-                                    StartResponsePipeAndProcessMesages(requestMessage.Data["client"], requestMessage["id"], serverPipe);
+                                    StartResponsePipeAndProcessMesages(requestMessage.Data["client"], requestMessage["id"], serverPipe, binaryFraming);
                                 }
                                 else {
-                                    Session.Start(requestMessage.Data["client"], requestMessage["id"], serverPipe, serverPipe);
+                                    Session.Start(requestMessage.Data["client"], requestMessage["id"], serverPipe, serverPipe, binaryFraming);
                                 }
                             }).Wait();
                         }
@@ -332,11 +366,13 @@ namespace CoApp.Toolkit.Engine {
 
                     }, _cancellationTokenSource.Token, TaskContinuationOptions.AttachedToParent, TaskScheduler.Current);
 
+                    return true;
                 }
             }
             catch /* (Exception e) */ {
                 RequestStop();
             }
+            return false;
         }
 
         public static bool DoesTheServiceNeedARestart {
@@ -401,8 +437,9 @@ namespace CoApp.Toolkit.Engine {
         /// <param name="clientId">The client id.</param>
         /// <param name="sessionId">The session id.</param>
         /// <param name="serverPipe">The server pipe.</param>
+        /// <param name="binaryFraming">if set to <c>true</c> responses are sent as framed batches.</param>
         /// <remarks></remarks>
-        private void StartResponsePipeAndProcessMesages(string clientId, string sessionId, NamedPipeServerStream serverPipe) {
+        private void StartResponsePipeAndProcessMesages(string clientId, string sessionId, NamedPipeServerStream serverPipe, bool binaryFraming) {
             try {
                 var channelname = OutputPipeName + sessionId;
                 var responsePipe = new NamedPipeServerStream(channelname, PipeDirection.Out, Instances, PipeTransmissionMode.Message, PipeOptions.Asynchronous,
@@ -410,7 +447,7 @@ namespace CoApp.Toolkit.Engine {
                 Task.Factory.FromAsync(responsePipe.BeginWaitForConnection, responsePipe.EndWaitForConnection, responsePipe,
                     TaskCreationOptions.AttachedToParent).ContinueWith(t => {
                         if (responsePipe.IsConnected) {
-                            Session.Start(clientId, sessionId, serverPipe, responsePipe);
+                            Session.Start(clientId, sessionId, serverPipe, responsePipe, binaryFraming);
                         }
                     }, TaskContinuationOptions.AttachedToParent);
             }
@@ -419,4 +456,4 @@ namespace CoApp.Toolkit.Engine {
             }
         }
     }
-}
\ No newline at end of file
+}
\ No newline at end of file
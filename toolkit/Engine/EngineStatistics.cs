@@ -0,0 +1,288 @@
+//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Toolkit.Engine {
+    using System;
+    using System.Collections.Concurrent;
+    using System.Collections.Generic;
+    using System.Diagnostics;
+    using System.IO;
+    using System.Linq;
+    using System.Text;
+    using System.Threading;
+    using Logging;
+
+    /// <summary>
+    /// A lock-free latency histogram.
+    ///
+    /// Latencies are kept in microsecond buckets, eight per power of two, so percentiles are accurate to within about 12%.
+    /// </summary>
+    /// <remarks></remarks>
+    internal class LatencyHistogram {
+        private const int SubBucketBits = 3;
+        private const int SubBuckets = 1 << SubBucketBits;
+
+        private readonly long[] _buckets = new long[64 * SubBuckets];
+        private long _count;
+        private long _failures;
+        private long _totalTicks;
+        private long _maxTicks;
+
+        public readonly string Name;
+
+        public LatencyHistogram(string name) {
+            Name = name;
+        }
+
+        public long Count {
+            get { return Interlocked.Read(ref _count); }
+        }
+
+        public long Failures {
+            get { return Interlocked.Read(ref _failures); }
+        }
+
+        public TimeSpan Mean {
+            get {
+                var count = Count;
+                return count == 0 ? TimeSpan.Zero : FromStopwatchTicks(Interlocked.Read(ref _totalTicks) / count);
+            }
+        }
+
+        public TimeSpan Max {
+            get { return FromStopwatchTicks(Interlocked.Read(ref _maxTicks)); }
+        }
+
+        /// <summary>
+        /// Records a single operation.
+        /// </summary>
+        /// <param name="stopwatchTicks">The elapsed time, in <see cref="Stopwatch"/> ticks.</param>
+        /// <param name="failed">if set, the operation failed.</param>
+        /// <remarks></remarks>
+        public void Record(long stopwatchTicks, bool failed = false) {
+            if (stopwatchTicks < 0) {
+                stopwatchTicks = 0;
+            }
+
+            // (in floating point: multiplying the ticks by a million first overflows on operations of a few hours, with a
+            // high-resolution timer.)
+            Interlocked.Increment(ref _buckets[BucketIndex(stopwatchTicks * (1000000.0 / Stopwatch.Frequency))]);
+            Interlocked.Increment(ref _count);
+            Interlocked.Add(ref _totalTicks, stopwatchTicks);
+            if (failed) {
+                Interlocked.Increment(ref _failures);
+            }
+
+            var max = Interlocked.Read(ref _maxTicks);
+            while (stopwatchTicks > max) {
+                var previous = Interlocked.CompareExchange(ref _maxTicks, stopwatchTicks, max);
+                if (previous == max) {
+                    break;
+                }
+                max = previous;
+            }
+        }
+
+        public void Record(TimeSpan elapsed, bool failed = false) {
+            Record((long)(elapsed.TotalSeconds * Stopwatch.Frequency), failed);
+        }
+
+        /// <summary>
+        /// Gets the latency that the given fraction of operations finished within.
+        /// </summary>
+        /// <param name="fraction">The fraction (ie, 0.99 for the 99th percentile).</param>
+        /// <returns></returns>
+        /// <remarks>The counts are read without stopping writers, so the result is approximate while operations are being recorded.</remarks>
+        public TimeSpan GetPercentile(double fraction) {
+            var counts = new long[_buckets.Length];
+            long total = 0;
+            for (var i = 0; i < counts.Length; i++) {
+                counts[i] = Interlocked.Read(ref _buckets[i]);
+                total += counts[i];
+            }
+
+            if (total == 0) {
+                return TimeSpan.Zero;
+            }
+
+            var target = (long)Math.Ceiling(total * fraction);
+            long seen = 0;
+            for (var i = 0; i < counts.Length; i++) {
+                seen += counts[i];
+                if (seen >= target && counts[i] > 0) {
+                    return TimeSpan.FromTicks(BucketUpperBound(i) * 10);
+                }
+            }
+            return Max;
+        }
+
+        private int BucketIndex(double microseconds) {
+            if (microseconds < SubBuckets) {
+                return (int)microseconds;
+            }
+            if (microseconds >= long.MaxValue) {
+                return _buckets.Length - 1;
+            }
+
+            var value = (long)microseconds;
+            var exponent = 0;
+            for (var v = value; v > 1; v >>= 1) {
+                exponent++;
+            }
+
+            var subBucket = (int)(value >> (exponent - SubBucketBits)) & (SubBuckets - 1);
+            return Math.Min((exponent - SubBucketBits + 1) * SubBuckets + subBucket, _buckets.Length - 1);
+        }
+
+        private static long BucketUpperBound(int index) {
+            if (index < SubBuckets) {
+                return index + 1;
+            }
+
+            var shift = index / SubBuckets - 1;
+            var subBucket = index % SubBuckets;
+            return (long)(SubBuckets + subBucket + 1) << shift;
+        }
+
+        private static TimeSpan FromStopwatchTicks(long stopwatchTicks) {
+            return TimeSpan.FromTicks((long)(stopwatchTicks * (10000000.0 / Stopwatch.Frequency)));
+        }
+    }
+
+    /// <summary>
+    /// Times an operation from creation to Dispose, and records it in a histogram.
+    /// </summary>
+    /// <remarks>
+    ///   Use in a using block:
+    ///     using (EngineStatistics.Measure(EngineStatistics.FeedScan)) { ... }
+    /// </remarks>
+    internal struct MeasuredOperation : IDisposable {
+        private readonly LatencyHistogram _histogram;
+        private readonly long _started;
+
+        internal MeasuredOperation(LatencyHistogram histogram) {
+            _histogram = histogram;
+            _started = Stopwatch.GetTimestamp();
+        }
+
+        public void Dispose() {
+            if (_histogram != null) {
+                _histogram.Record(Stopwatch.GetTimestamp() - _started);
+            }
+        }
+    }
+
+    /// <summary>
+    /// Counters and latency histograms for each request command, and for the internal phases of the engine.
+    /// </summary>
+    /// <remarks></remarks>
+    internal static class EngineStatistics {
+        public static readonly LatencyHistogram FeedScan = new LatencyHistogram("feed-scan");
+        public static readonly LatencyHistogram Recognition = new LatencyHistogram("recognition");
+        public static readonly LatencyHistogram Resolution = new LatencyHistogram("resolution");
+        public static readonly LatencyHistogram Download = new LatencyHistogram("download");
+        public static readonly LatencyHistogram Composition = new LatencyHistogram("composition");
+
+        /// <summary>
+        /// The name every command the engine doesn't recognize is counted under, so clients can't grow the set of histograms.
+        /// </summary>
+        public const string UnknownCommand = "unknown-command";
+
+        private static readonly ConcurrentDictionary<string, LatencyHistogram> _commands = new ConcurrentDictionary<string, LatencyHistogram>();
+        private static readonly object _snapshotLock = new object();
+        private static Timer _snapshotTimer;
+
+        public static IEnumerable<LatencyHistogram> Phases {
+            get { return new[] {FeedScan, Recognition, Resolution, Download, Composition}; }
+        }
+
+        public static IEnumerable<LatencyHistogram> Commands {
+            get { return _commands.Values.OrderBy(each => each.Name).ToArray(); }
+        }
+
+        /// <summary>
+        /// Gets the histogram for a request command.
+        /// </summary>
+        /// <param name="command">The command.</param>
+        /// <param name="recognized">if set to <c>false</c> the command isn't one the engine handles, and is counted under <see cref="UnknownCommand"/>.</param>
+        /// <returns></returns>
+        /// <remarks></remarks>
+        public static LatencyHistogram Command(string command, bool recognized) {
+            return _commands.GetOrAdd(recognized && !string.IsNullOrEmpty(command) ? command : UnknownCommand, each => new LatencyHistogram(each));
+        }
+
+        public static MeasuredOperation Measure(LatencyHistogram histogram) {
+            return new MeasuredOperation(histogram);
+        }
+
+        /// <summary>
+        /// Starts writing a snapshot file periodically, if the '#StatisticsSnapshotInterval' setting (in seconds) is set.
+        /// </summary>
+        /// <remarks></remarks>
+        public static void StartSnapshots() {
+            var interval = PackageManagerSettings.CoAppSettings["#StatisticsSnapshotInterval"].IntValue;
+            if (interval <= 0) {
+                return;
+            }
+
+            var snapshotFile = Path.Combine(PackageManagerSettings.CoAppCacheDirectory, "engine-statistics.txt");
+            lock (_snapshotLock) {
+                StopSnapshots();
+                _snapshotTimer = new Timer(state => WriteSnapshot(snapshotFile), null, interval * 1000, interval * 1000);
+            }
+        }
+
+        public static void StopSnapshots() {
+            var timer = Interlocked.Exchange(ref _snapshotTimer, null);
+            if (timer != null) {
+                timer.Dispose();
+            }
+        }
+
+        /// <summary>
+        /// Writes all the statistics to a text file, one line per histogram.
+        /// </summary>
+        /// <param name="filename">The filename.</param>
+        /// <remarks></remarks>
+        public static void WriteSnapshot(string filename) {
+            try {
+                var text = new StringBuilder();
+                text.AppendFormat("# CoApp engine statistics {0:u}\r\n", DateTime.Now);
+                text.Append("# kind\tname\tcount\tfailures\tmean-ms\tp50-ms\tp90-ms\tp99-ms\tmax-ms\r\n");
+
+                foreach (var histogram in Phases) {
+                    AppendLine(text, "phase", histogram);
+                }
+                foreach (var histogram in Commands) {
+                    AppendLine(text, "command", histogram);
+                }
+
+                // write it beside the old one first, and swap it in, so a reader never sees half a file.
+                var tempFile = filename + ".tmp";
+                File.WriteAllText(tempFile, text.ToString());
+                if (File.Exists(filename)) {
+                    File.Replace(tempFile, filename, null);
+                }
+                else {
+                    File.Move(tempFile, filename);
+                }
+            }
+            catch (Exception e) {
+                Logger.Error(e);
+            }
+        }
+
+        private static void AppendLine(StringBuilder text, string kind, LatencyHistogram histogram) {
+            text.AppendFormat("{0}\t{1}\t{2}\t{3}\t{4:0.###}\t{5:0.###}\t{6:0.###}\t{7:0.###}\t{8:0.###}\r\n", kind, histogram.Name, histogram.Count,
+                histogram.Failures, histogram.Mean.TotalMilliseconds, histogram.GetPercentile(0.5).TotalMilliseconds,
+                histogram.GetPercentile(0.9).TotalMilliseconds, histogram.GetPercentile(0.99).TotalMilliseconds, histogram.Max.TotalMilliseconds);
+        }
+    }
+}
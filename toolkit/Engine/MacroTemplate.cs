@@ -0,0 +1,235 @@
+//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Toolkit.Engine {
+    using System;
+    using System.Collections.Concurrent;
+    using System.Collections.Generic;
+    using System.IO;
+    using System.Text;
+
+    /// <summary>
+    /// Text with ${macro} (or url-encoded $%7Bmacro%7D) references, parsed once into literal segments and macro slots.
+    ///
+    /// Evaluating a template just walks the segments; the text isn't re-scanned. A macro whose value has macros in
+    /// it is resolved recursively, and a macro that can't be resolved is left in the text as-is.
+    /// </summary>
+    /// <remarks>
+    /// Templates are cached by their text, so the rules of a package are only ever parsed once.
+    /// </remarks>
+    internal class MacroTemplate {
+        private const int MaxCachedTemplates = 4096;
+        private const int MaxDepth = 32;
+
+        /// <summary>
+        /// Macro names can't span lines, or go on forever.
+        /// </summary>
+        private const int MaxMacroLength = 1024;
+
+        private static readonly ConcurrentDictionary<string, MacroTemplate> _cache = new ConcurrentDictionary<string, MacroTemplate>();
+
+        private readonly Segment[] _segments;
+
+        private class Segment {
+            /// <summary>
+            /// The literal text; for a macro, the original reference (used when it can't be resolved).
+            /// </summary>
+            internal string Text;
+
+            /// <summary>
+            /// The macro name; null for literal text.
+            /// </summary>
+            internal string Macro;
+        }
+
+        private MacroTemplate(Segment[] segments) {
+            _segments = segments;
+        }
+
+        /// <summary>
+        /// Gets the (cached) template for some text.
+        /// </summary>
+        /// <param name="text">The text.</param>
+        /// <returns></returns>
+        /// <remarks></remarks>
+        internal static MacroTemplate Get(string text) {
+            MacroTemplate result;
+            if (_cache.TryGetValue(text ?? string.Empty, out result)) {
+                return result;
+            }
+
+            if (_cache.Count >= MaxCachedTemplates) {
+                _cache.Clear();
+            }
+
+            return _cache.GetOrAdd(text ?? string.Empty, Parse);
+        }
+
+        private static MacroTemplate Parse(string text) {
+            var segments = new List<Segment>();
+            var literal = new StringBuilder();
+
+            Scan(new StringReader(text), ch => literal.Append(ch), (macro, reference) => {
+                if (literal.Length > 0) {
+                    segments.Add(new Segment {Text = literal.ToString()});
+                    literal.Length = 0;
+                }
+                segments.Add(new Segment {Text = reference, Macro = macro});
+            });
+
+            if (literal.Length > 0) {
+                segments.Add(new Segment {Text = literal.ToString()});
+            }
+            return new MacroTemplate(segments.ToArray());
+        }
+
+        /// <summary>
+        /// Evaluates the template.
+        /// </summary>
+        /// <param name="getMacroValue">Returns the value of a macro; null if it isn't known.</param>
+        /// <returns></returns>
+        /// <remarks></remarks>
+        internal string Evaluate(Func<string, string> getMacroValue) {
+            if (_segments.Length == 1 && _segments[0].Macro == null) {
+                return _segments[0].Text;
+            }
+
+            var result = new StringBuilder();
+            Append(result, getMacroValue, 0);
+            return result.ToString();
+        }
+
+        private void Append(StringBuilder result, Func<string, string> getMacroValue, int depth) {
+            foreach (var segment in _segments) {
+                if (segment.Macro == null) {
+                    result.Append(segment.Text);
+                    continue;
+                }
+                AppendMacro(result, segment.Macro, segment.Text, getMacroValue, depth);
+            }
+        }
+
+        private static void AppendMacro(StringBuilder result, string macro, string reference, Func<string, string> getMacroValue, int depth) {
+            var value = depth < MaxDepth ? getMacroValue(macro) : null;
+            if (value == null) {
+                result.Append(reference);
+                return;
+            }
+            Get(value).Append(result, getMacroValue, depth + 1);
+        }
+
+        /// <summary>
+        /// Copies text from a reader to a writer, resolving macros as it goes.
+        ///
+        /// Nothing more than a single macro reference is ever held in memory, so it's fine for large files.
+        /// </summary>
+        /// <param name="input">The input.</param>
+        /// <param name="output">The output.</param>
+        /// <param name="getMacroValue">Returns the value of a macro; null if it isn't known.</param>
+        /// <remarks></remarks>
+        internal static void Evaluate(TextReader input, TextWriter output, Func<string, string> getMacroValue) {
+            var value = new StringBuilder();
+            Scan(input, output.Write, (macro, reference) => {
+                value.Length = 0;
+                AppendMacro(value, macro, reference, getMacroValue, 0);
+                output.Write(value.ToString());
+            });
+        }
+
+        /// <summary>
+        /// Splits text into literal characters and macro references.
+        /// </summary>
+        /// <param name="input">The input.</param>
+        /// <param name="literal">Called for each literal character.</param>
+        /// <param name="macro">Called for each macro reference, with the macro name and the original text of the reference.</param>
+        /// <remarks></remarks>
+        private static void Scan(TextReader input, Action<char> literal, Action<string, string> macro) {
+            var pending = new StringBuilder();
+            int next;
+
+            while ((next = input.Read()) != -1) {
+                if (next != '$') {
+                    literal((char)next);
+                    continue;
+                }
+
+                // could be the start of a reference; hang on to what we've seen until we know.
+                pending.Length = 0;
+                pending.Append('$');
+
+                string closer;
+                if (input.Peek() == '{') {
+                    pending.Append((char)input.Read());
+                    closer = "}";
+                }
+                else if (input.Peek() == '%' && Expect(input, pending, "%7B")) {
+                    closer = "%7D";
+                }
+                else {
+                    FlushPending(pending, literal);
+                    continue;
+                }
+
+                var nameStart = pending.Length;
+                var closed = false;
+                while (pending.Length - nameStart < MaxMacroLength) {
+                    var ch = input.Peek();
+                    if (ch == -1 || ch == '\r' || ch == '\n') {
+                        break;
+                    }
+
+                    pending.Append((char)input.Read());
+                    if (EndsWith(pending, closer) && pending.Length - closer.Length >= nameStart) {
+                        closed = true;
+                        break;
+                    }
+                }
+
+                if (!closed) {
+                    // not a reference after all.
+                    FlushPending(pending, literal);
+                    continue;
+                }
+
+                var reference = pending.ToString();
+                macro(reference.Substring(nameStart, reference.Length - nameStart - closer.Length), reference);
+            }
+        }
+
+        private static bool Expect(TextReader input, StringBuilder pending, string text) {
+            foreach (var ch in text) {
+                if (input.Peek() != ch) {
+                    return false;
+                }
+                pending.Append((char)input.Read());
+            }
+            return true;
+        }
+
+        private static bool EndsWith(StringBuilder text, string suffix) {
+            if (text.Length < suffix.Length) {
+                return false;
+            }
+            for (var i = 0; i < suffix.Length; i++) {
+                if (text[text.Length - suffix.Length + i] != suffix[i]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        private static void FlushPending(StringBuilder pending, Action<char> literal) {
+            for (var i = 0; i < pending.Length; i++) {
+                literal(pending[i]);
+            }
+            pending.Length = 0;
+        }
+    }
+}
@@ -16,6 +16,7 @@ namespace CoApp.Toolkit.Engine {
     using System.Diagnostics;
     using System.IO;
     using System.Linq;
+    using System.Text;
     using System.Text.RegularExpressions;
     using System.Threading;
     using System.Threading.Tasks;
@@ -130,6 +131,44 @@ namespace CoApp.Toolkit.Engine {
             }
         }
 
+        /// <summary>
+        /// Creates an opaque cursor for a position in the results of a find-packages query.
+        /// </summary>
+        /// <param name="query">The query.</param>
+        /// <param name="position">The position of the next package to send.</param>
+        /// <returns></returns>
+        private static string CreateCursor(string query, int position) {
+            return Convert.ToBase64String(Encoding.UTF8.GetBytes("{0}:{1:x8}".format(position, QueryHash(query))));
+        }
+
+        /// <summary>
+        /// Gets the position from a cursor created by <see cref="CreateCursor"/>.
+        /// </summary>
+        /// <param name="cursor">The cursor.</param>
+        /// <param name="query">The query.</param>
+        /// <returns>The position, or null if the cursor isn't valid for this query.</returns>
+        private static int? ParseCursor(string cursor, string query) {
+            try {
+                var parts = Encoding.UTF8.GetString(Convert.FromBase64String(cursor)).Split(':');
+                int position;
+                if (parts.Length == 2 && int.TryParse(parts[0], out position) && position >= 0 &&
+                    parts[1].Equals("{0:x8}".format(QueryHash(query)), StringComparison.OrdinalIgnoreCase)) {
+                    return position;
+                }
+            } catch (FormatException) {
+            }
+            return null;
+        }
+
+        private static uint QueryHash(string query) {
+            // FNV-1a; string.GetHashCode isn't guaranteed to be stable across engine restarts.
+            var hash = 2166136261;
+            foreach (var ch in query) {
+                hash = (hash ^ ch) * 16777619;
+            }
+            return hash;
+        }
+
         private void LogMessage(string message, params object[] objs) {
             string msg = message.format(objs);
             // do something with the message?
@@ -137,7 +176,7 @@ namespace CoApp.Toolkit.Engine {
 
         public Task FindPackages( string canonicalName, string name, string version, string arch, string publicKeyToken,
             bool? dependencies, bool? installed, bool? active, bool? required, bool? blocked, bool? latest, 
-            int? index, int? maxResults, string location, bool? forceScan, PackageManagerMessages messages ) {
+            int? index, int? maxResults, string location, bool? forceScan, PackageManagerMessages messages, string cursor ) {
 
             var t = Task.Factory.StartNew(() => {
                 if (messages != null) {
@@ -178,60 +217,92 @@ namespace CoApp.Toolkit.Engine {
                     }
                 }
 
-                var results = SearchForPackages(name, version, arch, publicKeyToken, location);
-                // filter results of list based on secondary filters
-
-                results = from package in results
-                    where
-                        (installed == null || package.IsInstalled == installed) && (active == null || package.IsActive == active) &&
-                            (required == null || package.IsRequired == required) && (blocked == null || package.IsBlocked == blocked)
+                // a cursor is only good for the query that handed it out.
+                var query = "{0}|{1}|{2}|{3}|{4}|{5}|{6}|{7}|{8}|{9}|{10}".format(name, version, arch, publicKeyToken, dependencies, installed, active,
+                    required, blocked, latest, location);
 
-                    select package;
+                if (!string.IsNullOrEmpty(cursor)) {
+                    var cursorPosition = ParseCursor(cursor, query);
+                    if (cursorPosition == null) {
+                        PackageManagerMessages.Invoke.Error("find-packages", "cursor",
+                            "Cursor '{0}' does not belong to this query".format(cursor));
+                        return;
+                    }
+                    index = cursorPosition;
+                }
 
+                // filter results of list based on secondary filters
+                Func<Package, bool> isMatch = package =>
+                    (installed == null || package.IsInstalled == installed) && (active == null || package.IsActive == active) &&
+                        (required == null || package.IsRequired == required) && (blocked == null || package.IsBlocked == blocked);
 
-                // only the latest?
-                if (latest == true) {
-                    results = results.HighestPackages();
-                }
+                IEnumerable<Package> results;
+                // where to look for supercedents: null for every feed.
+                ICollection<PackageFeed> supercedentFeeds = null;
 
-                // if the client has asked for the dependencies as well, include them in the result set.
-                // otherwise the client will get the names in 
-                if (dependencies == true) {
-                    // grab the dependencies too.
-                    var deps = results.SelectMany(each => each.InternalPackageData.Dependencies).Distinct();
+                if (latest == true || dependencies == true) {
+                    // these need the whole result set before we can send anything.
+                    results = SearchForPackages(name, version, arch, publicKeyToken, location).Where(isMatch);
 
+                    // only the latest?
                     if (latest == true) {
-                        deps = deps.HighestPackages();
+                        results = results.HighestPackages();
                     }
 
-                    results = results.Union(deps).Distinct();
-                }
+                    // if the client has asked for the dependencies as well, include them in the result set.
+                    // otherwise the client will get the names in 
+                    if (dependencies == true) {
+                        // grab the dependencies too.
+                        var deps = results.SelectMany(each => each.InternalPackageData.Dependencies).Distinct();
 
-                // paginate the results
-                if (index.HasValue) {
-                    results = results.Skip(index.Value);
-                }
+                        if (latest == true) {
+                            deps = deps.HighestPackages();
+                        }
 
-                if (maxResults.HasValue) {
-                    results = results.Take(maxResults.Value);
+                        results = results.Union(deps).Distinct();
+                    }
+                }
+                else {
+                    // otherwise, send each match along as soon as its feed turns it up; its supercedents come from the feeds
+                    // searched so far, rather than waiting on every feed (remote ones included) for each package sent.
+                    supercedentFeeds = new List<PackageFeed>();
+                    results = StreamPackages(name, version, arch, publicKeyToken, location, supercedentFeeds).Where(isMatch);
                 }
 
-                if (results.Any()) {
-                    foreach (var package in results) {
-                        if (CancellationRequested) {
-                            PackageManagerMessages.Invoke.OperationCancelled("find-packages");
-                            return;
-                        }
+                // paginate the results
+                var skip = index ?? 0;
+                var position = 0;
+                var sent = 0;
 
-                        // otherwise, we're installing a dependency, and we need something compatable.
-                        var supercedents = (from p in SearchForPackages(package.Name, null, package.Architecture.ToString(), package.PublicKeyToken)
-                            where p.InternalPackageData.PolicyMinimumVersion <= package.Version && p.InternalPackageData.PolicyMaximumVersion >= package.Version
-                            select p).OrderByDescending(p => p.Version).ToArray();
+                foreach (var package in results) {
+                    if (CancellationRequested) {
+                        PackageManagerMessages.Invoke.OperationCancelled("find-packages");
+                        return;
+                    }
+
+                    if (position++ < skip) {
+                        continue;
+                    }
 
-                        PackageManagerMessages.Invoke.PackageInformation(package, supercedents);
+                    if (maxResults.HasValue && sent >= maxResults.Value) {
+                        // there is at least one more; give the client a place to pick up from.
+                        PackageManagerMessages.Invoke.MorePackagesAvailable(CreateCursor(query, skip + sent));
+                        break;
                     }
+
+                    // otherwise, we're installing a dependency, and we need something compatable.
+                    var candidates = supercedentFeeds == null
+                        ? SearchForPackages(package.Name, null, package.Architecture.ToString(), package.PublicKeyToken)
+                        : supercedentFeeds.SelectMany(each => each.FindPackages(package.Name, null, package.Architecture.ToString(), package.PublicKeyToken)).Distinct();
+                    var supercedents = (from p in candidates
+                        where p.InternalPackageData.PolicyMinimumVersion <= package.Version && p.InternalPackageData.PolicyMaximumVersion >= package.Version
+                        select p).OrderByDescending(p => p.Version).ToArray();
+
+                    PackageManagerMessages.Invoke.PackageInformation(package, supercedents);
+                    sent++;
                 }
-                else {
+
+                if (sent == 0) {
                     PackageManagerMessages.Invoke.NoPackagesFound();
                 }
 
@@ -330,7 +401,9 @@ namespace CoApp.Toolkit.Engine {
 
                             IEnumerable<Package> installGraph = null;
                             try {
-                                installGraph = GenerateInstallGraph(package).ToArray();
+                                using (EngineStatistics.Measure(EngineStatistics.Resolution)) {
+                                    installGraph = GenerateInstallGraph(package).ToArray();
+                                }
                             }
                             catch (OperationCompletedBeforeResultException) {
                                 // we encountered an unresolvable condition in the install graph.
@@ -356,6 +429,16 @@ namespace CoApp.Toolkit.Engine {
                             }
 
                             // we've got an install graph.
+                            // packages that are still inside an archive feed only get extracted now that we know we're installing them.
+                            foreach (var p in installGraph.Where(each => !each.InternalPackageData.HasLocalLocation && each.InternalPackageData.HasArchiveLocation)) {
+                                try {
+                                    p.InternalPackageData.LocalLocation = p.InternalPackageData.ArchiveExtractor();
+                                }
+                                catch (Exception e) {
+                                    Logger.Error(e);
+                                }
+                            }
+
                             // let's see if we've got all the files
                             var missingFiles = from p in installGraph where !p.InternalPackageData.HasLocalLocation select p;
 
@@ -475,6 +558,7 @@ namespace CoApp.Toolkit.Engine {
                             //----------------------------------------------------------------------------
                             // wait until either the manualResetEvent is set, but check every second or so
                             // to see if the client has cancelled the operation.
+                            var waitingForDownloads = missingFiles.Any() ? Stopwatch.StartNew() : null;
                             while (!manualResetEvent.WaitOne(500)) {
                                 if (CancellationRequested) {
                                     PackageManagerMessages.Invoke.OperationCancelled("install-package");
@@ -484,6 +568,9 @@ namespace CoApp.Toolkit.Engine {
                                 // we can also use this opportunity to update progress on any outstanding download tasks.
                                 overallProgress += missingFiles.Sum(missingFile => ((missingFile.PackageSessionData.DownloadProgressDelta*eachTaskIsWorth)/100));
                             }
+                            if (waitingForDownloads != null) {
+                                EngineStatistics.Download.Record(waitingForDownloads.Elapsed);
+                            }
                         } while (true);
 
                     }
@@ -1170,6 +1257,74 @@ namespace CoApp.Toolkit.Engine {
             return feeds.SelectMany(each => each.FindPackages(name, version, arch, publicKeyToken)).Distinct().ToArray();
         }
 
+        /// <summary>
+        /// Gets packages from all visible feeds based on criteria, yielding each feed's matches as soon as that feed has answered.
+        /// 
+        /// The local feeds are searched first, without waiting for the system feeds to load. The remaining feeds are searched 
+        /// in parallel, but their matches are always yielded in feed order, so a position in the results stays put between calls.
+        /// 
+        /// The searches aren't attached to the calling task: when the caller stops early (eg, at max-results), the ones that
+        /// haven't started are cancelled, and the rest finish on their own without holding up the request.
+        /// </summary>
+        /// <param name="name"></param>
+        /// <param name="version"></param>
+        /// <param name="arch"></param>
+        /// <param name="publicKeyToken"></param>
+        /// <param name="location"></param>
+        /// <param name="searchedFeeds">If given, each feed is added to it once it's been searched (and before its matches are yielded).</param>
+        /// <returns></returns>
+        internal IEnumerable<Package> StreamPackages(string name, string version, string arch, string publicKeyToken, string location = null,
+            ICollection<PackageFeed> searchedFeeds = null) {
+            var seen = new HashSet<Package>();
+            var localFeeds = new PackageFeed[] {
+                SessionPackageFeed.Instance, InstalledPackageFeed.Instance
+            };
+
+            foreach (var feed in localFeeds.Where(each => string.IsNullOrEmpty(location) || each.IsLocationMatch(location))) {
+                var matches = feed.FindPackages(name, version, arch, publicKeyToken).ToArray();
+                if (searchedFeeds != null) {
+                    searchedFeeds.Add(feed);
+                }
+                foreach (var package in matches) {
+                    if (seen.Add(package)) {
+                        yield return package;
+                    }
+                }
+            }
+
+            var cancellation = new CancellationTokenSource();
+            var searches = (from feed in Feeds.Except(localFeeds)
+                where string.IsNullOrEmpty(location) || feed.IsLocationMatch(location)
+                select new {
+                    feed,
+                    search = SearchFeed(feed, name, version, arch, publicKeyToken, cancellation.Token)
+                }).ToArray();
+
+            try {
+                foreach (var each in searches) {
+                    var matches = each.search.Result;
+                    if (searchedFeeds != null) {
+                        searchedFeeds.Add(each.feed);
+                    }
+                    foreach (var package in matches) {
+                        if (seen.Add(package)) {
+                            yield return package;
+                        }
+                    }
+                }
+            }
+            finally {
+                cancellation.Cancel();
+            }
+        }
+
+        private static Task<Package[]> SearchFeed(PackageFeed feed, string name, string version, string arch, string publicKeyToken, CancellationToken cancellationToken) {
+            var search = Task<Package[]>.Factory.StartNew(() => feed.FindPackages(name, version, arch, publicKeyToken).ToArray(), cancellationToken).AutoManage();
+            // nobody waits on a search that's abandoned, so its failure is observed here.
+            search.ContinueWith(antecedent => antecedent.Exception, TaskContinuationOptions.OnlyOnFaulted);
+            return search;
+        }
+
         /// <summary>
         /// Gets just installed packages based on criteria
         /// </summary>
@@ -16,6 +16,7 @@ namespace CoApp.Toolkit.Engine {
     using System.Collections.ObjectModel;
     using System.IO;
     using System.Linq;
+    using System.Text;
     using Configuration;
     using Crypto;
     using Exceptions;
@@ -369,45 +370,61 @@ namespace CoApp.Toolkit.Engine {
                 return string.Empty;
             }
 
-            return text.FormatWithMacros((macro) => {
-                if(DefaultMacros.Value.ContainsKey(macro) ) {
-                    return DefaultMacros.Value[macro];
+            return MacroTemplate.Get(text).Evaluate(GetMacroValue);
+        }
+
+        /// <summary>
+        /// Copies a file, resolving the variables in it as it goes.
+        /// </summary>
+        /// <param name="sourceFile">The source file.</param>
+        /// <param name="destinationFile">The destination file.</param>
+        /// <remarks></remarks>
+        internal void ResolveVariablesInFile(string sourceFile, string destinationFile) {
+            using (var reader = new StreamReader(sourceFile, true)) {
+                using (var writer = new StreamWriter(destinationFile, false, new UTF8Encoding(false))) {
+                    MacroTemplate.Evaluate(reader, writer, GetMacroValue);
                 }
+            }
+        }
+
+        private string GetMacroValue(string macro) {
+            if(DefaultMacros.Value.ContainsKey(macro) ) {
+                return DefaultMacros.Value[macro];
+            }
 
-                switch( macro.ToLower() ) {
-                    case "packagedir":
-                    case "packagedirectory":
-                    case "packagefolder":
-                        return PackageDirectory;
+            switch( macro.ToLower() ) {
+                case "packagedir":
+                case "packagedirectory":
+                case "packagefolder":
+                    return PackageDirectory;
 
-                    case "targetdirectory":
-                        return TargetDirectory;
+                case "targetdirectory":
+                    return TargetDirectory;
 
-                    case "publishedpackagedir":
-                    case "publishedpackagedirectory":
-                    case "publishedpackagefolder":
-                        return @"${apps}\${productname}";
+                case "publishedpackagedir":
+                case "publishedpackagedirectory":
+                case "publishedpackagefolder":
+                    return @"${apps}\${productname}";
 
-                    case "productname":
-                    case "packagename":
-                        return Name;
+                case "productname":
+                case "packagename":
+                    return Name;
 
-                    case "version" :
-                        return Version.ToString();
+                case "version" :
+                    return Version.ToString();
 
-                    case "arch" :
-                    case "architecture":
-                        return Architecture.ToString();
+                case "arch" :
+                case "architecture":
+                    return Architecture.ToString();
 
-                    case "canonicalname":
-                        return CanonicalName;
+                case "canonicalname":
+                    return CanonicalName;
 
-                    case "cosmeticname" :
-                        return CosmeticName;
+                case "cosmeticname" :
+                    return CosmeticName;
 
-                }
-                return null;
-            });
+            }
+            return null;
         }
 
         internal void UpdateDependencyFlags() {
@@ -553,145 +570,141 @@ namespace CoApp.Toolkit.Engine {
         }
 
         public void DoPackageComposition(bool makeCurrent) {
+            using (EngineStatistics.Measure(EngineStatistics.Composition)) {
+                ComposePackage(makeCurrent);
+            }
+        }
+
+        private void ComposePackage(bool makeCurrent) {
             // GS01: if package composition fails, and we're in the middle of installing a package
             // we should roll back the package install.
             var rules = ImplicitRules.Union(InternalPackageData.CompositionRules).ToArray();
 
             var packagedir = ResolveVariables("${packagedir}\\");
             var appsdir = ResolveVariables("${apps}\\");
-            
-            foreach (var rule in rules.Where(r => r.Action == CompositionAction.FileCopy)) {
-                var destination = ResolveVariablesAndEnsurePathParentage(packagedir,  rule.Destination);
-                var source = ResolveVariablesAndEnsurePathParentage(packagedir, rule.Source);
-                
-                // file copy operations may only manipulate files in the package directory.
-                if( string.IsNullOrEmpty(source) ) {
-                    Logger.Error("ERROR: Illegal file copy rule. Source must be in package directory [{0}] => [{1}]", rule.Destination, destination);
-                    continue;
-                }
+            // the plan owns the rewritten files it renders; they are deleted however composition ends.
+            using (var plan = new CompositionPlan()) {
+                var copiedFiles = new Dictionary<string, string>(StringComparer.CurrentCultureIgnoreCase);
 
-                if (string.IsNullOrEmpty(destination)) {
-                    Logger.Error("ERROR: Illegal file copy rule. Destination must be in package directory [{0}] => [{1}]", source, rule.Source);
-                    continue;
-                }
-
-                if( !File.Exists(source) ) {
-                    Logger.Error("ERROR: Illegal file copy rule. Source file does not exist [{0}] => [{1}]", source, destination);
-                    continue;
-                }
+                foreach (var rule in rules.Where(r => r.Action == CompositionAction.FileCopy)) {
+                    var destination = ResolveVariablesAndEnsurePathParentage(packagedir,  rule.Destination);
+                    var source = ResolveVariablesAndEnsurePathParentage(packagedir, rule.Source);
+                
+                    // file copy operations may only manipulate files in the package directory.
+                    if( string.IsNullOrEmpty(source) ) {
+                        Logger.Error("ERROR: Illegal file copy rule. Source must be in package directory [{0}] => [{1}]", rule.Destination, destination);
+                        continue;
+                    }
 
-                File.Copy(source, destination);
-            }
+                    if (string.IsNullOrEmpty(destination)) {
+                        Logger.Error("ERROR: Illegal file copy rule. Destination must be in package directory [{0}] => [{1}]", source, rule.Source);
+                        continue;
+                    }
 
-            foreach (var rule in rules.Where(r => r.Action == CompositionAction.FileRewrite)) {
-                var destination = ResolveVariablesAndEnsurePathParentage(packagedir, rule.Destination);
-                var source = ResolveVariablesAndEnsurePathParentage(packagedir, rule.Source);
+                    if( !File.Exists(source) ) {
+                        Logger.Error("ERROR: Illegal file copy rule. Source file does not exist [{0}] => [{1}]", source, destination);
+                        continue;
+                    }
 
-                // file copy operations may only manipulate files in the package directory.
-                if (string.IsNullOrEmpty(source)) {
-                    Logger.Error("ERROR: Illegal file rewrite rule. Source must be in package directory [{0}] => [{1}]", rule.Destination, destination);
-                    continue;
+                    plan.Add(CompositionAction.FileCopy, destination, source);
+                    copiedFiles[destination] = source;
                 }
 
-                if (string.IsNullOrEmpty(destination)) {
-                    Logger.Error("ERROR: Illegal file rewrite rule. Destination must be in package directory [{0}] => [{1}]", source, rule.Source);
-                    continue;
-                }
+                foreach (var rule in rules.Where(r => r.Action == CompositionAction.FileRewrite)) {
+                    var destination = ResolveVariablesAndEnsurePathParentage(packagedir, rule.Destination);
+                    var source = ResolveVariablesAndEnsurePathParentage(packagedir, rule.Source);
 
-                if (!File.Exists(source)) {
-                    Logger.Error("ERROR: Illegal file rewrite rule. Source file does not exist [{0}] => [{1}]", source, destination);
-                    continue;
-                }
+                    // file copy operations may only manipulate files in the package directory.
+                    if (string.IsNullOrEmpty(source)) {
+                        Logger.Error("ERROR: Illegal file rewrite rule. Source must be in package directory [{0}] => [{1}]", rule.Destination, destination);
+                        continue;
+                    }
 
-                File.WriteAllText(destination, ResolveVariables(File.ReadAllText(source)));
-            }
+                    if (string.IsNullOrEmpty(destination)) {
+                        Logger.Error("ERROR: Illegal file rewrite rule. Destination must be in package directory [{0}] => [{1}]", source, rule.Source);
+                        continue;
+                    }
 
-            foreach (var rule in rules.Where(r => r.Action == CompositionAction.SymlinkFolder)) {
-                var link = ResolveVariablesAndEnsurePathParentage(appsdir, rule.Destination);
-                var dir = ResolveVariablesAndEnsurePathParentage(packagedir, rule.Source+"\\");
+                    // the copies haven't happened yet, so a rewrite of a copied file reads the original.
+                    string copiedFrom;
+                    if (copiedFiles.TryGetValue(source, out copiedFrom)) {
+                        source = copiedFrom;
+                    }
 
-                if( string.IsNullOrEmpty(link) ) {
-                    Logger.Error("ERROR: Illegal folder symlink rule. Destination location '{0}' must be a subpath of {1}", rule.Destination, appsdir);
-                    continue;
-                }
+                    if (!File.Exists(source)) {
+                        Logger.Error("ERROR: Illegal file rewrite rule. Source file does not exist [{0}] => [{1}]", source, destination);
+                        continue;
+                    }
 
-                if (string.IsNullOrEmpty(dir)) {
-                    Logger.Error("ERROR: Illegal folder symlink rule. Source folder '{0}' must be a subpath of {1}", rule.Source, packagedir);
-                    continue;
+                    // (added before it's rendered, so a render that fails part way is cleaned up too.)
+                    var rendered = destination.GenerateTemporaryFilename();
+                    plan.Add(CompositionAction.FileRewrite, destination, rendered);
+                    ResolveVariablesInFile(source, rendered);
                 }
 
-                if (!Directory.Exists(dir)) {
-                    Logger.Error("ERROR: Illegal folder symlink rule. Source folder '{0}' does not exist.", dir);
-                    continue;
-                }
+                foreach (var rule in rules.Where(r => r.Action == CompositionAction.SymlinkFolder)) {
+                    var link = ResolveVariablesAndEnsurePathParentage(appsdir, rule.Destination);
+                    var dir = ResolveVariablesAndEnsurePathParentage(packagedir, rule.Source+"\\");
 
-                if (makeCurrent || !Directory.Exists(link)) {
-                    try {
-                        Logger.Message("Creatign Directory Symlink [{0}] => [{1}]", link, dir);
-                        Symlink.MakeDirectoryLink(link, dir);
+                    if( string.IsNullOrEmpty(link) ) {
+                        Logger.Error("ERROR: Illegal folder symlink rule. Destination location '{0}' must be a subpath of {1}", rule.Destination, appsdir);
+                        continue;
                     }
-                    catch (Exception) {
-                        Logger.Error("Warning: Directory Symlink Link Failed. [{0}] => [{1}]", link, dir);
-                    }
-                }
-            }
 
-            foreach (var rule in rules.Where(r => r.Action == CompositionAction.SymlinkFile)) {
-                var link = ResolveVariablesAndEnsurePathParentage(appsdir, rule.Destination);
-                var file = ResolveVariablesAndEnsurePathParentage(packagedir, rule.Source);
+                    if (string.IsNullOrEmpty(dir)) {
+                        Logger.Error("ERROR: Illegal folder symlink rule. Source folder '{0}' must be a subpath of {1}", rule.Source, packagedir);
+                        continue;
+                    }
 
-                if (string.IsNullOrEmpty(link)) {
-                    Logger.Error("ERROR: Illegal file symlink rule. Destination location '{0}' must be a subpath of {1}", rule.Destination, appsdir);
-                    continue;
-                }
+                    if (!Directory.Exists(dir)) {
+                        Logger.Error("ERROR: Illegal folder symlink rule. Source folder '{0}' does not exist.", dir);
+                        continue;
+                    }
 
-                if (string.IsNullOrEmpty(file)) {
-                    Logger.Error("ERROR: Illegal file symlink rule. Source file '{0}' must be a subpath of {1}", rule.Source, packagedir);
-                    continue;
+                    plan.Add(CompositionAction.SymlinkFolder, link, dir);
                 }
 
-                if (!File.Exists(file)) {
-                    Logger.Error("ERROR: Illegal folder symlink rule. Source file '{0}' does not exist.", file);
-                    continue;
-                }
+                foreach (var rule in rules.Where(r => r.Action == CompositionAction.SymlinkFile)) {
+                    var link = ResolveVariablesAndEnsurePathParentage(appsdir, rule.Destination);
+                    var file = ResolveVariablesAndEnsurePathParentage(packagedir, rule.Source);
 
-                if (makeCurrent || !File.Exists(link)) {
-                    if (!Directory.Exists(Path.GetDirectoryName(link))) {
-                        Directory.CreateDirectory(Path.GetDirectoryName(link));
+                    if (string.IsNullOrEmpty(link)) {
+                        Logger.Error("ERROR: Illegal file symlink rule. Destination location '{0}' must be a subpath of {1}", rule.Destination, appsdir);
+                        continue;
                     }
 
-                    try {
-                        Logger.Message("Creating file Symlink [{0}] => [{1}]", link, file);
-                        Symlink.MakeFileLink(link, file);
-                    }
-                    catch (Exception) {
-                        Logger.Error("Warning: File Symlink Link Failed. [{0}] => [{1}]", link, file);
+                    if (string.IsNullOrEmpty(file)) {
+                        Logger.Error("ERROR: Illegal file symlink rule. Source file '{0}' must be a subpath of {1}", rule.Source, packagedir);
+                        continue;
                     }
-                }
-            }
 
-            foreach (var rule in rules.Where(r => r.Action == CompositionAction.Shortcut)) {
-                var shortcutPath = ResolveVariables(rule.Destination).GetFullPath();
-                var target = ResolveVariablesAndEnsurePathParentage(packagedir, rule.Source);
+                    if (!File.Exists(file)) {
+                        Logger.Error("ERROR: Illegal folder symlink rule. Source file '{0}' does not exist.", file);
+                        continue;
+                    }
 
-                if (string.IsNullOrEmpty(target)) {
-                    Logger.Error("ERROR: Illegal shortcut rule. Source file '{0}' must be a subpath of {1}", rule.Source, packagedir);
-                    continue;
+                    plan.Add(CompositionAction.SymlinkFile, link, file);
                 }
 
-                if (!File.Exists(target)) {
-                    Logger.Error("ERROR: Illegal shortcut rule. Source file '{0}' does not exist.", target);
-                    continue;
-                }
+                foreach (var rule in rules.Where(r => r.Action == CompositionAction.Shortcut)) {
+                    var shortcutPath = ResolveVariables(rule.Destination).GetFullPath();
+                    var target = ResolveVariablesAndEnsurePathParentage(packagedir, rule.Source);
+
+                    if (string.IsNullOrEmpty(target)) {
+                        Logger.Error("ERROR: Illegal shortcut rule. Source file '{0}' must be a subpath of {1}", rule.Source, packagedir);
+                        continue;
+                    }
 
-                if (makeCurrent || !File.Exists(shortcutPath)) {
-                    if (!Directory.Exists(Path.GetDirectoryName(shortcutPath))) {
-                        Logger.Message("Creating Shortcut [{0}] => [{1}]", shortcutPath, target);
-                        Directory.CreateDirectory(Path.GetDirectoryName(shortcutPath));
+                    if (!File.Exists(target)) {
+                        Logger.Error("ERROR: Illegal shortcut rule. Source file '{0}' does not exist.", target);
+                        continue;
                     }
 
-                    ShellLink.CreateShortcut(shortcutPath, target);
+                    plan.Add(CompositionAction.Shortcut, shortcutPath, target);
                 }
+
+                // only the files and links that aren't already right get touched; if any of it fails, it's all rolled back.
+                plan.Apply(makeCurrent);
             }
 
             foreach (var rule in rules.Where(r => r.Action == CompositionAction.EnvironmentVariable)) {
@@ -910,6 +923,15 @@ namespace CoApp.Toolkit.Engine {
             get { return !string.IsNullOrEmpty(RemoteLocation); }
         }
 
+        /// <summary>
+        /// For a package that is still packed inside an archive feed: extracts the package file, and returns where it was put.
+        /// </summary>
+        internal Func<string> ArchiveExtractor { get; set; }
+
+        public bool HasArchiveLocation {
+            get { return ArchiveExtractor != null; }
+        }
+
         public IEnumerable<string> LocalLocations { get { return _localLocations.ToArray(); } }
         public IEnumerable<string> RemoteLocations { get { return _remoteLocations.Select(each => each.AbsoluteUri).ToArray(); } }
         public IEnumerable<string> FeedLocations { get { return _feedLocations.ToArray(); } }
@@ -1113,7 +1135,7 @@ namespace CoApp.Toolkit.Engine {
 
         public bool IsPotentiallyInstallable {
             get {
-                return !PackageFailedInstall && (_package.InternalPackageData.HasLocalLocation || !CouldNotDownload && _package.InternalPackageData.HasRemoteLocation);
+                return !PackageFailedInstall && (_package.InternalPackageData.HasLocalLocation || _package.InternalPackageData.HasArchiveLocation || !CouldNotDownload && _package.InternalPackageData.HasRemoteLocation);
             }
         }
 
@@ -74,7 +74,33 @@ namespace CoApp.Toolkit.Engine {
         /// <returns></returns>
         /// <remarks></remarks>
         internal static IEnumerable<Package> Match(this IEnumerable<Package> packageSet, string wildcardMatch) {
-            return from p in packageSet where p.CosmeticName.IsWildcardMatch(wildcardMatch) select p;
+            return packageSet.WhereWildcardMatch(wildcardMatch, p => p.CosmeticName);
+        }
+
+        /// <summary>
+        /// finds packages that match the given wildcard-masks (an empty mask matches everything)
+        /// </summary>
+        /// <param name="packageSet">The package set to search thru.</param>
+        /// <param name="name">The name mask.</param>
+        /// <param name="version">The version mask.</param>
+        /// <param name="arch">The architecture mask.</param>
+        /// <param name="publicKeyToken">The public key token mask.</param>
+        /// <returns></returns>
+        /// <remarks></remarks>
+        internal static IEnumerable<Package> Match(this IEnumerable<Package> packageSet, string name, string version, string arch, string publicKeyToken) {
+            if (!string.IsNullOrEmpty(name)) {
+                packageSet = packageSet.WhereWildcardMatch(name, p => p.Name);
+            }
+            if (!string.IsNullOrEmpty(version)) {
+                packageSet = packageSet.WhereWildcardMatch(version, p => p.Version.ToString());
+            }
+            if (!string.IsNullOrEmpty(arch)) {
+                packageSet = packageSet.WhereWildcardMatch(arch, p => p.Architecture.ToString());
+            }
+            if (!string.IsNullOrEmpty(publicKeyToken)) {
+                packageSet = packageSet.WhereWildcardMatch(publicKeyToken, p => p.PublicKeyToken);
+            }
+            return packageSet;
         }
 
         /// <summary>
@@ -32,6 +32,14 @@ namespace CoApp.Toolkit.Engine {
         public Action<Package> PackageDetails;
         public Action NoPackagesFound;
         /// <summary>
+        /// cursor (pass it back to find-packages to get the next page of results)
+        /// </summary>
+        public Action<string> MorePackagesAvailable;
+        /// <summary>
+        /// kind (phase/command), name, count, failures, mean ms, p50 ms, p90 ms, p99 ms, max ms
+        /// </summary>
+        public Action<string, string, long, long, double, double, double, double, double> EngineStatistic;
+        /// <summary>
         /// location, lastScanned, isSession, isSuppressed, isValidated
         /// </summary>
         public Action<string, DateTime, bool, bool, bool> FeedDetails;
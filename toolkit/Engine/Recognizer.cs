@@ -10,6 +10,7 @@
 
 namespace CoApp.Toolkit.Engine {
     using System;
+    using System.Diagnostics;
     using System.IO;
     using System.Threading.Tasks;
     using Extensions;
@@ -43,6 +44,12 @@ namespace CoApp.Toolkit.Engine {
                 }
             }
 
+            using (EngineStatistics.Measure(EngineStatistics.Recognition)) {
+                return RecognizeItem(item, forceRescan);
+            }
+        }
+
+        private static Task<RecognitionInfo> RecognizeItem(string item, bool forceRescan) {
             try {
                 var location = new Uri(item);
                 if (!location.IsFile) {
@@ -51,8 +58,11 @@ namespace CoApp.Toolkit.Engine {
                     // we have to issue a request to the client to get it for us
 
                     // first let's create a delegate to run when the file gets resolved.
+                    var requested = Stopwatch.StartNew();
                     var completion = new Task<RecognitionInfo>((rrfState) => {
                         var state = rrfState as RequestRemoteFileState;
+                        EngineStatistics.Download.Record(requested.Elapsed, state == null || string.IsNullOrEmpty(state.LocalLocation));
+
                         if (state == null || string.IsNullOrEmpty(state.LocalLocation)) {
                             // didn't fill in the local location? -- this happens when the client can't download.
                             // PackageManagerMessages.Invoke.FileNotRecognized() ?
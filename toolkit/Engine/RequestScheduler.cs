@@ -0,0 +1,154 @@
+//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Toolkit.Engine {
+    using System;
+    using System.Collections.Generic;
+    using System.Threading.Tasks;
+
+    /// <summary>
+    /// Decides when requests from client sessions get to run.
+    ///
+    /// Each session gets its own queue of waiting requests; when a slot frees up, sessions take turns (round-robin), so a
+    /// single busy client can't keep everyone else waiting behind its backlog.
+    /// </summary>
+    /// <remarks>
+    /// Some requests are answers to questions an in-flight request asked the client (ie, 'recognize-file' after a
+    /// 'require-remote-file'). Those never wait in line, otherwise a full set of slots waiting on their answers would never drain.
+    /// </remarks>
+    internal class RequestScheduler {
+        internal static readonly RequestScheduler Instance = new RequestScheduler(Math.Max(8, Environment.ProcessorCount * 4));
+
+        private static readonly HashSet<string> _immediateCommands = new HashSet<string>(StringComparer.CurrentCultureIgnoreCase) {
+            "download-progress", "recognize-file", "unable-to-acquire", "stop-service", "set-logging"
+        };
+
+        private readonly object _sync = new object();
+        private readonly Queue<RequestQueue> _waitingQueues = new Queue<RequestQueue>();
+        private readonly int _maxRunningRequests;
+        private int _runningRequests;
+
+        /// <summary>
+        /// The requests waiting to run for a single session.
+        /// </summary>
+        internal class RequestQueue {
+            internal readonly Queue<TaskCompletionSource<bool>> Waiting = new Queue<TaskCompletionSource<bool>>();
+            internal bool IsInLine;
+            internal bool IsClosed;
+        }
+
+        internal RequestScheduler(int maxRunningRequests) {
+            _maxRunningRequests = maxRunningRequests;
+        }
+
+        /// <summary>
+        /// Determines whether the request is allowed to skip the line.
+        /// </summary>
+        /// <param name="command">The request command.</param>
+        /// <returns></returns>
+        internal static bool IsImmediate(string command) {
+            return _immediateCommands.Contains(command);
+        }
+
+        /// <summary>
+        /// Creates a queue for a session.
+        /// </summary>
+        /// <returns></returns>
+        internal RequestQueue CreateQueue() {
+            return new RequestQueue();
+        }
+
+        /// <summary>
+        /// Puts a request in line.
+        ///
+        /// The returned task completes when the request may run; the caller must call <see cref="Release"/> once the request has finished.
+        /// The task is cancelled if the queue is closed before the request's turn comes up.
+        /// </summary>
+        /// <param name="queue">The session's queue.</param>
+        /// <returns></returns>
+        internal Task Admit(RequestQueue queue) {
+            var admission = new TaskCompletionSource<bool>();
+            lock (_sync) {
+                if (queue.IsClosed) {
+                    admission.SetCanceled();
+                    return admission.Task;
+                }
+
+                queue.Waiting.Enqueue(admission);
+                if (!queue.IsInLine) {
+                    queue.IsInLine = true;
+                    _waitingQueues.Enqueue(queue);
+                }
+            }
+            Pump();
+            return admission.Task;
+        }
+
+        /// <summary>
+        /// Gives back the slot held by a request that was admitted.
+        /// </summary>
+        internal void Release() {
+            lock (_sync) {
+                _runningRequests--;
+            }
+            Pump();
+        }
+
+        /// <summary>
+        /// Closes a session's queue; any requests still waiting are cancelled.
+        /// </summary>
+        /// <param name="queue">The queue.</param>
+        internal void Close(RequestQueue queue) {
+            TaskCompletionSource<bool>[] abandoned;
+            lock (_sync) {
+                queue.IsClosed = true;
+                abandoned = queue.Waiting.ToArray();
+                queue.Waiting.Clear();
+            }
+            foreach (var admission in abandoned) {
+                admission.TrySetCanceled();
+            }
+        }
+
+        private void Pump() {
+            while (true) {
+                TaskCompletionSource<bool> next = null;
+                lock (_sync) {
+                    if (_runningRequests >= _maxRunningRequests) {
+                        return;
+                    }
+
+                    while (next == null && _waitingQueues.Count > 0) {
+                        var queue = _waitingQueues.Dequeue();
+                        if (queue.Waiting.Count > 0) {
+                            next = queue.Waiting.Dequeue();
+                        }
+
+                        // back of the line, if it still has more waiting.
+                        if (queue.Waiting.Count > 0) {
+                            _waitingQueues.Enqueue(queue);
+                        }
+                        else {
+                            queue.IsInLine = false;
+                        }
+                    }
+
+                    if (next == null) {
+                        return;
+                    }
+                    _runningRequests++;
+                }
+
+                // completing the admission runs the request's continuation; do that outside the lock.
+                next.SetResult(true);
+            }
+        }
+    }
+}
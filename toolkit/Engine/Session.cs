@@ -12,6 +12,7 @@ namespace CoApp.Toolkit.Engine {
     using System;
     using System.Collections.Generic;
     using System.Diagnostics;
+    using System.Globalization;
     using System.IO;
     using System.IO.Pipes;
     using System.Linq;
@@ -71,6 +72,11 @@ namespace CoApp.Toolkit.Engine {
         /// </summary>
         private NamedPipeServerStream _responsePipe;
 
+        /// <summary>
+        ///   batches responses into framed pipe writes, when the client asked for binary framing.
+        /// </summary>
+        private FramedMessageWriter _framedWriter;
+
         private bool _ended;
 
         private readonly ManualResetEvent _resetEvent = new ManualResetEvent(true);
@@ -85,6 +91,7 @@ namespace CoApp.Toolkit.Engine {
         private SessionCacheMessages _sessionCacheMessages;
 
         private readonly PackageManagerMessages _messages;
+        private readonly RequestScheduler.RequestQueue _requestQueue = RequestScheduler.Instance.CreateQueue();
 
         private bool Connected {
             get { return _resetEvent.WaitOne(0); }
@@ -131,9 +138,10 @@ namespace CoApp.Toolkit.Engine {
         /// <param name = "sessionId">The session id.</param>
         /// <param name = "serverPipe">The server pipe.</param>
         /// <param name = "responsePipe">The response pipe.</param>
+        /// <param name = "binaryFraming">if set to <c>true</c> responses are sent as framed batches.</param>
         /// <remarks>
         /// </remarks>
-        public static void Start(string clientId, string sessionId, NamedPipeServerStream serverPipe, NamedPipeServerStream responsePipe) {
+        public static void Start(string clientId, string sessionId, NamedPipeServerStream serverPipe, NamedPipeServerStream responsePipe, bool binaryFraming = false) {
             var isElevated = false;
             var userId = string.Empty;
 
@@ -157,6 +165,7 @@ namespace CoApp.Toolkit.Engine {
                     // found just one session.
                     session._serverPipe = serverPipe;
                     session._responsePipe = responsePipe;
+                    session.SetFraming(binaryFraming);
                     Logger.Message("Rejoining existing session...");
                     session.SendSessionStarted(sessionId);
                     session.SendQueuedMessages();
@@ -173,7 +182,7 @@ namespace CoApp.Toolkit.Engine {
             }
             // no viable matching session.
             // Let's start a new one.
-            Add(new Session(clientId, sessionId, serverPipe, responsePipe, userId, isElevated));
+            Add(new Session(clientId, sessionId, serverPipe, responsePipe, userId, isElevated, binaryFraming));
             Logger.Message("Starting new session...");
         }
 
@@ -186,10 +195,11 @@ namespace CoApp.Toolkit.Engine {
                     _activeSessions.Remove(this);
                 }
 
-                Logger.Message("Ending Client: [{0}]-[{1}]".format(_clientId, _sessionId));
+                Logger.Message("Ending Client: [{0}]-[{1}]", _clientId, _sessionId);
 
                 // end any outstanding tasks as gracefully as we can.
                 _cancellationTokenSource.Cancel();
+                RequestScheduler.Instance.Close(_requestQueue);
 
                 // drop all our local session data.
                 _sessionCache.Clear();
@@ -197,6 +207,7 @@ namespace CoApp.Toolkit.Engine {
 
                 // close and clean up the pipes. 
                 Disconnect();
+                SetFraming(false);
 
                 GC.Collect();
             }
@@ -210,7 +221,7 @@ namespace CoApp.Toolkit.Engine {
                 Connected = false;
             }
 
-            Logger.Message("disposing of pipes: [{0}]-[{1}]".format(_clientId, _sessionId));
+            Logger.Message("disposing of pipes: [{0}]-[{1}]", _clientId, _sessionId);
             try {
                 if (_serverPipe != null) {
                     _serverPipe.Close();
@@ -239,10 +250,11 @@ namespace CoApp.Toolkit.Engine {
         /// <param name = "sessionId">The session id.</param>
         /// <param name = "serverPipe">The server pipe.</param>
         /// <param name = "responsePipe">The response pipe.</param>
+        /// <param name = "binaryFraming">if set to <c>true</c> responses are sent as framed batches.</param>
         /// <remarks>
         /// </remarks>
         protected Session(string clientId, string sessionId, NamedPipeServerStream serverPipe, NamedPipeServerStream responsePipe, string userId,
-            bool isElevated) {
+            bool isElevated, bool binaryFraming) {
             _clientId = clientId;
             _sessionId = sessionId;
             _serverPipe = serverPipe;
@@ -250,6 +262,7 @@ namespace CoApp.Toolkit.Engine {
             _userId = userId;
             _isElevated = isElevated;
             _isAsychronous = serverPipe == responsePipe;
+            SetFraming(binaryFraming);
             Connected = true;
 
             // default handlers work for all messages now.
@@ -267,6 +280,7 @@ namespace CoApp.Toolkit.Engine {
                 InstallingPackageProgress = SendInstallingPackage,
                 NoFeedsFound = SendNoFeedsFound,
                 NoPackagesFound = SendNoPackagesFound,
+                MorePackagesAvailable = SendMorePackagesAvailable,
                 OperationCancelled = SendCancellationRequested,
                 PackageBlocked = SendPackageIsBlocked,
                 PackageDetails = SendPackageDetails,
@@ -285,7 +299,8 @@ namespace CoApp.Toolkit.Engine {
         
 
             // this session task
-            _task = Task.Factory.StartNew(ProcessMesages, _cancellationTokenSource.Token);
+            // (it spends its life blocked on the pipe; give it its own thread rather than tie up one from the pool.)
+            _task = Task.Factory.StartNew(ProcessMesages, _cancellationTokenSource.Token, TaskCreationOptions.LongRunning, TaskScheduler.Default);
 
             // this task is not attached to a parent anywhere.
             _task.AutoManage();
@@ -305,7 +320,10 @@ namespace CoApp.Toolkit.Engine {
                 return;
             }
 
-            Logger.Message("adding message to queue: {0}".format(response));
+            if (Logger.Messages) {
+                // (messages aren't safe to encode from another thread, so this can't be left to the log writer.)
+                Logger.Message("adding message to queue: {0}", response.ToString());
+            }
             Disconnect();
 
             lock (_outputQueue) {
@@ -313,6 +331,41 @@ namespace CoApp.Toolkit.Engine {
             }
         }
 
+        /// <summary>
+        ///   Switches the response pipe between framed batches and one write per message.
+        ///   Anything still waiting in a previous batch is moved to the output queue.
+        /// </summary>
+        /// <param name = "binaryFraming">if set to <c>true</c> responses are sent as framed batches.</param>
+        private void SetFraming(bool binaryFraming) {
+            var framedWriter = _framedWriter;
+            _framedWriter = binaryFraming && _responsePipe != null
+                ? new FramedMessageWriter(_responsePipe, messages => {
+                    foreach (var each in messages) {
+                        QueueResponseMessage(each);
+                    }
+                })
+                : null;
+
+            if (framedWriter != null) {
+                var unsent = framedWriter.Detach();
+                lock (_outputQueue) {
+                    foreach (var each in unsent) {
+                        _outputQueue.Enqueue(each);
+                    }
+                }
+            }
+        }
+
+        /// <summary>
+        ///   Pushes any batched responses into the pipe.
+        /// </summary>
+        private void FlushResponses() {
+            var framedWriter = _framedWriter;
+            if (framedWriter != null) {
+                framedWriter.Flush();
+            }
+        }
+
         private void SendQueuedMessages() {
             while (_outputQueue.Any() && _responsePipe != null) {
                
@@ -356,6 +409,12 @@ namespace CoApp.Toolkit.Engine {
                     catch {
                         // no worries if we can't get that.
                     }
+                    var framedWriter = _framedWriter;
+                    if (framedWriter != null) {
+                        framedWriter.Write(message);
+                        return;
+                    }
+
                     _responsePipe.WriteLineAsync(message.ToString()).ContinueWith(antecedent => QueueResponseMessage(message),
                         TaskContinuationOptions.OnlyOnFaulted);
                 }
@@ -463,47 +522,31 @@ namespace CoApp.Toolkit.Engine {
                                     return;
                                 }
 
-                                var rawMessage = Encoding.UTF8.GetString(serverInput, 0, antecedent.Result);
-
-                                if (string.IsNullOrEmpty(rawMessage)) {
+                                if (antecedent.Result <= 0) {
                                     return;
                                 }
-                                var requestMessage = new UrlEncodedMessage(rawMessage);
-                                var rqid = requestMessage["rqid"].ToString();
-
-                                // create a request cache.
-                                new RequestCacheMessages().Register();
-
-                                var dispatchTask = Dispatch(requestMessage);
-
-                                if (!string.IsNullOrEmpty(rqid)) {
-                                    if (dispatchTask == null) { // completed synchronously.
-                                        WriteAsync(new UrlEncodedMessage("task-complete") {{ "rqid", rqid } });
-                                    } else {
-                                        dispatchTask.ContinueWith(dispatchAntecedent => {
-                                            try {
-                                                // had to force this to ensure that async writes are at least in the pipe 
-                                                // before waiting on the pipe drain.
-                                                // without this, it is possible that the async writes are still 'getting to the pipe' 
-                                                // and not actually in the pipe, **even though the async write is complete**
-                                                Thread.Sleep(50);
-                                                if (_responsePipe != null) {
-                                                    _responsePipe.WaitForPipeDrain();
-                                                    WriteAsync(new UrlEncodedMessage("task-complete") {
-                                                        {
-                                                            "rqid", rqid
-                                                            }
-                                                    });
-                                                }
-                                            } catch (Exception e) {
-                                                Logger.Error(e);
-                                                // supress any exceptions.
+                                var requestMessage = new UrlEncodedMessage(serverInput, 0, antecedent.Result);
+
+                                if (RequestScheduler.IsImmediate(requestMessage.Command)) {
+                                    ProcessRequest(requestMessage);
+                                }
+                                else {
+                                    // wait our turn; the next read doesn't have to wait for this one.
+                                    RequestScheduler.Instance.Admit(_requestQueue).ContinueWith(admission => {
+                                        Task dispatchTask = null;
+                                        try {
+                                            dispatchTask = ProcessRequest(requestMessage);
+                                        }
+                                        finally {
+                                            if (dispatchTask == null) {
+                                                RequestScheduler.Instance.Release();
+                                            }
+                                            else {
+                                                dispatchTask.ContinueWith(dispatchAntecedent => RequestScheduler.Instance.Release());
                                             }
-                                        });
-                                    }
+                                        }
+                                    }, TaskContinuationOptions.AttachedToParent | TaskContinuationOptions.OnlyOnRanToCompletion);
                                 }
-
-                                WriteErrorsOnException(dispatchTask);
                                 // readTask = null;
                             }).AutoManage();
 
@@ -550,6 +593,60 @@ namespace CoApp.Toolkit.Engine {
             }
         }
 
+        /// <summary>
+        ///   Dispatches a request and sends the task-complete for it when it's done.
+        /// </summary>
+        /// <param name = "requestMessage">The request message.</param>
+        /// <returns>the dispatched task; null if the request completed synchronously.</returns>
+        /// <remarks>
+        /// </remarks>
+        private Task ProcessRequest(UrlEncodedMessage requestMessage) {
+            var rqid = requestMessage["rqid"].ToString();
+
+            // create a request cache.
+            new RequestCacheMessages().Register();
+
+            var started = Stopwatch.GetTimestamp();
+            bool recognized;
+            var dispatchTask = Dispatch(requestMessage, out recognized);
+            var histogram = EngineStatistics.Command(requestMessage.Command, recognized);
+
+            if (dispatchTask == null) {
+                histogram.Record(Stopwatch.GetTimestamp() - started);
+            }
+            else {
+                dispatchTask.ContinueWith(antecedent => histogram.Record(Stopwatch.GetTimestamp() - started, antecedent.IsFaulted),
+                    TaskContinuationOptions.ExecuteSynchronously);
+            }
+
+            if (!string.IsNullOrEmpty(rqid)) {
+                if (dispatchTask == null) { // completed synchronously.
+                    SendTaskComplete(rqid);
+                } else {
+                    dispatchTask.ContinueWith(dispatchAntecedent => {
+                        try {
+                            // had to force this to ensure that async writes are at least in the pipe 
+                            // before waiting on the pipe drain.
+                            // without this, it is possible that the async writes are still 'getting to the pipe' 
+                            // and not actually in the pipe, **even though the async write is complete**
+                            FlushResponses();
+                            Thread.Sleep(50);
+                            if (_responsePipe != null) {
+                                _responsePipe.WaitForPipeDrain();
+                                SendTaskComplete(rqid);
+                            }
+                        } catch (Exception e) {
+                            Logger.Error(e);
+                            // supress any exceptions.
+                        }
+                    });
+                }
+            }
+
+            WriteErrorsOnException(dispatchTask);
+            return dispatchTask;
+        }
+
         private void WriteErrorsOnException(Task task) {
             if (IsCancelled) {
                 return;
@@ -579,15 +676,21 @@ namespace CoApp.Toolkit.Engine {
         ///   Dispatches the specified request message.
         /// </summary>
         /// <param name = "requestMessage">The request message.</param>
+        /// <param name = "recognized">set to false if the command isn't one the engine handles.</param>
         /// <remarks>
         /// </remarks>
-        private Task Dispatch(UrlEncodedMessage requestMessage) {
-            Logger.Message("Request:{0}".format(requestMessage.ToSmallerString()));
+        private Task Dispatch(UrlEncodedMessage requestMessage, out bool recognized) {
+            // (a request turned away before the switch hasn't had its command checked.)
+            recognized = false;
+            if (Logger.Messages) {
+                Logger.Message("Request:{0}", requestMessage.ToSmallerString());
+            }
             if (IsCancelled) {
                 SendCancellationRequested("Service is shutting down");
                 return null;
             }
 
+            recognized = true;
             switch (requestMessage.Command) {
                 case "find-packages":
                     // get the package names collection and run the command
@@ -596,7 +699,7 @@ namespace CoApp.Toolkit.Engine {
                         requestMessage["active"], requestMessage["required"], requestMessage["blocked"], requestMessage["latest"], requestMessage["index"],
                         requestMessage["max-results"], requestMessage["location"], requestMessage["force-scan"], new PackageManagerMessages {
                             RequestId = requestMessage["rqid"],
-                        }.Extend(_messages));
+                        }.Extend(_messages), requestMessage["cursor"]);
 
                 case "get-package-details":
                     return NewPackageManager.Instance.GetPackageDetails(requestMessage["canonical-name"].ToString(), new PackageManagerMessages {
@@ -813,6 +916,7 @@ namespace CoApp.Toolkit.Engine {
 
                 case "set-logging" :
                     try {
+                        Logger.EnableSessionLogging();
                         var b = (bool?)requestMessage["messages"];
                         if (b.HasValue) {
                             SessionCache<string>.Value["LogMessages"] = b.ToString();
@@ -835,8 +939,18 @@ namespace CoApp.Toolkit.Engine {
                     }
                     return null; //"set-logging".AsResultTask();
 
+                case "get-engine-statistics":
+                    foreach (var histogram in EngineStatistics.Phases) {
+                        SendEngineStatistic("phase", histogram, requestMessage["rqid"]);
+                    }
+                    foreach (var histogram in EngineStatistics.Commands) {
+                        SendEngineStatistic("command", histogram, requestMessage["rqid"]);
+                    }
+                    return null;
+
                 default:
                     // not recognized command, return error code.
+                    recognized = false;
                     WriteAsync(new UrlEncodedMessage("unknown-command") {
                         {"command", requestMessage.Command},
                         {"rqid", requestMessage["rqid"].ToString() },
@@ -849,14 +963,44 @@ namespace CoApp.Toolkit.Engine {
 
         private void SendSessionStarted(string sessionId) {
             WriteAsync(new UrlEncodedMessage("session-started") {
-                {"session-id", sessionId}
+                {"session-id", sessionId},
+                {"framing", _framedWriter != null ? FramedMessages.BinaryFraming : null},
             });
         }
 
+        private void SendTaskComplete(string rqid) {
+            WriteAsync(new UrlEncodedMessage("task-complete") {
+                {"rqid", rqid}
+            });
+            // the client is waiting on this one; don't leave it sitting in a batch.
+            FlushResponses();
+        }
+
         private void SendNoPackagesFound() {
             WriteAsync(new UrlEncodedMessage("no-packages-found"));
         }
 
+        private void SendEngineStatistic(string kind, LatencyHistogram histogram, string rqid) {
+            WriteAsync(new UrlEncodedMessage("engine-statistic") {
+                {"kind", kind},
+                {"name", histogram.Name},
+                {"count", histogram.Count.ToString()},
+                {"failures", histogram.Failures.ToString()},
+                {"mean-ms", histogram.Mean.TotalMilliseconds.ToString(CultureInfo.InvariantCulture)},
+                {"p50-ms", histogram.GetPercentile(0.5).TotalMilliseconds.ToString(CultureInfo.InvariantCulture)},
+                {"p90-ms", histogram.GetPercentile(0.9).TotalMilliseconds.ToString(CultureInfo.InvariantCulture)},
+                {"p99-ms", histogram.GetPercentile(0.99).TotalMilliseconds.ToString(CultureInfo.InvariantCulture)},
+                {"max-ms", histogram.Max.TotalMilliseconds.ToString(CultureInfo.InvariantCulture)},
+                {"rqid", rqid},
+            });
+        }
+
+        private void SendMorePackagesAvailable(string cursor) {
+            WriteAsync(new UrlEncodedMessage("more-packages-available") {
+                {"cursor", cursor}
+            });
+        }
+
         private void SendFoundPackage(Package package, IEnumerable<Package> supercedentPackages) {
             var msg = new UrlEncodedMessage("found-package") {
                 {"canonical-name", package.CanonicalName},
@@ -1102,4 +1246,4 @@ namespace CoApp.Toolkit.Engine {
 
         #endregion
     }
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -91,6 +91,12 @@ namespace CoApp.Toolkit.Engine.Client {
         private NamedPipeClientStream _pipe;
         internal const int BufferSize = 1024*1024*2;
 
+        /// <summary>
+        /// When set (the default), new sessions ask the engine to batch responses into framed pipe writes.
+        /// The reader understands both formats, so this only matters before connecting.
+        /// </summary>
+        public bool UseBinaryFraming = true;
+
         public int ActiveCalls {
             get { return ManualEventQueue.EventQueues.Keys.Count; }
         }
@@ -182,24 +188,22 @@ namespace CoApp.Toolkit.Engine.Client {
                             return;
                         }
 
-                        var rawMessage = Encoding.UTF8.GetString(incomingMessage, 0, antecedent.Result);
-
-                        if (string.IsNullOrEmpty(rawMessage)) {
-                            return;
-                        }
+                        // a single read may carry a whole batch of framed responses.
+                        foreach (var responseMessage in FramedMessages.ReadMessages(incomingMessage, antecedent.Result)) {
+                            int? rqid = responseMessage["rqid"];
 
-                        var responseMessage = new UrlEncodedMessage(rawMessage);
-                        int? rqid = responseMessage["rqid"];
-
-                        Logger.Message("Response:{0}".format(responseMessage.ToSmallerString()));
+                            if (Logger.Messages) {
+                                Logger.Message("Response:{0}", responseMessage.ToSmallerString());
+                            }
 
-                        try {
-                            ManualEventQueue.GetQueue(rqid.GetValueOrDefault()).Enqueue(responseMessage);
-                        }
-                        catch {
-                            //  Console.WriteLine("Unable to queue the response to the right request event queue!");
-                            // Console.WriteLine("    Response:{0}", responseMessage.Command);
-                            // not able to queue up the response to the right task?
+                            try {
+                                ManualEventQueue.GetQueue(rqid.GetValueOrDefault()).Enqueue(responseMessage);
+                            }
+                            catch {
+                                //  Console.WriteLine("Unable to queue the response to the right request event queue!");
+                                // Console.WriteLine("    Response:{0}", responseMessage.Command);
+                                // not able to queue up the response to the right task?
+                            }
                         }
                     }).AutoManage();
                     readTask.Wait();
@@ -243,10 +247,26 @@ namespace CoApp.Toolkit.Engine.Client {
                     messages);
             }
 
+            // the same package can turn up for more than one parameter; only pass it along the first time.
+            var passedAlong = new HashSet<Package>();
+            var packageInformation = messages == null ? null : messages.PackageInformation;
+            var streamingMessages = new PackageManagerMessages {
+                PackageInformation = package => {
+                    lock (passedAlong) {
+                        if (!passedAlong.Add(package)) {
+                            return;
+                        }
+                    }
+                    if (packageInformation != null) {
+                        packageInformation(package);
+                    }
+                }
+            }.Extend(messages);
+
             // spawn the tasks off in parallel
             var tasks =
                 parameters.Select(
-                    each => GetPackages(each, minVersion, maxVersion, dependencies, installed, active, required, blocked, latest, location, forceScan, messages))
+                    each => GetPackages(each, minVersion, maxVersion, dependencies, installed, active, required, blocked, latest, location, forceScan, streamingMessages))
                     .ToArray();
 
             // return a task that is the sum of all the tasks.
@@ -266,12 +286,19 @@ namespace CoApp.Toolkit.Engine.Client {
             bool? forceScan = null, PackageManagerMessages messages = null) {
             Connect().Wait();
             var packages = new List<Package>();
+            var packageInformation = messages == null ? null : messages.PackageInformation;
 
             if (parameter.IsNullOrEmpty()) {
                 return FindPackages( /* canonicalName:*/
                     null, /* name */null, /* version */null, /* arch */ null, /* pkt */null, dependencies, installed, active, required, blocked, latest,
                     /* index */null, /* max-results */null, location, forceScan, new PackageManagerMessages {
-                        PackageInformation = package => packages.Add(package),
+                        PackageInformation = package => {
+                            packages.Add(package);
+                            // results stream in as the engine finds them; let the caller see them now.
+                            if (packageInformation != null) {
+                                packageInformation(package);
+                            }
+                        },
                     }.Extend(messages)).ContinueWith(antecedent => {
                         if( antecedent.IsFaulted || antecedent.IsCanceled ) {
                             throw antecedent.Exception.Flatten().InnerExceptions.FirstOrDefault();
@@ -346,6 +373,7 @@ namespace CoApp.Toolkit.Engine.Client {
             Connect().Wait();
 
             var packages = new List<Package>();
+            var packageInformation = messages == null ? null : messages.PackageInformation;
 
             return FindPackages(packageName != null && packageName.IsFullMatch ? packageName.CanonicalName : null, packageName == null ? null : packageName.Name,
                 packageName == null ? null : packageName.Version, packageName == null ? null : packageName.Arch,
@@ -355,6 +383,9 @@ namespace CoApp.Toolkit.Engine.Client {
                         if ((!minVersion.HasValue || package.Version >= minVersion) &&
                             (!maxVersion.HasValue || package.Version <= maxVersion)) {
                             packages.Add(package);
+                            if (packageInformation != null) {
+                                packageInformation(package);
+                            }
                         }
                     },
                 }.Extend(messages)).ContinueWith(antecedent => { 
@@ -367,7 +398,7 @@ namespace CoApp.Toolkit.Engine.Client {
 
         public Task FindPackages(string canonicalName = null, string name = null, string version = null, string arch = null, string publicKeyToken = null,
             bool? dependencies = null, bool? installed = null, bool? active = null, bool? required = null, bool? blocked = null, bool? latest = null,
-            int? index = null, int? maxResults = null, string location = null, bool? forceScan = null, PackageManagerMessages messages = null) {
+            int? index = null, int? maxResults = null, string location = null, bool? forceScan = null, PackageManagerMessages messages = null, string cursor = null) {
 
             return Connect().ContinueWith((antecedent) => {
                 if (messages != null) {
@@ -388,6 +419,7 @@ namespace CoApp.Toolkit.Engine.Client {
                         {"latest", latest},
                         {"index", index},
                         {"max-results", maxResults},
+                        {"cursor", cursor},
                         {"location", location},
                         {"force-scan", forceScan},
                         {"rqid", Task.CurrentId},
@@ -432,7 +464,7 @@ namespace CoApp.Toolkit.Engine.Client {
                                     PackageManagerSettings.CoAppSettings["#AnonymousId"].StringValue = uniqId;
                                 }
                                 
-                                Logger.Message("Pinging `http://coapp.org/telemetry/?anonid={0}&pkg={1}` ".format(uniqId, pkgCanonicalName));
+                                Logger.Message("Pinging `http://coapp.org/telemetry/?anonid={0}&pkg={1}` ", uniqId, pkgCanonicalName);
                                 var req =
                                     HttpWebRequest.Create("http://coapp.org/telemetry/?anonid={0}&pkg={1}".format(uniqId, pkgCanonicalName));
                                 req.BetterGetResponse().Close();
@@ -660,6 +692,23 @@ namespace CoApp.Toolkit.Engine.Client {
             }, TaskContinuationOptions.OnlyOnRanToCompletion).AutoManage();
         }
 
+        public Task GetEngineStatistics(PackageManagerMessages messages = null) {
+            return Connect().ContinueWith((antecedent) => {
+                if (messages != null) {
+                    messages.Register();
+                }
+
+                using (var eventQueue = new ManualEventQueue()) {
+                    WriteAsync(new UrlEncodedMessage("get-engine-statistics") {
+                        {"rqid", Task.CurrentId},
+                    });
+
+                    // will return when the final message comes thru.
+                    eventQueue.DispatchResponses();
+                }
+            }, TaskContinuationOptions.OnlyOnRanToCompletion).AutoManage();
+        }
+
         public Task GetPolicy(string policyName, PackageManagerMessages messages = null) {
             return Connect().ContinueWith((antecedent) => {
                 if (messages != null) {
@@ -761,6 +810,12 @@ namespace CoApp.Toolkit.Engine.Client {
                     PackageManagerMessages.Invoke.FileNotFound(responseMessage["filename"]);
                     break;
 
+                case "engine-statistic":
+                    PackageManagerMessages.Invoke.EngineStatistic(responseMessage["kind"], responseMessage["name"], (long?) responseMessage["count"] ?? 0,
+                        (long?) responseMessage["failures"] ?? 0, (double?) responseMessage["mean-ms"] ?? 0, (double?) responseMessage["p50-ms"] ?? 0,
+                        (double?) responseMessage["p90-ms"] ?? 0, (double?) responseMessage["p99-ms"] ?? 0, (double?) responseMessage["max-ms"] ?? 0);
+                    break;
+
                 case "found-feed":
                     PackageManagerMessages.Invoke.FeedDetails(responseMessage["location"], DateTime.FromFileTime((long?) responseMessage["last-scanned"] ?? 0),
                         (bool?) responseMessage["session"] ?? false, (bool?) responseMessage["suppressed"] ?? false,
@@ -814,6 +869,10 @@ namespace CoApp.Toolkit.Engine.Client {
                     PackageManagerMessages.Invoke.NoPackagesFound();
                     break;
 
+                case "more-packages-available":
+                    PackageManagerMessages.Invoke.MorePackagesAvailable(responseMessage["cursor"]);
+                    break;
+
                 case "operation-cancelled":
                     PackageManagerMessages.Invoke.OperationCancelled(responseMessage["message"]);
                     return false;
@@ -941,7 +1000,8 @@ namespace CoApp.Toolkit.Engine.Client {
                 {"client", clientId},
                 {"id", sessionId},
                 {"rqid", sessionId},
+                {"framing", UseBinaryFraming ? FramedMessages.BinaryFraming : null},
             });
         }
     }
-}
\ No newline at end of file
+}
\ No newline at end of file
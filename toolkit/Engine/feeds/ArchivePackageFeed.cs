@@ -4,19 +4,199 @@
 // </copyright>
 // <license>
 //     The software is licensed under the Apache 2.0 License (the "License")
-//     You may not use the software except in compliance with the License. 
+//     You may not use the software except in compliance with the License.
 // </license>
 //-----------------------------------------------------------------------
 
-
-
 namespace CoApp.Toolkit.Engine.Feeds {
     using System;
+    using System.Collections.Generic;
+    using System.IO;
+    using System.Linq;
+    using Extensions;
+    using Logging;
+    using Model.Atom;
+    using PackageFormatHandlers;
 
+    /// <summary>
+    /// A package feed represented by a zip archive of packages (ie, an offline repository).
+    ///
+    /// Only the archive's central directory is read when the feed is scanned; a package is extracted (straight out of the
+    /// memory-mapped archive) when it's actually going to be installed. The archive is only open while it's being scanned
+    /// or a package is being extracted from it, so it isn't locked in between.
+    /// </summary>
+    /// <remarks>
+    /// To know what a package is without extracting it, the archive has to carry an atom feed (any .xml file in it) that
+    /// describes it. Packages that no feed in the archive describes have to be extracted at scan time, so that their
+    /// details can be read from the package itself.
+    /// </remarks>
     internal class ArchivePackageFeed : PackageFeed {
-        internal ArchivePackageFeed(string location)
-            : base(location) {
-                throw new NotImplementedException();
+        /// <summary>
+        /// feeds bigger than this in the archive are not looked at.
+        /// </summary>
+        private const long MaxFeedSize = 16 * 1024 * 1024;
+
+        /// <summary>
+        /// the collection of packages found in this feed.
+        /// </summary>
+        private readonly List<Package> _packageList = new List<Package>();
+
+        /// <summary>
+        /// the archive file on disk.
+        /// </summary>
+        private readonly string _path;
+
+        /// <summary>
+        /// when the archive was last written, as of the last scan.
+        /// </summary>
+        private DateTime _archiveTimestamp;
+
+        /// <summary>
+        /// Initializes a new instance of the <see cref="ArchivePackageFeed"/> class.
+        /// </summary>
+        /// <param name="location">The local path of the archive.</param>
+        /// <remarks></remarks>
+        internal ArchivePackageFeed(string location) : base(location) {
+            _path = location;
+        }
+
+        /// <summary>
+        /// The feed is stale if the archive has changed since it was scanned.
+        /// </summary>
+        internal override bool Stale {
+            get { return base.Stale || (Scanned && File.GetLastWriteTimeUtc(_path) != _archiveTimestamp); }
+            set { base.Stale = value; }
+        }
+
+        /// <summary>
+        /// Reads the archive's central directory, and creates package representations of the packages in it.
+        ///
+        /// This will only read the archive if the Scanned property is false (or the feed is stale).
+        /// </summary>
+        /// <remarks></remarks>
+        protected void Scan() {
+            if (!Scanned || Stale) {
+                using (EngineStatistics.Measure(EngineStatistics.FeedScan)) {
+                    lock (this) {
+                        LastScanned = DateTime.Now;
+                        _packageList.Clear();
+
+                        _archiveTimestamp = File.GetLastWriteTimeUtc(_path);
+                        using (var archive = new IndexedZipFile(_path)) {
+                            // the packages in the archive, by filename (it's the last part of the package's remote location in a feed).
+                            var packageEntries = new Dictionary<string, IndexedZipEntry>(StringComparer.CurrentCultureIgnoreCase);
+                            foreach (var entry in archive.Entries.Where(each => !each.IsDirectory && each.Name.EndsWith(".msi", StringComparison.CurrentCultureIgnoreCase))) {
+                                var filename = Path.GetFileName(entry.Name);
+                                if (!packageEntries.ContainsKey(filename)) {
+                                    packageEntries.Add(filename, entry);
+                                }
+                            }
+
+                            // a feed in the archive tells us what its packages are, without having to open them.
+                            var described = new HashSet<IndexedZipEntry>();
+                            foreach (var feed in archive.Entries.Where(each => each.Name.EndsWith(".xml", StringComparison.CurrentCultureIgnoreCase) && each.UncompressedSize <= MaxFeedSize).Select(each => ReadFeed(archive, each)).Where(feed => feed != null)) {
+                                foreach (var pkg in feed.Packages) {
+                                    var entry = FindPackageEntry(pkg, packageEntries);
+                                    if (entry == null || !described.Add(entry)) {
+                                        // not in this archive (or it's already in the list).
+                                        continue;
+                                    }
+
+                                    var entryName = entry.Name;
+                                    pkg.InternalPackageData.ArchiveExtractor = () => ExtractPackage(entryName);
+                                    Add(pkg);
+                                }
+                            }
+
+                            // anything else has to be extracted now, so we can see what it is.
+                            foreach (var entry in packageEntries.Values.Where(each => !described.Contains(each))) {
+                                try {
+                                    var pkg = Package.GetPackageFromFilename(Extract(archive, entry));
+                                    if (pkg != null) {
+                                        Add(pkg);
+                                    }
+                                }
+                                catch (Exception e) {
+                                    Logger.Warning(e);
+                                }
+                            }
+                        }
+
+                        Stale = false;
+                        Scanned = true;
+                    }
+                }
+            }
+        }
+
+        private void Add(Package pkg) {
+            pkg.InternalPackageData.FeedLocation = Location;
+            if (!_packageList.Contains(pkg)) {
+                _packageList.Add(pkg);
+            }
+        }
+
+        private static AtomFeed ReadFeed(IndexedZipFile archive, IndexedZipEntry entry) {
+            try {
+                using (var reader = new StreamReader(archive.OpenEntry(entry))) {
+                    return AtomFeed.Load(reader.ReadToEnd());
+                }
+            }
+            catch {
+                // not an atom feed.
+                return null;
+            }
+        }
+
+        private static IndexedZipEntry FindPackageEntry(Package pkg, Dictionary<string, IndexedZipEntry> packageEntries) {
+            IndexedZipEntry entry;
+            foreach (var location in pkg.InternalPackageData.RemoteLocations) {
+                try {
+                    if (packageEntries.TryGetValue(Path.GetFileName(new Uri(location).LocalPath), out entry)) {
+                        return entry;
+                    }
+                }
+                catch {
+                    // not a usable location.
+                }
+            }
+            return packageEntries.TryGetValue(pkg.CanonicalName + ".msi", out entry) ? entry : null;
+        }
+
+        /// <summary>
+        /// Extracts a package from the archive into the package cache.
+        /// </summary>
+        /// <param name="entryName">The name of the package's entry in the archive.</param>
+        /// <returns>the path of the extracted package file</returns>
+        /// <remarks></remarks>
+        private string ExtractPackage(string entryName) {
+            Scan();
+            lock (this) {
+                using (var archive = new IndexedZipFile(_path)) {
+                    var entry = archive.Entries.FirstOrDefault(each => each.Name == entryName);
+                    if (entry == null) {
+                        throw new FileNotFoundException("Package is no longer in archive '{0}'.".format(_path), entryName);
+                    }
+                    return Extract(archive, entry);
+                }
+            }
+        }
+
+        private static string Extract(IndexedZipFile archive, IndexedZipEntry entry) {
+            var destination = Path.Combine(PackageManagerSettings.CoAppPackageCache, Path.GetFileName(entry.Name));
+
+            // it's already been extracted (and isn't some other file of the same name, or a damaged copy).
+            if (IndexedZipFile.IsExtractedTo(entry, destination)) {
+                return destination;
+            }
+
+            archive.ExtractEntry(entry, destination);
+            return destination;
+        }
+
+        internal override IEnumerable<Package> FindPackages(string name, string version, string arch, string publicKeyToken) {
+            Scan();
+            return _packageList.Match(name, version, arch, publicKeyToken);
         }
     }
-}
\ No newline at end of file
+}
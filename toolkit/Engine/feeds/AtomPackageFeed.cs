@@ -106,36 +106,34 @@ namespace CoApp.Toolkit.Engine.Feeds {
         /// <remarks></remarks>
         protected void Scan() {
             if (!Scanned || Stale) {
-                // bring the file local first
-                EnsureFileIsLocal().ContinueWith(antecedent => {
-                    if (antecedent.IsFaulted || antecedent.IsCanceled || !antecedent.Result) {              
-                        Scanned = false;
-                        LastScanned = DateTime.MinValue;
-                        return false;
-                    }
-                    Stale = false;
+                using (EngineStatistics.Measure(EngineStatistics.FeedScan)) {
+                    // bring the file local first
+                    EnsureFileIsLocal().ContinueWith(antecedent => {
+                        if (antecedent.IsFaulted || antecedent.IsCanceled || !antecedent.Result) {              
+                            Scanned = false;
+                            LastScanned = DateTime.MinValue;
+                            return false;
+                        }
+                        Stale = false;
 
-                    // we're good to load the file from the _localLocation
-                    var feed = AtomFeed.LoadFile(_localLocation);
+                        // we're good to load the file from the _localLocation
+                        var feed = AtomFeed.LoadFile(_localLocation);
 
-                    // since AtomFeeds are so nicely integrated with Package now, we can just get the packages from there :)
-                    _packageList.AddRange(feed.Packages);
+                        // since AtomFeeds are so nicely integrated with Package now, we can just get the packages from there :)
+                        _packageList.AddRange(feed.Packages);
 
                     
-                    Scanned = true;
-                    LastScanned = DateTime.Now;
-                    return true;
-                }).Wait(); // block on this actually finishing for now.
+                        Scanned = true;
+                        LastScanned = DateTime.Now;
+                        return true;
+                    }).Wait(); // block on this actually finishing for now.
+                }
             }
         }
 
         internal override IEnumerable<Package> FindPackages(string name, string version, string arch, string publicKeyToken) { 
             Scan();
-            return from p in _packageList where
-                (string.IsNullOrEmpty(name) || p.Name.IsWildcardMatch(name)) &&
-                (string.IsNullOrEmpty(version) || p.Version.ToString().IsWildcardMatch(version)) &&
-                (string.IsNullOrEmpty(arch) || p.Architecture.ToString().IsWildcardMatch(arch)) &&
-                (string.IsNullOrEmpty(publicKeyToken) || p.PublicKeyToken.IsWildcardMatch(publicKeyToken)) select p;
+            return _packageList.Match(name, version, arch, publicKeyToken);
         }
     }
 }
\ No newline at end of file
@@ -58,23 +58,26 @@ namespace CoApp.Toolkit.Engine.Feeds {
         /// </remarks>
         protected void Scan() {
             if (!Scanned || Stale) {
-                LastScanned = DateTime.Now;
+                using (EngineStatistics.Measure(EngineStatistics.FeedScan)) {
+                    LastScanned = DateTime.Now;
 
-                // GS01: BUG: recursive now should use ** in pattern match.
-                var files = _path.DirectoryEnumerateFilesSmarter(_filter, false ? SearchOption.AllDirectories : SearchOption.TopDirectoryOnly /*, NewPackageManager.Instance.BlockedScanLocations*/);
-                files = from file in files
-                    where Recognizer.Recognize(file).Result.IsPackageFile // Since we know this to be local, it'm ok with blocking on the result.
-                    select file;
+                    // a '**' in the filter (ie, 'c:\\packages\\**\\*.msi') makes it a recursive feed.
+                    var files = _path.DirectoryEnumerateFilesSmarter(_filter, _filter.Contains("**") ? SearchOption.AllDirectories : SearchOption.TopDirectoryOnly,
+                        NewPackageManager.Instance.BlockedScanLocations);
+                    files = from file in files
+                        where Recognizer.Recognize(file).Result.IsPackageFile // Since we know this to be local, it'm ok with blocking on the result.
+                        select file;
 
-                foreach (var pkg in files.Select(Package.GetPackageFromFilename).Where(pkg => pkg != null)) {
-                    pkg.InternalPackageData.FeedLocation = Location;
+                    foreach (var pkg in files.Select(Package.GetPackageFromFilename).Where(pkg => pkg != null)) {
+                        pkg.InternalPackageData.FeedLocation = Location;
 
-                    if (!_packageList.Contains(pkg)) {
-                        _packageList.Add(pkg);
+                        if (!_packageList.Contains(pkg)) {
+                            _packageList.Add(pkg);
+                        }
                     }
+                    Stale = false;
+                    Scanned = true;
                 }
-                Stale = false;
-                Scanned = true;
             }
         }
 
@@ -92,11 +95,7 @@ namespace CoApp.Toolkit.Engine.Feeds {
         /// <remarks></remarks>
         internal override IEnumerable<Package> FindPackages(string name, string version, string arch, string publicKeyToken) {
             Scan();
-            return from p in _packageList where
-                (string.IsNullOrEmpty(name) || p.Name.IsWildcardMatch(name)) &&
-                (string.IsNullOrEmpty(version) || p.Version.ToString().IsWildcardMatch(version)) &&
-                (string.IsNullOrEmpty(arch) || p.Architecture.ToString().IsWildcardMatch(arch)) &&
-                (string.IsNullOrEmpty(publicKeyToken) || p.PublicKeyToken.IsWildcardMatch(publicKeyToken)) select p;
+            return _packageList.Match(name, version, arch, publicKeyToken);
         }
     }
 }
\ No newline at end of file
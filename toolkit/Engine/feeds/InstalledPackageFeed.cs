@@ -4,8 +4,11 @@ using System.Linq;
 using System.Text;
 
 namespace CoApp.Toolkit.Engine.Feeds {
+    using System.Collections.Concurrent;
     using System.IO;
+    using System.Threading;
     using Extensions;
+    using Logging;
     using PackageFormatHandlers;
     using Win32;
 
@@ -13,6 +16,8 @@ namespace CoApp.Toolkit.Engine.Feeds {
         internal static string CanonicalLocation = "CoApp://InstalledPackages";
         internal static InstalledPackageFeed Instance = new InstalledPackageFeed();
 
+        private const int PackageCacheVersion = 1;
+
         private readonly HashSet<long> _nonCoAppMSIFiles = new HashSet<long>();
 
         /// <summary>
@@ -20,8 +25,35 @@ namespace CoApp.Toolkit.Engine.Feeds {
         /// </summary>
         private readonly List<Package> _packageList = new List<Package>();
 
+        /// <summary>
+        /// The CoApp MSIs we've already read, by path. Lets us skip opening them again on the next scan.
+        /// </summary>
+        private ConcurrentDictionary<string, CachedPackage> _packageCache = new ConcurrentDictionary<string, CachedPackage>(StringComparer.OrdinalIgnoreCase);
+
+        /// <summary>
+        /// The identity and package metadata of a CoApp MSI; good for as long as the file is unchanged.
+        /// </summary>
+        private class CachedPackage {
+            internal string Path;
+            internal long Length;
+            internal long CreationTime;
+            internal long LastWriteTime;
+            internal Guid ProductCode;
+            internal string PackageFeed;
+            internal Package Package;
+
+            internal bool IsFor(FileInfo file) {
+                return file.Length == Length && file.CreationTimeUtc.Ticks == CreationTime && file.LastWriteTimeUtc.Ticks == LastWriteTime;
+            }
+        }
+
+        private static string PackageCacheFile {
+            get { return Path.Combine(PackageManagerSettings.CoAppCacheDirectory, "installed-packages.cache"); }
+        }
+
         private InstalledPackageFeed() : base(CanonicalLocation) {
             LoadCache();
+            LoadPackageCache();
         }
 
         internal void PackageRemoved( Package package ) {
@@ -45,53 +77,73 @@ namespace CoApp.Toolkit.Engine.Feeds {
         protected void Scan() {
             lock (this) {
                 if (!Scanned || Stale) {
-                    LastScanned = DateTime.Now;
+                    using (EngineStatistics.Measure(EngineStatistics.FeedScan)) {
+                        LastScanned = DateTime.Now;
 
-                    // add the cached package directory, 'cause on backlevel platform, they taint the MSI in the installed files folder.
-                    var installedFiles =
-                        MSIBase.InstalledMSIFilenames.Union(PackageManagerSettings.CoAppPackageCache.FindFilesSmarter("*.msi")).ToArray();
+                        // add the cached package directory, 'cause on backlevel platform, they taint the MSI in the installed files folder.
+                        var installedFiles =
+                            MSIBase.InstalledMSIFilenames.Union(PackageManagerSettings.CoAppPackageCache.FindFilesSmarter("*.msi")).ToArray();
 
-                    /*
-                    for (var i = 0; i < installedFiles.Length;i++ ) {
-                        var packageFilename = installedFiles[i];
+                        /*
+                        for (var i = 0; i < installedFiles.Length;i++ ) {
+                            var packageFilename = installedFiles[i];
 
-                        Progress = (i*100)/installedFiles.Length;
+                            Progress = (i*100)/installedFiles.Length;
 
-                        var lookup = File.GetCreationTime(packageFilename).Ticks + packageFilename.GetHashCode();
+                            var lookup = File.GetCreationTime(packageFilename).Ticks + packageFilename.GetHashCode();
 
-                        if( _nonCoAppMSIFiles.Contains(lookup) ) {
-                            // already identified as a not-coapp-package.
-                            continue;
-                        }
+                            if( _nonCoAppMSIFiles.Contains(lookup) ) {
+                                // already identified as a not-coapp-package.
+                                continue;
+                            }
 
-                        var pkg = Package.GetPackageFromFilename(packageFilename);
+                            var pkg = Package.GetPackageFromFilename(packageFilename);
 
-                        if (pkg != null && pkg.IsInstalled) { 
-                            _packageList.Add(pkg);
-                        } 
-                    }
+                            if (pkg != null && pkg.IsInstalled) { 
+                                _packageList.Add(pkg);
+                            } 
+                        }
 
-                     * */
-                    var count = installedFiles.Length;
+                         * */
+                        var remaining = installedFiles.Length;
+                        var installedPackages = new ConcurrentBag<Package>();
+                        var nonCoAppMSIFiles = new ConcurrentBag<long>();
+                        var packageCache = new ConcurrentDictionary<string, CachedPackage>(StringComparer.OrdinalIgnoreCase);
 
-                    installedFiles.AsParallel().ForAll(each => {
-                        count--;
-                        Progress = (count - installedFiles.Length)*100/installedFiles.Length;
-                        var lookup = File.GetCreationTime(each).Ticks + each.GetHashCode();
+                        installedFiles.AsParallel().ForAll(each => {
+                            Progress = (installedFiles.Length - Interlocked.Decrement(ref remaining))*100/installedFiles.Length;
+                            var lookup = File.GetCreationTime(each).Ticks + each.GetHashCode();
 
-                        if (!_nonCoAppMSIFiles.Contains(lookup)) {
-                            var pkg = Package.GetPackageFromFilename(each);
+                            if (!_nonCoAppMSIFiles.Contains(lookup)) {
+                                var cached = GetCachedPackage(each);
 
-                            if (pkg != null && pkg.IsInstalled) {
-                                _packageList.Add(pkg);
+                                if (cached == null) {
+                                    nonCoAppMSIFiles.Add(lookup);
+                                    return;
+                                }
+
+                                packageCache[cached.Path] = cached;
+                                if (cached.Package.IsInstalled) {
+                                    installedPackages.Add(cached.Package);
+                                }
                             }
+                        });
+
+                        foreach (var pkg in installedPackages.Where(pkg => !_packageList.Contains(pkg))) {
+                            _packageList.Add(pkg);
+                        }
+                        foreach (var lookup in nonCoAppMSIFiles) {
+                            _nonCoAppMSIFiles.Add(lookup);
                         }
-                    });
+                        // entries for files that have gone away get dropped here.
+                        _packageCache = packageCache;
 
-                    SaveCache();
-                    Progress = 100;
-                    Scanned = true;
-                    Stale = false;
+                        SaveCache();
+                        SavePackageCache();
+                        Progress = 100;
+                        Scanned = true;
+                        Stale = false;
+                    }
                 }
             }
         }
@@ -116,6 +168,99 @@ namespace CoApp.Toolkit.Engine.Feeds {
             }
         }
 
+        /// <summary>
+        /// Gets the package for an MSI, from the package cache if the file hasn't changed since we last read it.
+        /// </summary>
+        /// <param name="filename">The filename.</param>
+        /// <returns>null if the file isn't a CoApp package.</returns>
+        /// <remarks></remarks>
+        private CachedPackage GetCachedPackage(string filename) {
+            filename = filename.CanonicalizePathIfLocalAndExists();
+            var file = new FileInfo(filename);
+            if (!file.Exists) {
+                return null;
+            }
+
+            CachedPackage cached;
+            if (_packageCache.TryGetValue(filename, out cached) && cached.IsFor(file)) {
+                if (cached.Package == null) {
+                    // loaded from disk; we haven't needed the package object till now.
+                    cached.Package = CoAppMSI.GetCoAppPackageFromFeed(filename, cached.ProductCode, cached.PackageFeed);
+                }
+                return cached;
+            }
+
+            string packageFeed;
+            var pkg = CoAppMSI.GetCoAppPackageFileInformation(filename, out packageFeed);
+            if (pkg == null || pkg.ProductCode == null) {
+                return null;
+            }
+
+            return new CachedPackage {
+                Path = filename,
+                Length = file.Length,
+                CreationTime = file.CreationTimeUtc.Ticks,
+                LastWriteTime = file.LastWriteTimeUtc.Ticks,
+                ProductCode = pkg.ProductCode.Value,
+                PackageFeed = packageFeed,
+                Package = pkg,
+            };
+        }
+
+        private void LoadPackageCache() {
+            try {
+                if (!File.Exists(PackageCacheFile)) {
+                    return;
+                }
+
+                using (var binaryReader = new BinaryReader(File.OpenRead(PackageCacheFile), Encoding.UTF8)) {
+                    if (binaryReader.ReadInt32() != PackageCacheVersion) {
+                        return;
+                    }
+
+                    var count = binaryReader.ReadInt32();
+                    for (var i = 0; i < count; i++) {
+                        var cached = new CachedPackage {
+                            Path = binaryReader.ReadString(),
+                            Length = binaryReader.ReadInt64(),
+                            CreationTime = binaryReader.ReadInt64(),
+                            LastWriteTime = binaryReader.ReadInt64(),
+                            ProductCode = new Guid(binaryReader.ReadBytes(16)),
+                            PackageFeed = binaryReader.ReadString(),
+                        };
+                        _packageCache[cached.Path] = cached;
+                    }
+                }
+            }
+            catch (Exception e) {
+                // a bad cache just means we read the MSIs again.
+                Logger.Error(e);
+                _packageCache.Clear();
+            }
+        }
+
+        private void SavePackageCache() {
+            try {
+                // order of the following is very important.
+                using (var binaryWriter = new BinaryWriter(File.Create(PackageCacheFile), Encoding.UTF8)) {
+                    var entries = _packageCache.Values.ToArray();
+                    binaryWriter.Write(PackageCacheVersion);
+                    binaryWriter.Write(entries.Length);
+                    foreach (var cached in entries) {
+                        binaryWriter.Write(cached.Path);
+                        binaryWriter.Write(cached.Length);
+                        binaryWriter.Write(cached.CreationTime);
+                        binaryWriter.Write(cached.LastWriteTime);
+                        binaryWriter.Write(cached.ProductCode.ToByteArray());
+                        binaryWriter.Write(cached.PackageFeed);
+                    }
+                }
+            }
+            catch (Exception e) {
+                Logger.Error(e);
+            }
+        }
+
         private void SaveCache() {
             using (var ms = new MemoryStream()) {
                 var binaryWriter = new BinaryWriter(ms);
@@ -144,11 +289,7 @@ namespace CoApp.Toolkit.Engine.Feeds {
         /// <remarks></remarks>
         internal override IEnumerable<Package> FindPackages(string name, string version, string arch, string publicKeyToken) { 
             Scan();
-            return from p in _packageList where
-                (string.IsNullOrEmpty(name) || p.Name.IsWildcardMatch(name)) &&
-                (string.IsNullOrEmpty(version) || p.Version.ToString().IsWildcardMatch(version)) &&
-                (string.IsNullOrEmpty(arch) || p.Architecture.ToString().IsWildcardMatch(arch)) &&
-                (string.IsNullOrEmpty(publicKeyToken) || p.PublicKeyToken.IsWildcardMatch(publicKeyToken)) select p;
+            return _packageList.Match(name, version, arch, publicKeyToken);
         }
     }
 }
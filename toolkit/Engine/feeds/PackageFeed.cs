@@ -149,11 +149,9 @@ namespace CoApp.Toolkit.Engine.Feeds {
                             result = new AtomPackageFeed(info.FullPath);
                         }
 
-                        /*
                         if (info.IsArchive) {
                             result = new ArchivePackageFeed(info.FullPath);
                         }
-                         * */
                     }
                         // TODO: URL based feeds
                     else if (info.IsURL) {
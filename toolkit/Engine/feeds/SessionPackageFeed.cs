@@ -47,10 +47,7 @@ namespace CoApp.Toolkit.Engine.Feeds {
         /// <returns></returns>
         /// <remarks></remarks>
         internal override IEnumerable<Package> FindPackages(string name, string version, string arch, string publicKeyToken) { 
-            return from p in _packageList where 
-                (string.IsNullOrEmpty(name) || p.Name.IsWildcardMatch(name)) &&
-                (string.IsNullOrEmpty(version) || p.Version.ToString().IsWildcardMatch(version)) &&
-                (string.IsNullOrEmpty(arch) || p.Architecture.ToString().IsWildcardMatch(arch)) &&
-                (string.IsNullOrEmpty(publicKeyToken) || p.PublicKeyToken.IsWildcardMatch(publicKeyToken)) select p;        }
+            return _packageList.Match(name, version, arch, publicKeyToken);
+        }
     }
 }
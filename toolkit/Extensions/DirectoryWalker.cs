@@ -0,0 +1,332 @@
+//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Toolkit.Extensions {
+    using System;
+    using System.Collections.Concurrent;
+    using System.Collections.Generic;
+    using System.IO;
+    using System.Linq;
+    using System.Threading;
+    using System.Threading.Tasks;
+
+    /// <summary>
+    /// Finds the files under a directory that match a wildcard mask, reading the subdirectories in parallel.
+    ///
+    /// The mask is relative to the root, and may have folders in it (ie, 'foo\*\**\*.msi'); subdirectories that the mask
+    /// can't possibly match anything in are never opened. Directories that can't be read are quietly skipped, as are any
+    /// that match one of the skip patterns.
+    ///
+    /// The files come back in the same order as a plain recursive walk: a directory's files (in the order the filesystem
+    /// lists them), then everything under each of its subdirectories in turn. The paths are built on the root as it was
+    /// given; case is only folded to match them against the mask.
+    /// </summary>
+    /// <remarks>
+    /// Worker threads read directories ahead of the caller, the most recently found first (so, roughly in the order the
+    /// caller will want them), up to MaxReadAhead directories that the caller hasn't got to yet. When the caller gets to a
+    /// directory no one has started on, it reads it itself. A caller that stops early doesn't wait for the whole tree (the
+    /// walk is cancelled when the enumerator is disposed). Once a directory's files have been handed out, it's let go of:
+    /// what's held is the directories read ahead, and the ones the caller has yet to get to.
+    ///
+    /// With only one processor, the workers just take turns with the caller (and cost more than they save), so the walk
+    /// is done on the caller's thread, one directory at a time.
+    /// </remarks>
+    internal class DirectoryWalker {
+        private const int MaxReadAhead = 256;
+
+        private readonly string _root;
+        private readonly bool _recursive;
+        private readonly WildcardPattern _filePattern;
+        private readonly WildcardPattern[] _folderPatterns;
+        private readonly int _firstDoubleStar;
+        private readonly string[] _skipPathPatterns;
+
+        /// <summary>
+        /// Initializes a new instance of the <see cref="DirectoryWalker"/> class.
+        /// </summary>
+        /// <param name="root">The directory to start in; the paths returned start with it, as given.</param>
+        /// <param name="searchPattern">The wildcard mask (see <see cref="StringExtensions.NewIsWildcardMatch"/>), matched case insensitively; null matches every file.</param>
+        /// <param name="searchOption">Whether to look in subdirectories at all.</param>
+        /// <param name="skipPathPatterns">Wildcard masks for directories that should not be looked in; may be null.</param>
+        /// <remarks></remarks>
+        internal DirectoryWalker(string root, string searchPattern, SearchOption searchOption, IEnumerable<string> skipPathPatterns) {
+            _root = root;
+            _recursive = searchOption == SearchOption.AllDirectories;
+
+            if (searchPattern == null) {
+                _folderPatterns = new WildcardPattern[0];
+                _firstDoubleStar = 0;
+            }
+            else {
+                searchPattern = searchPattern.ToLower();
+                var separator = root.EndsWith("\\") || root.EndsWith("/") ? string.Empty : Path.DirectorySeparatorChar.ToString();
+                _filePattern = WildcardPattern.GetNew(root.ToLower() + separator, searchPattern, WildcardPattern.StartMode.Anchored);
+
+                // every part of the mask but the last is a folder; up to the first '**', each one has to match the folder at that depth.
+                var parts = searchPattern.Split('\\', '/');
+                _folderPatterns = parts.Take(parts.Length - 1).Select(each => WildcardPattern.GetNew(null, each, WildcardPattern.StartMode.Anchored)).ToArray();
+                _firstDoubleStar = Array.FindIndex(parts, each => each.Contains("**"));
+            }
+
+            _skipPathPatterns = skipPathPatterns == null ? new string[0] : skipPathPatterns.Where(each => !string.IsNullOrEmpty(each)).Select(each => each.TrimEnd('\\', '/')).ToArray();
+        }
+
+        /// <summary>
+        /// Gets the matching files, in walk order (see above).
+        /// </summary>
+        /// <returns></returns>
+        /// <remarks></remarks>
+        internal IEnumerable<string> EnumerateFiles() {
+            if (IsSkipped(_root)) {
+                yield break;
+            }
+
+            if (!_recursive || !CanDescend(0, null)) {
+                // no point in starting threads for a single directory.
+                foreach (var file in ReadDirectory(_root, -1, null)) {
+                    yield return file;
+                }
+                yield break;
+            }
+
+            if (Environment.ProcessorCount == 1) {
+                foreach (var file in WalkSequentially(_root, -1)) {
+                    yield return file;
+                }
+                yield break;
+            }
+
+            using (var walk = new Walk(this)) {
+                var folders = new Stack<Folder>();
+                folders.Push(new Folder(_root, -1));
+                while (folders.Count > 0) {
+                    var folder = walk.Take(folders.Pop());
+                    for (var i = folder.Subdirectories.Count - 1; i >= 0; i--) {
+                        folders.Push(folder.Subdirectories[i]);
+                    }
+                    var files = folder.Files;
+                    folder.Release();
+                    foreach (var file in files) {
+                        yield return file;
+                    }
+                }
+            }
+        }
+
+        /// <summary>
+        /// Walks a directory and everything under it on the caller's thread, in walk order.
+        /// </summary>
+        /// <param name="directory">The directory.</param>
+        /// <param name="depth">The depth of the directory (-1 for the root).</param>
+        /// <returns></returns>
+        /// <remarks></remarks>
+        private IEnumerable<string> WalkSequentially(string directory, int depth) {
+            var subdirectories = new List<string>();
+            foreach (var file in ReadDirectory(directory, depth, subdirectories.Add)) {
+                yield return file;
+            }
+            foreach (var subdirectory in subdirectories) {
+                foreach (var file in WalkSequentially(subdirectory, depth + 1)) {
+                    yield return file;
+                }
+            }
+        }
+
+        /// <summary>
+        /// Determines whether the mask can match anything inside a subdirectory.
+        /// </summary>
+        /// <param name="depth">The depth of the subdirectory (0 for one directly in the root).</param>
+        /// <param name="name">The (lowercase) name of the subdirectory; null to ask if any subdirectory could.</param>
+        /// <returns></returns>
+        /// <remarks></remarks>
+        private bool CanDescend(int depth, string name) {
+            if (!_recursive) {
+                return false;
+            }
+            if (_firstDoubleStar >= 0 && depth >= _firstDoubleStar) {
+                return true;
+            }
+            if (depth >= _folderPatterns.Length) {
+                return false;
+            }
+            return name == null || _folderPatterns[depth].IsMatch(name);
+        }
+
+        private bool IsSkipped(string directory) {
+            return _skipPathPatterns.Length > 0 && _skipPathPatterns.Any(each => directory.IsWildcardMatch(each));
+        }
+
+        /// <summary>
+        /// Reads a directory, returning the files that match, and handing back the subdirectories worth looking in.
+        /// </summary>
+        /// <param name="directory">The directory.</param>
+        /// <param name="depth">The depth of the directory (-1 for the root).</param>
+        /// <param name="subdirectory">Called with each subdirectory worth looking in; may be null.</param>
+        /// <returns></returns>
+        /// <remarks></remarks>
+        private IEnumerable<string> ReadDirectory(string directory, int depth, Action<string> subdirectory) {
+            IEnumerable<FileSystemInfo> entries;
+            try {
+                entries = new DirectoryInfo(directory).EnumerateFileSystemInfos();
+            }
+            catch {
+                yield break;
+            }
+
+            using (var each = entries.GetEnumerator()) {
+                while (true) {
+                    // (access can be denied part way thru, too.)
+                    try {
+                        if (!each.MoveNext()) {
+                            break;
+                        }
+                    }
+                    catch {
+                        break;
+                    }
+
+                    var path = Path.Combine(directory, each.Current.Name);
+
+                    // (directories come back as DirectoryInfos; asking for the attributes can mean another trip to the disk.)
+                    if (each.Current is DirectoryInfo) {
+                        if (subdirectory != null && CanDescend(depth + 1, each.Current.Name.ToLower()) && !IsSkipped(path)) {
+                            subdirectory(path);
+                        }
+                        continue;
+                    }
+
+                    if (_filePattern == null || _filePattern.IsMatch(path.ToLower())) {
+                        yield return path;
+                    }
+                }
+            }
+        }
+
+        /// <summary>
+        /// A directory in a walk, and (once it's been read) what's in it.
+        /// </summary>
+        private class Folder {
+            internal readonly string Path;
+            internal readonly int Depth;
+            internal readonly ManualResetEventSlim Read = new ManualResetEventSlim(false);
+            internal List<string> Files;
+            internal List<Folder> Subdirectories;
+            internal bool ReadAhead;
+            private int _claimed;
+
+            internal Folder(string path, int depth) {
+                Path = path;
+                Depth = depth;
+            }
+
+            /// <summary>
+            /// Claims the folder for reading; only the first to ask gets it.
+            /// </summary>
+            internal bool Claim() {
+                return Interlocked.CompareExchange(ref _claimed, 1, 0) == 0;
+            }
+
+            /// <summary>
+            /// Lets go of what was read, once the caller has it (the folder may still be on the unread stack for a while).
+            /// </summary>
+            internal void Release() {
+                Files = null;
+                Subdirectories = null;
+                Read.Dispose();
+            }
+        }
+
+        /// <summary>
+        /// A walk in progress: the worker threads reading ahead, and the folders waiting to be read.
+        /// </summary>
+        private class Walk : IDisposable {
+            private readonly DirectoryWalker _walker;
+            private readonly ConcurrentStack<Folder> _unread = new ConcurrentStack<Folder>();
+            private readonly SemaphoreSlim _available = new SemaphoreSlim(0);
+            private readonly SemaphoreSlim _readAhead = new SemaphoreSlim(MaxReadAhead);
+            private readonly CancellationTokenSource _cancellation = new CancellationTokenSource();
+            private Exception _error;
+
+            internal Walk(DirectoryWalker walker) {
+                _walker = walker;
+
+                // reading directories is mostly waiting on the disk, so it's worth having more threads than cores.
+                var workerCount = Math.Min(Environment.ProcessorCount * 2, 16);
+                for (var i = 0; i < workerCount; i++) {
+                    Task.Factory.StartNew(Work, TaskCreationOptions.LongRunning);
+                }
+            }
+
+            /// <summary>
+            /// Gets a folder's contents: reads it now if no one has started on it, or waits for the worker that has.
+            /// </summary>
+            internal Folder Take(Folder folder) {
+                if (folder.Claim()) {
+                    ReadFolder(folder);
+                    return folder;
+                }
+
+                try {
+                    folder.Read.Wait(_cancellation.Token);
+                }
+                catch (OperationCanceledException) {
+                    throw _error;
+                }
+                if (folder.ReadAhead) {
+                    _readAhead.Release();
+                }
+                return folder;
+            }
+
+            private void ReadFolder(Folder folder) {
+                var subdirectories = new List<Folder>();
+                folder.Files = _walker.ReadDirectory(folder.Path, folder.Depth, each => subdirectories.Add(new Folder(each, folder.Depth + 1))).ToList();
+                folder.Subdirectories = subdirectories;
+
+                // the first subdirectory is the one wanted first, so it goes on the stack last.
+                for (var i = subdirectories.Count - 1; i >= 0; i--) {
+                    _unread.Push(subdirectories[i]);
+                    _available.Release();
+                }
+                folder.Read.Set();
+            }
+
+            private void Work() {
+                var token = _cancellation.Token;
+                try {
+                    while (true) {
+                        _available.Wait(token);
+                        _readAhead.Wait(token);
+
+                        Folder folder;
+                        if (!_unread.TryPop(out folder) || !folder.Claim()) {
+                            // the caller got to it first.
+                            _readAhead.Release();
+                            continue;
+                        }
+                        folder.ReadAhead = true;
+                        ReadFolder(folder);
+                    }
+                }
+                catch (OperationCanceledException) {
+                }
+                catch (Exception e) {
+                    _error = e;
+                    _cancellation.Cancel();
+                }
+            }
+
+            public void Dispose() {
+                // the caller is done with the walk (or stopped early); let the workers go.
+                _cancellation.Cancel();
+            }
+        }
+    }
+}
@@ -371,29 +371,8 @@ namespace CoApp.Toolkit.Extensions {
 
         public static IEnumerable<string> DirectoryEnumerateFilesSmarter(this string path, SearchOption searchOption) {
             // finds all the files in a set of subdirectories, softly skipping when access is blocked
-            var files = Enumerable.Empty<string>();
-            try {
-                files = Directory.EnumerateFiles(path);
-            } catch {
-            }
-
-            foreach (var file in files) {
-                yield return file;
-            }
-
-            if (searchOption == SearchOption.AllDirectories) {
-                var directories = Enumerable.Empty<string>();
-                try {
-                    directories = Directory.EnumerateDirectories(path);
-                } catch {
-                }
-                foreach (var directory in directories) {
-                    files = DirectoryEnumerateFilesSmarter(directory, searchOption);
-                    foreach (var file in files) {
-                        yield return file;
-                    }
-                }
-            }
+            // (a directory's files come first, then everything under each subdirectory in turn)
+            return new DirectoryWalker(path, null, searchOption, null).EnumerateFiles();
         }
 
         /// <summary>
@@ -404,11 +383,14 @@ namespace CoApp.Toolkit.Extensions {
         /// <param name="searchOption">The search option.</param>
         /// <param name="skipPathPatterns">The skip path patterns.</param>
         /// <returns></returns>
-        /// <remarks></remarks>
-        public static IEnumerable<string> DirectoryEnumerateFilesSmarter(this string path, string searchPattern, SearchOption searchOption) {
-            return
-                DirectoryEnumerateFilesSmarter(path.ToLower(), searchOption).Where(
-                    file => file.ToLower().NewIsWildcardMatch(searchPattern.ToLower(), true, path.ToLower()));
+        /// <remarks>
+        /// The search pattern may have folders in it (ie, '**\*.msi' or 'x86\*.dll'); only the subdirectories that
+        /// it could match are searched. It's matched case insensitively, but the files come back as they are on disk
+        /// (under <paramref name="path"/>, as given), and in the same order as a plain recursive walk: a directory's
+        /// files first, then everything under each of its subdirectories in turn.
+        /// </remarks>
+        public static IEnumerable<string> DirectoryEnumerateFilesSmarter(this string path, string searchPattern, SearchOption searchOption, IEnumerable<string> skipPathPatterns = null) {
+            return new DirectoryWalker(path, searchPattern, searchOption, skipPathPatterns).EnumerateFiles();
         }
         
         /// <summary>
@@ -434,7 +416,7 @@ namespace CoApp.Toolkit.Extensions {
         /// </summary>
         /// <param name="pathMask">The path mask.</param>
         /// <param name="searchOption">The search option.</param>
-        /// <returns></returns>
+        /// <returns>The matching files, in the order DirectoryEnumerateFilesSmarter finds them.</returns>
         /// <remarks></remarks>
         public static IEnumerable<string> FindFilesSmarter(this string pathMask, string subpathMask = null) {
 
@@ -458,9 +440,9 @@ namespace CoApp.Toolkit.Extensions {
             // the root path is everything before 
             path = path.Substring(0, j);
 
-            // call DEFS with the minimally constrained path & mask
-            return path.ToLower().DirectoryEnumerateFilesSmarter(mask.ToLower(),
-                mask.IndexOf("**") > -1 ? SearchOption.AllDirectories : SearchOption.TopDirectoryOnly);
+            // call DEFS with the minimally constrained path & mask (it only goes into the subdirectories the mask can match)
+            return path.DirectoryEnumerateFilesSmarter(mask,
+                mask.IndexOf("**") > -1 || mask.IndexOf('\\') > -1 ? SearchOption.AllDirectories : SearchOption.TopDirectoryOnly);
         }
 
         /// <summary>
@@ -20,6 +20,7 @@
 
 namespace CoApp.Toolkit.Extensions {
     using System;
+    using System.Collections.Concurrent;
     using System.Collections.Generic;
     using System.Globalization;
     using System.IO;
@@ -230,9 +231,9 @@ namespace CoApp.Toolkit.Extensions {
 
 
         /// <summary>
-        /// wildcard cache for IsWildcardMatch (so we're not rebuilding the regex every time)
+        /// regex cache for IsWildcardMatch calls that pass a raw regex as the prefix (so we're not rebuilding the regex every time)
         /// </summary>
-        private static readonly Dictionary<string, Regex> _wildcards = new Dictionary<string, Regex>();
+        private static readonly ConcurrentDictionary<string, Regex> _wildcards = new ConcurrentDictionary<string, Regex>();
 
         /// <summary>
         /// Determines if a given string is a match for the given wildcard pattern.
@@ -245,62 +246,67 @@ namespace CoApp.Toolkit.Extensions {
         /// <remarks></remarks>
         public static bool IsWildcardMatch(this string text, string wildcardMask, string ignorePrefix = null, bool escapePrefix = true) {
             //find out if the wildcard is rooted?
-            if (Path.GetPathRoot(wildcardMask) == String.Empty) {
-                ignorePrefix = String.IsNullOrEmpty(ignorePrefix) ? (text.Contains("\\") ?  @".*\\?" : string.Empty ): escapePrefix  ? Regex.Escape(ignorePrefix) : ignorePrefix;
-            } else {
-                ignorePrefix = String.Empty;
+            var isRooted = Path.GetPathRoot(wildcardMask) != String.Empty;
+            if (!isRooted && !escapePrefix && !String.IsNullOrEmpty(ignorePrefix)) {
+                return GetWildcardRegex(wildcardMask, ignorePrefix).IsMatch(text);
             }
+            return GetWildcardPattern(wildcardMask, isRooted ? null : ignorePrefix, isRooted, text.Contains("\\")).IsMatch(text);
+        }
 
-            var key = wildcardMask + ignorePrefix;
-            if (_wildcards.ContainsKey(key)) {
-                return _wildcards[key].IsMatch(text);
-            }
+        /// <summary>
+        /// Matches a single wildcard mask against many strings (looking up the compiled mask once).
+        /// </summary>
+        /// <param name="source">The strings.</param>
+        /// <param name="wildcardMask">The wildcard mask.</param>
+        /// <returns>the strings that match</returns>
+        /// <remarks>Uses the same rules as <see cref="IsWildcardMatch"/>.</remarks>
+        public static IEnumerable<string> WhereWildcardMatch(this IEnumerable<string> source, string wildcardMask) {
+            return source.WhereWildcardMatch(wildcardMask, each => each);
+        }
 
-            if (wildcardMask.EndsWith("**")) {
-                wildcardMask += @"\*";
+        /// <summary>
+        /// Matches a single wildcard mask against a string taken from each of many items (looking up the compiled mask once).
+        /// </summary>
+        /// <typeparam name="T">the type of the items</typeparam>
+        /// <param name="source">The items.</param>
+        /// <param name="wildcardMask">The wildcard mask.</param>
+        /// <param name="selector">Gets the string to match from an item.</param>
+        /// <returns>the items that match</returns>
+        /// <remarks>Uses the same rules as <see cref="IsWildcardMatch"/>.</remarks>
+        public static IEnumerable<T> WhereWildcardMatch<T>(this IEnumerable<T> source, string wildcardMask, Func<T, string> selector) {
+            var isRooted = Path.GetPathRoot(wildcardMask) != String.Empty;
+            var textMatcher = GetWildcardPattern(wildcardMask, null, isRooted, false);
+            var pathMatcher = GetWildcardPattern(wildcardMask, null, isRooted, true);
+            return source.Where(each => {
+                var text = selector(each);
+                return text != null && (text.Contains("\\") ? pathMatcher : textMatcher).IsMatch(text);
+            });
+        }
+
+        private static WildcardPattern GetWildcardPattern(string wildcardMask, string ignorePrefix, bool isRooted, bool textIsPath) {
+            if (!String.IsNullOrEmpty(ignorePrefix)) {
+                return WildcardPattern.Get(ignorePrefix, wildcardMask, WildcardPattern.StartMode.Anchored);
             }
-            var regexStuff = '^' + ignorePrefix;
-
-            var regexPart2 = wildcardMask.CommentEach(_validFpCharsThatHurtRegexs);
-            regexPart2 = regexPart2.Replace("?", @".");
-            regexPart2 = regexPart2.Replace("**", @"?");
-            regexPart2 = regexPart2.Replace("*", @"[^\\\/\<\>\|]*");
-            regexPart2 = regexPart2.Replace("?", @"[^\<\>\|]*");
-
-            regexStuff += regexPart2 + '$';
-
-            var mask = new Regex(regexStuff, RegexOptions.IgnoreCase);
-            /*
-            var mask =
-                new Regex(
-                    '^' + ignorePrefix +
-                        (wildcardMask.Replace(".", @"[.]").Replace(@"\", @"\\").Replace("?", @".").Replace("+", @"\+").Replace("**",
-                            @"?") // temporarily move it so the next one doesn't clobber
-                            .Replace("*", @"[^\\\/\<\>\|]*") //     \/\<\>\|
-                            .Replace("?", @"[^\<\>\|]*") + '$'), RegexOptions.IgnoreCase);*/
 
-            
-            lock (_wildcards) {
-                if (!_wildcards.ContainsKey(key)) {
-                    _wildcards.Add(key, mask);
-                }
-            }
-            return mask.IsMatch(text);
+            // an unrooted mask can match the tail end of a path.
+            return WildcardPattern.Get(null, wildcardMask, !isRooted && textIsPath ? WildcardPattern.StartMode.AnySuffix : WildcardPattern.StartMode.Anchored);
         }
 
         /// <summary>
-        /// wildcard cache for IsWildcardMatch (so we're not rebuilding the regex every time)
+        /// Builds the regex for a mask when the caller passed a regex as the prefix.
         /// </summary>
-        private static readonly Dictionary<string, Regex> _newWildcards = new Dictionary<string, Regex>();
-        private static Regex EscapeFilepathCharacters = new Regex(@"([\\|\$|\^|\{|\[|\||\)|\+|\.|\]|\}|\/])");
-
-        private static Regex WildcardToRegex( string wildcard, string noEscapePrefix = "^" ) {
-            return new Regex(noEscapePrefix + EscapeFilepathCharacters.Replace(wildcard, "\\$1")
-                .Replace("?", @".")
-                .Replace("**", @"?")
-                .Replace("*", @"[^\\\/\<\>\|]*")
-                .Replace("?", @".*") + '$');
-            
+        private static Regex GetWildcardRegex(string wildcardMask, string regexPrefix) {
+            return _wildcards.GetOrAdd(wildcardMask + regexPrefix, key => {
+                if (wildcardMask.EndsWith("**")) {
+                    wildcardMask += @"\*";
+                }
+                var regexPart2 = wildcardMask.CommentEach(_validFpCharsThatHurtRegexs);
+                regexPart2 = regexPart2.Replace("?", @".");
+                regexPart2 = regexPart2.Replace("**", @"?");
+                regexPart2 = regexPart2.Replace("*", @"[^\\\/\<\>\|]*");
+                regexPart2 = regexPart2.Replace("?", @"[^\<\>\|]*");
+                return new Regex('^' + regexPrefix + regexPart2 + '$', RegexOptions.IgnoreCase);
+            });
         }
 
         /// <summary>
@@ -315,27 +321,19 @@ namespace CoApp.Toolkit.Extensions {
         /// <param name="wildcardMask"></param>
         /// <returns></returns>
         public static bool NewIsWildcardMatch(this string text, string wildcardMask, bool isMatchingLocation = false, string currentLocation = null) {
-            string key;
-            
             if (!isMatchingLocation) {
-                key = (currentLocation ?? "" )+ wildcardMask;
-                if (!_newWildcards.ContainsKey(key)) {
-                    _newWildcards.Add(key, WildcardToRegex(key));
-                }
-                
-                return _newWildcards[key].IsMatch(text);
+                // the location is part of the mask.
+                return WildcardPattern.GetNew(null, (currentLocation ?? "") + wildcardMask, WildcardPattern.StartMode.Anchored).IsMatch(text);
             }
 
-            key = wildcardMask + (currentLocation ?? "" );
-            if (!_newWildcards.ContainsKey(key)) {
-                var prefix = currentLocation == null
-                    ? @".*[\\|\/]"
-                    : Regex.Escape((currentLocation.EndsWith("\\") || currentLocation.EndsWith("/")
-                        ? currentLocation : currentLocation + (text.Contains("\\") ? "\\" : (text.Contains("/") ? "/" : ""))));
-                _newWildcards.Add(key, WildcardToRegex(wildcardMask, prefix));
+            if (currentLocation == null) {
+                return WildcardPattern.GetNew(null, wildcardMask, WildcardPattern.StartMode.AfterSeparator).IsMatch(text);
             }
-            
-            return _newWildcards[key].IsMatch(text);
+
+            // (the location has never been anchored to the start of the text.)
+            var prefix = currentLocation.EndsWith("\\") || currentLocation.EndsWith("/")
+                ? currentLocation : currentLocation + (text.Contains("\\") ? "\\" : (text.Contains("/") ? "/" : ""));
+            return WildcardPattern.GetNew(prefix, wildcardMask, WildcardPattern.StartMode.AnySuffix).IsMatch(text);
         }
 
         /// <summary>
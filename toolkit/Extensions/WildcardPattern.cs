@@ -0,0 +1,316 @@
+//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Toolkit.Extensions {
+    using System;
+    using System.Collections.Concurrent;
+    using System.Collections.Generic;
+    using System.Linq;
+
+    /// <summary>
+    /// A compiled wildcard mask.
+    ///
+    /// The mask is turned into a list of elements (a literal character, '?' or a star that can't cross certain
+    /// characters), which is run as a little NFA over the text: no regex, and no backtracking. Masks that start or end with
+    /// plain text are checked against that first, and a mask with no wildcards at all is just a string comparison.
+    /// </summary>
+    /// <remarks>
+    /// Compiled patterns are immutable, and cached (see <see cref="Get"/>), so they can be shared freely between threads.
+    /// </remarks>
+    public class WildcardPattern {
+        private const int MaxCachedPatterns = 2048;
+
+        /// <summary>
+        /// The characters that a '*' can't match.
+        /// </summary>
+        internal const string SingleStarExcludes = "\\/<>|";
+
+        /// <summary>
+        /// The characters that a '**' can't match in <see cref="StringExtensions.IsWildcardMatch"/>.
+        /// </summary>
+        internal const string DoubleStarExcludes = "<>|";
+
+        /// <summary>
+        /// The characters that a '?' (or '**' in <see cref="StringExtensions.NewIsWildcardMatch"/>) can't match.
+        /// </summary>
+        internal const string AnyCharExcludes = "\n";
+
+        private static readonly ConcurrentDictionary<string, WildcardPattern> _cache = new ConcurrentDictionary<string, WildcardPattern>();
+
+        /// <summary>
+        /// Where a match may start in the text.
+        /// </summary>
+        public enum StartMode {
+            /// <summary>
+            /// The whole text has to match.
+            /// </summary>
+            Anchored,
+
+            /// <summary>
+            /// Any tail end of the text may match.
+            /// </summary>
+            AnySuffix,
+
+            /// <summary>
+            /// The part of the text following any path separator ('\', '/' or '|') may match.
+            /// </summary>
+            AfterSeparator,
+        }
+
+        private enum ElementKind : byte {
+            Literal,
+            AnyChar,
+            Star,
+        }
+
+        private readonly ElementKind[] _kinds;
+        private readonly char[] _chars;
+        private readonly string[] _excludes;
+        private readonly bool _ignoreCase;
+        private readonly StartMode _startMode;
+        private readonly string _literalPrefix;
+        private readonly string _literalSuffix;
+        private readonly bool _isLiteral;
+
+        [ThreadStatic]
+        private static bool[] _current;
+
+        [ThreadStatic]
+        private static bool[] _next;
+
+        private WildcardPattern(List<ElementKind> kinds, List<char> chars, List<string> excludes, bool ignoreCase, StartMode startMode) {
+            _kinds = kinds.ToArray();
+            _chars = chars.ToArray();
+            _excludes = excludes.ToArray();
+            _ignoreCase = ignoreCase;
+            _startMode = startMode;
+
+            var prefixLength = 0;
+            while (prefixLength < _kinds.Length && _kinds[prefixLength] == ElementKind.Literal) {
+                prefixLength++;
+            }
+            var suffixStart = _kinds.Length;
+            while (suffixStart > prefixLength && _kinds[suffixStart - 1] == ElementKind.Literal) {
+                suffixStart--;
+            }
+
+            _isLiteral = prefixLength == _kinds.Length;
+            _literalPrefix = new string(_chars, 0, prefixLength);
+            _literalSuffix = new string(_chars, suffixStart, _chars.Length - suffixStart);
+        }
+
+        /// <summary>
+        /// Compiles (or gets from the cache) a pattern with the rules of <see cref="StringExtensions.IsWildcardMatch"/>:
+        /// case insensitive, '*' stops at path separators, '**' doesn't.
+        /// </summary>
+        /// <param name="literalPrefix">Text that must come before the mask (matched literally); may be null.</param>
+        /// <param name="wildcardMask">The wildcard mask.</param>
+        /// <param name="startMode">The start mode.</param>
+        /// <returns></returns>
+        /// <remarks></remarks>
+        public static WildcardPattern Get(string literalPrefix, string wildcardMask, StartMode startMode) {
+            return GetOrCompile("c", literalPrefix, wildcardMask, startMode, true, DoubleStarExcludes, true);
+        }
+
+        /// <summary>
+        /// Compiles (or gets from the cache) a pattern with the rules of <see cref="StringExtensions.NewIsWildcardMatch"/>:
+        /// case sensitive, '*' stops at path separators, '**' matches anything.
+        /// </summary>
+        /// <param name="literalPrefix">Text that must come before the mask (matched literally); may be null.</param>
+        /// <param name="wildcardMask">The wildcard mask.</param>
+        /// <param name="startMode">The start mode.</param>
+        /// <returns></returns>
+        /// <remarks></remarks>
+        public static WildcardPattern GetNew(string literalPrefix, string wildcardMask, StartMode startMode) {
+            return GetOrCompile("n", literalPrefix, wildcardMask, startMode, false, AnyCharExcludes, false);
+        }
+
+        private static WildcardPattern GetOrCompile(string dialect, string literalPrefix, string wildcardMask, StartMode startMode, bool ignoreCase, string doubleStarExcludes,
+            bool extendTrailingDoubleStar) {
+            literalPrefix = literalPrefix ?? string.Empty;
+            wildcardMask = wildcardMask ?? string.Empty;
+
+            var key = dialect + (int)startMode + literalPrefix.Length + "|" + literalPrefix + wildcardMask;
+            WildcardPattern result;
+            if (_cache.TryGetValue(key, out result)) {
+                return result;
+            }
+
+            if (_cache.Count >= MaxCachedPatterns) {
+                _cache.Clear();
+            }
+
+            return _cache.GetOrAdd(key, k => Compile(literalPrefix, wildcardMask, startMode, ignoreCase, doubleStarExcludes, extendTrailingDoubleStar));
+        }
+
+        private static WildcardPattern Compile(string literalPrefix, string wildcardMask, StartMode startMode, bool ignoreCase, string doubleStarExcludes, bool extendTrailingDoubleStar) {
+            var kinds = new List<ElementKind>();
+            var chars = new List<char>();
+            var excludes = new List<string>();
+
+            Action<ElementKind, char, string> add = (kind, ch, exclude) => {
+                // a star right after an identical star adds nothing.
+                if (kind == ElementKind.Star && kinds.Count > 0 && kinds[kinds.Count - 1] == ElementKind.Star && excludes[excludes.Count - 1] == exclude) {
+                    return;
+                }
+                kinds.Add(kind);
+                chars.Add(ignoreCase ? char.ToLowerInvariant(ch) : ch);
+                excludes.Add(exclude);
+            };
+
+            foreach (var ch in literalPrefix) {
+                add(ElementKind.Literal, ch, null);
+            }
+
+            if (extendTrailingDoubleStar && wildcardMask.EndsWith("**")) {
+                // IsWildcardMatch has always treated a trailing '**' as '**\*'.
+                wildcardMask += @"\*";
+            }
+
+            for (var i = 0; i < wildcardMask.Length; i++) {
+                switch (wildcardMask[i]) {
+                    case '?':
+                        add(ElementKind.AnyChar, '?', AnyCharExcludes);
+                        break;
+
+                    case '*':
+                        if (i + 1 < wildcardMask.Length && wildcardMask[i + 1] == '*') {
+                            add(ElementKind.Star, '*', doubleStarExcludes);
+                            i++;
+                        }
+                        else {
+                            add(ElementKind.Star, '*', SingleStarExcludes);
+                        }
+                        break;
+
+                    default:
+                        add(ElementKind.Literal, wildcardMask[i], null);
+                        break;
+                }
+            }
+
+            return new WildcardPattern(kinds, chars, excludes, ignoreCase, startMode);
+        }
+
+        /// <summary>
+        /// Determines whether the specified text matches the pattern.
+        /// </summary>
+        /// <param name="text">The text.</param>
+        /// <returns><c>true</c> if the specified text is a match; otherwise, <c>false</c>.</returns>
+        /// <remarks></remarks>
+        public bool IsMatch(string text) {
+            if (text == null) {
+                return false;
+            }
+
+            // fast paths: the plain text at either end has to be there.
+            var comparison = _ignoreCase ? StringComparison.OrdinalIgnoreCase : StringComparison.Ordinal;
+            if (_startMode == StartMode.Anchored) {
+                if (_isLiteral) {
+                    return text.Equals(_literalPrefix, comparison);
+                }
+                if (!text.StartsWith(_literalPrefix, comparison)) {
+                    return false;
+                }
+            }
+
+            if (text.Length < _literalSuffix.Length || !text.EndsWith(_literalSuffix, comparison)) {
+                return false;
+            }
+
+            return Run(text);
+        }
+
+        /// <summary>
+        /// Matches the pattern against many strings.
+        /// </summary>
+        /// <param name="texts">The texts.</param>
+        /// <returns>the texts that match</returns>
+        /// <remarks></remarks>
+        public IEnumerable<string> Matches(IEnumerable<string> texts) {
+            return texts.Where(IsMatch);
+        }
+
+        private bool Run(string text) {
+            var stateCount = _kinds.Length + 1;
+            var current = _current;
+            var next = _next;
+            if (current == null || current.Length < stateCount) {
+                _current = current = new bool[Math.Max(stateCount, 32)];
+                _next = next = new bool[current.Length];
+            }
+            Array.Clear(current, 0, stateCount);
+
+            if (_startMode != StartMode.AfterSeparator) {
+                Enter(current, 0);
+            }
+
+            for (var position = 0; position < text.Length; position++) {
+                var ch = _ignoreCase ? char.ToLowerInvariant(text[position]) : text[position];
+                Array.Clear(next, 0, stateCount);
+                var anyActive = false;
+
+                for (var state = 0; state < _kinds.Length; state++) {
+                    if (!current[state]) {
+                        continue;
+                    }
+
+                    switch (_kinds[state]) {
+                        case ElementKind.Literal:
+                            if (_chars[state] == ch) {
+                                anyActive |= Enter(next, state + 1);
+                            }
+                            break;
+
+                        case ElementKind.AnyChar:
+                            if (_excludes[state].IndexOf(ch) < 0) {
+                                anyActive |= Enter(next, state + 1);
+                            }
+                            break;
+
+                        case ElementKind.Star:
+                            if (_excludes[state].IndexOf(ch) < 0) {
+                                anyActive |= Enter(next, state);
+                            }
+                            break;
+                    }
+                }
+
+                // unanchored patterns can start again at the next position.
+                if (_startMode == StartMode.AnySuffix || (_startMode == StartMode.AfterSeparator && (ch == '\\' || ch == '/' || ch == '|'))) {
+                    anyActive |= Enter(next, 0);
+                }
+
+                // (after a separator, a match can still start further along.)
+                if (!anyActive && _startMode == StartMode.Anchored) {
+                    return false;
+                }
+
+                var swap = current;
+                current = next;
+                next = swap;
+            }
+
+            return current[_kinds.Length];
+        }
+
+        /// <summary>
+        /// Marks a state as active, along with the states after any stars that follow it (a star can match nothing).
+        /// </summary>
+        private bool Enter(bool[] states, int state) {
+            states[state] = true;
+            while (state < _kinds.Length && _kinds[state] == ElementKind.Star) {
+                state++;
+                states[state] = true;
+            }
+            return true;
+        }
+    }
+}
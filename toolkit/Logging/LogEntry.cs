@@ -0,0 +1,83 @@
+//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Toolkit.Logging {
+    using System;
+    using System.Diagnostics;
+    using System.Linq;
+    using System.Threading;
+
+    /// <summary>
+    /// A single log entry, as handed to the log sinks.
+    ///
+    /// The message is kept as a format string and its arguments, and only formatted when a sink asks for it
+    /// (on the log writer thread), so the code doing the logging never pays for it. That's only done when every
+    /// argument is a value that can't change (strings, numbers and the like); otherwise, the message is formatted
+    /// right away, so it says what the arguments were when it was logged (and nothing reads them from another thread).
+    /// </summary>
+    /// <remarks></remarks>
+    public class LogEntry {
+        private readonly string _format;
+        private readonly object[] _args;
+        private string _message;
+
+        internal LogEntry(EventLogEntryType type, string format, object[] args, string data = null, short eventId = 0, short category = 0) {
+            Timestamp = DateTime.Now;
+            ThreadId = Thread.CurrentThread.ManagedThreadId;
+            Type = type;
+            Data = data;
+            EventId = eventId;
+            Category = category;
+            _format = format ?? string.Empty;
+            _args = args;
+
+            if (args != null && !args.All(IsImmutable)) {
+                _message = Format();
+                _args = null;
+            }
+        }
+
+        public DateTime Timestamp { get; private set; }
+        public int ThreadId { get; private set; }
+        public EventLogEntryType Type { get; private set; }
+        public short EventId { get; private set; }
+        public short Category { get; private set; }
+
+        /// <summary>
+        /// Extra data that goes along with the message (ie, a stack trace); may be null.
+        /// </summary>
+        public string Data { get; private set; }
+
+        /// <summary>
+        /// Gets the formatted message.
+        /// </summary>
+        public string Message {
+            get { return _message ?? (_message = Format()); }
+        }
+
+        private string Format() {
+            try {
+                return _args == null || _args.Length == 0 ? string.Format(_format) : string.Format(_format, _args);
+            }
+            catch (FormatException) {
+                // not every message is really a format string; don't lose it.
+                return _format;
+            }
+        }
+
+        private static bool IsImmutable(object value) {
+            if (value == null || value is string || value is Type || value is Version || value is Uri) {
+                return true;
+            }
+            var type = value.GetType();
+            return type.IsPrimitive || type.IsEnum || value is decimal || value is DateTime || value is DateTimeOffset || value is TimeSpan || value is Guid;
+        }
+    }
+}
@@ -0,0 +1,224 @@
+//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Toolkit.Logging {
+    using System;
+    using System.Collections.Generic;
+    using System.Diagnostics;
+    using System.IO;
+    using System.Runtime.InteropServices;
+    using System.Text;
+    using System.Threading;
+    using Extensions;
+
+    /// <summary>
+    /// Somewhere for log entries to go.
+    ///
+    /// Sinks are only ever called from the log writer thread, one batch at a time, so they don't need to be thread safe.
+    /// </summary>
+    /// <remarks></remarks>
+    public interface ILogSink {
+        /// <summary>
+        /// Writes a batch of entries.
+        /// </summary>
+        /// <param name="entries">The entries, oldest first.</param>
+        void Write(IList<LogEntry> entries);
+    }
+
+    /// <summary>
+    /// Writes log entries to the Windows event log (in the 'CoApp' log), and to the debugger (for dbgview).
+    /// </summary>
+    /// <remarks></remarks>
+    public class EventLogSink : ILogSink {
+        private const int MaxMessageLength = 4096;
+
+        [DllImport("kernel32.dll", CharSet = CharSet.Auto)]
+        internal static extern void OutputDebugString(string message);
+
+        private readonly string _source;
+        private readonly short _pid;
+        private EventLog _eventLog;
+        private bool _initialized;
+
+        public EventLogSink(string source) {
+            _source = source;
+            _pid = (short)Process.GetCurrentProcess().Id;
+        }
+
+        private void Initialize() {
+            _initialized = true;
+            try {
+                if (!EventLog.SourceExists(_source)) {
+                    EventLog.CreateEventSource(_source, "CoApp");
+                }
+
+                // a brand new source takes a moment to show up.
+                for (var i = 0; i < 50 && !EventLog.SourceExists(_source); i++) {
+                    Thread.Sleep(20);
+                }
+                _eventLog = new EventLog("CoApp", ".", _source);
+            }
+            catch {
+                _eventLog = null;
+            }
+        }
+
+        public void Write(IList<LogEntry> entries) {
+            if (!_initialized) {
+                Initialize();
+            }
+
+            foreach (var entry in entries) {
+                var message = entry.Message;
+                if (message.Length > MaxMessageLength) {
+                    message = message.Substring(0, MaxMessageLength) + "==>[SNIPPED FOR BEREVITY]";
+                }
+
+                if (_eventLog != null) {
+                    try {
+                        _eventLog.WriteEntry(message, entry.Type, _pid, entry.Category, entry.Data == null ? null : entry.Data.ToByteArray());
+                    }
+                    catch {
+                    }
+                }
+
+                try {
+                    // we're gonna output this to dbgview too for now.
+                    if (entry.EventId == 0 && entry.Category == 0) {
+                        OutputDebugString(string.Format("«{0}/{1}»-{2}", entry.Type, _source, message.Replace("\r\n", "\r\n»")));
+                    }
+                    else {
+                        OutputDebugString(string.Format("«{0}/{1}»({2}/{3})-{4}", entry.Type, _source, entry.EventId, entry.Category, message.Replace("\r\n", "\r\n»")));
+                    }
+
+                    if (!string.IsNullOrEmpty(entry.Data)) {
+                        if (entry.Data.Length < 2048) {
+                            OutputDebugString("   »RawData:" + entry.Data.Replace("\r\n", "\r\n»"));
+                        }
+                        else {
+                            OutputDebugString("   »RawData is [] bytes" + entry.Data.Length);
+                        }
+                    }
+                }
+                catch {
+                }
+            }
+        }
+    }
+
+    /// <summary>
+    /// Writes log entries to a text file, one tab-separated line per entry (time, type, thread, message, data).
+    ///
+    /// When the file gets bigger than <see cref="MaxFileSize"/>, it's renamed to 'name.1.ext' (pushing older ones
+    /// along to 'name.2.ext' and so on) and a new file is started; only <see cref="MaxFiles"/> old files are kept.
+    /// </summary>
+    /// <remarks></remarks>
+    public class RollingFileLogSink : ILogSink {
+        private readonly string _filename;
+        private StreamWriter _writer;
+
+        public long MaxFileSize { get; set; }
+        public int MaxFiles { get; set; }
+
+        public RollingFileLogSink(string filename) {
+            _filename = filename;
+            MaxFileSize = 8 * 1024 * 1024;
+            MaxFiles = 4;
+        }
+
+        public void Write(IList<LogEntry> entries) {
+            try {
+                if (_writer == null) {
+                    var folder = Path.GetDirectoryName(_filename);
+                    if (!string.IsNullOrEmpty(folder) && !Directory.Exists(folder)) {
+                        Directory.CreateDirectory(folder);
+                    }
+                    _writer = new StreamWriter(new FileStream(_filename, FileMode.Append, FileAccess.Write, FileShare.ReadWrite | FileShare.Delete), Encoding.UTF8);
+                }
+
+                foreach (var entry in entries) {
+                    _writer.Write(entry.Timestamp.ToString("yyyy-MM-dd HH:mm:ss.fff"));
+                    _writer.Write('\t');
+                    _writer.Write(entry.Type);
+                    _writer.Write('\t');
+                    _writer.Write(entry.ThreadId);
+                    _writer.Write('\t');
+                    _writer.Write(Escape(entry.Message));
+                    if (!string.IsNullOrEmpty(entry.Data)) {
+                        _writer.Write('\t');
+                        _writer.Write(Escape(entry.Data));
+                    }
+                    _writer.Write("\r\n");
+                }
+                _writer.Flush();
+
+                if (_writer.BaseStream.Length > MaxFileSize) {
+                    Roll();
+                }
+            }
+            catch {
+                // if we can't log, we can't whine about it either.
+                Close();
+            }
+        }
+
+        private void Roll() {
+            Close();
+
+            var folder = Path.GetDirectoryName(_filename) ?? string.Empty;
+            var name = Path.GetFileNameWithoutExtension(_filename);
+            var extension = Path.GetExtension(_filename);
+            Func<int, string> rolledName = n => Path.Combine(folder, "{0}.{1}{2}".format(name, n, extension));
+
+            if (File.Exists(rolledName(MaxFiles))) {
+                File.Delete(rolledName(MaxFiles));
+            }
+            for (var n = MaxFiles - 1; n >= 1; n--) {
+                if (File.Exists(rolledName(n))) {
+                    File.Move(rolledName(n), rolledName(n + 1));
+                }
+            }
+            File.Move(_filename, rolledName(1));
+        }
+
+        private void Close() {
+            if (_writer != null) {
+                try {
+                    _writer.Dispose();
+                }
+                catch {
+                }
+                _writer = null;
+            }
+        }
+
+        private static string Escape(string text) {
+            return text.Replace("\\", "\\\\").Replace("\t", "\\t").Replace("\r", "\\r").Replace("\n", "\\n");
+        }
+    }
+
+    /// <summary>
+    /// Writes log entries to the standard error stream.
+    /// </summary>
+    /// <remarks></remarks>
+    public class StandardErrorLogSink : ILogSink {
+        public void Write(IList<LogEntry> entries) {
+            try {
+                var text = new StringBuilder();
+                foreach (var entry in entries) {
+                    text.AppendFormat("[{0:HH:mm:ss.fff}] {1}: {2}\r\n", entry.Timestamp, entry.Type, entry.Message);
+                }
+                Console.Error.Write(text.ToString());
+            }
+            catch {
+            }
+        }
+    }
+}
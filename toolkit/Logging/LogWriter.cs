@@ -0,0 +1,216 @@
+//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Toolkit.Logging {
+    using System;
+    using System.Collections.Generic;
+    using System.Diagnostics;
+    using System.Threading;
+
+    /// <summary>
+    /// Gets log entries from the threads doing the logging to the sinks.
+    ///
+    /// Entries go into a fixed-size lock-free ring buffer; a background thread takes them out in batches and hands them
+    /// to each sink. Adding an entry never blocks: if the buffer is full, the entry is dropped (and counted, so that
+    /// the writer can say how many went missing).
+    /// </summary>
+    /// <remarks>
+    /// The ring is a bounded multi-producer queue in the style of Dmitry Vyukov's: each slot has a sequence number that
+    /// says whether it's ready to be filled or ready to be read, so producers only ever contend on a single CAS.
+    /// </remarks>
+    internal class LogWriter {
+        private const int MaxBatchSize = 256;
+        private static readonly TimeSpan IdleWait = TimeSpan.FromSeconds(1);
+
+        private readonly LogEntry[] _entries;
+        private readonly long[] _sequences;
+        private readonly int _mask;
+
+        private long _enqueuePosition;
+        private long _dequeuePosition;
+        private long _written;
+        private long _dropped;
+
+        private int _idle;
+        private int _started;
+        private readonly AutoResetEvent _wakeup = new AutoResetEvent(false);
+        private readonly object _flushSync = new object();
+
+        private ILogSink[] _sinks = new ILogSink[0];
+
+        /// <summary>
+        /// Initializes a new instance of the <see cref="LogWriter"/> class.
+        /// </summary>
+        /// <param name="capacity">The capacity of the buffer (rounded up to a power of two).</param>
+        /// <remarks></remarks>
+        internal LogWriter(int capacity) {
+            var size = 2;
+            while (size < capacity) {
+                size <<= 1;
+            }
+
+            _entries = new LogEntry[size];
+            _sequences = new long[size];
+            _mask = size - 1;
+            for (var i = 0; i < size; i++) {
+                _sequences[i] = i;
+            }
+        }
+
+        internal ILogSink[] Sinks {
+            get { return _sinks; }
+        }
+
+        internal void AddSink(ILogSink sink) {
+            ILogSink[] sinks, updated;
+            do {
+                sinks = _sinks;
+                updated = new ILogSink[sinks.Length + 1];
+                sinks.CopyTo(updated, 0);
+                updated[sinks.Length] = sink;
+            } while (Interlocked.CompareExchange(ref _sinks, updated, sinks) != sinks);
+        }
+
+        internal void RemoveSink(ILogSink sink) {
+            ILogSink[] sinks, updated;
+            do {
+                sinks = _sinks;
+                updated = Array.FindAll(sinks, each => !ReferenceEquals(each, sink));
+            } while (Interlocked.CompareExchange(ref _sinks, updated, sinks) != sinks);
+        }
+
+        /// <summary>
+        /// Adds an entry to the buffer.
+        /// </summary>
+        /// <param name="entry">The entry.</param>
+        /// <returns><c>false</c> if the buffer was full, and the entry was dropped.</returns>
+        /// <remarks></remarks>
+        internal bool Enqueue(LogEntry entry) {
+            if (_started == 0 && Interlocked.CompareExchange(ref _started, 1, 0) == 0) {
+                new Thread(WriterLoop) {IsBackground = true, Name = "CoApp log writer"}.Start();
+            }
+
+            var position = Interlocked.Read(ref _enqueuePosition);
+            while (true) {
+                var index = (int)(position & _mask);
+                var difference = Thread.VolatileRead(ref _sequences[index]) - position;
+
+                if (difference == 0) {
+                    var claimed = Interlocked.CompareExchange(ref _enqueuePosition, position + 1, position);
+                    if (claimed == position) {
+                        _entries[index] = entry;
+                        Thread.VolatileWrite(ref _sequences[index], position + 1);
+                        break;
+                    }
+                    position = claimed;
+                }
+                else if (difference < 0) {
+                    Interlocked.Increment(ref _dropped);
+                    return false;
+                }
+                else {
+                    position = Interlocked.Read(ref _enqueuePosition);
+                }
+            }
+
+            if (_idle == 1 && Interlocked.CompareExchange(ref _idle, 0, 1) == 1) {
+                _wakeup.Set();
+            }
+            return true;
+        }
+
+        /// <summary>
+        /// Waits until everything logged so far has been handed to the sinks.
+        /// </summary>
+        /// <param name="timeout">The longest to wait.</param>
+        /// <returns><c>true</c> if everything was written.</returns>
+        /// <remarks></remarks>
+        internal bool Flush(TimeSpan timeout) {
+            var target = Interlocked.Read(ref _enqueuePosition);
+            var stopwatch = Stopwatch.StartNew();
+
+            lock (_flushSync) {
+                while (Interlocked.Read(ref _written) < target && _started != 0) {
+                    _wakeup.Set();
+                    var remaining = timeout - stopwatch.Elapsed;
+                    if (remaining <= TimeSpan.Zero) {
+                        return false;
+                    }
+                    Monitor.Wait(_flushSync, remaining < IdleWait ? remaining : IdleWait);
+                }
+            }
+            return true;
+        }
+
+        private bool TryDequeue(out LogEntry entry) {
+            // only the writer thread takes things out, so the dequeue position is ours alone.
+            var index = (int)(_dequeuePosition & _mask);
+            if (Thread.VolatileRead(ref _sequences[index]) != _dequeuePosition + 1) {
+                entry = null;
+                return false;
+            }
+
+            entry = _entries[index];
+            _entries[index] = null;
+            Thread.VolatileWrite(ref _sequences[index], _dequeuePosition + _entries.Length);
+            _dequeuePosition++;
+            return true;
+        }
+
+        private void WriterLoop() {
+            var batch = new List<LogEntry>(MaxBatchSize);
+            long reportedDrops = 0;
+
+            while (true) {
+                LogEntry entry;
+                var taken = 0;
+                while (taken < MaxBatchSize && TryDequeue(out entry)) {
+                    batch.Add(entry);
+                    taken++;
+                }
+
+                var dropped = Interlocked.Read(ref _dropped);
+                if (dropped != reportedDrops) {
+                    batch.Add(new LogEntry(EventLogEntryType.Warning, "Log buffer overflowed; {0} entries were dropped.", new object[] {dropped - reportedDrops}));
+                    reportedDrops = dropped;
+                }
+
+                if (batch.Count > 0) {
+                    foreach (var sink in _sinks) {
+                        try {
+                            sink.Write(batch);
+                        }
+                        catch {
+                            // a broken sink shouldn't take the others down with it.
+                        }
+                    }
+
+                    // (the drop notice isn't one of the entries anyone's waiting for.)
+                    Interlocked.Add(ref _written, taken);
+                    batch.Clear();
+
+                    lock (_flushSync) {
+                        Monitor.PulseAll(_flushSync);
+                    }
+                    continue;
+                }
+
+                // nothing to do: say we're going to sleep, then check once more, so that we can't miss a wakeup.
+                Interlocked.Exchange(ref _idle, 1);
+                if (Thread.VolatileRead(ref _sequences[(int)(_dequeuePosition & _mask)]) == _dequeuePosition + 1) {
+                    Interlocked.Exchange(ref _idle, 0);
+                    continue;
+                }
+                _wakeup.WaitOne(IdleWait);
+                Interlocked.Exchange(ref _idle, 0);
+            }
+        }
+    }
+}
@@ -13,26 +13,39 @@ namespace CoApp.Toolkit.Logging {
     using Extensions;
     using Tasks;
 
+    /// <summary>
+    /// The CoApp logger.
+    /// 
+    /// Logging calls don't write anything themselves: the entry (with its unformatted message) goes into a lock-free
+    /// buffer, and a background thread formats and writes batches of them to the sinks (by default, the event log).
+    /// When a level is turned off, a call costs a single field check.
+    /// </summary>
+    /// <remarks></remarks>
     public static class Logger {
-        private static EventLog _eventLog;
         private static readonly string Source;
-        private static bool _ready;
-        private static short pid;
+        private static readonly LogWriter _writer = new LogWriter(8192);
         
 #if COAPP_ENGINE_CORE
-        private static bool _messages;
+        // sessions can turn on logging just for themselves (see 'set-logging'); until one does, there's no point in looking in the session cache.
+        private static volatile bool _sessionLogging;
+
+        internal static void EnableSessionLogging() {
+            _sessionLogging = true;
+        }
+
+        private static volatile bool _messages;
         public static bool Messages {
-            get { return _messages || SessionCache<string>.Value["LogMessages"].IsTrue(); }
+            get { return _messages || (_sessionLogging && SessionCache<string>.Value["LogMessages"].IsTrue()); }
             set { _messages = value; }
         }
-        private static bool _errors;
+        private static volatile bool _errors;
         public static bool Errors {
-            get { return _errors || SessionCache<string>.Value["LogErrors"].IsTrue(); }
+            get { return _errors || (_sessionLogging && SessionCache<string>.Value["LogErrors"].IsTrue()); }
             set { _errors= value; }
         }
-        private static bool _warnings;
+        private static volatile bool _warnings;
         public static bool Warnings {
-            get { return _warnings || SessionCache<string>.Value["LogWarnings"].IsTrue(); }
+            get { return _warnings || (_sessionLogging && SessionCache<string>.Value["LogWarnings"].IsTrue()); }
             set { _warnings = value; }
         }
 #else 
@@ -40,13 +53,9 @@ namespace CoApp.Toolkit.Logging {
         public static bool Errors { get; set; }
         public static bool Warnings { get; set; }
 #endif 
-        
-        [DllImport("kernel32.dll", CharSet = CharSet.Auto)]
-        internal static extern void OutputDebugString(string message);
 
         static Logger() {
             try {
-                pid = (short)Process.GetCurrentProcess().Id;
                 Errors = true;
 #if DEBUG
     // by default, we'll turn warnings on only in a debug version.
@@ -64,95 +73,112 @@ namespace CoApp.Toolkit.Logging {
                     Source = "CoApp (misc)";
                 }
 
-                if (!EventLog.SourceExists(Source)) {
-                    EventLog.CreateEventSource(Source, "CoApp");
-                }
-                _eventLog = new EventLog("CoApp", ".", Source);
+                // setting up the event log source happens on the writer thread, the first time something is logged.
+                _writer.AddSink(new EventLogSink(Source));
 
-                Task.Factory.StartNew(() => {
-                    while (!EventLog.SourceExists(Source)) {
-                        Thread.Sleep(20);
-                    }
-                    _ready = true;
-                });
+                // give the writer a chance to finish up before the process goes away.
+                AppDomain.CurrentDomain.ProcessExit += (sender, args) => Flush(TimeSpan.FromSeconds(2));
             } catch {
-                _ready = true; 
             }
         }
 
-        /// <devdoc>
-        ///    <para>
-        ///       Writes an entry of the specified type with the
-        ///       user-defined <paramref name="eventID"/> and <paramref name="category"/> to the event log, and appends binary data to 
-        ///       the message. The Event Viewer does not interpret this data; it
-        ///       displays raw data only in a combined hexadecimal and text format. 
-        ///    </para> 
-        /// </devdoc>
-        private static void WriteEntry(string message, EventLogEntryType type = EventLogEntryType.Information, short eventID = 0, short category = 0, byte[] rawData = null) {
-            try {
-                if (message.Length > 4096) {
-                    message = message.Substring(0, 4096) + "==>[SNIPPED FOR BEREVITY]";
-                }
-                if (!_ready) {
-                    Task.Factory.StartNew(() => {
-                        for (var i = 0; i < 20 && !_ready; i++) {
-                            Thread.Sleep(10);
-                        }
-                        // go ahead and try, but don't whine if this gets dropped.
-                        try {
-                            _eventLog.WriteEntry(message, type, (short)pid, (short)category, rawData);
-                        } catch {
-
-                        }
-                    });
-                } else {
-                    try {
-                        _eventLog.WriteEntry(message, type, (short)pid, (short)category, rawData);
-                    } catch {
+        /// <summary>
+        /// Adds a place for log entries to go.
+        /// </summary>
+        /// <param name="sink">The sink.</param>
+        public static void AddSink(ILogSink sink) {
+            _writer.AddSink(sink);
+        }
 
-                    }
-                }
+        /// <summary>
+        /// Removes a log sink.
+        /// </summary>
+        /// <param name="sink">The sink.</param>
+        public static void RemoveSink(ILogSink sink) {
+            _writer.RemoveSink(sink);
+        }
 
-                // we're gonna output this to dbgview too for now.
-                if (eventID == 0 && category == 0) {
-                    OutputDebugString(string.Format("«{0}/{1}»-{2}", type, Source, message.Replace("\r\n", "\r\n»")));
-                } else {
-                    OutputDebugString(string.Format("«{0}/{1}»({2}/{3})-{4}", type, Source, eventID, category, message.Replace("\r\n", "\r\n»")));
-                }
-                if (!rawData.IsNullOrEmpty()) {
-                    var rd = rawData.ToUtf8String().Replace("\r\n", "\r\n»");
-                    if (!string.IsNullOrEmpty(rd) && rd.Length < 2048) {
-                        OutputDebugString("   »RawData:" + rd);
-                    } else {
-                        OutputDebugString("   »RawData is [] bytes" + rawData.Length);
-                    }
-                }
-            } catch {
-                
-            }
-        } 
+        public static IEnumerable<ILogSink> Sinks {
+            get { return _writer.Sinks; }
+        }
+
+        /// <summary>
+        /// Waits until everything logged so far has been written to the sinks.
+        /// </summary>
+        /// <param name="timeout">The longest to wait.</param>
+        /// <returns><c>true</c> if everything was written.</returns>
+        public static bool Flush(TimeSpan timeout) {
+            return _writer.Flush(timeout);
+        }
+
+        private static void WriteEntry(string message, object[] args, EventLogEntryType type = EventLogEntryType.Information, short eventID = 0, short category = 0, string data = null) {
+            _writer.Enqueue(new LogEntry(type, message, args, data, eventID, category));
+        }
 
         public static void Message(string message, params object[] args) {
             if (Messages) {
-                WriteEntry(message.format(args));
+                WriteEntry(message, args);
+            }
+        }
+
+        /// <summary>
+        /// Logs a message with one argument. Unlike the params overload, this doesn't make an array (or box value types)
+        /// unless the level is on.
+        /// </summary>
+        public static void Message<T1>(string message, T1 arg1) {
+            if (Messages) {
+                WriteEntry(message, new object[] {arg1});
+            }
+        }
+
+        public static void Message<T1, T2>(string message, T1 arg1, T2 arg2) {
+            if (Messages) {
+                WriteEntry(message, new object[] {arg1, arg2});
+            }
+        }
+
+        public static void Message<T1, T2, T3>(string message, T1 arg1, T2 arg2, T3 arg3) {
+            if (Messages) {
+                WriteEntry(message, new object[] {arg1, arg2, arg3});
             }
         }
 
         public static void MessageWithData(string message, string data, params object[] args) {
             if (Messages) {
-                WriteEntry(message.format(args),rawData : data.ToByteArray());
+                WriteEntry(message, args, data: data);
             }
         }
 
         public static void Warning(string message, params object[] args) {
             if (Warnings) {
-                WriteEntry(message.format(args), EventLogEntryType.Warning);
+                WriteEntry(message, args, EventLogEntryType.Warning);
+            }
+        }
+
+        /// <summary>
+        /// Logs a warning with one argument (see <see cref="Message{T1}"/>).
+        /// </summary>
+        public static void Warning<T1>(string message, T1 arg1) {
+            if (Warnings) {
+                WriteEntry(message, new object[] {arg1}, EventLogEntryType.Warning);
+            }
+        }
+
+        public static void Warning<T1, T2>(string message, T1 arg1, T2 arg2) {
+            if (Warnings) {
+                WriteEntry(message, new object[] {arg1, arg2}, EventLogEntryType.Warning);
+            }
+        }
+
+        public static void Warning<T1, T2, T3>(string message, T1 arg1, T2 arg2, T3 arg3) {
+            if (Warnings) {
+                WriteEntry(message, new object[] {arg1, arg2, arg3}, EventLogEntryType.Warning);
             }
         }
 
         public static void WarningWithData(string message, string data, params object[] args) {
             if (Warnings) {
-                WriteEntry(message.format(args), EventLogEntryType.Warning, rawData: data.ToByteArray());
+                WriteEntry(message, args, EventLogEntryType.Warning, data: data);
             }
         }
 
@@ -162,9 +188,9 @@ namespace CoApp.Toolkit.Logging {
                 if (!exception.Logged) {
                     exception.Logged = true;
                     if(exception.InnerException != null ) {
-                        WriteEntry("{0}/{1} - {2}".format(exception.GetType(), exception.InnerException.GetType(), exception.Message), EventLogEntryType.Warning, 0, 0, exception.strace.ToByteArray());    
+                        WriteEntry("{0}/{1} - {2}", new object[] {exception.GetType(), exception.InnerException.GetType(), exception.Message}, EventLogEntryType.Warning, 0, 0, exception.strace);    
                     } else {
-                        WriteEntry("{0} - {1}".format(exception.GetType(), exception.Message), EventLogEntryType.Warning, 0, 0, exception.strace.ToByteArray());    
+                        WriteEntry("{0} - {1}", new object[] {exception.GetType(), exception.Message}, EventLogEntryType.Warning, 0, 0, exception.strace);    
                     }
                 }
             }
@@ -173,22 +199,43 @@ namespace CoApp.Toolkit.Logging {
         public static void Warning(Exception exception) {
             if (Warnings) {
                 if (exception.InnerException != null) {
-                    WriteEntry("{0}/{1} - {2}".format(exception.GetType(), exception.InnerException.GetType(), exception.Message), EventLogEntryType.Warning, 0, 0, exception.StackTrace.ToByteArray());
+                    WriteEntry("{0}/{1} - {2}", new object[] {exception.GetType(), exception.InnerException.GetType(), exception.Message}, EventLogEntryType.Warning, 0, 0, exception.StackTrace);
                 } else {
-                    WriteEntry("{0} - {1}".format(exception.GetType(), exception.Message), EventLogEntryType.Warning, 0, 0, exception.StackTrace.ToByteArray());
+                    WriteEntry("{0} - {1}", new object[] {exception.GetType(), exception.Message}, EventLogEntryType.Warning, 0, 0, exception.StackTrace);
                 }
             }
         }
        
         public static void Error(string message, params object[] args) {
             if (Errors) {
-                WriteEntry(message.format(args), EventLogEntryType.Error);
+                WriteEntry(message, args, EventLogEntryType.Error);
+            }
+        }
+
+        /// <summary>
+        /// Logs a error with one argument (see <see cref="Message{T1}"/>).
+        /// </summary>
+        public static void Error<T1>(string message, T1 arg1) {
+            if (Errors) {
+                WriteEntry(message, new object[] {arg1}, EventLogEntryType.Error);
+            }
+        }
+
+        public static void Error<T1, T2>(string message, T1 arg1, T2 arg2) {
+            if (Errors) {
+                WriteEntry(message, new object[] {arg1, arg2}, EventLogEntryType.Error);
+            }
+        }
+
+        public static void Error<T1, T2, T3>(string message, T1 arg1, T2 arg2, T3 arg3) {
+            if (Errors) {
+                WriteEntry(message, new object[] {arg1, arg2, arg3}, EventLogEntryType.Error);
             }
         }
 
         public static void ErrorWithData(string message, string data, params object[] args) {
             if (Errors) {
-                WriteEntry(message.format(args), EventLogEntryType.Error, rawData: data.ToByteArray());
+                WriteEntry(message, args, EventLogEntryType.Error, data: data);
             }
         }
 
@@ -197,9 +244,9 @@ namespace CoApp.Toolkit.Logging {
                 if (!exception.Logged) {
                     exception.Logged = true;
                     if (exception.InnerException != null) {
-                        WriteEntry("{0}/{1} - {2}".format(exception.GetType(), exception.InnerException.GetType(), exception.Message), EventLogEntryType.Error, 0, 0, exception.strace.ToByteArray());
+                        WriteEntry("{0}/{1} - {2}", new object[] {exception.GetType(), exception.InnerException.GetType(), exception.Message}, EventLogEntryType.Error, 0, 0, exception.strace);
                     } else {
-                        WriteEntry("{0} - {1}".format(exception.GetType(), exception.Message), EventLogEntryType.Error, 0, 0, exception.strace.ToByteArray());
+                        WriteEntry("{0} - {1}", new object[] {exception.GetType(), exception.Message}, EventLogEntryType.Error, 0, 0, exception.strace);
                     }
                 }
             }
@@ -208,9 +255,9 @@ namespace CoApp.Toolkit.Logging {
         public static void Error(Exception exception) {
             if (Errors) {
                 if (exception.InnerException != null) {
-                    WriteEntry("{0}/{1} - {2}".format(exception.GetType(), exception.InnerException.GetType(), exception.Message), EventLogEntryType.Error, 0, 0, exception.StackTrace.ToByteArray());
+                    WriteEntry("{0}/{1} - {2}", new object[] {exception.GetType(), exception.InnerException.GetType(), exception.Message}, EventLogEntryType.Error, 0, 0, exception.StackTrace);
                 } else {
-                    WriteEntry("{0} - {1}".format(exception.GetType(), exception.Message), EventLogEntryType.Error, 0, 0, exception.StackTrace.ToByteArray());
+                    WriteEntry("{0} - {1}", new object[] {exception.GetType(), exception.Message}, EventLogEntryType.Error, 0, 0, exception.StackTrace);
                 }
             }
         }
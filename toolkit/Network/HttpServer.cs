@@ -14,6 +14,8 @@ using System.Linq;
 using System.Text;
 
 namespace CoApp.Toolkit.Network {
+    using System.Collections.Concurrent;
+    using System.Globalization;
     using System.IO;
     using System.Net;
     using System.Threading.Tasks;
@@ -21,17 +23,55 @@ namespace CoApp.Toolkit.Network {
     using Tasks;
     using Console = System.Console;
 
+    /// <summary>
+    ///   A small web server for package feeds, serving files and directory listings from local directories.
+    /// </summary>
+    /// <remarks>
+    ///   <para>
+    ///     Several accepts are kept outstanding (<see cref = "PendingAccepts" />), so a burst of clients isn't served
+    ///     one accept at a time. No more than <see cref = "MaxConnections" /> requests are served at once; past
+    ///     that, nothing more is accepted until one finishes, and new connections wait in the listener's queue.
+    ///   </para>
+    ///   <para>
+    ///     Files are streamed to the client through one buffer of <see cref = "BufferSize" /> bytes per request
+    ///     (from a pool), so serving a large file takes no more memory than serving a small one. Single byte
+    ///     ranges (<c>Range: bytes=...</c>) are honoured, for resumed and segmented downloads.
+    ///   </para>
+    /// </remarks>
     public class HttpServer {
         private readonly string _host;
         private readonly int _port;
         private readonly HttpListener _listener = new HttpListener();
         private readonly Dictionary<string, string> _virtualDirs = new Dictionary<string, string>();
+        private readonly ConcurrentStack<byte[]> _buffers = new ConcurrentStack<byte[]>();
+        private readonly object _sync = new object();
+        private bool _running;
+        private int _pendingAccepts;
+        private int _activeRequests;
 
         public HttpServer(string host = "*", int port = 80 ) {
             _host = host.ToLower();
             _port = port;
+            PendingAccepts = Math.Max(2, Environment.ProcessorCount*2);
+            MaxConnections = 64;
+            BufferSize = 64*1024;
         }
 
+        /// <summary>
+        ///   The number of accepts kept outstanding on the listener. Set before <see cref = "Start" />.
+        /// </summary>
+        public int PendingAccepts { get; set; }
+
+        /// <summary>
+        ///   The most requests served at once. Set before <see cref = "Start" />.
+        /// </summary>
+        public int MaxConnections { get; set; }
+
+        /// <summary>
+        ///   The size of the buffer a file is streamed through; each request being served holds one. Set before <see cref = "Start" />.
+        /// </summary>
+        public int BufferSize { get; set; }
+
         public void AddVirtualDir(string prefix,string localPath) {
             if (string.IsNullOrEmpty(prefix))
                 prefix = string.Empty;
@@ -84,75 +124,362 @@ namespace CoApp.Toolkit.Network {
 
         private long GetContentLength(string location) {
             if (Directory.Exists(location)) {
-                return GetDirectoryListing(location).Length;
-            } 
+                return GetDirectoryListing(location).ToByteArray().Length;
+            }
             var fi = new FileInfo(location);
             return fi.Length;
         }
 
         public void Start() {
-            _listener.Start();
+            lock (_sync) {
+                if (_running) {
+                    return;
+                }
+                _listener.Start();
+                _running = true;
+            }
+            Accept();
+        }
 
-            Task.Factory.FromAsync<HttpListenerContext>(_listener.BeginGetContext, _listener.EndGetContext, _listener).ContinueWith(
-                (antecedent) => {
-                    Start(); // start a new listener.
+        public void Stop() {
+            lock (_sync) {
+                _running = false;
+                // _listener.Abort();
+                _listener.Stop();
+            }
+        }
 
-                    try {
-                        var request = antecedent.Result.Request;
-                        var response = antecedent.Result.Response;
-                        var lp = GetLocalPath(request.Url);
-
-                        switch( request.HttpMethod ) {
-                            case "HEAD":
-                                if (Exists(lp)) {
-                                    response.AddHeader("Last-Modified", GetLocationLastModified(lp).ToString("r"));
-                                    response.ContentLength64 = GetContentLength(lp);
-                                } else {
-                                    response.StatusCode = (int)HttpStatusCode.NotFound;
-                                }
-                                response.Close();
-
-                                break;
-                            case "GET":
-                                if (!Exists(lp)) {
-                                    response.StatusCode = (int)HttpStatusCode.NotFound;
-                                    response.Close();
-                                    break;
-                                }
-                                response.AddHeader("Last-Modified", GetLocationLastModified(lp).ToString("r"));
-                                response.ContentLength64 = GetContentLength(lp);
-                                if( Directory.Exists(lp)) {
-                                    response.ContentType = "text/html";
-                                    var buf = GetDirectoryListing(lp).ToByteArray();
-                                    response.OutputStream.Write(buf,0,buf.Length);
-                                    response.OutputStream.Flush();
-                                    response.Close();
-                                    break;
-                                }
-
-                                var data = File.ReadAllBytes(lp);
-                                response.OutputStream.Write(data, 0, data.Length);
-                                response.Close();
-                                break;
-                            case "POST":
-
-                                break;
-
-                            default:
-                                Console.WriteLine("Unknown HTTP VERB : {0}", request.HttpMethod );
-                                break;
+        /// <summary>
+        ///   Tops the outstanding accepts back up to <see cref = "PendingAccepts" />, as far as <see cref = "MaxConnections" /> allows.
+        /// </summary>
+        private void Accept() {
+            while (true) {
+                lock (_sync) {
+                    if (!_running || _pendingAccepts >= PendingAccepts || _pendingAccepts + _activeRequests >= MaxConnections) {
+                        return;
+                    }
+                    _pendingAccepts++;
+                }
+
+                Task<HttpListenerContext> accept;
+                try {
+                    accept = Task.Factory.FromAsync<HttpListenerContext>(_listener.BeginGetContext, _listener.EndGetContext, _listener);
+                }
+                catch (Exception e) {
+                    // stopped under us.
+                    lock (_sync) {
+                        _pendingAccepts--;
+                    }
+                    if (_running) {
+                        Console.WriteLine("HTTP Server Error: {0}", e.Message);
+                    }
+                    return;
+                }
+
+                // not attached to the parent: each accept would otherwise be the child of the one before it,
+                // and the chain of them would live as long as the server does.
+                accept.ContinueWith(OnAccepted);
+            }
+        }
+
+        private void OnAccepted(Task<HttpListenerContext> antecedent) {
+            if (antecedent.IsFaulted) {
+                // the listener has been stopped (or a connection was dropped before it was accepted).
+                var e = antecedent.Exception.GetBaseException();
+                lock (_sync) {
+                    _pendingAccepts--;
+                }
+                if (_running) {
+                    Console.WriteLine("HTTP Server Error: {0}", e.Message);
+                    Accept();
+                }
+                return;
+            }
+
+            lock (_sync) {
+                _pendingAccepts--;
+                _activeRequests++;
+            }
+            Accept(); // start a new listener.
+
+            var context = antecedent.Result;
+            try {
+                if (Serve(context)) {
+                    // the file is on its way; the transfer calls Completed when it's done.
+                    return;
+                }
+            }
+            catch (Exception e) {
+                Console.WriteLine("HTTP Server Error: {0}", e.Message);
+                context.Response.Abort();
+            }
+            Completed();
+        }
+
+        private void Completed() {
+            lock (_sync) {
+                _activeRequests--;
+            }
+            Accept();
+        }
+
+        /// <summary>
+        ///   Answers a request. Returns true if a file transfer was started (which finishes the request itself), false if the request is done with.
+        /// </summary>
+        private bool Serve(HttpListenerContext context) {
+            var request = context.Request;
+            var response = context.Response;
+            var lp = GetLocalPath(request.Url);
+
+            switch (request.HttpMethod) {
+                case "HEAD":
+                    if (Exists(lp)) {
+                        response.AddHeader("Last-Modified", GetLocationLastModified(lp).ToString("r"));
+                        response.ContentLength64 = GetContentLength(lp);
+                        if (File.Exists(lp)) {
+                            response.AddHeader("Accept-Ranges", "bytes");
                         }
+                    } else {
+                        response.StatusCode = (int)HttpStatusCode.NotFound;
+                    }
+                    response.Close();
+                    return false;
+
+                case "GET":
+                    if (!Exists(lp)) {
+                        response.StatusCode = (int)HttpStatusCode.NotFound;
+                        response.Close();
+                        return false;
                     }
-                    catch( Exception e) {
-                        Console.WriteLine("HTTP Server Error: {0}",e.Message);
+                    var lastModified = GetLocationLastModified(lp).ToString("r");
+                    response.AddHeader("Last-Modified", lastModified);
+                    if (Directory.Exists(lp)) {
+                        response.ContentType = "text/html";
+                        var buf = GetDirectoryListing(lp).ToByteArray();
+                        response.ContentLength64 = buf.Length;
+                        response.OutputStream.Write(buf, 0, buf.Length);
+                        response.OutputStream.Flush();
+                        response.Close();
+                        return false;
                     }
-                }, TaskContinuationOptions.AttachedToParent);
+                    return SendFile(context, lp, lastModified);
+
+                default:
+                    // (POST included; nothing here takes uploads.)
+                    Console.WriteLine("Unknown HTTP VERB : {0}", request.HttpMethod);
+                    response.StatusCode = (int)HttpStatusCode.MethodNotAllowed;
+                    response.AddHeader("Allow", "GET, HEAD");
+                    response.Close();
+                    return false;
+            }
         }
 
-        public void Stop() {
-            // _listener.Abort();
-            _listener.Stop();
+        private bool SendFile(HttpListenerContext context, string localPath, string lastModified) {
+            var request = context.Request;
+            var response = context.Response;
+            var file = new FileStream(localPath, FileMode.Open, FileAccess.Read, FileShare.Read, 4096, FileOptions.SequentialScan);
+            try {
+                var length = file.Length;
+                var first = 0L;
+                var count = length;
+
+                response.AddHeader("Accept-Ranges", "bytes");
+                var range = request.Headers["Range"];
+                var ifRange = request.Headers["If-Range"];
+                long rangeFirst, rangeLast;
+                // a range is only good against the version of the file the client already has part of.
+                if (range != null && (ifRange == null || ifRange == lastModified) && TryParseRange(range, length, out rangeFirst, out rangeLast)) {
+                    if (rangeFirst >= length) {
+                        response.StatusCode = (int)HttpStatusCode.RequestedRangeNotSatisfiable;
+                        response.AddHeader("Content-Range", string.Format(CultureInfo.InvariantCulture, "bytes */{0}", length));
+                        response.Close();
+                        file.Close();
+                        return false;
+                    }
+                    first = rangeFirst;
+                    count = rangeLast - rangeFirst + 1;
+                    response.StatusCode = (int)HttpStatusCode.PartialContent;
+                    response.AddHeader("Content-Range", string.Format(CultureInfo.InvariantCulture, "bytes {0}-{1}/{2}", rangeFirst, rangeLast, length));
+                }
+
+                response.SendChunked = false;
+                response.ContentLength64 = count;
+                if (count == 0) {
+                    response.Close();
+                    file.Close();
+                    return false;
+                }
+                file.Position = first;
+                new FileTransfer(this, context, file, count).Start();
+                return true;
+            }
+            catch {
+                file.Close();
+                throw;
+            }
+        }
+
+        /// <summary>
+        ///   Parses a Range header for a single range of bytes ("bytes=first-last", "bytes=first-" or "bytes=-suffix").
+        /// </summary>
+        /// <remarks>
+        ///   Returns false for anything else (several ranges, other units, nonsense), and the whole file is sent
+        ///   instead, as RFC 2616 allows. A range that starts at or past the end of the file comes back with
+        ///   <paramref name = "first" /> at or past <paramref name = "length" />; otherwise <paramref name = "last" /> is
+        ///   trimmed to the end of the file.
+        /// </remarks>
+        private static bool TryParseRange(string header, long length, out long first, out long last) {
+            first = last = 0;
+            header = header.Trim();
+            if (!header.StartsWith("bytes=", StringComparison.OrdinalIgnoreCase)) {
+                return false;
+            }
+            var spec = header.Substring(6).Trim();
+            var dash = spec.IndexOf('-');
+            if (dash < 0 || spec.IndexOf(',') >= 0) {
+                return false;
+            }
+
+            var from = spec.Substring(0, dash).Trim();
+            var to = spec.Substring(dash + 1).Trim();
+            long value;
+            if (from.Length == 0) {
+                // the last n bytes.
+                if (!long.TryParse(to, NumberStyles.None, CultureInfo.InvariantCulture, out value)) {
+                    return false;
+                }
+                if (value == 0) {
+                    first = length;
+                    return true;
+                }
+                first = Math.Max(0, length - value);
+                last = length - 1;
+                return true;
+            }
+
+            if (!long.TryParse(from, NumberStyles.None, CultureInfo.InvariantCulture, out first)) {
+                return false;
+            }
+            if (to.Length == 0) {
+                last = length - 1;
+                return true;
+            }
+            if (!long.TryParse(to, NumberStyles.None, CultureInfo.InvariantCulture, out value) || value < first) {
+                return false;
+            }
+            last = Math.Min(value, length - 1);
+            return true;
+        }
+
+        private byte[] RentBuffer() {
+            byte[] buffer;
+            while (_buffers.TryPop(out buffer)) {
+                if (buffer.Length == BufferSize) {
+                    return buffer;
+                }
+            }
+            return new byte[BufferSize];
         }
 
+        private void ReturnBuffer(byte[] buffer) {
+            // (the count is only approximate, with other threads at it; that's fine.)
+            if (buffer.Length == BufferSize && _buffers.Count < MaxConnections) {
+                _buffers.Push(buffer);
+            }
+        }
+
+        /// <summary>
+        ///   Copies (part of) a file to a response, a buffer at a time: a read from the file, then an asynchronous
+        ///   write to the client, so a slow client holds on to a buffer but not to a thread.
+        /// </summary>
+        private class FileTransfer {
+            private readonly HttpServer _server;
+            private readonly HttpListenerContext _context;
+            private readonly FileStream _file;
+            private readonly Stream _output;
+            private long _remaining;
+            private byte[] _buffer;
+
+            internal FileTransfer(HttpServer server, HttpListenerContext context, FileStream file, long count) {
+                _server = server;
+                _context = context;
+                _file = file;
+                _output = context.Response.OutputStream;
+                _remaining = count;
+            }
+
+            internal void Start() {
+                _buffer = _server.RentBuffer();
+                Next();
+            }
+
+            private void Next() {
+                while (_remaining > 0) {
+                    int read;
+                    try {
+                        read = _file.Read(_buffer, 0, (int)Math.Min(_buffer.Length, _remaining));
+                    }
+                    catch (Exception e) {
+                        Console.WriteLine("HTTP Server Error: {0}", e.Message);
+                        Finish(false);
+                        return;
+                    }
+                    if (read == 0) {
+                        // the file got shorter under us; there's no way to tell the client but to drop the connection.
+                        Finish(false);
+                        return;
+                    }
+                    _remaining -= read;
+
+                    try {
+                        var result = _output.BeginWrite(_buffer, 0, read, OnWritten, null);
+                        if (!result.CompletedSynchronously) {
+                            return;
+                        }
+                        _output.EndWrite(result);
+                    }
+                    catch (Exception) {
+                        // the client went away (or gave up on a segment); nothing to report.
+                        Finish(false);
+                        return;
+                    }
+                }
+                Finish(true);
+            }
+
+            private void OnWritten(IAsyncResult result) {
+                if (result.CompletedSynchronously) {
+                    // Next carries on from here itself.
+                    return;
+                }
+                try {
+                    _output.EndWrite(result);
+                }
+                catch (Exception) {
+                    // (as above.)
+                    Finish(false);
+                    return;
+                }
+                Next();
+            }
+
+            private void Finish(bool succeeded) {
+                _file.Close();
+                _server.ReturnBuffer(_buffer);
+                _buffer = null;
+                try {
+                    if (succeeded) {
+                        _context.Response.Close();
+                    }
+                    else {
+                        _context.Response.Abort();
+                    }
+                }
+                catch (Exception) {
+                    _context.Response.Abort();
+                }
+                _server.Completed();
+            }
+        }
     }
 }
@@ -51,6 +51,11 @@ namespace CoApp.Toolkit.PackageFormatHandlers {
         /// <param name="path"></param>
         /// <returns></returns>
         internal static bool HasCoAppProperties(string localPackagePath) {
+            var properties = ReadMsiPropertiesDirectly(localPackagePath);
+            if (properties != null) {
+                return properties.ContainsKey("CoAppPackageFeed") && properties.ContainsKey("CoAppCompositionData");
+            }
+
             lock (typeof (MSIBase)) {
                 try {
                     using (var database = new Database(localPackagePath, DatabaseOpenMode.ReadOnly)) {
@@ -73,6 +78,19 @@ namespace CoApp.Toolkit.PackageFormatHandlers {
         /// <returns></returns>
         /// <remarks></remarks>
         internal static Package GetCoAppPackageFileInformation(string localPackagePath) {
+            string atomFeedText;
+            return GetCoAppPackageFileInformation(localPackagePath, out atomFeedText);
+        }
+
+        /// <summary>
+        /// Gets the package for a CoApp MSI, along with the package feed text it was read from (so that the caller can cache it).
+        /// </summary>
+        /// <param name="localPackagePath">The local package path.</param>
+        /// <param name="atomFeedText">The package feed text; null if it's not a CoApp package.</param>
+        /// <returns>the package; null if it's not a CoApp package.</returns>
+        /// <remarks></remarks>
+        internal static Package GetCoAppPackageFileInformation(string localPackagePath, out string atomFeedText) {
+            atomFeedText = null;
             if (!IsCoAppPackageFile(localPackagePath)) {
                 return null;
             }
@@ -80,9 +98,21 @@ namespace CoApp.Toolkit.PackageFormatHandlers {
             var packageProperties = GetMsiProperties(localPackagePath);
 
             // pull out the rules & feed, send the info to the pm. 
-            var atomFeedText = packageProperties["CoAppPackageFeed"];
+            atomFeedText = packageProperties["CoAppPackageFeed"];
             var productCode = new Guid( packageProperties["ProductCode"] );
 
+            return GetCoAppPackageFromFeed(localPackagePath, productCode, atomFeedText);
+        }
+
+        /// <summary>
+        /// Gets the package for a CoApp MSI from its package feed text, without opening the MSI.
+        /// </summary>
+        /// <param name="localPackagePath">The local package path.</param>
+        /// <param name="productCode">The product code of the MSI.</param>
+        /// <param name="atomFeedText">The package feed text from the MSI.</param>
+        /// <returns></returns>
+        /// <remarks></remarks>
+        internal static Package GetCoAppPackageFromFeed(string localPackagePath, Guid productCode, string atomFeedText) {
             var feed = AtomFeed.Load(atomFeedText);
             var result = feed.Packages.Where(each => each.ProductCode == productCode).ToArray().FirstOrDefault();
             
@@ -0,0 +1,377 @@
+﻿//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Toolkit.PackageFormatHandlers {
+    using System;
+    using System.Collections.Generic;
+    using System.IO;
+    using System.IO.MemoryMappedFiles;
+    using System.Text;
+
+    /// <summary>
+    /// A read-only reader for OLE compound files (the container format that MSIs are stored in).
+    ///
+    /// The file is memory-mapped, and nothing is cached but the allocation tables and the directory,
+    /// so any number of threads can read streams from the same instance at once.
+    /// </summary>
+    /// <remarks>
+    /// See [MS-CFB]: Compound File Binary File Format.
+    /// Only the streams at the root of the file are exposed; that's all an MSI database uses.
+    /// </remarks>
+    public class CompoundFile : IDisposable {
+        private const int HeaderSize = 512;
+        private const int DirectoryEntrySize = 128;
+        private const int HeaderDifatEntries = 109;
+
+        private const uint MaxRegularSector = 0xFFFFFFFA;
+        private const uint EndOfChain = 0xFFFFFFFE;
+        private const uint FreeSector = 0xFFFFFFFF;
+        private const uint NoStream = 0xFFFFFFFF;
+
+        private const byte StreamObject = 2;
+        private const byte RootStorageObject = 5;
+
+        private static readonly byte[] Signature = new byte[] { 0xD0, 0xCF, 0x11, 0xE0, 0xA1, 0xB1, 0x1A, 0xE1 };
+
+        private readonly MemoryMappedFile _file;
+        private readonly MemoryMappedViewAccessor _view;
+        private readonly long _length;
+
+        private readonly int _sectorSize;
+        private readonly int _miniSectorSize;
+        private readonly uint _miniStreamCutoff;
+        private readonly uint[] _fat;
+        private readonly uint[] _miniFat;
+        private readonly DirectoryEntry _root;
+        private readonly Dictionary<string, DirectoryEntry> _streams = new Dictionary<string, DirectoryEntry>(StringComparer.Ordinal);
+        private byte[] _miniStream;
+
+        private class DirectoryEntry {
+            internal string Name;
+            internal byte Type;
+            internal uint LeftSibling;
+            internal uint RightSibling;
+            internal uint Child;
+            internal uint StartSector;
+            internal long Size;
+        }
+
+        /// <summary>
+        /// Opens a compound file for reading.
+        /// </summary>
+        /// <param name="filename">The filename.</param>
+        /// <exception cref="InvalidDataException">The file is not a valid compound file.</exception>
+        /// <remarks></remarks>
+        public CompoundFile(string filename) {
+            var fileStream = new FileStream(filename, FileMode.Open, FileAccess.Read, FileShare.ReadWrite | FileShare.Delete);
+            try {
+                _length = fileStream.Length;
+                if (_length < HeaderSize) {
+                    throw new InvalidDataException("File is too small to be a compound file.");
+                }
+
+                _file = MemoryMappedFile.CreateFromFile(fileStream, null, 0, MemoryMappedFileAccess.Read, null, HandleInheritability.None, false);
+            }
+            catch {
+                fileStream.Dispose();
+                throw;
+            }
+
+            try {
+                _view = _file.CreateViewAccessor(0, 0, MemoryMappedFileAccess.Read);
+
+                var header = Read(0, HeaderSize);
+                for (var i = 0; i < Signature.Length; i++) {
+                    if (header[i] != Signature[i]) {
+                        throw new InvalidDataException("File is not a compound file.");
+                    }
+                }
+
+                var majorVersion = BitConverter.ToUInt16(header, 0x1A);
+                var sectorShift = BitConverter.ToUInt16(header, 0x1E);
+                var miniSectorShift = BitConverter.ToUInt16(header, 0x20);
+                if ((sectorShift != 9 && sectorShift != 12) || miniSectorShift != 6) {
+                    throw new InvalidDataException("Unsupported compound file sector size.");
+                }
+
+                _sectorSize = 1 << sectorShift;
+                _miniSectorSize = 1 << miniSectorShift;
+                _miniStreamCutoff = BitConverter.ToUInt32(header, 0x38);
+
+                var fatSectorCount = BitConverter.ToUInt32(header, 0x2C);
+                var firstDirectorySector = BitConverter.ToUInt32(header, 0x30);
+                var firstMiniFatSector = BitConverter.ToUInt32(header, 0x3C);
+                var firstDifatSector = BitConverter.ToUInt32(header, 0x44);
+
+                _fat = ReadFat(header, fatSectorCount, firstDifatSector);
+                _miniFat = ToUInt32Array(ReadChain(firstMiniFatSector, -1));
+
+                var directory = ReadChain(firstDirectorySector, -1);
+                var entries = new DirectoryEntry[directory.Length / DirectoryEntrySize];
+                for (var i = 0; i < entries.Length; i++) {
+                    entries[i] = ReadDirectoryEntry(directory, i * DirectoryEntrySize, majorVersion);
+                }
+
+                if (entries.Length == 0 || entries[0].Type != RootStorageObject) {
+                    throw new InvalidDataException("Compound file has no root storage.");
+                }
+                _root = entries[0];
+
+                // the children of a storage are kept in a red-black tree; we just need them all.
+                var pending = new Stack<uint>();
+                var visited = new HashSet<uint>();
+                pending.Push(_root.Child);
+                while (pending.Count > 0) {
+                    var index = pending.Pop();
+                    if (index == NoStream || index >= entries.Length || !visited.Add(index)) {
+                        continue;
+                    }
+                    var entry = entries[index];
+                    if (entry.Type == StreamObject) {
+                        _streams[entry.Name] = entry;
+                    }
+                    pending.Push(entry.LeftSibling);
+                    pending.Push(entry.RightSibling);
+                }
+            }
+            catch {
+                Dispose();
+                throw;
+            }
+        }
+
+        /// <summary>
+        /// Checks whether a file starts with the compound file signature (without reading any further).
+        /// </summary>
+        /// <param name="filename">The filename.</param>
+        /// <returns><c>true</c> if the file can be read and has the signature.</returns>
+        /// <remarks></remarks>
+        public static bool HasSignature(string filename) {
+            try {
+                using (var fileStream = new FileStream(filename, FileMode.Open, FileAccess.Read, FileShare.ReadWrite | FileShare.Delete)) {
+                    var header = new byte[Signature.Length];
+                    if (fileStream.Read(header, 0, header.Length) != header.Length) {
+                        return false;
+                    }
+                    for (var i = 0; i < Signature.Length; i++) {
+                        if (header[i] != Signature[i]) {
+                            return false;
+                        }
+                    }
+                    return true;
+                }
+            }
+            catch {
+                return false;
+            }
+        }
+
+        /// <summary>
+        /// Gets the names of the streams at the root of the file.
+        /// </summary>
+        public IEnumerable<string> StreamNames {
+            get { return _streams.Keys; }
+        }
+
+        public bool HasStream(string name) {
+            return _streams.ContainsKey(name);
+        }
+
+        /// <summary>
+        /// Gets the length of a stream.
+        /// </summary>
+        /// <param name="name">The stream name.</param>
+        /// <returns>the length, or -1 if there is no such stream.</returns>
+        public long GetStreamLength(string name) {
+            DirectoryEntry entry;
+            return _streams.TryGetValue(name, out entry) ? entry.Size : -1;
+        }
+
+        /// <summary>
+        /// Reads the whole of a stream.
+        /// </summary>
+        /// <param name="name">The stream name.</param>
+        /// <returns>the stream contents, or null if there is no such stream.</returns>
+        /// <remarks></remarks>
+        public byte[] ReadStream(string name) {
+            DirectoryEntry entry;
+            if (!_streams.TryGetValue(name, out entry)) {
+                return null;
+            }
+
+            if (entry.Size >= _miniStreamCutoff) {
+                return ReadChain(entry.StartSector, entry.Size);
+            }
+
+            // small streams live in the mini stream, in 64 byte sectors.
+            var miniStream = MiniStream;
+            var result = new byte[entry.Size];
+            var sector = entry.StartSector;
+            for (var offset = 0; offset < result.Length; offset += _miniSectorSize) {
+                if (sector > MaxRegularSector || sector >= _miniFat.Length) {
+                    throw new InvalidDataException("Mini stream chain is broken.");
+                }
+                var position = (long)sector * _miniSectorSize;
+                var count = Math.Min(_miniSectorSize, result.Length - offset);
+                if (position + count > miniStream.Length) {
+                    throw new InvalidDataException("Mini stream chain is out of range.");
+                }
+                Buffer.BlockCopy(miniStream, (int)position, result, offset, count);
+                sector = _miniFat[sector];
+            }
+            return result;
+        }
+
+        private byte[] MiniStream {
+            get {
+                // benign race: two threads may both read it, and one copy wins.
+                return _miniStream ?? (_miniStream = ReadChain(_root.StartSector, _root.Size));
+            }
+        }
+
+        private uint[] ReadFat(byte[] header, uint fatSectorCount, uint firstDifatSector) {
+            var entriesPerSector = _sectorSize / 4;
+            var fatSectors = new List<uint>();
+
+            for (var i = 0; i < HeaderDifatEntries && fatSectors.Count < fatSectorCount; i++) {
+                var sector = BitConverter.ToUInt32(header, 0x4C + i * 4);
+                if (sector > MaxRegularSector) {
+                    break;
+                }
+                fatSectors.Add(sector);
+            }
+
+            // the rest of the FAT sector list is in a chain of DIFAT sectors; the last entry of each points to the next.
+            var difatSector = firstDifatSector;
+            for (var guard = 0; fatSectors.Count < fatSectorCount && difatSector <= MaxRegularSector; guard++) {
+                if (guard > fatSectorCount) {
+                    throw new InvalidDataException("DIFAT chain is broken.");
+                }
+                var difat = Read(SectorOffset(difatSector), _sectorSize);
+                for (var i = 0; i < entriesPerSector - 1 && fatSectors.Count < fatSectorCount; i++) {
+                    var sector = BitConverter.ToUInt32(difat, i * 4);
+                    if (sector > MaxRegularSector) {
+                        break;
+                    }
+                    fatSectors.Add(sector);
+                }
+                difatSector = BitConverter.ToUInt32(difat, (entriesPerSector - 1) * 4);
+            }
+
+            var fat = new uint[fatSectors.Count * entriesPerSector];
+            for (var i = 0; i < fatSectors.Count; i++) {
+                var sector = Read(SectorOffset(fatSectors[i]), _sectorSize);
+                Buffer.BlockCopy(sector, 0, fat, i * _sectorSize, _sectorSize);
+            }
+            return fat;
+        }
+
+        /// <summary>
+        /// Reads a chain of regular sectors.
+        /// </summary>
+        /// <param name="startSector">The start sector.</param>
+        /// <param name="size">The number of bytes to read; -1 to read the whole chain.</param>
+        /// <returns></returns>
+        private byte[] ReadChain(uint startSector, long size) {
+            var runs = new List<KeyValuePair<uint, int>>();
+            var sectors = 0;
+            var sector = startSector;
+
+            // follow the chain, gathering runs of contiguous sectors so that they can be copied in one go.
+            while (sector <= MaxRegularSector && (size < 0 || (long)sectors * _sectorSize < size)) {
+                if (sector >= _fat.Length || sectors > _fat.Length) {
+                    throw new InvalidDataException("Sector chain is broken.");
+                }
+                if (runs.Count > 0 && runs[runs.Count - 1].Key + runs[runs.Count - 1].Value == sector) {
+                    runs[runs.Count - 1] = new KeyValuePair<uint, int>(runs[runs.Count - 1].Key, runs[runs.Count - 1].Value + 1);
+                }
+                else {
+                    runs.Add(new KeyValuePair<uint, int>(sector, 1));
+                }
+                sectors++;
+                sector = _fat[sector];
+            }
+
+            var length = (long)sectors * _sectorSize;
+            if (size >= 0) {
+                if (size > length) {
+                    throw new InvalidDataException("Stream is longer than its sector chain.");
+                }
+                length = size;
+            }
+
+            var result = new byte[length];
+            var offset = 0;
+            foreach (var run in runs) {
+                var count = (int)Math.Min((long)run.Value * _sectorSize, length - offset);
+                ReadInto(SectorOffset(run.Key), result, offset, count);
+                offset += count;
+            }
+            return result;
+        }
+
+        private DirectoryEntry ReadDirectoryEntry(byte[] directory, int offset, int majorVersion) {
+            var nameLength = Math.Min((int)BitConverter.ToUInt16(directory, offset + 0x40), 64);
+            var size = BitConverter.ToInt64(directory, offset + 0x78);
+            if (majorVersion == 3) {
+                // version 3 files only use the low 32 bits; the rest may be garbage.
+                size &= 0xFFFFFFFF;
+            }
+
+            return new DirectoryEntry {
+                Name = nameLength > 2 ? Encoding.Unicode.GetString(directory, offset, nameLength - 2) : string.Empty,
+                Type = directory[offset + 0x42],
+                LeftSibling = BitConverter.ToUInt32(directory, offset + 0x44),
+                RightSibling = BitConverter.ToUInt32(directory, offset + 0x48),
+                Child = BitConverter.ToUInt32(directory, offset + 0x4C),
+                StartSector = BitConverter.ToUInt32(directory, offset + 0x74),
+                Size = size,
+            };
+        }
+
+        private long SectorOffset(uint sector) {
+            return ((long)sector + 1) * _sectorSize;
+        }
+
+        private byte[] Read(long offset, int count) {
+            var result = new byte[count];
+            ReadInto(offset, result, 0, count);
+            return result;
+        }
+
+        private void ReadInto(long position, byte[] buffer, int offset, int count) {
+            if (position < 0 || position + count > _length) {
+                // the last sector of a file is allowed to be short.
+                if (position < _length) {
+                    count = (int)(_length - position);
+                }
+                else {
+                    throw new InvalidDataException("Sector is past the end of the file.");
+                }
+            }
+            _view.ReadArray(position, buffer, offset, count);
+        }
+
+        private static uint[] ToUInt32Array(byte[] bytes) {
+            var result = new uint[bytes.Length / 4];
+            Buffer.BlockCopy(bytes, 0, result, 0, result.Length * 4);
+            return result;
+        }
+
+        public void Dispose() {
+            if (_view != null) {
+                _view.Dispose();
+            }
+            if (_file != null) {
+                _file.Dispose();
+            }
+        }
+    }
+}
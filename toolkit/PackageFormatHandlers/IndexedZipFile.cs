@@ -0,0 +1,330 @@
+﻿//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Toolkit.PackageFormatHandlers {
+    using System;
+    using System.Collections.Generic;
+    using System.IO;
+    using System.IO.MemoryMappedFiles;
+    using System.Text;
+    using Extensions;
+    using Ionic.Crc;
+    using Ionic.Zlib;
+
+    /// <summary>
+    /// A file inside a zip archive, as described by the archive's central directory.
+    /// </summary>
+    /// <remarks></remarks>
+    public class IndexedZipEntry {
+        public string Name { get; internal set; }
+        public long CompressedSize { get; internal set; }
+        public long UncompressedSize { get; internal set; }
+        public int Crc32 { get; internal set; }
+        internal int Method;
+        internal int Flags;
+        internal long LocalHeaderOffset;
+
+        public bool IsDirectory {
+            get { return Name.EndsWith("/") || Name.EndsWith("\\"); }
+        }
+    }
+
+    /// <summary>
+    /// A read-only, random-access reader for zip archives.
+    ///
+    /// Only the central directory is read up front; each entry is read straight out of the memory-mapped archive when it's
+    /// asked for, so pulling one file out of a large archive touches nothing else in it. Entries can be read by any
+    /// number of threads at once.
+    /// </summary>
+    /// <remarks>
+    /// See the PKWARE APPNOTE. Handles Zip64 archives; entries must be stored or deflated, and not encrypted.
+    /// </remarks>
+    public class IndexedZipFile : IDisposable {
+        private const int EndOfCentralDirectorySignature = 0x06054b50;
+        private const int Zip64EndOfCentralDirectorySignature = 0x06064b50;
+        private const int Zip64LocatorSignature = 0x07064b50;
+        private const int CentralDirectorySignature = 0x02014b50;
+        private const int LocalHeaderSignature = 0x04034b50;
+
+        private const int EndOfCentralDirectorySize = 22;
+        private const int Zip64LocatorSize = 20;
+        private const int Zip64EndOfCentralDirectorySize = 56;
+        private const int CentralDirectoryEntrySize = 46;
+        private const int LocalHeaderSize = 30;
+        private const int MaxCommentSize = 0xFFFF;
+
+        private const int Stored = 0;
+        private const int Deflated = 8;
+        private const int EncryptedFlag = 0x0001;
+        private const int Utf8NameFlag = 0x0800;
+
+        private static readonly Encoding DefaultNameEncoding = Encoding.GetEncoding(437);
+
+        private readonly MemoryMappedFile _file;
+        private readonly long _length;
+        private readonly List<IndexedZipEntry> _entries = new List<IndexedZipEntry>();
+
+        /// <summary>
+        /// Opens a zip archive and reads its central directory.
+        /// </summary>
+        /// <param name="filename">The filename.</param>
+        /// <exception cref="InvalidDataException">The file is not a valid zip archive.</exception>
+        /// <remarks></remarks>
+        public IndexedZipFile(string filename) {
+            var fileStream = new FileStream(filename, FileMode.Open, FileAccess.Read, FileShare.ReadWrite | FileShare.Delete);
+            try {
+                _length = fileStream.Length;
+                if (_length < EndOfCentralDirectorySize) {
+                    throw new InvalidDataException("File is too small to be a zip archive.");
+                }
+
+                _file = MemoryMappedFile.CreateFromFile(fileStream, null, 0, MemoryMappedFileAccess.Read, null, HandleInheritability.None, false);
+            }
+            catch {
+                fileStream.Dispose();
+                throw;
+            }
+
+            try {
+                ReadCentralDirectory();
+            }
+            catch {
+                Dispose();
+                throw;
+            }
+        }
+
+        /// <summary>
+        /// Gets the entries in the archive, in central directory order.
+        /// </summary>
+        public IEnumerable<IndexedZipEntry> Entries {
+            get { return _entries.AsReadOnly(); }
+        }
+
+        private void ReadCentralDirectory() {
+            // the end record is at the very end, unless there's a comment after it.
+            var tailLength = (int)Math.Min(_length, EndOfCentralDirectorySize + MaxCommentSize);
+            var tail = Read(_length - tailLength, tailLength);
+
+            var end = -1;
+            for (var i = tailLength - EndOfCentralDirectorySize; i >= 0; i--) {
+                if (BitConverter.ToInt32(tail, i) == EndOfCentralDirectorySignature && i + EndOfCentralDirectorySize + BitConverter.ToUInt16(tail, i + 20) <= tailLength) {
+                    end = i;
+                    break;
+                }
+            }
+            if (end < 0) {
+                throw new InvalidDataException("File is not a zip archive.");
+            }
+
+            long entryCount = BitConverter.ToUInt16(tail, end + 10);
+            long directorySize = BitConverter.ToUInt32(tail, end + 12);
+            long directoryOffset = BitConverter.ToUInt32(tail, end + 16);
+
+            // anything too big for the end record is in the Zip64 one, which the locator just in front of it points to.
+            var endPosition = _length - tailLength + end;
+            if (entryCount == 0xFFFF || directorySize == 0xFFFFFFFF || directoryOffset == 0xFFFFFFFF) {
+                if (endPosition < Zip64LocatorSize) {
+                    throw new InvalidDataException("Zip64 end of central directory locator is missing.");
+                }
+                var locator = Read(endPosition - Zip64LocatorSize, Zip64LocatorSize);
+                if (BitConverter.ToInt32(locator, 0) != Zip64LocatorSignature) {
+                    throw new InvalidDataException("Zip64 end of central directory locator is missing.");
+                }
+                var zip64End = Read(BitConverter.ToInt64(locator, 8), Zip64EndOfCentralDirectorySize);
+                if (BitConverter.ToInt32(zip64End, 0) != Zip64EndOfCentralDirectorySignature) {
+                    throw new InvalidDataException("Zip64 end of central directory is missing.");
+                }
+                entryCount = BitConverter.ToInt64(zip64End, 32);
+                directorySize = BitConverter.ToInt64(zip64End, 40);
+                directoryOffset = BitConverter.ToInt64(zip64End, 48);
+            }
+
+            if (directorySize > int.MaxValue || directoryOffset + directorySize > _length || entryCount > directorySize / CentralDirectoryEntrySize) {
+                throw new InvalidDataException("Zip central directory is out of range.");
+            }
+
+            var directory = Read(directoryOffset, (int)directorySize);
+            var offset = 0;
+            for (long i = 0; i < entryCount; i++) {
+                if (offset + CentralDirectoryEntrySize > directory.Length || BitConverter.ToInt32(directory, offset) != CentralDirectorySignature) {
+                    throw new InvalidDataException("Zip central directory is corrupt.");
+                }
+                offset = ReadDirectoryEntry(directory, offset);
+            }
+        }
+
+        /// <summary>
+        /// Reads one central directory entry, and returns the offset of the next one.
+        /// </summary>
+        private int ReadDirectoryEntry(byte[] directory, int offset) {
+            var flags = BitConverter.ToUInt16(directory, offset + 8);
+            var nameLength = BitConverter.ToUInt16(directory, offset + 28);
+            var extraLength = BitConverter.ToUInt16(directory, offset + 30);
+            var commentLength = BitConverter.ToUInt16(directory, offset + 32);
+            var next = offset + CentralDirectoryEntrySize + nameLength + extraLength + commentLength;
+            if (next > directory.Length) {
+                throw new InvalidDataException("Zip central directory is corrupt.");
+            }
+
+            var entry = new IndexedZipEntry {
+                Name = ((flags & Utf8NameFlag) != 0 ? Encoding.UTF8 : DefaultNameEncoding).GetString(directory, offset + CentralDirectoryEntrySize, nameLength),
+                Flags = flags,
+                Method = BitConverter.ToUInt16(directory, offset + 10),
+                Crc32 = BitConverter.ToInt32(directory, offset + 16),
+                CompressedSize = BitConverter.ToUInt32(directory, offset + 20),
+                UncompressedSize = BitConverter.ToUInt32(directory, offset + 24),
+                LocalHeaderOffset = BitConverter.ToUInt32(directory, offset + 42),
+            };
+
+            // the Zip64 extra field has the real values of whichever of those didn't fit (in this order).
+            var extra = offset + CentralDirectoryEntrySize + nameLength;
+            var extraEnd = extra + extraLength;
+            while (extra + 4 <= extraEnd) {
+                var id = BitConverter.ToUInt16(directory, extra);
+                var size = BitConverter.ToUInt16(directory, extra + 2);
+                var field = extra + 4;
+                extra = field + size;
+                if (id != 0x0001 || extra > extraEnd) {
+                    continue;
+                }
+                if (entry.UncompressedSize == 0xFFFFFFFF && field + 8 <= extra) {
+                    entry.UncompressedSize = BitConverter.ToInt64(directory, field);
+                    field += 8;
+                }
+                if (entry.CompressedSize == 0xFFFFFFFF && field + 8 <= extra) {
+                    entry.CompressedSize = BitConverter.ToInt64(directory, field);
+                    field += 8;
+                }
+                if (entry.LocalHeaderOffset == 0xFFFFFFFF && field + 8 <= extra) {
+                    entry.LocalHeaderOffset = BitConverter.ToInt64(directory, field);
+                }
+            }
+
+            _entries.Add(entry);
+            return next;
+        }
+
+        /// <summary>
+        /// Opens an entry for reading. The data is not checked against the entry's CRC.
+        /// </summary>
+        /// <param name="entry">The entry.</param>
+        /// <returns>a stream of the uncompressed contents of the entry</returns>
+        /// <exception cref="InvalidDataException">The entry can't be read.</exception>
+        /// <remarks></remarks>
+        public Stream OpenEntry(IndexedZipEntry entry) {
+            if ((entry.Flags & EncryptedFlag) != 0) {
+                throw new InvalidDataException("Zip entry '{0}' is encrypted.".format(entry.Name));
+            }
+            if (entry.Method != Stored && entry.Method != Deflated) {
+                throw new InvalidDataException("Zip entry '{0}' uses an unsupported compression method ({1}).".format(entry.Name, entry.Method));
+            }
+
+            // the local header repeats the name, and has its own (possibly different) extra field; the data is after that.
+            var header = Read(entry.LocalHeaderOffset, LocalHeaderSize);
+            if (BitConverter.ToInt32(header, 0) != LocalHeaderSignature) {
+                throw new InvalidDataException("Zip entry '{0}' has no local header.".format(entry.Name));
+            }
+            var dataOffset = entry.LocalHeaderOffset + LocalHeaderSize + BitConverter.ToUInt16(header, 26) + BitConverter.ToUInt16(header, 28);
+            if (dataOffset + entry.CompressedSize > _length) {
+                throw new InvalidDataException("Zip entry '{0}' is past the end of the file.".format(entry.Name));
+            }
+
+            if (entry.CompressedSize == 0) {
+                // (a view of length zero would be the whole rest of the file.)
+                return new MemoryStream(new byte[0], false);
+            }
+
+            Stream data = _file.CreateViewStream(dataOffset, entry.CompressedSize, MemoryMappedFileAccess.Read);
+            return entry.Method == Deflated ? new DeflateStream(data, CompressionMode.Decompress) : data;
+        }
+
+        /// <summary>
+        /// Copies an entry out to a file, checking its CRC as it goes.
+        ///
+        /// The file is written under a temporary name, and only swapped in for the destination when it's complete (and
+        /// checked), so the destination never holds a partial or corrupt file.
+        /// </summary>
+        /// <param name="entry">The entry.</param>
+        /// <param name="destination">The destination file; it is replaced if it already exists.</param>
+        /// <exception cref="InvalidDataException">The entry can't be read, or doesn't match its CRC.</exception>
+        /// <remarks></remarks>
+        public void ExtractEntry(IndexedZipEntry entry, string destination) {
+            var temporary = destination + "." + Path.GetRandomFileName();
+            try {
+                int crc;
+                long length;
+                using (var input = OpenEntry(entry)) {
+                    using (var output = new FileStream(temporary, FileMode.CreateNew, FileAccess.Write, FileShare.None)) {
+                        crc = new CRC32().GetCrc32AndCopy(input, output);
+                        length = output.Length;
+                    }
+                }
+
+                if (length != entry.UncompressedSize || crc != entry.Crc32) {
+                    throw new InvalidDataException("Zip entry '{0}' is corrupt (CRC or length mismatch).".format(entry.Name));
+                }
+
+                if (File.Exists(destination)) {
+                    File.Replace(temporary, destination, null);
+                }
+                else {
+                    File.Move(temporary, destination);
+                }
+            }
+            finally {
+                if (File.Exists(temporary)) {
+                    File.Delete(temporary);
+                }
+            }
+        }
+
+        /// <summary>
+        /// Determines whether a file holds exactly what an entry does: it's the same length, and matches the entry's CRC.
+        /// </summary>
+        /// <param name="entry">The entry.</param>
+        /// <param name="filename">The file (which need not exist).</param>
+        /// <returns>true if the file is a complete, intact copy of the entry</returns>
+        /// <remarks></remarks>
+        public static bool IsExtractedTo(IndexedZipEntry entry, string filename) {
+            try {
+                using (var file = new FileStream(filename, FileMode.Open, FileAccess.Read, FileShare.Read)) {
+                    return file.Length == entry.UncompressedSize && new CRC32().GetCrc32(file) == entry.Crc32;
+                }
+            }
+            catch (IOException) {
+                return false;
+            }
+            catch (UnauthorizedAccessException) {
+                return false;
+            }
+        }
+
+        private byte[] Read(long offset, int count) {
+            if (offset < 0 || offset + count > _length) {
+                throw new InvalidDataException("Zip archive is truncated.");
+            }
+
+            var result = new byte[count];
+            if (count > 0) {
+                using (var view = _file.CreateViewAccessor(offset, count, MemoryMappedFileAccess.Read)) {
+                    view.ReadArray(0, result, 0, count);
+                }
+            }
+            return result;
+        }
+
+        public void Dispose() {
+            if (_file != null) {
+                _file.Dispose();
+            }
+        }
+    }
+}
@@ -160,10 +160,11 @@ namespace CoApp.Toolkit.PackageFormatHandlers {
         /// <remarks></remarks>
         public static MsiProperties GetMsiProperties(string localPackagePath) {
 
-            localPackagePath = localPackagePath.ToLower();
+            // paths are cached without regard to case, but the file is opened by the path as given.
+            var cacheKey = localPackagePath.ToLower();
 
             try {
-                var result = SessionCache<MsiProperties>.Value[localPackagePath];
+                var result = SessionCache<MsiProperties>.Value[cacheKey];
                 if (result != null) {
                     return result;
                 }
@@ -172,6 +173,11 @@ namespace CoApp.Toolkit.PackageFormatHandlers {
                 // no worry.
             }
 
+            var managedResult = ReadMsiPropertiesDirectly(localPackagePath);
+            if (managedResult != null) {
+                return managedResult;
+            }
+
             try {
                 lock (typeof (MSIBase)) {
                     using (var database = new Database(localPackagePath, DatabaseOpenMode.ReadOnly)) {
@@ -189,7 +195,7 @@ namespace CoApp.Toolkit.PackageFormatHandlers {
                                 // if (SessionCache<MsiProperties>.Value[localPackagePath] != null) {
                                    //  return SessionCache<MsiProperties>.Value[localPackagePath];
                                 // }
-                                SessionCache<MsiProperties>.Value[localPackagePath] = result;
+                                SessionCache<MsiProperties>.Value[cacheKey] = result;
                             }
                             catch {
 
@@ -203,5 +209,36 @@ namespace CoApp.Toolkit.PackageFormatHandlers {
                 throw new InvalidPackageException(InvalidReason.NotValidMSI, localPackagePath);
             }
         }
+
+        /// <summary>
+        /// Reads the Property table straight out of the file with the managed reader.
+        /// 
+        /// This doesn't have to hold the MSI lock, so package scans can read many files in parallel.
+        /// </summary>
+        /// <param name="localPackagePath">The local package path.</param>
+        /// <returns>the properties; null if the managed reader can't read the file (the caller should fall back to MSI.DLL)</returns>
+        /// <remarks></remarks>
+        internal static MsiProperties ReadMsiPropertiesDirectly(string localPackagePath) {
+            try {
+                var result = new MsiProperties(localPackagePath);
+                foreach (var property in MsiDatabaseReader.GetProperties(localPackagePath)) {
+                    result.Add(property.Key, property.Value);
+                }
+
+                try {
+                    SessionCache<MsiProperties>.Value[localPackagePath.ToLower()] = result;
+                }
+                catch {
+                }
+                return result;
+            }
+            catch (Exception e) {
+                // most files the scans look at aren't MSIs at all; that's not worth a log entry. One that looks like an MSI, but that we couldn't read, is.
+                if (CompoundFile.HasSignature(localPackagePath)) {
+                    Logger.Message("Managed MSI reader failed on '{0}' ({1}); using MSI API", localPackagePath, e.Message);
+                }
+                return null;
+            }
+        }
     }
 }
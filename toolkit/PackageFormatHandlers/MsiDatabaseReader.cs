@@ -0,0 +1,366 @@
+﻿//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Toolkit.PackageFormatHandlers {
+    using System;
+    using System.Collections.Generic;
+    using System.IO;
+    using System.Linq;
+    using System.Text;
+
+    /// <summary>
+    /// Reads the tables of an MSI database straight out of the compound file, without going thru the Windows Installer API.
+    ///
+    /// Nothing here takes a global lock (unlike MSI.DLL, which has to be serialized), so lots of files can be
+    /// read in parallel when scanning for packages. It's read-only, and only understands what's needed to pull
+    /// rows out of tables: no views, no transforms, no summary information.
+    /// </summary>
+    /// <remarks>
+    /// The storage layout (stream name encoding, string pool, column-major tables) isn't documented by Microsoft;
+    /// this follows the layout used by the Wine implementation of MSI.
+    /// </remarks>
+    public class MsiDatabaseReader : IDisposable {
+        private const char TableStreamPrefix = (char)0x4840;
+
+        private const int ColumnTypeValid = 0x0100;
+        private const int ColumnTypeString = 0x0800;
+        private const int ColumnTypeNullable = 0x1000;
+        private const int ColumnTypeKey = 0x2000;
+
+        private readonly CompoundFile _compoundFile;
+        private readonly Dictionary<string, string> _tableStreams = new Dictionary<string, string>(StringComparer.Ordinal);
+        private readonly Dictionary<string, Column[]> _columns = new Dictionary<string, Column[]>(StringComparer.Ordinal);
+
+        private int _stringRefSize = 2;
+        private Encoding _encoding;
+        private byte[] _stringData;
+        private int[] _stringOffsets;
+        private int[] _stringLengths;
+        private string[] _strings;
+
+        private class Column {
+            internal string Name;
+            internal int Number;
+            internal int Type;
+
+            internal bool IsString {
+                get { return (Type & ColumnTypeString) != 0; }
+            }
+
+            internal bool IsBinary {
+                get { return (Type & ~ColumnTypeNullable) == (ColumnTypeString | ColumnTypeValid); }
+            }
+        }
+
+        /// <summary>
+        /// Opens an MSI database for reading.
+        /// </summary>
+        /// <param name="filename">The filename.</param>
+        /// <exception cref="InvalidDataException">The file is not an MSI database (or is damaged).</exception>
+        /// <remarks></remarks>
+        public MsiDatabaseReader(string filename) {
+            _compoundFile = new CompoundFile(filename);
+            try {
+                foreach (var streamName in _compoundFile.StreamNames) {
+                    var name = DecodeStreamName(streamName);
+                    if (name.Length > 1 && name[0] == TableStreamPrefix) {
+                        _tableStreams[name.Substring(1)] = streamName;
+                    }
+                }
+
+                LoadStringPool();
+                LoadCatalog();
+            }
+            catch {
+                _compoundFile.Dispose();
+                throw;
+            }
+        }
+
+        /// <summary>
+        /// Gets the names of the tables in the database.
+        /// </summary>
+        public IEnumerable<string> TableNames {
+            get { return _columns.Keys; }
+        }
+
+        public bool HasTable(string tableName) {
+            return _columns.ContainsKey(tableName);
+        }
+
+        /// <summary>
+        /// Gets the column names of a table, in column order.
+        /// </summary>
+        /// <param name="tableName">Name of the table.</param>
+        /// <returns></returns>
+        /// <remarks></remarks>
+        public IEnumerable<string> GetColumnNames(string tableName) {
+            Column[] columns;
+            return _columns.TryGetValue(tableName, out columns) ? columns.Select(each => each.Name) : Enumerable.Empty<string>();
+        }
+
+        /// <summary>
+        /// Reads all the rows from a table.
+        ///
+        /// Each row has one value per column: a string for string columns, an int for integer columns, and null
+        /// for null values. Binary columns (which refer to streams) are returned as null.
+        /// </summary>
+        /// <param name="tableName">Name of the table.</param>
+        /// <returns>the rows; empty if there is no such table.</returns>
+        /// <remarks></remarks>
+        public IList<object[]> ReadTable(string tableName) {
+            Column[] columns;
+            if (!_columns.TryGetValue(tableName, out columns)) {
+                return new List<object[]>();
+            }
+            return ReadRows(tableName, columns);
+        }
+
+        /// <summary>
+        /// Reads the Property table.
+        /// </summary>
+        /// <returns>the properties, by name</returns>
+        /// <remarks></remarks>
+        public Dictionary<string, string> ReadProperties() {
+            var result = new Dictionary<string, string>();
+            foreach (var row in ReadTable("Property")) {
+                var name = row[0] as string;
+                if (name != null) {
+                    result[name] = (row.Length > 1 ? row[1] as string : null) ?? string.Empty;
+                }
+            }
+            return result;
+        }
+
+        /// <summary>
+        /// Reads the Property table of an MSI file.
+        /// </summary>
+        /// <param name="filename">The filename.</param>
+        /// <returns></returns>
+        /// <remarks></remarks>
+        public static Dictionary<string, string> GetProperties(string filename) {
+            using (var reader = new MsiDatabaseReader(filename)) {
+                return reader.ReadProperties();
+            }
+        }
+
+        private void LoadStringPool() {
+            var pool = ReadTableStream("_StringPool");
+            var data = ReadTableStream("_StringData");
+            if (pool == null || data == null || pool.Length < 4) {
+                throw new InvalidDataException("MSI database has no string pool.");
+            }
+
+            var header = BitConverter.ToUInt16(pool, 2);
+            var codepage = BitConverter.ToUInt16(pool, 0) | ((header & 0x7FFF) << 16);
+            if ((header & 0x8000) != 0) {
+                // databases with lots of strings use three byte string references.
+                _stringRefSize = 3;
+            }
+
+            try {
+                _encoding = codepage == 0 ? Encoding.Default : Encoding.GetEncoding(codepage);
+            }
+            catch (Exception) {
+                _encoding = Encoding.UTF8;
+            }
+
+            // each entry is a pair of 16 bit words: length, refcount. string ids start at 1.
+            var entries = pool.Length / 4;
+            var offsets = new List<int> { 0 };
+            var lengths = new List<int> { 0 };
+            var offset = 0;
+
+            for (var i = 1; i < entries;) {
+                var length = (int)BitConverter.ToUInt16(pool, i * 4);
+                var refs = BitConverter.ToUInt16(pool, i * 4 + 2);
+
+                if (length == 0 && refs == 0) {
+                    // unused id.
+                    offsets.Add(offset);
+                    lengths.Add(0);
+                    i++;
+                    continue;
+                }
+
+                if (length == 0) {
+                    // strings over 64k: the length is in the entry that follows.
+                    if (i + 1 >= entries) {
+                        break;
+                    }
+                    length = BitConverter.ToUInt16(pool, i * 4 + 4) | (BitConverter.ToUInt16(pool, i * 4 + 6) << 16);
+                    i += 2;
+                }
+                else {
+                    i++;
+                }
+
+                if (offset + length > data.Length) {
+                    throw new InvalidDataException("MSI string pool is damaged.");
+                }
+                offsets.Add(offset);
+                lengths.Add(length);
+                offset += length;
+            }
+
+            _stringData = data;
+            _stringOffsets = offsets.ToArray();
+            _stringLengths = lengths.ToArray();
+            _strings = new string[_stringOffsets.Length];
+        }
+
+        private string GetString(int id) {
+            if (id <= 0 || id >= _strings.Length) {
+                return null;
+            }
+
+            // decoded on first use; most lookups only ever touch a handful of strings.
+            return _strings[id] ?? (_strings[id] = _encoding.GetString(_stringData, _stringOffsets[id], _stringLengths[id]));
+        }
+
+        private void LoadCatalog() {
+            // the system tables describe themselves implicitly.
+            var columnsOfColumns = new[] {
+                new Column { Name = "Table", Number = 1, Type = ColumnTypeValid | ColumnTypeString | ColumnTypeKey | 64 },
+                new Column { Name = "Number", Number = 2, Type = ColumnTypeValid | ColumnTypeKey | 2 },
+                new Column { Name = "Name", Number = 3, Type = ColumnTypeValid | ColumnTypeString | 64 },
+                new Column { Name = "Type", Number = 4, Type = ColumnTypeValid | 2 },
+            };
+
+            var tables = new Dictionary<string, List<Column>>(StringComparer.Ordinal);
+            foreach (var row in ReadRows("_Columns", columnsOfColumns)) {
+                var table = row[0] as string;
+                var name = row[2] as string;
+                if (table == null || name == null || !(row[1] is int) || !(row[3] is int)) {
+                    continue;
+                }
+
+                List<Column> columns;
+                if (!tables.TryGetValue(table, out columns)) {
+                    tables.Add(table, columns = new List<Column>());
+                }
+                columns.Add(new Column { Name = name, Number = (int)row[1], Type = (int)row[3] });
+            }
+
+            foreach (var table in tables) {
+                _columns[table.Key] = table.Value.OrderBy(each => each.Number).ToArray();
+            }
+        }
+
+        private IList<object[]> ReadRows(string tableName, Column[] columns) {
+            var result = new List<object[]>();
+            var data = ReadTableStream(tableName);
+            if (data == null || data.Length == 0) {
+                return result;
+            }
+
+            var widths = columns.Select(ColumnWidth).ToArray();
+            var rowSize = widths.Sum();
+            var rowCount = data.Length / rowSize;
+
+            for (var row = 0; row < rowCount; row++) {
+                result.Add(new object[columns.Length]);
+            }
+
+            // tables are stored a column at a time: all the values of the first column, then the second...
+            var columnStart = 0;
+            for (var c = 0; c < columns.Length; c++) {
+                var column = columns[c];
+                var width = widths[c];
+
+                for (var row = 0; row < rowCount; row++) {
+                    var position = columnStart + row * width;
+                    var raw = data[position] | (data[position + 1] << 8);
+                    if (width == 3) {
+                        raw |= data[position + 2] << 16;
+                    }
+                    else if (width == 4) {
+                        raw |= (data[position + 2] << 16) | (data[position + 3] << 24);
+                    }
+
+                    if (column.IsBinary || raw == 0) {
+                        continue;
+                    }
+
+                    if (column.IsString) {
+                        result[row][c] = GetString(raw);
+                    }
+                    else if (width == 2) {
+                        result[row][c] = raw - 0x8000;
+                    }
+                    else {
+                        result[row][c] = raw ^ unchecked((int)0x80000000);
+                    }
+                }
+                columnStart += width * rowCount;
+            }
+            return result;
+        }
+
+        private int ColumnWidth(Column column) {
+            if (column.IsBinary) {
+                return 2;
+            }
+            if (column.IsString) {
+                return _stringRefSize;
+            }
+            return (column.Type & 0xff) <= 2 ? 2 : 4;
+        }
+
+        private byte[] ReadTableStream(string tableName) {
+            string streamName;
+            return _tableStreams.TryGetValue(tableName, out streamName) ? _compoundFile.ReadStream(streamName) : null;
+        }
+
+        /// <summary>
+        /// Decodes an MSI stream name.
+        ///
+        /// MSI packs names into fewer characters than the compound file allows by mapping pairs of
+        /// [0-9A-Za-z._] characters into a single character in the range 0x3800-0x47FF (and single ones into 0x4800-0x483F).
+        /// </summary>
+        /// <param name="name">The raw name.</param>
+        /// <returns></returns>
+        /// <remarks></remarks>
+        private static string DecodeStreamName(string name) {
+            var result = new StringBuilder(name.Length * 2);
+            foreach (var ch in name) {
+                if (ch >= 0x3800 && ch < 0x4800) {
+                    var packed = ch - 0x3800;
+                    result.Append(DecodeCharacter(packed & 0x3f));
+                    result.Append(DecodeCharacter((packed >> 6) & 0x3f));
+                }
+                else if (ch >= 0x4800 && ch < 0x4840) {
+                    result.Append(DecodeCharacter(ch - 0x4800));
+                }
+                else {
+                    result.Append(ch);
+                }
+            }
+            return result.ToString();
+        }
+
+        private static char DecodeCharacter(int value) {
+            if (value < 10) {
+                return (char)('0' + value);
+            }
+            if (value < 36) {
+                return (char)('A' + value - 10);
+            }
+            if (value < 62) {
+                return (char)('a' + value - 36);
+            }
+            return value == 62 ? '.' : '_';
+        }
+
+        public void Dispose() {
+            _compoundFile.Dispose();
+        }
+    }
+}
@@ -0,0 +1,295 @@
+//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Toolkit.Pipes {
+    using System;
+    using System.Collections.Generic;
+    using System.IO;
+    using System.Text;
+    using System.Threading;
+    using System.Threading.Tasks;
+
+    /// <summary>
+    /// Wire format for batched pipe messages.
+    ///
+    /// A framed pipe write starts with a single <see cref="Marker"/> byte, followed by any number of frames.
+    /// Each frame is a four byte little-endian length, followed by that many bytes of a UTF-8 url-encoded message.
+    ///
+    /// A url-encoded message can never contain a NUL byte, so a reader can always tell a framed write apart
+    /// from a legacy single-message write.
+    /// </summary>
+    /// <remarks></remarks>
+    public static class FramedMessages {
+        /// <summary>
+        /// The first byte of every framed pipe write.
+        /// </summary>
+        public const byte Marker = 0;
+
+        /// <summary>
+        /// The value of the 'framing' field in start-session/session-started when binary framing is used.
+        /// </summary>
+        public const string BinaryFraming = "binary";
+
+        /// <summary>
+        /// Size of the frame length prefix
+        /// </summary>
+        internal const int LengthPrefixSize = 4;
+
+        /// <summary>
+        /// Determines whether the buffer holds a framed write.
+        /// </summary>
+        /// <param name="buffer">The buffer.</param>
+        /// <param name="count">The number of valid bytes in the buffer.</param>
+        /// <returns></returns>
+        /// <remarks></remarks>
+        public static bool IsFramed(byte[] buffer, int count) {
+            return count > 0 && buffer[0] == Marker;
+        }
+
+        /// <summary>
+        /// Parses the messages contained in a single pipe read, straight from the read buffer.
+        ///
+        /// Handles both framed writes and legacy single-message writes.
+        /// </summary>
+        /// <param name="buffer">The buffer.</param>
+        /// <param name="count">The number of valid bytes in the buffer.</param>
+        /// <returns></returns>
+        /// <remarks></remarks>
+        public static IEnumerable<UrlEncodedMessage> ReadMessages(byte[] buffer, int count) {
+            if (count <= 0) {
+                yield break;
+            }
+
+            if (!IsFramed(buffer, count)) {
+                yield return new UrlEncodedMessage(buffer, 0, count);
+                yield break;
+            }
+
+            var offset = 1;
+            while (offset + LengthPrefixSize <= count) {
+                var length = buffer[offset] | (buffer[offset + 1] << 8) | (buffer[offset + 2] << 16) | (buffer[offset + 3] << 24);
+                offset += LengthPrefixSize;
+
+                if (length < 0 || offset + length > count) {
+                    throw new InvalidDataException("Truncated message frame in pipe read.");
+                }
+
+                if (length > 0) {
+                    yield return new UrlEncodedMessage(buffer, offset, length);
+                }
+                offset += length;
+            }
+        }
+    }
+
+    /// <summary>
+    /// Packs outgoing messages into framed pipe writes.
+    ///
+    /// Messages are encoded straight into a pending batch, which is written out as a single pipe write when
+    /// it reaches <see cref="MaxBatchSize"/>, when <see cref="FlushInterval"/> has passed since the first
+    /// message was added, or when <see cref="Flush"/> is called.
+    /// </summary>
+    /// <remarks></remarks>
+    public class FramedMessageWriter : IDisposable {
+        /// <summary>
+        /// Default size at which a batch is written out.
+        /// Must stay well under the size of the client's read buffer.
+        /// </summary>
+        public const int DefaultMaxBatchSize = 64 * 1024;
+
+        /// <summary>
+        /// Default time a message may wait in a batch before it is written.
+        /// </summary>
+        public static readonly TimeSpan DefaultFlushInterval = new TimeSpan(0, 0, 0, 0, 20);
+
+        private readonly Stream _stream;
+        private readonly Action<IEnumerable<UrlEncodedMessage>> _onFailure;
+        private readonly Timer _timer;
+        private readonly object _sync = new object();
+
+        private byte[] _batch;
+        private int _batchLength;
+        private List<UrlEncodedMessage> _batchMessages;
+
+        // batches whose pipe writes have finished, kept to be filled again, so a busy writer cycles through
+        // a few buffers rather than allocating one per write.
+        private const int MaxSpareBatches = 4;
+        private readonly Stack<KeyValuePair<byte[], List<UrlEncodedMessage>>> _spareBatches = new Stack<KeyValuePair<byte[], List<UrlEncodedMessage>>>();
+        private bool _timerArmed;
+        private bool _disposed;
+
+        /// <summary>
+        /// Gets or sets the size at which a batch is written out.
+        /// </summary>
+        public int MaxBatchSize { get; set; }
+
+        /// <summary>
+        /// Gets or sets the maximum time a message waits in a batch before it is written.
+        /// </summary>
+        public TimeSpan FlushInterval { get; set; }
+
+        /// <summary>
+        /// Initializes a new instance of the <see cref="FramedMessageWriter"/> class.
+        /// </summary>
+        /// <param name="stream">The stream (pipe) to write to.</param>
+        /// <param name="onFailure">Called with the messages of a batch that could not be written.</param>
+        /// <remarks></remarks>
+        public FramedMessageWriter(Stream stream, Action<IEnumerable<UrlEncodedMessage>> onFailure) {
+            _stream = stream;
+            _onFailure = onFailure;
+            MaxBatchSize = DefaultMaxBatchSize;
+            FlushInterval = DefaultFlushInterval;
+            _timer = new Timer(state => Flush(), null, Timeout.Infinite, Timeout.Infinite);
+            ResetBatch();
+        }
+
+        /// <summary>
+        /// Adds a message to the pending batch.
+        /// </summary>
+        /// <param name="message">The message.</param>
+        /// <remarks></remarks>
+        public void Write(UrlEncodedMessage message) {
+            lock (_sync) {
+                if (_disposed) {
+                    throw new ObjectDisposedException("FramedMessageWriter");
+                }
+
+                // encode straight into the batch, after a placeholder for the length.
+                // (a batch can overshoot MaxBatchSize by one message; it is written out right after.)
+                var frameStart = _batchLength;
+                var length = message.Encode(ref _batch, frameStart + FramedMessages.LengthPrefixSize);
+
+                _batch[frameStart] = (byte)length;
+                _batch[frameStart + 1] = (byte)(length >> 8);
+                _batch[frameStart + 2] = (byte)(length >> 16);
+                _batch[frameStart + 3] = (byte)(length >> 24);
+                _batchLength = frameStart + FramedMessages.LengthPrefixSize + length;
+                _batchMessages.Add(message);
+
+                if (_batchLength >= MaxBatchSize) {
+                    FlushBatch();
+                }
+                else if (!_timerArmed) {
+                    _timerArmed = true;
+                    _timer.Change((long)FlushInterval.TotalMilliseconds, Timeout.Infinite);
+                }
+            }
+        }
+
+        /// <summary>
+        /// Writes out any pending messages now.
+        /// </summary>
+        /// <remarks></remarks>
+        public void Flush() {
+            lock (_sync) {
+                if (!_disposed) {
+                    FlushBatch();
+                }
+            }
+        }
+
+        /// <summary>
+        /// Issues the pipe write for the pending batch. Must be called while holding _sync, so that batches
+        /// hit the pipe in the order their messages were written.
+        /// </summary>
+        /// <remarks></remarks>
+        private void FlushBatch() {
+            if (_timerArmed) {
+                _timerArmed = false;
+                _timer.Change(Timeout.Infinite, Timeout.Infinite);
+            }
+
+            if (_batchMessages.Count == 0) {
+                return;
+            }
+
+            var buffer = _batch;
+            var count = _batchLength;
+            var messages = _batchMessages;
+            ResetBatch();
+
+            try {
+                _stream.WriteAsync(buffer, 0, count).ContinueWith(antecedent => {
+                    if (antecedent.Exception != null) {
+                        _onFailure(messages);
+                    }
+                    else {
+                        Recycle(buffer, messages);
+                    }
+                });
+            }
+            catch /* (Exception e) */ {
+                _onFailure(messages);
+            }
+        }
+
+        /// <summary>
+        /// Starts a new batch, in a spare buffer if there is one (the previous buffer belongs to the pending pipe write).
+        /// Must be called while holding _sync.
+        /// </summary>
+        /// <remarks></remarks>
+        private void ResetBatch() {
+            _batch = null;
+            while (_batch == null && _spareBatches.Count > 0) {
+                var spare = _spareBatches.Pop();
+                if (spare.Key.Length >= MaxBatchSize + 1024) {
+                    _batch = spare.Key;
+                    _batchMessages = spare.Value;
+                }
+            }
+            if (_batch == null) {
+                _batch = new byte[MaxBatchSize + 1024];
+                _batchMessages = new List<UrlEncodedMessage>();
+            }
+
+            _batch[0] = FramedMessages.Marker;
+            _batchLength = 1;
+        }
+
+        /// <summary>
+        /// Keeps the buffer of a batch whose pipe write has finished, to be filled again.
+        /// </summary>
+        /// <remarks></remarks>
+        private void Recycle(byte[] buffer, List<UrlEncodedMessage> messages) {
+            messages.Clear();
+            lock (_sync) {
+                if (!_disposed && _spareBatches.Count < MaxSpareBatches) {
+                    _spareBatches.Push(new KeyValuePair<byte[], List<UrlEncodedMessage>>(buffer, messages));
+                }
+            }
+        }
+
+        /// <summary>
+        /// Stops the writer and hands back any messages that were still waiting in the pending batch.
+        /// </summary>
+        /// <returns>The unsent messages.</returns>
+        /// <remarks></remarks>
+        public IEnumerable<UrlEncodedMessage> Detach() {
+            lock (_sync) {
+                if (_disposed) {
+                    return new UrlEncodedMessage[0];
+                }
+                _disposed = true;
+                _timer.Dispose();
+                var pending = _batchMessages;
+                ResetBatch();
+                return pending;
+            }
+        }
+
+        /// <summary>
+        /// Stops the writer. Any messages still waiting in the pending batch are dropped.
+        /// </summary>
+        /// <remarks></remarks>
+        public void Dispose() {
+            Detach();
+        }
+    }
+}
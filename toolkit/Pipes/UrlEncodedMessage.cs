@@ -12,8 +12,9 @@ namespace CoApp.Toolkit.Pipes {
     using System;
     using System.Collections;
     using System.Collections.Generic;
+    using System.Globalization;
     using System.Linq;
-    using System.Text.RegularExpressions;
+    using System.Text;
     using Extensions;
 
     /// <summary>
@@ -26,7 +27,12 @@ namespace CoApp.Toolkit.Pipes {
     /// </remarks>
     public class UrlEncodedMessage : IEnumerable<string> {
 
-        public class UrlEncodedMessageValue {
+        /// <summary>
+        /// Typed view over a single message value. 
+        /// 
+        /// This is a struct so that reading a field out of a message doesn't allocate.
+        /// </summary>
+        public struct UrlEncodedMessageValue {
             private readonly string _value;
             public UrlEncodedMessageValue(string value) {
                 _value = value;
@@ -62,43 +68,53 @@ namespace CoApp.Toolkit.Pipes {
                 return null;
             }
 
+            public static implicit operator double?(UrlEncodedMessageValue value) {
+                if (value._value == null)
+                    return null;
+
+                double outVal;
+                if (Double.TryParse(value._value, NumberStyles.Float, CultureInfo.InvariantCulture, out outVal)) {
+                    return outVal;
+                }
+                return null;
+            }
+
             public static implicit operator bool?(UrlEncodedMessageValue value) {
                 if (value._value == null)
                     return null;
 
-                switch (value._value.ToLower()) {
-                    case "true":
-                        return true;
-                        
-                    case "false":
-                        return false;
-                        
-                    default:
-                        return null;
+                if (value._value.Equals("true", StringComparison.OrdinalIgnoreCase)) {
+                    return true;
                 }
+                if (value._value.Equals("false", StringComparison.OrdinalIgnoreCase)) {
+                    return false;
+                }
+                return null;
             }
         }
 
         /// <summary>
-        /// 
+        /// Tokens up to this length (in encoded bytes) are looked up in the token pool before allocating a new string.
         /// </summary>
-        private static readonly char[] _query = new[] {
-            '?'
-        };
+        private const int MaxPooledTokenLength = 32;
 
         /// <summary>
-        /// 
+        /// Direct-mapped cache of recently decoded short tokens (commands, keys, and small values like 'True'). 
+        /// Slots are overwritten on collision, so the pool never grows. Reference reads/writes are atomic, 
+        /// so no locking is needed.
         /// </summary>
-        private static readonly char[] _separator = new[] {
-            '&'
-        };
+        private static readonly string[] _tokenPool = new string[1024];
 
         /// <summary>
-        /// 
+        /// Per-thread scratch buffers used while parsing and encoding.
         /// </summary>
-        private static readonly char[] _equals = new[] {
-            '='
-        };
+        [ThreadStatic]
+        private static byte[] _decodeBuffer;
+
+        [ThreadStatic]
+        private static byte[] _encodeBuffer;
+
+        private static readonly byte[] _hexDigits = Encoding.ASCII.GetBytes("0123456789abcdef");
 
         /// <summary>
         /// 
@@ -116,13 +132,22 @@ namespace CoApp.Toolkit.Pipes {
         /// <param name="rawMessage">The raw message.</param>
         /// <remarks></remarks>
         public UrlEncodedMessage(string rawMessage) {
-            var parts = rawMessage.Split(_query, StringSplitOptions.RemoveEmptyEntries);
-            Command = (parts.FirstOrDefault() ?? "" ).UrlDecode().ToLower();
-            Data = (parts.Skip(1).FirstOrDefault() ?? "").Split(_separator, StringSplitOptions.RemoveEmptyEntries).Select(
-                p => p.Split(_equals, StringSplitOptions.RemoveEmptyEntries)).ToDictionary(
-                    s => s[0].UrlDecode(),
-                    s => s.Length > 1 ? s[1].UrlDecode() : String.Empty);
-            
+            rawMessage = rawMessage ?? string.Empty;
+            var buffer = GetScratch(ref _encodeBuffer, Encoding.UTF8.GetMaxByteCount(rawMessage.Length));
+            var count = Encoding.UTF8.GetBytes(rawMessage, 0, rawMessage.Length, buffer, 0);
+            Parse(buffer, 0, count);
+        }
+
+        /// <summary>
+        /// Initializes a new instance of the <see cref="UrlEncodedMessage"/> class straight from the UTF-8 bytes 
+        /// of a received message, without building an intermediate string.
+        /// </summary>
+        /// <param name="buffer">The buffer.</param>
+        /// <param name="offset">The offset of the message in the buffer.</param>
+        /// <param name="count">The length of the message.</param>
+        /// <remarks></remarks>
+        public UrlEncodedMessage(byte[] buffer, int offset, int count) {
+            Parse(buffer, offset, count);
         }
 
         /// <summary>
@@ -137,7 +162,326 @@ namespace CoApp.Toolkit.Pipes {
         }
 
         public UrlEncodedMessageValue this[string key] {
-            get { return new UrlEncodedMessageValue( Data.ContainsKey(key) ? Data[key] : null ); }
+            get {
+                string value;
+                return new UrlEncodedMessageValue(Data.TryGetValue(key, out value) ? value : null);
+            }
+        }
+
+        /// <summary>
+        /// Single pass parser: splits, url-decodes and lowercases (the command) as it walks the bytes.
+        /// </summary>
+        /// <param name="buffer">The buffer.</param>
+        /// <param name="offset">The offset.</param>
+        /// <param name="count">The count.</param>
+        /// <remarks></remarks>
+        private void Parse(byte[] buffer, int offset, int count) {
+            var end = offset + count;
+            var position = offset;
+
+            // skip leading '?' characters, as Split(RemoveEmptyEntries) used to.
+            while (position < end && buffer[position] == '?') {
+                position++;
+            }
+
+            var tokenStart = position;
+            while (position < end && buffer[position] != '?') {
+                position++;
+            }
+            Command = DecodeToken(buffer, tokenStart, position - tokenStart, true);
+
+            Data = new Dictionary<string, string>();
+
+            // the query is the next run of text between '?' characters.
+            while (position < end && buffer[position] == '?') {
+                position++;
+            }
+            var queryEnd = position;
+            while (queryEnd < end && buffer[queryEnd] != '?') {
+                queryEnd++;
+            }
+
+            // pairs are separated by '&'; within a pair, the first run of text between '=' characters 
+            // is the key, and the second is the value.
+            while (position < queryEnd) {
+                var pairEnd = position;
+                while (pairEnd < queryEnd && buffer[pairEnd] != '&') {
+                    pairEnd++;
+                }
+
+                var keyStart = position;
+                while (keyStart < pairEnd && buffer[keyStart] == '=') {
+                    keyStart++;
+                }
+                var keyEnd = keyStart;
+                while (keyEnd < pairEnd && buffer[keyEnd] != '=') {
+                    keyEnd++;
+                }
+                var valueStart = keyEnd;
+                while (valueStart < pairEnd && buffer[valueStart] == '=') {
+                    valueStart++;
+                }
+                var valueEnd = valueStart;
+                while (valueEnd < pairEnd && buffer[valueEnd] != '=') {
+                    valueEnd++;
+                }
+
+                if (keyEnd > keyStart) {
+                    Data[DecodeToken(buffer, keyStart, keyEnd - keyStart, false)] = DecodeToken(buffer, valueStart, valueEnd - valueStart, false);
+                }
+                position = pairEnd + 1;
+            }
+        }
+
+        /// <summary>
+        /// Url-decodes a run of UTF-8 bytes into a string, using the per-thread scratch buffer for the decoded bytes.
+        /// </summary>
+        /// <param name="buffer">The buffer.</param>
+        /// <param name="offset">The offset.</param>
+        /// <param name="count">The count.</param>
+        /// <param name="lowerCase">if set to <c>true</c> ASCII letters are lowercased.</param>
+        /// <returns></returns>
+        /// <remarks></remarks>
+        private static string DecodeToken(byte[] buffer, int offset, int count, bool lowerCase) {
+            if (count == 0) {
+                return string.Empty;
+            }
+
+            // each %uXXXX (6 bytes) becomes at most 3 UTF-8 bytes, so the output is never longer than the input.
+            var decoded = GetScratch(ref _decodeBuffer, count);
+            var length = 0;
+            var end = offset + count;
+
+            for (var i = offset; i < end; i++) {
+                var b = buffer[i];
+                if (b == '+') {
+                    decoded[length++] = (byte)' ';
+                    continue;
+                }
+
+                if (b == '%' && i + 2 < end && buffer[i + 1] != '%') {
+                    int xchar;
+                    if (buffer[i + 1] == 'u' && i + 5 < end && (xchar = HexValue(buffer, i + 2, 4)) != -1) {
+                        length = AppendUtf8((char)xchar, decoded, length);
+                        i += 5;
+                        continue;
+                    }
+                    if ((xchar = HexValue(buffer, i + 1, 2)) != -1) {
+                        b = (byte)xchar;
+                        i += 2;
+                    }
+                }
+
+                if (lowerCase && b >= 'A' && b <= 'Z') {
+                    b = (byte)(b + ('a' - 'A'));
+                }
+                decoded[length++] = b;
+            }
+
+            return length <= MaxPooledTokenLength ? PooledString(decoded, length) : Encoding.UTF8.GetString(decoded, 0, length);
+        }
+
+        private static int HexValue(byte[] buffer, int offset, int count) {
+            var value = 0;
+            for (var i = offset; i < offset + count; i++) {
+                var c = buffer[i];
+                int digit;
+                if (c >= '0' && c <= '9') {
+                    digit = c - '0';
+                } else if (c >= 'a' && c <= 'f') {
+                    digit = c - 'a' + 10;
+                } else if (c >= 'A' && c <= 'F') {
+                    digit = c - 'A' + 10;
+                } else {
+                    return -1;
+                }
+                value = (value << 4) + digit;
+            }
+            return value;
+        }
+
+        private static int AppendUtf8(char c, byte[] output, int length) {
+            if (c < 0x80) {
+                output[length++] = (byte)c;
+            } else if (c < 0x800) {
+                output[length++] = (byte)(0xC0 | (c >> 6));
+                output[length++] = (byte)(0x80 | (c & 0x3F));
+            } else {
+                if (char.IsSurrogate(c)) {
+                    // a lone surrogate can't be encoded; same replacement character Encoding.UTF8 would use.
+                    c = '\uFFFD';
+                }
+                output[length++] = (byte)(0xE0 | (c >> 12));
+                output[length++] = (byte)(0x80 | ((c >> 6) & 0x3F));
+                output[length++] = (byte)(0x80 | (c & 0x3F));
+            }
+            return length;
+        }
+
+        /// <summary>
+        /// Returns the pooled string for the given decoded bytes, creating (and pooling) it if it isn't there.
+        /// </summary>
+        /// <param name="bytes">The decoded bytes.</param>
+        /// <param name="length">The length.</param>
+        /// <returns></returns>
+        /// <remarks></remarks>
+        private static string PooledString(byte[] bytes, int length) {
+            var hash = unchecked((int)2166136261);
+            for (var i = 0; i < length; i++) {
+                if (bytes[i] > 0x7F) {
+                    // pool only holds plain ASCII tokens, so that the comparison below can be done byte-for-char.
+                    return Encoding.UTF8.GetString(bytes, 0, length);
+                }
+                hash = unchecked((hash ^ bytes[i]) * 16777619);
+            }
+
+            var slot = hash & (_tokenPool.Length - 1);
+            var pooled = _tokenPool[slot];
+            if (pooled != null && pooled.Length == length) {
+                var i = 0;
+                while (i < length && pooled[i] == bytes[i]) {
+                    i++;
+                }
+                if (i == length) {
+                    return pooled;
+                }
+            }
+
+            pooled = Encoding.ASCII.GetString(bytes, 0, length);
+            _tokenPool[slot] = pooled;
+            return pooled;
+        }
+
+        private static byte[] GetScratch(ref byte[] scratch, int size) {
+            if (scratch == null || scratch.Length < size) {
+                scratch = new byte[Math.Max(size, 4096)];
+            }
+            return scratch;
+        }
+
+        /// <summary>
+        /// Url-encodes this message straight into a byte buffer, growing it if it is too small.
+        /// </summary>
+        /// <param name="buffer">The buffer to write into. Replaced with a larger one if needed.</param>
+        /// <param name="offset">The offset to start writing at.</param>
+        /// <returns>The number of bytes written.</returns>
+        /// <remarks></remarks>
+        public int Encode(ref byte[] buffer, int offset) {
+            return Encode(ref buffer, offset, int.MaxValue);
+        }
+
+        /// <summary>
+        /// Url-encodes this message straight into a byte buffer, truncating each value to maxValueLength characters.
+        /// </summary>
+        /// <param name="buffer">The buffer to write into. Replaced with a larger one if needed.</param>
+        /// <param name="offset">The offset to start writing at.</param>
+        /// <param name="maxValueLength">Maximum length of each value.</param>
+        /// <returns>The number of bytes written.</returns>
+        /// <remarks></remarks>
+        private int Encode(ref byte[] buffer, int offset, int maxValueLength) {
+            var position = EncodeToken(Command, int.MaxValue, Data.Count > 0, ref buffer, offset);
+
+            if (Data.Count > 0) {
+                position = Append((byte)'?', ref buffer, position);
+                foreach (var each in Data) {
+                    if (string.IsNullOrEmpty(each.Value)) {
+                        continue;
+                    }
+                    position = EncodeToken(each.Key, int.MaxValue, false, ref buffer, position);
+                    position = Append((byte)'=', ref buffer, position);
+                    position = EncodeToken(each.Value, maxValueLength, false, ref buffer, position);
+                    position = Append((byte)'&', ref buffer, position);
+                }
+            }
+            return position - offset;
+        }
+
+        private static int Append(byte b, ref byte[] buffer, int position) {
+            if (position >= buffer.Length) {
+                Array.Resize(ref buffer, Math.Max(buffer.Length * 2, 256));
+            }
+            buffer[position] = b;
+            return position + 1;
+        }
+
+        /// <summary>
+        /// Url-encodes a string into the buffer; produces the same output as <see cref="StringExtensions.UrlEncode"/>.
+        /// </summary>
+        private static int EncodeToken(string text, int maxLength, bool lowerCase, ref byte[] buffer, int position) {
+            if (string.IsNullOrEmpty(text)) {
+                return position;
+            }
+
+            var length = Math.Min(text.Length, maxLength);
+
+            // worst case: every UTF-8 byte (up to 3 per char) becomes %xx
+            if (position + length * 9 > buffer.Length) {
+                Array.Resize(ref buffer, Math.Max(buffer.Length * 2, position + length * 9));
+            }
+
+            for (var i = 0; i < length; i++) {
+                int c = text[i];
+
+                if (c >= 0x80) {
+                    if (char.IsHighSurrogate(text, i) && i + 1 < text.Length && char.IsLowSurrogate(text[i + 1])) {
+                        c = char.ConvertToUtf32(text[i], text[i + 1]);
+                        i++;
+                        position = EncodeByte(0xF0 | (c >> 18), buffer, position);
+                        position = EncodeByte(0x80 | ((c >> 12) & 0x3F), buffer, position);
+                    } else {
+                        if (char.IsSurrogate((char)c)) {
+                            c = 0xFFFD;
+                        }
+                        if (c >= 0x800) {
+                            position = EncodeByte(0xE0 | (c >> 12), buffer, position);
+                        } else {
+                            position = EncodeByte(0xC0 | (c >> 6), buffer, position);
+                            position = EncodeByte(0x80 | (c & 0x3F), buffer, position);
+                            continue;
+                        }
+                    }
+                    position = EncodeByte(0x80 | ((c >> 6) & 0x3F), buffer, position);
+                    position = EncodeByte(0x80 | (c & 0x3F), buffer, position);
+                    continue;
+                }
+
+                if (lowerCase && c >= 'A' && c <= 'Z') {
+                    c += 'a' - 'A';
+                }
+                position = EncodeByte(c, buffer, position);
+            }
+            return position;
+        }
+
+        private static int EncodeByte(int b, byte[] buffer, int position) {
+            if ((b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z') || (b >= '0' && b <= '9')) {
+                buffer[position++] = (byte)b;
+                return position;
+            }
+
+            switch (b) {
+                case '!':
+                case '\'':
+                case '(':
+                case ')':
+                case '*':
+                case '-':
+                case '.':
+                case '_':
+                    buffer[position++] = (byte)b;
+                    break;
+
+                case ' ':
+                    buffer[position++] = (byte)'+';
+                    break;
+
+                default:
+                    buffer[position++] = (byte)'%';
+                    buffer[position++] = _hexDigits[(b >> 4) & 0x0F];
+                    buffer[position++] = _hexDigits[b & 0x0F];
+                    break;
+            }
+            return position;
         }
 
         /// <summary>
@@ -146,15 +490,17 @@ namespace CoApp.Toolkit.Pipes {
         /// <returns>A <see cref="System.String"/> that represents this instance.</returns>
         /// <remarks></remarks>
         public override string ToString() {
-            return Data.Any()
-                ? Data.Keys.Aggregate(Command.UrlEncode().ToLower() + "?", (current, k) => current + (!string.IsNullOrEmpty(Data[k]) ? (k.UrlEncode() + "=" + Data[k].UrlEncode() + "&") : string.Empty))
-                : Command.UrlEncode();
+            var buffer = GetScratch(ref _encodeBuffer, 0);
+            var length = Encode(ref buffer, 0, int.MaxValue);
+            _encodeBuffer = buffer;
+            return Encoding.ASCII.GetString(buffer, 0, length);
         }
 
         public string ToSmallerString() {
-            return Data.Any()
-                ? Data.Keys.Aggregate(Command.UrlEncode().ToLower() + "?", (current, k) => current + (!string.IsNullOrEmpty(Data[k]) ? (k.UrlEncode() + "=" + Data[k].Substring(0, Math.Min(Data[k].Length, 512)).UrlEncode() + "&") : string.Empty))
-                : Command.UrlEncode();
+            var buffer = GetScratch(ref _encodeBuffer, 0);
+            var length = Encode(ref buffer, 0, 512);
+            _encodeBuffer = buffer;
+            return Encoding.ASCII.GetString(buffer, 0, length);
         }
 
         /// <summary>
@@ -252,8 +598,8 @@ namespace CoApp.Toolkit.Pipes {
         /// <returns></returns>
         /// <remarks></remarks>
         public IEnumerable<string> GetCollection(string collectionName) {
-            var rx = new Regex(@"^{0}\[\d*\]$".format(Regex.Escape(collectionName)));
-            return from k in Data.Keys where rx.IsMatch(k) select Data[k];
+            // matches keys of the form 'name[123]' (or 'name[]')
+            return from each in Data where IsCollectionKey(each.Key, collectionName, true) select each.Value;
         }
 
         /// <summary>
@@ -263,8 +609,26 @@ namespace CoApp.Toolkit.Pipes {
         /// <returns></returns>
         /// <remarks></remarks>
         public IEnumerable<KeyValuePair<string,string>> GetKeyValuePairs(string collectionName) {
-            var rx = new Regex(@"^{0}\[(.*)\]$".format(Regex.Escape(collectionName)));
-            return from k in Data.Keys let match = rx.Match(k) where match.Success select new KeyValuePair<string,string> (match.Groups[1].Captures[0].Value, Data[k]);
+            // matches keys of the form 'name[element]'
+            return from each in Data
+                where IsCollectionKey(each.Key, collectionName, false)
+                select new KeyValuePair<string, string>(each.Key.Substring(collectionName.Length + 1, each.Key.Length - collectionName.Length - 2), each.Value);
+        }
+
+        private static bool IsCollectionKey(string key, string collectionName, bool digitsOnly) {
+            if (key.Length < collectionName.Length + 2 || key[collectionName.Length] != '[' || key[key.Length - 1] != ']' ||
+                string.CompareOrdinal(key, 0, collectionName, 0, collectionName.Length) != 0) {
+                return false;
+            }
+
+            if (digitsOnly) {
+                for (var i = collectionName.Length + 1; i < key.Length - 1; i++) {
+                    if (!char.IsDigit(key[i])) {
+                        return false;
+                    }
+                }
+            }
+            return true;
         }
 
         public static implicit operator string(UrlEncodedMessage value) {
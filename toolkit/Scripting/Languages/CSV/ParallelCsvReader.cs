@@ -0,0 +1,1258 @@
+﻿//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack . All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Toolkit.Scripting.Languages.CSV
+{
+    using System;
+    using System.Collections.Generic;
+    using System.Globalization;
+    using System.IO;
+    using System.IO.MemoryMappedFiles;
+    using System.Text;
+    using System.Threading.Tasks;
+    using Events;
+    using Toolkit.Exceptions;
+
+    /// <summary>
+	/// Reads a CSV file by splitting it into chunks at record boundaries, and parsing the chunks in parallel.
+	/// </summary>
+	/// <remarks>
+	/// <para>
+	/// Each chunk is parsed by a <see cref="T:CsvReader"/> with the same settings, so the records are exactly the ones
+	/// a single <see cref="T:CsvReader"/> would read from the whole file. The record indexes and positions in a
+	/// <see cref="T:MalformedCsvException"/> are relative to the chunk the record is in, though.
+	/// </para>
+	/// <para>
+	/// The file is memory-mapped, and the chunk boundaries are found by scanning its bytes. A new line is only a
+	/// record boundary if it isn't inside a quoted field, which depends on everything before it; so the chunks are
+	/// scanned in parallel supposing each one starts at a record, and then going through them in order tells which
+	/// ones really do. A chunk that starts inside a quoted field is joined to the one before it, and scanned again
+	/// from inside the quotes to find out where it ends.
+	/// </para>
+	/// <para>
+	/// The file has to be in UTF-8 or in a single byte encoding that agrees with ASCII, and the delimiter, quote,
+	/// escape and comment characters have to be ASCII; otherwise, the file is read as a single chunk. The scan can't
+	/// get past malformed data (anything but a delimiter or a new line after a closing quote), so from there on, the
+	/// file is read as a single chunk as well.
+	/// </para>
+	/// </remarks>
+	public class ParallelCsvReader
+	{
+		#region Constants
+
+		/// <summary>
+		/// Defines the default size of a chunk, in bytes.
+		/// </summary>
+		public const int DefaultChunkSize = 0x400000;
+
+		/// <summary>
+		/// The buffer size for reading a chunk.
+		/// </summary>
+		private const int ChunkBufferSize = 0x10000;
+
+		/// <summary>
+		/// The number of bytes scanned at a time.
+		/// </summary>
+		private const int ScanBlockSize = 0x10000;
+
+		/// <summary>
+		/// The number of bytes after a block that the scan may look at (the rest of a UTF-8 sequence).
+		/// </summary>
+		private const int ScanLookahead = 2;
+
+		#endregion
+
+		#region Fields
+
+		#region Settings
+
+		/// <summary>
+		/// Contains the path of the CSV file.
+		/// </summary>
+		private readonly string _path;
+
+		/// <summary>
+		/// Contains the encoding of the CSV file.
+		/// </summary>
+		private readonly Encoding _encoding;
+
+		/// <summary>
+		/// Indicates if field names are located on the first non commented line.
+		/// </summary>
+		private readonly bool _hasHeaders;
+
+		/// <summary>
+		/// Contains the delimiter character separating each field.
+		/// </summary>
+		private readonly char _delimiter;
+
+		/// <summary>
+		/// Contains the quotation character wrapping every field.
+		/// </summary>
+		private readonly char _quote;
+
+		/// <summary>
+		/// Contains the escape character letting insert quotation characters inside a quoted field.
+		/// </summary>
+		private readonly char _escape;
+
+		/// <summary>
+		/// Contains the comment character indicating that a line is commented out.
+		/// </summary>
+		private readonly char _comment;
+
+		/// <summary>
+		/// Determines which values should be trimmed.
+		/// </summary>
+		private readonly ValueTrimmingOptions _trimmingOptions;
+
+		/// <summary>
+		/// Contains the size of a chunk, in bytes.
+		/// </summary>
+		private int _chunkSize = DefaultChunkSize;
+
+		/// <summary>
+		/// Contains the maximum number of chunks parsed at the same time.
+		/// </summary>
+		private int _maxDegreeOfParallelism = Environment.ProcessorCount;
+
+		/// <summary>
+		/// Contains the default action to take when a parsing error has occured.
+		/// </summary>
+		private ParseErrorAction _defaultParseErrorAction = ParseErrorAction.RaiseEvent;
+
+		/// <summary>
+		/// Contains the action to take when a field is missing.
+		/// </summary>
+		private MissingFieldAction _missingFieldAction;
+
+		/// <summary>
+		/// Indicates if the reader supports multiline.
+		/// </summary>
+		private bool _supportsMultiline = true;
+
+		/// <summary>
+		/// Indicates if the reader will skip empty lines.
+		/// </summary>
+		private bool _skipEmptyLines = true;
+
+		#endregion
+
+		#endregion
+
+		#region Constructors
+
+		/// <summary>
+		/// Initializes a new instance of the ParallelCsvReader class.
+		/// </summary>
+		/// <param name="path">The path of the CSV file.</param>
+		/// <param name="hasHeaders"><see langword="true"/> if field names are located on the first non commented line, otherwise, <see langword="false"/>.</param>
+		/// <exception cref="T:ArgumentNullException">
+		///		<paramref name="path"/> is a <see langword="null"/>.
+		/// </exception>
+		public ParallelCsvReader(string path, bool hasHeaders)
+			: this(path, hasHeaders, Encoding.UTF8, CsvReader.DefaultDelimiter, CsvReader.DefaultQuote, CsvReader.DefaultEscape, CsvReader.DefaultComment, ValueTrimmingOptions.UnquotedOnly)
+		{
+		}
+
+		/// <summary>
+		/// Initializes a new instance of the ParallelCsvReader class.
+		/// </summary>
+		/// <param name="path">The path of the CSV file.</param>
+		/// <param name="hasHeaders"><see langword="true"/> if field names are located on the first non commented line, otherwise, <see langword="false"/>.</param>
+		/// <param name="delimiter">The delimiter character separating each field (default is ',').</param>
+		/// <exception cref="T:ArgumentNullException">
+		///		<paramref name="path"/> is a <see langword="null"/>.
+		/// </exception>
+		public ParallelCsvReader(string path, bool hasHeaders, char delimiter)
+			: this(path, hasHeaders, Encoding.UTF8, delimiter, CsvReader.DefaultQuote, CsvReader.DefaultEscape, CsvReader.DefaultComment, ValueTrimmingOptions.UnquotedOnly)
+		{
+		}
+
+		/// <summary>
+		/// Initializes a new instance of the ParallelCsvReader class.
+		/// </summary>
+		/// <param name="path">The path of the CSV file.</param>
+		/// <param name="hasHeaders"><see langword="true"/> if field names are located on the first non commented line, otherwise, <see langword="false"/>.</param>
+		/// <param name="encoding">The encoding of the file (a byte order mark at the start of the file overrides it).</param>
+		/// <param name="delimiter">The delimiter character separating each field (default is ',').</param>
+		/// <param name="quote">The quotation character wrapping every field (default is ''').</param>
+		/// <param name="escape">
+		/// The escape character letting insert quotation characters inside a quoted field (default is '\').
+		/// If no escape character, set to '\0' to gain some performance.
+		/// </param>
+		/// <param name="comment">The comment character indicating that a line is commented out (default is '#').</param>
+		/// <param name="trimmingOptions">Determines which values should be trimmed.</param>
+		/// <exception cref="T:ArgumentNullException">
+		///		<paramref name="path"/> or <paramref name="encoding"/> is a <see langword="null"/>.
+		/// </exception>
+		public ParallelCsvReader(string path, bool hasHeaders, Encoding encoding, char delimiter, char quote, char escape, char comment, ValueTrimmingOptions trimmingOptions)
+		{
+			if (path == null)
+				throw new ArgumentNullException("path");
+
+			if (encoding == null)
+				throw new ArgumentNullException("encoding");
+
+			_path = path;
+			_hasHeaders = hasHeaders;
+			_encoding = encoding;
+			_delimiter = delimiter;
+			_quote = quote;
+			_escape = escape;
+			_comment = comment;
+			_trimmingOptions = trimmingOptions;
+		}
+
+		#endregion
+
+		#region Events
+
+		/// <summary>
+		/// Occurs when there is an error while parsing the CSV stream.
+		/// </summary>
+		/// <remarks>
+		/// The chunks are parsed at the same time, so the handler can be called from more than one thread at once.
+		/// </remarks>
+		public event EventHandler<ParseErrorEventArgs> ParseError;
+
+		/// <summary>
+		/// Raises the <see cref="M:ParseError"/> event.
+		/// </summary>
+		/// <param name="e">The <see cref="ParseErrorEventArgs"/> that contains the event data.</param>
+		protected virtual void OnParseError(ParseErrorEventArgs e)
+		{
+			EventHandler<ParseErrorEventArgs> handler = ParseError;
+
+			if (handler != null)
+				handler(this, e);
+		}
+
+		#endregion
+
+		#region Properties
+
+		/// <summary>
+		/// Gets the path of the CSV file.
+		/// </summary>
+		/// <value>The path of the CSV file.</value>
+		public string Path
+		{
+			get
+			{
+				return _path;
+			}
+		}
+
+		/// <summary>
+		/// Gets the encoding of the CSV file.
+		/// </summary>
+		/// <value>The encoding of the CSV file.</value>
+		public Encoding Encoding
+		{
+			get
+			{
+				return _encoding;
+			}
+		}
+
+		/// <summary>
+		/// Gets the comment character indicating that a line is commented out.
+		/// </summary>
+		/// <value>The comment character indicating that a line is commented out.</value>
+		public char Comment
+		{
+			get
+			{
+				return _comment;
+			}
+		}
+
+		/// <summary>
+		/// Gets the escape character letting insert quotation characters inside a quoted field.
+		/// </summary>
+		/// <value>The escape character letting insert quotation characters inside a quoted field.</value>
+		public char Escape
+		{
+			get
+			{
+				return _escape;
+			}
+		}
+
+		/// <summary>
+		/// Gets the delimiter character separating each field.
+		/// </summary>
+		/// <value>The delimiter character separating each field.</value>
+		public char Delimiter
+		{
+			get
+			{
+				return _delimiter;
+			}
+		}
+
+		/// <summary>
+		/// Gets the quotation character wrapping every field.
+		/// </summary>
+		/// <value>The quotation character wrapping every field.</value>
+		public char Quote
+		{
+			get
+			{
+				return _quote;
+			}
+		}
+
+		/// <summary>
+		/// Indicates if field names are located on the first non commented line.
+		/// </summary>
+		/// <value><see langword="true"/> if field names are located on the first non commented line, otherwise, <see langword="false"/>.</value>
+		public bool HasHeaders
+		{
+			get
+			{
+				return _hasHeaders;
+			}
+		}
+
+		/// <summary>
+		/// Indicates if spaces at the start and end of a field are trimmed.
+		/// </summary>
+		/// <value><see langword="true"/> if spaces at the start and end of a field are trimmed, otherwise, <see langword="false"/>.</value>
+		public ValueTrimmingOptions TrimmingOption
+		{
+			get
+			{
+				return _trimmingOptions;
+			}
+		}
+
+		/// <summary>
+		/// Gets or sets the size of a chunk, in bytes.
+		/// </summary>
+		/// <value>The size of a chunk, in bytes (a chunk is extended to the end of a record).</value>
+		/// <exception cref="ArgumentOutOfRangeException">
+		///		The value is less than 1.
+		/// </exception>
+		public int ChunkSize
+		{
+			get
+			{
+				return _chunkSize;
+			}
+			set
+			{
+				if (value <= 0)
+					throw new ArgumentOutOfRangeException("value", value, string.Empty);
+
+				_chunkSize = value;
+			}
+		}
+
+		/// <summary>
+		/// Gets or sets the maximum number of chunks parsed at the same time.
+		/// </summary>
+		/// <value>The maximum number of chunks parsed at the same time (the number of processors, by default).</value>
+		/// <exception cref="ArgumentOutOfRangeException">
+		///		The value is less than 1.
+		/// </exception>
+		public int MaxDegreeOfParallelism
+		{
+			get
+			{
+				return _maxDegreeOfParallelism;
+			}
+			set
+			{
+				if (value <= 0)
+					throw new ArgumentOutOfRangeException("value", value, string.Empty);
+
+				_maxDegreeOfParallelism = value;
+			}
+		}
+
+		/// <summary>
+		/// Gets or sets the default action to take when a parsing error has occured.
+		/// </summary>
+		/// <value>The default action to take when a parsing error has occured.</value>
+		public ParseErrorAction DefaultParseErrorAction
+		{
+			get
+			{
+				return _defaultParseErrorAction;
+			}
+			set
+			{
+				_defaultParseErrorAction = value;
+			}
+		}
+
+		/// <summary>
+		/// Gets or sets the action to take when a field is missing.
+		/// </summary>
+		/// <value>The action to take when a field is missing.</value>
+		public MissingFieldAction MissingFieldAction
+		{
+			get
+			{
+				return _missingFieldAction;
+			}
+			set
+			{
+				_missingFieldAction = value;
+			}
+		}
+
+		/// <summary>
+		/// Gets or sets a value indicating if the reader supports multiline fields.
+		/// </summary>
+		/// <value>A value indicating if the reader supports multiline field.</value>
+		public bool SupportsMultiline
+		{
+			get
+			{
+				return _supportsMultiline;
+			}
+			set
+			{
+				_supportsMultiline = value;
+			}
+		}
+
+		/// <summary>
+		/// Gets or sets a value indicating if the reader will skip empty lines.
+		/// </summary>
+		/// <value>A value indicating if the reader will skip empty lines.</value>
+		public bool SkipEmptyLines
+		{
+			get
+			{
+				return _skipEmptyLines;
+			}
+			set
+			{
+				_skipEmptyLines = value;
+			}
+		}
+
+		#endregion
+
+		#region Methods
+
+		#region GetFieldHeaders
+
+		/// <summary>
+		/// Gets the field headers.
+		/// </summary>
+		/// <returns>The field headers or an empty array if headers are not supported.</returns>
+		public string[] GetFieldHeaders()
+		{
+			using (CsvReader csv = CreateReader(new StreamReader(_path, _encoding, true), _hasHeaders))
+				return csv.GetFieldHeaders();
+		}
+
+		#endregion
+
+		#region ReadRecords
+
+		/// <summary>
+		/// Reads the records of the file.
+		/// </summary>
+		/// <param name="preserveOrder">
+		/// <see langword="true"/> to return the records in the order they are in the file; <see langword="false"/> to
+		/// return each chunk's records as soon as the chunk has been parsed.
+		/// </param>
+		/// <returns>The records (the records of a chunk are always in order).</returns>
+		/// <remarks>
+		/// At most <see cref="P:MaxDegreeOfParallelism"/> chunks are parsed ahead of the records being enumerated.
+		/// </remarks>
+		/// <exception cref="MalformedCsvException">
+		///		The CSV data appears to be malformed.
+		/// </exception>
+		public IEnumerable<string[]> ReadRecords(bool preserveOrder)
+		{
+			if (new FileInfo(_path).Length == 0)
+				yield break;
+
+			var fileStream = new FileStream(_path, FileMode.Open, FileAccess.Read, FileShare.Read);
+			MemoryMappedFile file;
+			try
+			{
+				file = MemoryMappedFile.CreateFromFile(fileStream, null, 0, MemoryMappedFileAccess.Read, null, HandleInheritability.None, false);
+			}
+			catch
+			{
+				fileStream.Dispose();
+				throw;
+			}
+
+			var running = new List<Task<List<string[]>>>();
+
+			try
+			{
+				var chunks = new Queue<Chunk>(FindChunks(file, fileStream.Length));
+
+				while (chunks.Count > 0 || running.Count > 0)
+				{
+					while (chunks.Count > 0 && running.Count < _maxDegreeOfParallelism)
+					{
+						Chunk chunk = chunks.Dequeue();
+						running.Add(Task.Factory.StartNew(() => ParseChunk(file, chunk)));
+					}
+
+					int next = preserveOrder ? 0 : Task.WaitAny(running.ToArray());
+					Task<List<string[]>> task = running[next];
+					running.RemoveAt(next);
+
+					foreach (string[] record in GetResult(task))
+						yield return record;
+				}
+			}
+			finally
+			{
+				// let anything still parsing finish with the file before it's closed.
+				try
+				{
+					Task.WaitAll(running.ToArray());
+				}
+				catch (AggregateException)
+				{
+				}
+
+				file.Dispose();
+			}
+		}
+
+		private static List<string[]> GetResult(Task<List<string[]>> task)
+		{
+			try
+			{
+				return task.Result;
+			}
+			catch (AggregateException ex)
+			{
+				throw ex.InnerException;
+			}
+		}
+
+		#endregion
+
+		#region ParseChunk
+
+		/// <summary>
+		/// Parses the records of a chunk.
+		/// </summary>
+		/// <param name="file">The mapped file.</param>
+		/// <param name="chunk">The chunk.</param>
+		/// <returns>The records in the chunk.</returns>
+		private List<string[]> ParseChunk(MemoryMappedFile file, Chunk chunk)
+		{
+			var records = new List<string[]>();
+
+			TextReader reader;
+			if (chunk.Encoding == null)
+				reader = new StreamReader(_path, _encoding, true);
+			else
+				reader = new ChunkTextReader(chunk.Prefix, new StreamReader(file.CreateViewStream(chunk.Start, chunk.End - chunk.Start, MemoryMappedFileAccess.Read), chunk.Encoding, false, ChunkBufferSize));
+
+			// a chunk other than the first one starts with a copy of the file's first record (the headers, or the
+			// record that sets the field count), so that it's read exactly as the whole file would be.
+			bool first = chunk.Prefix.Length == 0;
+
+			using (CsvReader csv = CreateReader(reader, first && _hasHeaders))
+			{
+				if (!first && !csv.ReadNextRecord())
+					return records;
+
+				while (csv.ReadNextRecord())
+				{
+					var record = new string[csv.FieldCount];
+					csv.CopyCurrentRecordTo(record);
+					records.Add(record);
+				}
+			}
+
+			return records;
+		}
+
+		/// <summary>
+		/// Creates a <see cref="T:CsvReader"/> with the settings of this reader.
+		/// </summary>
+		private CsvReader CreateReader(TextReader reader, bool hasHeaders)
+		{
+			var csv = new CsvReader(reader, hasHeaders, _delimiter, _quote, _escape, _comment, _trimmingOptions, ChunkBufferSize);
+
+			csv.DefaultParseErrorAction = _defaultParseErrorAction;
+			csv.MissingFieldAction = _missingFieldAction;
+			csv.SupportsMultiline = _supportsMultiline;
+			csv.SkipEmptyLines = _skipEmptyLines;
+			csv.ParseError += (sender, e) => OnParseError(e);
+
+			return csv;
+		}
+
+		#endregion
+
+		#region FindChunks
+
+		/// <summary>
+		/// Splits the file into chunks that start at records.
+		/// </summary>
+		/// <param name="file">The mapped file.</param>
+		/// <param name="length">The length of the file.</param>
+		/// <returns>The chunks, in order.</returns>
+		private List<Chunk> FindChunks(MemoryMappedFile file, long length)
+		{
+			var chunks = new List<Chunk>();
+			var whole = new Chunk { Prefix = string.Empty };
+
+			byte[] head = Read(file, 0, (int)Math.Min(4, length));
+			int preambleLength;
+			bool utf8;
+			Encoding encoding = GetChunkEncoding(head, out preambleLength, out utf8);
+
+			if (encoding == null)
+			{
+				// not something the scan can make sense of; read the file the usual way.
+				chunks.Add(whole);
+				return chunks;
+			}
+
+			var scanner = new RecordScanner(this, utf8);
+
+			// the file's first record is needed at the start of every chunk (and it tells how many fields a record has).
+			ScanState state = ScanState.RecordStart;
+			int fieldIndex = 0;
+			bool recordEnded;
+			long firstRecordEnd = scanner.Scan(file, preambleLength, length, length, ref state, ref fieldIndex, true, out recordEnded);
+
+			if (!recordEnded)
+			{
+				chunks.Add(whole);
+				return chunks;
+			}
+
+			if (state == ScanState.CarriageReturn && firstRecordEnd < length && Read(file, firstRecordEnd, 1)[0] == '\n')
+				firstRecordEnd++;
+
+			scanner.FieldCount = fieldIndex + 1;
+
+			string prefix = encoding.GetString(Read(file, preambleLength, (int)(firstRecordEnd - preambleLength)));
+
+			// (a '\n' at the start of a chunk mustn't be taken as the end of a "\r\n" that ends the prefix.)
+			if (prefix.EndsWith("\r", StringComparison.Ordinal))
+				prefix += "\n";
+
+			// every chunk starts at a line; the first one is after the first record.
+			var starts = new List<long> { firstRecordEnd };
+
+			for (long nominal = firstRecordEnd + _chunkSize; nominal < length; nominal += _chunkSize)
+			{
+				long start = FindLineStart(file, Math.Max(nominal, starts[starts.Count - 1] + 1), length);
+
+				if (start >= length)
+					break;
+
+				starts.Add(start);
+			}
+
+			starts.Add(length);
+
+			int count = starts.Count - 1;
+			var startingAtRecord = new ScanState[count];
+
+			Parallel.For(0, count, new ParallelOptions { MaxDegreeOfParallelism = _maxDegreeOfParallelism }, i =>
+			{
+				int index = 0;
+				bool ended;
+
+				ScanState end = ScanState.RecordStart;
+				scanner.Scan(file, starts[i], starts[i + 1], length, ref end, ref index, false, out ended);
+				startingAtRecord[i] = end;
+			});
+
+			var chunk = new Chunk { Start = preambleLength, End = starts[1], Encoding = encoding, Prefix = string.Empty };
+			state = startingAtRecord[0];
+
+			for (int i = 1; i < count; i++)
+			{
+				if (state == ScanState.RecordStart)
+				{
+					chunks.Add(chunk);
+					chunk = new Chunk { Start = starts[i], End = starts[i + 1], Encoding = encoding, Prefix = prefix };
+					state = startingAtRecord[i];
+				}
+				else
+				{
+					// the line is part of a record that started before it. (the field count matters only if multiline
+					// fields aren't supported, and the field index isn't known here.)
+					chunk.End = starts[i + 1];
+
+					if (state == ScanState.Quoted && _supportsMultiline)
+					{
+						int index = -1;
+						bool ended;
+						scanner.Scan(file, starts[i], starts[i + 1], length, ref state, ref index, false, out ended);
+					}
+					else
+						state = ScanState.Uncertain;
+				}
+			}
+
+			chunks.Add(chunk);
+			return chunks;
+		}
+
+		/// <summary>
+		/// Gets the encoding to read the chunks with.
+		/// </summary>
+		/// <param name="head">The first bytes of the file.</param>
+		/// <param name="preambleLength">The length of the byte order mark at the start of the file.</param>
+		/// <param name="utf8">Set to <see langword="true"/> if the file is in UTF-8.</param>
+		/// <returns>The encoding (without a preamble), or <see langword="null"/> if the file can't be scanned.</returns>
+		private Encoding GetChunkEncoding(byte[] head, out int preambleLength, out bool utf8)
+		{
+			preambleLength = 0;
+			utf8 = false;
+
+			foreach (char c in new[] { _delimiter, _quote, _escape, _comment })
+			{
+				if (c >= 0x80)
+					return null;
+			}
+
+			if (head.Length >= 3 && head[0] == 0xEF && head[1] == 0xBB && head[2] == 0xBF)
+			{
+				// the reader would go by the byte order mark.
+				preambleLength = 3;
+				utf8 = true;
+				return new UTF8Encoding(false);
+			}
+
+			if (head.Length >= 2 && ((head[0] == 0xFE && head[1] == 0xFF) || (head[0] == 0xFF && head[1] == 0xFE)))
+				return null;
+
+			if (head.Length >= 4 && head[0] == 0 && head[1] == 0 && head[2] == 0xFE && head[3] == 0xFF)
+				return null;
+
+			if (_encoding is UTF8Encoding)
+			{
+				utf8 = true;
+				return new UTF8Encoding(false, _encoding.DecoderFallback is DecoderExceptionFallback);
+			}
+
+			if (!_encoding.IsSingleByte)
+				return null;
+
+			// the scan looks for these bytes.
+			foreach (char c in new[] { _delimiter, _quote, _escape, _comment, '\r', '\n', ' ', '\t' })
+			{
+				byte[] bytes = _encoding.GetBytes(new[] { c });
+				if (bytes.Length != 1 || bytes[0] != c)
+					return null;
+			}
+
+			return _encoding;
+		}
+
+		/// <summary>
+		/// Finds the first line that starts at or after a position.
+		/// </summary>
+		/// <returns>The position of the line, or the length of the file if there isn't one.</returns>
+		private static long FindLineStart(MemoryMappedFile file, long position, long length)
+		{
+			// the line starts after a '\n' (a lone '\r' ends a line too, but those are left alone).
+			position--;
+
+			while (position < length)
+			{
+				int count = (int)Math.Min(ScanBlockSize, length - position);
+				int index = Array.IndexOf(Read(file, position, count), (byte)'\n');
+
+				if (index >= 0)
+					return position + index + 1;
+
+				position += count;
+			}
+
+			return length;
+		}
+
+		/// <summary>
+		/// Reads bytes from the mapped file.
+		/// </summary>
+		private static byte[] Read(MemoryMappedFile file, long offset, int count)
+		{
+			var result = new byte[count];
+
+			if (count > 0)
+			{
+				using (MemoryMappedViewAccessor view = file.CreateViewAccessor(offset, count, MemoryMappedFileAccess.Read))
+					view.ReadArray(0, result, 0, count);
+			}
+
+			return result;
+		}
+
+		#endregion
+
+		#endregion
+
+		#region Chunk
+
+		/// <summary>
+		/// A range of the file that starts at a record.
+		/// </summary>
+		private class Chunk
+		{
+			/// <summary>
+			/// The position of the start of the chunk.
+			/// </summary>
+			public long Start;
+
+			/// <summary>
+			/// The position of the end of the chunk.
+			/// </summary>
+			public long End;
+
+			/// <summary>
+			/// The encoding to read the chunk with (<see langword="null"/> to read the whole file as usual).
+			/// </summary>
+			public Encoding Encoding;
+
+			/// <summary>
+			/// The text read before the chunk (the first record of the file, except for the first chunk).
+			/// </summary>
+			public string Prefix;
+		}
+
+		#endregion
+
+		#region ChunkTextReader
+
+		/// <summary>
+		/// Reads some text, and then a chunk of the file.
+		/// </summary>
+		private class ChunkTextReader
+			: TextReader
+		{
+			private readonly string _prefix;
+			private readonly TextReader _reader;
+			private int _position;
+
+			public ChunkTextReader(string prefix, TextReader reader)
+			{
+				_prefix = prefix;
+				_reader = reader;
+			}
+
+			public override int Peek()
+			{
+				return _position < _prefix.Length ? _prefix[_position] : _reader.Peek();
+			}
+
+			public override int Read()
+			{
+				return _position < _prefix.Length ? _prefix[_position++] : _reader.Read();
+			}
+
+			public override int Read(char[] buffer, int index, int count)
+			{
+				if (_position < _prefix.Length)
+				{
+					count = Math.Min(count, _prefix.Length - _position);
+					_prefix.CopyTo(_position, buffer, index, count);
+					_position += count;
+					return count;
+				}
+
+				return _reader.Read(buffer, index, count);
+			}
+
+			protected override void Dispose(bool disposing)
+			{
+				if (disposing)
+					_reader.Dispose();
+
+				base.Dispose(disposing);
+			}
+		}
+
+		#endregion
+
+		#region RecordScanner
+
+		/// <summary>
+		/// Where the scan is in the CSV syntax.
+		/// </summary>
+		private enum ScanState
+			: byte
+		{
+			/// <summary>
+			/// At the start of a line, before a record (or an empty or commented line).
+			/// </summary>
+			RecordStart,
+
+			/// <summary>
+			/// After a '\r' that ended a line (a '\n' after it is part of the same new line).
+			/// </summary>
+			CarriageReturn,
+
+			/// <summary>
+			/// At the start of a field.
+			/// </summary>
+			FieldStart,
+
+			/// <summary>
+			/// In a field that isn't quoted.
+			/// </summary>
+			Unquoted,
+
+			/// <summary>
+			/// In a quoted field.
+			/// </summary>
+			Quoted,
+
+			/// <summary>
+			/// After a quote in a quoted field, when the escape character is the quote: it's either escaping the next
+			/// quote, or the end of the field.
+			/// </summary>
+			QuotedQuote,
+
+			/// <summary>
+			/// After an escape character in a quoted field.
+			/// </summary>
+			Escaped,
+
+			/// <summary>
+			/// After the quote that ended a quoted field.
+			/// </summary>
+			AfterQuote,
+
+			/// <summary>
+			/// Skipping the rest of a line (a comment, or fields beyond the field count when multiline isn't supported).
+			/// </summary>
+			SkipLine,
+
+			/// <summary>
+			/// After malformed data; what the reader makes of it depends on how the error is handled.
+			/// </summary>
+			Uncertain,
+		}
+
+		/// <summary>
+		/// Follows the syntax of a CSV file, the way <see cref="T:CsvReader"/> reads it, to find where the records are.
+		/// </summary>
+		/// <remarks>
+		/// Most of the bytes are in the middle of fields, where only a few byte values matter; runs of the others are
+		/// skipped by looking each byte up in a table of the ones that do.
+		/// </remarks>
+		private class RecordScanner
+		{
+			private readonly byte _delimiter;
+			private readonly byte _quote;
+			private readonly byte _escape;
+			private readonly byte _comment;
+			private readonly bool _trimUnquoted;
+			private readonly bool _supportsMultiline;
+			private readonly bool _skipEmptyLines;
+			private readonly bool _utf8;
+			private readonly bool[] _unquotedStops = new bool[256];
+			private readonly bool[] _quotedStops = new bool[256];
+			private readonly bool[] _lineStops = new bool[256];
+
+			public RecordScanner(ParallelCsvReader reader, bool utf8)
+			{
+				_delimiter = (byte)reader._delimiter;
+				_quote = (byte)reader._quote;
+				_escape = (byte)reader._escape;
+				_comment = (byte)reader._comment;
+				_trimUnquoted = (reader._trimmingOptions & ValueTrimmingOptions.UnquotedOnly) != 0;
+				_supportsMultiline = reader._supportsMultiline;
+				_skipEmptyLines = reader._skipEmptyLines;
+				_utf8 = utf8;
+
+				_unquotedStops[_delimiter] = _unquotedStops['\r'] = _unquotedStops['\n'] = true;
+				_quotedStops[_quote] = _quotedStops[_escape] = true;
+				_lineStops['\r'] = _lineStops['\n'] = true;
+
+				FieldCount = int.MaxValue;
+			}
+
+			/// <summary>
+			/// The number of fields in a record (the fields after it are skipped when multiline isn't supported).
+			/// </summary>
+			public int FieldCount { get; set; }
+
+			/// <summary>
+			/// Scans a range of the file.
+			/// </summary>
+			/// <param name="file">The mapped file.</param>
+			/// <param name="start">The start of the range.</param>
+			/// <param name="end">The end of the range.</param>
+			/// <param name="length">The length of the file.</param>
+			/// <param name="state">The state at the start of the range; will contain the state where the scan stopped.</param>
+			/// <param name="fieldIndex">The index of the current field (-1 if it isn't known).</param>
+			/// <param name="stopAtRecordEnd"><see langword="true"/> to stop at the end of the first record.</param>
+			/// <param name="recordEnded">Set to <see langword="true"/> if the scan stopped at the end of a record.</param>
+			/// <returns>The position where the scan stopped.</returns>
+			public long Scan(MemoryMappedFile file, long start, long end, long length, ref ScanState state, ref int fieldIndex, bool stopAtRecordEnd, out bool recordEnded)
+			{
+				recordEnded = false;
+
+				long viewLength = Math.Min(end + ScanLookahead, length) - start;
+				if (viewLength <= 0)
+					return start;
+
+				var buffer = new byte[ScanBlockSize + ScanLookahead];
+				long position = start;
+
+				using (MemoryMappedViewAccessor view = file.CreateViewAccessor(start, viewLength, MemoryMappedFileAccess.Read))
+				{
+					while (position < end && state != ScanState.Uncertain)
+					{
+						int count = (int)Math.Min(ScanBlockSize, end - position);
+						int available = (int)Math.Min(buffer.Length, start + viewLength - position);
+						view.ReadArray(position - start, buffer, 0, available);
+
+						position += Scan(buffer, count, available, ref state, ref fieldIndex, stopAtRecordEnd, out recordEnded);
+
+						if (recordEnded)
+							break;
+					}
+				}
+
+				return position;
+			}
+
+			/// <summary>
+			/// Scans a block of bytes.
+			/// </summary>
+			/// <returns>The number of bytes scanned (which can be a little more than count).</returns>
+			private int Scan(byte[] buffer, int count, int available, ref ScanState state, ref int fieldIndex, bool stopAtRecordEnd, out bool recordEnded)
+			{
+				recordEnded = false;
+				int i = 0;
+				int width;
+				byte c;
+
+				while (i < count)
+				{
+					switch (state)
+					{
+						case ScanState.RecordStart:
+							c = buffer[i];
+
+							if (c == _comment)
+							{
+								state = ScanState.SkipLine;
+								i++;
+							}
+							else if (IsNewLine(c))
+							{
+								// an empty line is a record of its own, if it isn't skipped.
+								state = c == '\r' ? ScanState.CarriageReturn : ScanState.RecordStart;
+								i++;
+
+								if (!_skipEmptyLines && stopAtRecordEnd)
+								{
+									recordEnded = true;
+									return i;
+								}
+							}
+							else
+							{
+								fieldIndex = 0;
+								state = ScanState.FieldStart;
+							}
+							break;
+
+						case ScanState.CarriageReturn:
+							if (buffer[i] == '\n')
+								i++;
+
+							state = ScanState.RecordStart;
+							break;
+
+						case ScanState.FieldStart:
+							if (_trimUnquoted && (width = WhiteSpaceLength(buffer, i, available)) > 0)
+								i += width;
+							else if (buffer[i] == _quote)
+							{
+								state = ScanState.Quoted;
+								i++;
+							}
+							else
+								state = ScanState.Unquoted;
+							break;
+
+						case ScanState.Unquoted:
+							i = Skip(buffer, i, count, _unquotedStops);
+							if (i == count)
+								break;
+
+							c = buffer[i++];
+
+							if (c == _delimiter)
+								NextField(ref state, ref fieldIndex);
+							else
+							{
+								state = c == '\r' ? ScanState.CarriageReturn : ScanState.RecordStart;
+
+								if (stopAtRecordEnd)
+								{
+									recordEnded = true;
+									return i;
+								}
+							}
+							break;
+
+						case ScanState.Quoted:
+							i = Skip(buffer, i, count, _quotedStops);
+							if (i == count)
+								break;
+
+							c = buffer[i++];
+
+							if (c == _escape)
+								state = _escape == _quote ? ScanState.QuotedQuote : ScanState.Escaped;
+							else
+								state = ScanState.AfterQuote;
+							break;
+
+						case ScanState.QuotedQuote:
+							if (buffer[i] == _quote)
+							{
+								state = ScanState.Quoted;
+								i++;
+							}
+							else
+								state = ScanState.AfterQuote;
+							break;
+
+						case ScanState.Escaped:
+							state = ScanState.Quoted;
+							i++;
+							break;
+
+						case ScanState.AfterQuote:
+							c = buffer[i];
+
+							if ((width = WhiteSpaceLength(buffer, i, available)) > 0)
+								i += width;
+							else if (c == _delimiter)
+							{
+								NextField(ref state, ref fieldIndex);
+								i++;
+							}
+							else if (IsNewLine(c))
+							{
+								state = c == '\r' ? ScanState.CarriageReturn : ScanState.RecordStart;
+								i++;
+
+								if (stopAtRecordEnd)
+								{
+									recordEnded = true;
+									return i;
+								}
+							}
+							else
+							{
+								state = ScanState.Uncertain;
+								return count;
+							}
+							break;
+
+						case ScanState.SkipLine:
+							i = Skip(buffer, i, count, _lineStops);
+							if (i == count)
+								break;
+
+							c = buffer[i++];
+
+							if (IsNewLine(c))
+								state = c == '\r' ? ScanState.CarriageReturn : ScanState.RecordStart;
+							break;
+
+						default:
+							return count;
+					}
+				}
+
+				return i;
+			}
+
+			private void NextField(ref ScanState state, ref int fieldIndex)
+			{
+				if (fieldIndex >= 0)
+					fieldIndex++;
+
+				state = !_supportsMultiline && fieldIndex >= FieldCount ? ScanState.SkipLine : ScanState.FieldStart;
+			}
+
+			private bool IsNewLine(byte c)
+			{
+				return c == '\n' || (c == '\r' && _delimiter != '\r');
+			}
+
+			/// <summary>
+			/// Gets the length of the white space character at a position (see CsvReader.IsWhiteSpace).
+			/// </summary>
+			/// <returns>The number of bytes in the character, or 0 if it isn't white space.</returns>
+			private int WhiteSpaceLength(byte[] buffer, int index, int available)
+			{
+				byte c = buffer[index];
+
+				if (c == _delimiter)
+					return 0;
+
+				if (c == ' ' || c == '\t')
+					return 1;
+
+				// other white space is outside of Latin-1; in a single byte encoding, there's none of it.
+				if (c < 0x80 || !_utf8)
+					return 0;
+
+				int codePoint;
+				int width;
+
+				if ((c & 0xE0) == 0xC0 && index + 1 < available && (buffer[index + 1] & 0xC0) == 0x80)
+				{
+					codePoint = ((c & 0x1F) << 6) | (buffer[index + 1] & 0x3F);
+					width = 2;
+				}
+				else if ((c & 0xF0) == 0xE0 && index + 2 < available && (buffer[index + 1] & 0xC0) == 0x80 && (buffer[index + 2] & 0xC0) == 0x80)
+				{
+					codePoint = ((c & 0x0F) << 12) | ((buffer[index + 1] & 0x3F) << 6) | (buffer[index + 2] & 0x3F);
+					width = 3;
+				}
+				else
+					return 0;
+
+				return codePoint > 0xFF && CharUnicodeInfo.GetUnicodeCategory((char)codePoint) == UnicodeCategory.SpaceSeparator ? width : 0;
+			}
+
+			/// <summary>
+			/// Skips the bytes that aren't in a table of stops.
+			/// </summary>
+			/// <returns>The index of the first stop, or count if there isn't one.</returns>
+			private static int Skip(byte[] buffer, int index, int count, bool[] stops)
+			{
+				while (index < count && !stops[buffer[index]])
+					index++;
+
+				return index;
+			}
+		}
+
+		#endregion
+	}
+}
@@ -10,6 +10,7 @@
 
 namespace CoApp.Toolkit.Scripting.Languages.CSharp {
     using System.Collections.Generic;
+    using System.IO;
     using Utility;
 
     /// <summary>
@@ -105,5 +106,14 @@ namespace CoApp.Toolkit.Scripting.Languages.CSharp {
             tokenizer.Tokenize();
             return tokenizer.Tokens;
         }
+
+        /// <summary>
+        ///   Tokenizes source code from a stream, returning the tokens as they are found
+        /// </summary>
+        /// <param name = "reader">The C# source code to tokenize</param>
+        /// <returns>The tokens</returns>
+        public new static IEnumerable<Token> Tokenize(TextReader reader) {
+            return new CSharpTokenizer(new char[0]).TokenizeStream(reader);
+        }
     }
 }
\ No newline at end of file
@@ -10,6 +10,7 @@
 
 namespace CoApp.Toolkit.Scripting.Languages.GSharp {
     using System.Collections.Generic;
+    using System.IO;
     using CSharp;
     using Utility;
 
@@ -75,5 +76,14 @@ namespace CoApp.Toolkit.Scripting.Languages.GSharp {
             tokenizer.Tokenize();
             return tokenizer.Tokens;
         }
+
+        /// <summary>
+        ///   Tokenizes source code from a stream, returning the tokens as they are found
+        /// </summary>
+        /// <param name = "reader">The g# source code to tokenize</param>
+        /// <returns>The tokens</returns>
+        public new static IEnumerable<Token> Tokenize(TextReader reader) {
+            return new GSharpTokenizer(new char[0]).TokenizeStream(reader);
+        }
     }
 }
\ No newline at end of file
@@ -0,0 +1,600 @@
+﻿//-----------------------------------------------------------------------
+// <copyright company="CoApp Project">
+//     Copyright (c) 2011 Garrett Serack. All rights reserved.
+// </copyright>
+// <license>
+//     The software is licensed under the Apache 2.0 License (the "License")
+//     You may not use the software except in compliance with the License.
+// </license>
+//-----------------------------------------------------------------------
+
+namespace CoApp.Toolkit.Scripting.Languages.PropertySheet {
+    using System;
+    using System.Collections.Generic;
+    using System.IO;
+    using System.Linq;
+    using System.Security.Cryptography;
+    using System.Text;
+    using Extensions;
+    using Logging;
+    using Utility;
+
+    /// <summary>
+    /// Remembers what parsing a property sheet did, so that loading the same sheet again doesn't have to tokenize or parse it.
+    /// </summary>
+    /// <remarks>
+    /// A sheet is remembered as the list of its top-level blocks (a rule, or an @import, along with any whitespace and comments
+    /// in front of it), and each block as the operations the parser performed on the property sheet for it (get a rule, get a
+    /// property, add a value, import a file). Loading a sheet replays those operations onto a new property sheet.
+    ///
+    /// When a sheet has changed since it was last parsed, the blocks at the start and at the end that are still the same are
+    /// reused, and only the text between them is parsed again. If that doesn't work out cleanly (ie, the text in between
+    /// doesn't end where a block did), or it has an error in it, the whole sheet is parsed the old way, so errors are reported
+    /// exactly as they always have been.
+    ///
+    /// @import'ed files are loaded through the cache too, each time the importing sheet is replayed, so changes to them are
+    /// always seen.
+    ///
+    /// The cache is kept in memory, and written to <see cref="CacheFolder"/>, so that it survives from one run to the next.
+    /// </remarks>
+    public static class PropertySheetCache {
+        private const int CacheVersion = 2;
+
+        private static readonly Dictionary<string, CachedSheet> _sheets = new Dictionary<string, CachedSheet>(StringComparer.OrdinalIgnoreCase);
+
+        static PropertySheetCache() {
+            Enabled = true;
+            CacheFolder = Path.Combine(FilesystemExtensions.OriginalTempFolder, "PropertySheetCache");
+        }
+
+        /// <summary>
+        /// When false, property sheets are always parsed from scratch.
+        /// </summary>
+        public static bool Enabled { get; set; }
+
+        /// <summary>
+        /// Where the parsed sheets are written to. When null, the cache is only kept in memory.
+        /// </summary>
+        public static string CacheFolder { get; set; }
+
+        /// <summary>
+        /// Forgets everything that is cached (in memory; the cache folder is left alone).
+        /// </summary>
+        public static void Clear() {
+            lock (_sheets) {
+                _sheets.Clear();
+            }
+        }
+
+        private enum OperationType : byte {
+            Rule,
+            Property,
+            Value,
+            Import,
+        }
+
+        /// <summary>
+        /// Something the parser did to the property sheet.
+        ///
+        /// The Row is relative to the start of the block; the Column is as it is in the file.
+        /// </summary>
+        private class Operation {
+            internal OperationType Type;
+            internal int Row;
+            internal int Column;
+
+            // a rule's name, a property's name, or an imported filename.
+            internal string Name;
+            internal string Parameter;
+            internal string Class;
+            internal string Id;
+            internal string Label;
+            internal string CollectionName;
+            internal string Value;
+        }
+
+        private class Block {
+            internal int Length;
+            internal string Hash;
+
+            /// <summary>
+            /// How many characters the block started after the beginning of its line (the columns on the first line of the
+            /// block depend on it).
+            /// </summary>
+            internal int LineOffset;
+
+            internal List<Operation> Operations = new List<Operation>();
+        }
+
+        private class CachedSheet {
+            internal string Hash;
+            internal Block[] Blocks;
+
+            /// <summary>
+            /// the row each block starts on.
+            /// </summary>
+            internal int[] Rows;
+        }
+
+        /// <summary>
+        /// A parser that records what it does to the property sheet (a scratch one; @imports are only recorded).
+        /// </summary>
+        private class RecordingParser : PropertySheetParser {
+            private readonly int _prefixLength;
+            internal readonly List<Block> Blocks = new List<Block>();
+
+            /// <summary>
+            /// the end of each block (in the text being parsed).
+            /// </summary>
+            internal readonly List<int> BlockEnds = new List<int>();
+
+            private Block _block = new Block();
+
+            internal RecordingParser(string text, int prefixLength, string filename)
+                : base(text, filename, new PropertySheet()) {
+                _prefixLength = prefixLength;
+            }
+
+            internal void Run() {
+                Parse();
+                if (_block.Operations.Count > 0) {
+                    Blocks.Add(_block);
+                    BlockEnds.Add(-1);
+                }
+            }
+
+            protected override Rule GetRule(string name, string parameter, string @class, string id, SourceLocation sourceLocation) {
+                _block.Operations.Add(new Operation {
+                    Type = OperationType.Rule,
+                    Row = sourceLocation.Row,
+                    Column = sourceLocation.Column,
+                    Name = name,
+                    Parameter = parameter,
+                    Class = @class,
+                    Id = id,
+                });
+                return base.GetRule(name, parameter, @class, id, sourceLocation);
+            }
+
+            protected override NewRuleProperty GetRuleProperty(Rule rule, string name) {
+                _block.Operations.Add(new Operation {
+                    Type = OperationType.Property,
+                    Name = name,
+                });
+                return base.GetRuleProperty(rule, name);
+            }
+
+            protected override void AddPropertyValue(NewRuleProperty property, string label, string collectionName, string value, SourceLocation sourceLocation) {
+                _block.Operations.Add(new Operation {
+                    Type = OperationType.Value,
+                    Row = sourceLocation.Row,
+                    Column = sourceLocation.Column,
+                    Label = label,
+                    CollectionName = collectionName,
+                    Value = value,
+                });
+                base.AddPropertyValue(property, label, collectionName, value, sourceLocation);
+            }
+
+            protected override void Import(Token token, string importFilename) {
+                // the file is read when the block is replayed.
+                _block.Operations.Add(new Operation {
+                    Type = OperationType.Import,
+                    Row = token.Row,
+                    Column = token.Column,
+                    Name = importFilename,
+                });
+            }
+
+            protected override void EndOfBlock(Token token) {
+                Blocks.Add(_block);
+                BlockEnds.Add(token.Offset + 1 - _prefixLength);
+                _block = new Block();
+            }
+        }
+
+        /// <summary>
+        /// Parses a property sheet into the given property sheet, using the cache when it can.
+        /// </summary>
+        internal static PropertySheet Parse(string text, string filename, PropertySheet propertySheet) {
+            text = text ?? string.Empty;
+            var key = CacheKey(filename);
+
+            CachedSheet cached;
+            using (var md5 = MD5.Create()) {
+                var hash = Hash(md5, text, 0, text.Length);
+                cached = Lookup(key);
+
+                if (cached == null || cached.Hash != hash) {
+                    cached = Reparse(md5, text, filename, cached);
+                    if (cached == null) {
+                        // there's a problem in there somewhere; let the parser report it.
+                        return PropertySheetParser.ParseWithoutCache(text, filename, propertySheet);
+                    }
+                    cached.Hash = hash;
+                    Store(key, cached);
+                }
+            }
+
+            Replay(cached, filename, propertySheet);
+            return propertySheet;
+        }
+
+        private static void Replay(CachedSheet cached, string filename, PropertySheet propertySheet) {
+            Rule rule = null;
+            NewRuleProperty property = null;
+
+            for (var i = 0; i < cached.Blocks.Length; i++) {
+                var row = cached.Rows[i];
+                foreach (var op in cached.Blocks[i].Operations) {
+                    switch (op.Type) {
+                        case OperationType.Rule:
+                            rule = propertySheet.GetRule(op.Name, op.Parameter, op.Class, op.Id);
+                            rule.SourceLocation = new SourceLocation {
+                                Row = row + op.Row,
+                                Column = op.Column,
+                                SourceFile = filename,
+                            };
+                            break;
+
+                        case OperationType.Property:
+                            property = rule.GetRuleProperty(op.Name);
+                            break;
+
+                        case OperationType.Value:
+                            var pv = property.GetPropertyValue(op.Label, op.CollectionName);
+                            pv.Add(op.Value);
+                            pv.SourceLocation = new SourceLocation {
+                                Row = row + op.Row,
+                                Column = op.Column,
+                                SourceFile = filename,
+                            };
+                            break;
+
+                        case OperationType.Import:
+                            string importedFilename;
+                            var document = PropertySheetParser.ReadImport(new Token {Row = row + op.Row, Column = op.Column}, filename, op.Name, out importedFilename);
+                            Parse(document, importedFilename, propertySheet);
+                            break;
+                    }
+                }
+            }
+        }
+
+        /// <summary>
+        /// Works out the blocks of a sheet that has changed (or has never been seen), reusing the ones that haven't changed.
+        /// </summary>
+        /// <returns>the new blocks, or null if the text has to be parsed the old way.</returns>
+        private static CachedSheet Reparse(MD5 md5, string text, string filename, CachedSheet previous) {
+            var head = new List<Block>();
+            var tail = new List<Block>();
+            var start = 0;
+            var end = text.Length;
+
+            if (previous != null) {
+                // the last block is never reused at the front; it ends where the text did, not where a block did.
+                for (var i = 0; i < previous.Blocks.Length - 1; i++) {
+                    var block = previous.Blocks[i];
+                    if (start + block.Length > end || Hash(md5, text, start, block.Length) != block.Hash) {
+                        break;
+                    }
+                    head.Add(block);
+                    start += block.Length;
+                }
+
+                for (var i = previous.Blocks.Length - 1; i >= head.Count; i--) {
+                    var block = previous.Blocks[i];
+                    var blockStart = end - block.Length;
+                    if (blockStart < start || LineOffset(text, blockStart) != block.LineOffset || Hash(md5, text, blockStart, block.Length) != block.Hash) {
+                        break;
+                    }
+                    tail.Insert(0, block);
+                    end = blockStart;
+                }
+            }
+
+            var blocks = new List<Block>(head);
+            var offsets = new List<int>();
+            var offset = 0;
+            foreach (var block in head) {
+                offsets.Add(offset);
+                offset += block.Length;
+            }
+
+            if (end > start) {
+                // parse what's changed, with enough whitespace in front of it that the tokens get the same rows and columns
+                // that they would if the whole text was parsed.
+                var prefix = Prefix(text, start);
+                var parser = new RecordingParser(prefix + text.Substring(start, end - start), prefix.Length, filename);
+                try {
+                    parser.Run();
+                }
+                catch (Exception) {
+                    return null;
+                }
+
+                var lastEnd = parser.BlockEnds.Count > 0 ? parser.BlockEnds.Last() : -1;
+                if (tail.Count > 0 && lastEnd != end - start) {
+                    // the change didn't end where a block did; the blocks after it can't be trusted.
+                    return Reparse(md5, text, filename, null);
+                }
+
+                var rows = new RowCounter(text);
+                for (var i = 0; i < parser.Blocks.Count; i++) {
+                    var block = parser.Blocks[i];
+                    var blockEnd = parser.BlockEnds[i] < 0 ? end : start + parser.BlockEnds[i];
+                    block.Length = blockEnd - offset;
+                    block.Hash = Hash(md5, text, offset, block.Length);
+                    block.LineOffset = LineOffset(text, offset);
+
+                    var row = rows.RowAt(offset);
+                    foreach (var op in block.Operations.Where(each => each.Type != OperationType.Property)) {
+                        op.Row -= row;
+                    }
+
+                    blocks.Add(block);
+                    offsets.Add(offset);
+                    offset = blockEnd;
+                }
+
+                if (offset < end) {
+                    // whitespace or comments after the last block.
+                    blocks.Add(new Block {
+                        Length = end - offset,
+                        Hash = Hash(md5, text, offset, end - offset),
+                        LineOffset = LineOffset(text, offset),
+                    });
+                    offsets.Add(offset);
+                    offset = end;
+                }
+            }
+
+            foreach (var block in tail) {
+                blocks.Add(block);
+                offsets.Add(offset);
+                offset += block.Length;
+            }
+
+            var blockRows = new RowCounter(text);
+            return new CachedSheet {
+                Blocks = blocks.ToArray(),
+                Rows = offsets.Select(blockRows.RowAt).ToArray(),
+            };
+        }
+
+        /// <summary>
+        /// Works out which row the tokenizer says a character is on, for offsets that only ever go forward.
+        /// </summary>
+        private class RowCounter {
+            private readonly string _text;
+
+            // (the first character is never counted as a line break.)
+            private int _index = 1;
+            private int _row = 1;
+
+            internal RowCounter(string text) {
+                _text = text;
+            }
+
+            internal int RowAt(int offset) {
+                for (; _index < offset; _index++) {
+                    if (_text[_index] == '\n') {
+                        _row++;
+                    }
+                }
+                return _row;
+            }
+        }
+
+        /// <summary>
+        /// The number of characters between the last line break before <paramref name="offset"/> and it.
+        /// </summary>
+        private static int LineOffset(string text, int offset) {
+            return offset - LastLineBreak(text, offset);
+        }
+
+        private static int LastLineBreak(string text, int offset) {
+            for (var i = offset - 1; i > 0; i--) {
+                if (text[i] == '\n' || text[i] == '\r') {
+                    return i;
+                }
+            }
+            return 0;
+        }
+
+        /// <summary>
+        /// Whitespace that leaves the tokenizer at the same row and column as it is at <paramref name="offset"/> in the text.
+        /// </summary>
+        private static string Prefix(string text, int offset) {
+            if (offset == 0) {
+                return string.Empty;
+            }
+
+            var lineBreak = LastLineBreak(text, offset);
+            if (lineBreak == 0) {
+                return new string(' ', offset);
+            }
+            return " " + new string('\n', new RowCounter(text).RowAt(offset) - 1) + (text[lineBreak] == '\r' ? "\r" : string.Empty) + new string(' ', offset - lineBreak - 1);
+        }
+
+        private static string Hash(MD5 md5, string text, int start, int length) {
+            return md5.ComputeHash(Encoding.UTF8.GetBytes(text.Substring(start, length))).ToHexString();
+        }
+
+        private static string CacheKey(string filename) {
+            if (string.IsNullOrEmpty(filename)) {
+                return string.Empty;
+            }
+            try {
+                return filename.GetFullPath();
+            }
+            catch {
+                return filename;
+            }
+        }
+
+        private static CachedSheet Lookup(string key) {
+            lock (_sheets) {
+                CachedSheet cached;
+                if (_sheets.TryGetValue(key, out cached)) {
+                    return cached;
+                }
+            }
+
+            var cacheFile = CacheFile(key);
+            if (cacheFile == null || !File.Exists(cacheFile)) {
+                return null;
+            }
+
+            try {
+                using (var binaryReader = new BinaryReader(File.OpenRead(cacheFile), Encoding.UTF8)) {
+                    if (binaryReader.ReadInt32() != CacheVersion || !string.Equals(binaryReader.ReadString(), key, StringComparison.OrdinalIgnoreCase)) {
+                        return null;
+                    }
+
+                    var cached = new CachedSheet {
+                        Hash = binaryReader.ReadString(),
+                        Blocks = new Block[binaryReader.ReadInt32()],
+                    };
+                    cached.Rows = new int[cached.Blocks.Length];
+
+                    for (var i = 0; i < cached.Blocks.Length; i++) {
+                        cached.Rows[i] = binaryReader.ReadInt32();
+                        var block = cached.Blocks[i] = new Block {
+                            Length = binaryReader.ReadInt32(),
+                            Hash = binaryReader.ReadString(),
+                            LineOffset = binaryReader.ReadInt32(),
+                        };
+
+                        var count = binaryReader.ReadInt32();
+                        for (var j = 0; j < count; j++) {
+                            var op = new Operation {
+                                Type = (OperationType)binaryReader.ReadByte(),
+                                Row = binaryReader.ReadInt32(),
+                                Column = binaryReader.ReadInt32(),
+                            };
+
+                            switch (op.Type) {
+                                case OperationType.Rule:
+                                    op.Name = ReadString(binaryReader);
+                                    op.Parameter = ReadString(binaryReader);
+                                    op.Class = ReadString(binaryReader);
+                                    op.Id = ReadString(binaryReader);
+                                    break;
+                                case OperationType.Property:
+                                case OperationType.Import:
+                                    op.Name = ReadString(binaryReader);
+                                    break;
+                                case OperationType.Value:
+                                    op.Label = ReadString(binaryReader);
+                                    op.CollectionName = ReadString(binaryReader);
+                                    op.Value = ReadString(binaryReader);
+                                    break;
+                                default:
+                                    throw new InvalidDataException("Unknown operation in property sheet cache '{0}'".format(cacheFile));
+                            }
+                            block.Operations.Add(op);
+                        }
+                    }
+
+                    lock (_sheets) {
+                        _sheets[key] = cached;
+                    }
+                    return cached;
+                }
+            }
+            catch (Exception e) {
+                // a bad cache just means we parse the sheet again.
+                Logger.Error(e);
+                return null;
+            }
+        }
+
+        private static void Store(string key, CachedSheet cached) {
+            lock (_sheets) {
+                _sheets[key] = cached;
+            }
+
+            var cacheFile = CacheFile(key);
+            if (cacheFile == null) {
+                return;
+            }
+
+            try {
+                Directory.CreateDirectory(Path.GetDirectoryName(cacheFile));
+
+                // order of the following is very important.
+                using (var binaryWriter = new BinaryWriter(File.Create(cacheFile), Encoding.UTF8)) {
+                    binaryWriter.Write(CacheVersion);
+                    binaryWriter.Write(key);
+                    binaryWriter.Write(cached.Hash);
+                    binaryWriter.Write(cached.Blocks.Length);
+
+                    for (var i = 0; i < cached.Blocks.Length; i++) {
+                        var block = cached.Blocks[i];
+                        binaryWriter.Write(cached.Rows[i]);
+                        binaryWriter.Write(block.Length);
+                        binaryWriter.Write(block.Hash);
+                        binaryWriter.Write(block.LineOffset);
+                        binaryWriter.Write(block.Operations.Count);
+
+                        foreach (var op in block.Operations) {
+                            binaryWriter.Write((byte)op.Type);
+                            binaryWriter.Write(op.Row);
+                            binaryWriter.Write(op.Column);
+
+                            switch (op.Type) {
+                                case OperationType.Rule:
+                                    WriteString(binaryWriter, op.Name);
+                                    WriteString(binaryWriter, op.Parameter);
+                                    WriteString(binaryWriter, op.Class);
+                                    WriteString(binaryWriter, op.Id);
+                                    break;
+                                case OperationType.Property:
+                                case OperationType.Import:
+                                    WriteString(binaryWriter, op.Name);
+                                    break;
+                                case OperationType.Value:
+                                    WriteString(binaryWriter, op.Label);
+                                    WriteString(binaryWriter, op.CollectionName);
+                                    WriteString(binaryWriter, op.Value);
+                                    break;
+                            }
+                        }
+                    }
+                }
+            }
+            catch (Exception e) {
+                Logger.Error(e);
+                try {
+                    File.Delete(cacheFile);
+                }
+                catch {
+                    // we tried.
+                }
+            }
+        }
+
+        /// <summary>
+        /// The file a sheet is cached in (null if it isn't cached on disk).
+        /// </summary>
+        private static string CacheFile(string key) {
+            var folder = CacheFolder;
+            if (string.IsNullOrEmpty(folder) || string.IsNullOrEmpty(key)) {
+                return null;
+            }
+            return Path.Combine(folder, key.ToLower().MD5Hash() + ".cache");
+        }
+
+        private static string ReadString(BinaryReader binaryReader) {
+            return binaryReader.ReadBoolean() ? binaryReader.ReadString() : null;
+        }
+
+        private static void WriteString(BinaryWriter binaryWriter, string value) {
+            binaryWriter.Write(value != null);
+            if (value != null) {
+                binaryWriter.Write(value);
+            }
+        }
+    }
+}
@@ -148,35 +148,9 @@ namespace CoApp.Toolkit.Scripting.Languages.PropertySheet {
                     case ParseState.ImportFilename:
                         switch (token.Type) {
                             case TokenType.Semicolon:
-                                // import the specified file and insert it's rules into this sheet.
-                                string document = null;
-                                string filename = null;
-
-                                if (!string.IsNullOrEmpty(_filename)) {
-                                    // it's either a full path to a file, or a relative path to the current document.
-                                    try {
-                                        var folder = Path.GetDirectoryName(_filename.GetFullPath());
-                                        filename = Path.Combine(folder, importFilename);
-                                        if (File.Exists(filename)) {
-                                            document = File.ReadAllText(filename);
-                                        }
-                                    } catch {
-                                    } // hmm that didn't work. I guess just try the filename...
-                                }
-
-                                if( document == null ) {
-                                    // without a filename for the current document, all we can do is hope that there is a file at the specified string
-
-                                    filename = importFilename.GetFullPath();
-                                    if (!File.Exists(filename)) {
-                                        throw new EndUserParseException(token, _filename, "PSP 122", "Imported file '{0}' not found", filename);
-                                    }
-                                    document = File.ReadAllText(filename);
-                                }
-
-                                // parse the contents of that file into the current property sheet.
-                                new PropertySheetParser(document, filename, _propertySheet).Parse();
+                                Import(token, importFilename);
                                 state = ParseState.Global;
+                                EndOfBlock(token);
                                 continue;
                             default:
                                 throw new EndUserParseException(token, _filename, "PSP 121", "Expected a string literal for filename");
@@ -204,14 +178,12 @@ namespace CoApp.Toolkit.Scripting.Languages.PropertySheet {
                                    // throw new EndUserParseException(token, _filename, "PSP 113", "Duplicate rule with identical selector not allowed: {0} ", Rule.CreateSelectorString(ruleName, ruleParameter,ruleClass, ruleId )); 
                                 // }
 
-                                rule = _propertySheet.GetRule(ruleName, ruleParameter, ruleClass, ruleId);
+                                rule = GetRule(ruleName, ruleParameter, ruleClass, ruleId, sourceLocation);
                                 
                                 ruleName = null;
                                 ruleParameter = null;
                                 ruleClass = null;
                                 ruleId = null;
-
-                                rule.SourceLocation = sourceLocation;
                                 continue;
 
                             default:
@@ -261,6 +233,7 @@ namespace CoApp.Toolkit.Scripting.Languages.PropertySheet {
                                 // this rule is DONE.
                                 rule = null; // set this to null, so that we don't accidentally add new stuff to this rule.
                                 state = ParseState.Global;
+                                EndOfBlock(token);
                                 continue;
 
                             default:
@@ -271,7 +244,7 @@ namespace CoApp.Toolkit.Scripting.Languages.PropertySheet {
                         switch (token.Type) {
                             case TokenType.Colon:
                                 state = ParseState.HavePropertySeparator;
-                                property = rule.GetRuleProperty(propertyName);
+                                property = GetRuleProperty(rule, propertyName);
                                 continue;
 
                             default:
@@ -339,9 +312,7 @@ namespace CoApp.Toolkit.Scripting.Languages.PropertySheet {
 
                             case TokenType.Comma: {
                                     // turns out its a simple collection item.
-                                    var pv = property.GetPropertyValue(string.Empty);
-                                    pv.Add(presentlyUnknownValue);
-                                    pv.SourceLocation = sourceLocation;
+                                    AddPropertyValue(property, string.Empty, null, presentlyUnknownValue, sourceLocation);
                                     presentlyUnknownValue = null;
                                     state = ParseState.InPropertyCollectionWithoutLabel;
                                 }
@@ -349,9 +320,7 @@ namespace CoApp.Toolkit.Scripting.Languages.PropertySheet {
 
                             case TokenType.CloseBrace: {
                                     // turns out its a simple collection item.
-                                    var pv = property.GetPropertyValue(string.Empty);
-                                    pv.Add(presentlyUnknownValue);
-                                    pv.SourceLocation = sourceLocation;
+                                    AddPropertyValue(property, string.Empty, null, presentlyUnknownValue, sourceLocation);
                                     presentlyUnknownValue = null;
                                     state = ParseState.HavePropertyCompleted;
                                 }
@@ -366,9 +335,7 @@ namespace CoApp.Toolkit.Scripting.Languages.PropertySheet {
                             case TokenType.StringLiteral:
                             case TokenType.NumericLiteral:
                             case TokenType.Identifier: {
-                                    var pv = property.GetPropertyValue(propertyLabelText);
-                                    pv.Add(token.Data);
-                                    pv.SourceLocation = sourceLocation;
+                                    AddPropertyValue(property, propertyLabelText, null, (string)token.Data, sourceLocation);
                                     state = ParseState.InPropertyCollectionWithoutLabelWaitingForComma;
                                 }
                                 continue;
@@ -401,9 +368,7 @@ namespace CoApp.Toolkit.Scripting.Languages.PropertySheet {
                             case TokenType.Comma :
                             case TokenType.CloseBrace: {
                                 // assumes "${DEFAULTLAMBDAVALUE}" for the lamda value
-                                    var pv = property.GetPropertyValue(propertyLabelText, collectionName);
-                                    pv.Add("${DEFAULTLAMBDAVALUE}");
-                                    pv.SourceLocation = sourceLocation;
+                                    AddPropertyValue(property, propertyLabelText, collectionName, "${DEFAULTLAMBDAVALUE}", sourceLocation);
                                     collectionName = propertyLabelText = null;
                                     state = ParseState.InPropertyCollectionWithoutLabelWaitingForComma;
                                 }   
@@ -425,9 +390,7 @@ namespace CoApp.Toolkit.Scripting.Languages.PropertySheet {
                             case TokenType.StringLiteral:
                             case TokenType.NumericLiteral:
                             case TokenType.Identifier: {
-                                    var pv = property.GetPropertyValue(propertyLabelText, collectionName);
-                                    pv.Add(token.Data);
-                                    pv.SourceLocation = sourceLocation;
+                                    AddPropertyValue(property, propertyLabelText, collectionName, (string)token.Data, sourceLocation);
                                     collectionName = propertyLabelText = null;
                                     state = ParseState.InPropertyCollectionWithoutLabelWaitingForComma;
                                 }   
@@ -472,18 +435,14 @@ namespace CoApp.Toolkit.Scripting.Languages.PropertySheet {
                     case ParseState.HaveCollectionValue: 
                         switch (token.Type) {
                             case TokenType.Comma: {
-                                    var pv = property.GetPropertyValue(propertyLabelText);
-                                    pv.Add(presentlyUnknownValue);
-                                    pv.SourceLocation = sourceLocation;
+                                    AddPropertyValue(property, propertyLabelText, null, presentlyUnknownValue, sourceLocation);
                                     collectionName = propertyLabelText = null;
                                     state = ParseState.InPropertyCollectionWithLabel;
                                 }
                                 continue;
 
                             case TokenType.CloseBrace: {
-                                    var pv = property.GetPropertyValue(propertyLabelText);
-                                    pv.Add(presentlyUnknownValue);
-                                    pv.SourceLocation = sourceLocation;
+                                    AddPropertyValue(property, propertyLabelText, null, presentlyUnknownValue, sourceLocation);
                                     collectionName = propertyLabelText = null;
                                     state = ParseState.HavePropertyCompleted;
                                 }
@@ -516,9 +475,7 @@ namespace CoApp.Toolkit.Scripting.Languages.PropertySheet {
                             case TokenType.Semicolon: {
                                     // it turns out that what we thought the label was, is really the property value,
                                     // the label is an empty string
-                                    var pv = property.GetPropertyValue(string.Empty);
-                                    pv.Add(propertyLabelText);
-                                    pv.SourceLocation = sourceLocation;
+                                    AddPropertyValue(property, string.Empty, null, propertyLabelText, sourceLocation);
                                     propertyName = propertyLabelText = null;
                                     state = ParseState.InRule;
                                 }
@@ -534,9 +491,7 @@ namespace CoApp.Toolkit.Scripting.Languages.PropertySheet {
                             case TokenType.StringLiteral:
                             case TokenType.NumericLiteral: {
                                     // found our property-value. add it, and move along.
-                                    var pv = property.GetPropertyValue(propertyLabelText);
-                                    pv.Add(token.Data);
-                                    pv.SourceLocation = sourceLocation;
+                                    AddPropertyValue(property, propertyLabelText, null, (string)token.Data, sourceLocation);
                                     propertyName = propertyLabelText = null;
                                     state = ParseState.HavePropertyCompleted;
                                 }
@@ -568,8 +523,86 @@ namespace CoApp.Toolkit.Scripting.Languages.PropertySheet {
             return _propertySheet;
         }
 
+        /// <summary>
+        /// Gets (or creates) the rule for a selector, and records where it was (re)defined.
+        /// </summary>
+        protected virtual Rule GetRule(string name, string parameter, string @class, string id, SourceLocation sourceLocation) {
+            var rule = _propertySheet.GetRule(name, parameter, @class, id);
+            rule.SourceLocation = sourceLocation;
+            return rule;
+        }
+
+        protected virtual NewRuleProperty GetRuleProperty(Rule rule, string name) {
+            return rule.GetRuleProperty(name);
+        }
+
+        protected virtual void AddPropertyValue(NewRuleProperty property, string label, string collectionName, string value, SourceLocation sourceLocation) {
+            var pv = property.GetPropertyValue(label, collectionName);
+            pv.Add(value);
+            pv.SourceLocation = sourceLocation;
+        }
+
+        /// <summary>
+        /// Parses an @import'ed file into the current property sheet.
+        /// </summary>
+        protected virtual void Import(Token token, string importFilename) {
+            string filename;
+            var document = ReadImport(token, _filename, importFilename, out filename);
+            new PropertySheetParser(document, filename, _propertySheet).Parse();
+        }
+
+        /// <summary>
+        /// Called when a rule or an @import is finished, and the parser is back at the top level.
+        /// </summary>
+        /// <param name="token">the closing brace or semicolon.</param>
+        protected virtual void EndOfBlock(Token token) {
+        }
+
+        /// <summary>
+        /// Finds and reads the file that an @import refers to.
+        /// </summary>
+        /// <param name="token">the token to report an error at.</param>
+        /// <param name="currentFilename">the file that has the @import in it (may be null).</param>
+        /// <param name="importFilename">the filename in the @import</param>
+        /// <param name="filename">the full path of the imported file</param>
+        /// <returns>the contents of the imported file</returns>
+        internal static string ReadImport(Token token, string currentFilename, string importFilename, out string filename) {
+            string document = null;
+            filename = null;
+
+            if (!string.IsNullOrEmpty(currentFilename)) {
+                // it's either a full path to a file, or a relative path to the current document.
+                try {
+                    var folder = Path.GetDirectoryName(currentFilename.GetFullPath());
+                    filename = Path.Combine(folder, importFilename);
+                    if (File.Exists(filename)) {
+                        document = File.ReadAllText(filename);
+                    }
+                } catch {
+                } // hmm that didn't work. I guess just try the filename...
+            }
+
+            if( document == null ) {
+                // without a filename for the current document, all we can do is hope that there is a file at the specified string
+
+                filename = importFilename.GetFullPath();
+                if (!File.Exists(filename)) {
+                    throw new EndUserParseException(token, currentFilename, "PSP 122", "Imported file '{0}' not found", filename);
+                }
+                document = File.ReadAllText(filename);
+            }
+            return document;
+        }
+
         public static PropertySheet Parse(string propertySheetText, string originalFilename, PropertySheet propertySheet = null ) {
-            var p = new PropertySheetParser(propertySheetText,originalFilename,propertySheet ?? new PropertySheet());
+            if (PropertySheetCache.Enabled) {
+                return PropertySheetCache.Parse(propertySheetText, originalFilename, propertySheet ?? new PropertySheet());
+            }
+            return ParseWithoutCache(propertySheetText, originalFilename, propertySheet ?? new PropertySheet());
+        }
+
+        internal static PropertySheet ParseWithoutCache(string propertySheetText, string originalFilename, PropertySheet propertySheet) {
+            var p = new PropertySheetParser(propertySheetText,originalFilename,propertySheet);
             return p.Parse();
         }
 
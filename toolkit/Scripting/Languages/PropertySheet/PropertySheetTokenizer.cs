@@ -10,6 +10,7 @@
 
 namespace CoApp.Toolkit.Scripting.Languages.PropertySheet {
     using System.Collections.Generic;
+    using System.IO;
     using Utility;
 
     public class PropertySheetTokenizer : Tokenizer {
@@ -57,6 +58,15 @@ namespace CoApp.Toolkit.Scripting.Languages.PropertySheet {
             return tokenizer.Tokens;
         }
 
+        /// <summary>
+        ///   Tokenizes source code from a stream, returning the tokens as they are found
+        /// </summary>
+        /// <param name = "reader">The CPS source code to tokenize</param>
+        /// <returns>The tokens</returns>
+        public new static IEnumerable<Token> Tokenize(TextReader reader) {
+            return new PropertySheetTokenizer(new char[0]).TokenizeStream(reader);
+        }
+
         protected override void ParsePound() {
             AddToken(Pound);
         }
@@ -13,6 +13,11 @@ namespace CoApp.Toolkit.Scripting.Utility {
     ///   Represents a Token along with the textual representation of the token
     /// </summary>
     public struct Token {
+        /// <summary>
+        ///   the data, or the source text (a char[]) when the token points into it.
+        /// </summary>
+        private object _data;
+
         /// <summary>
         ///   The TokenType of the token
         /// </summary>
@@ -21,7 +26,17 @@ namespace CoApp.Toolkit.Scripting.Utility {
         /// <summary>
         ///   the data associated with the Token
         /// </summary>
-        public dynamic Data { get; set; }
+        /// <remarks>
+        ///   When the token points into the source text (see <see cref="Start"/> and <see cref="Length"/>), this is the
+        ///   text of the token, as a new string each time.
+        /// </remarks>
+        public dynamic Data {
+            get {
+                var source = _data as char[];
+                return source != null ? new string(source, Start, Length) : _data;
+            }
+            set { _data = value; }
+        }
 
         /// <summary>
         ///    the data in its raw state.
@@ -38,6 +53,29 @@ namespace CoApp.Toolkit.Scripting.Utility {
         /// </summary>
         public int Column { get; set; }
 
+        /// <summary>
+        /// The index in the source text of the last character of this token
+        /// </summary>
+        public int Offset { get; set; }
+
+        /// <summary>
+        /// The characters the token's data comes from (null when the data isn't just a piece of the source text)
+        /// </summary>
+        internal char[] Source {
+            get { return _data as char[]; }
+            set { _data = value; }
+        }
+
+        /// <summary>
+        /// Where the token's data starts in <see cref="Source"/>
+        /// </summary>
+        public int Start { get; set; }
+
+        /// <summary>
+        /// The number of characters of the token's data in <see cref="Source"/>
+        /// </summary>
+        public int Length { get; set; }
+
         /// <summary>
         ///   Indicates whether two instance are equal.
         /// </summary>
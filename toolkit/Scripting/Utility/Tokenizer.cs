@@ -9,9 +9,11 @@
 //-----------------------------------------------------------------------
 
 namespace CoApp.Toolkit.Scripting.Utility {
+    using System;
     using System.Collections.Generic;
     using System.Diagnostics.CodeAnalysis;
     using System.Globalization;
+    using System.IO;
 
     /// <summary>
     ///   A moderatly generic tokenizer class 
@@ -22,6 +24,14 @@ namespace CoApp.Toolkit.Scripting.Utility {
     ///   <para>
     ///     It should be pretty darned fast. Not the absolute fastest it could run, but a fair balance between
     ///     speed and complexity I'd wager.</para>
+    ///   <para>
+    ///     Characters are dispatched with a switch (which compiles to a jump table), and identifier characters
+    ///     are classified with a lookup table for ASCII; only other characters need a unicode category lookup.
+    ///     Identifiers (when there are no keywords to check), numbers and comments are tokens that point into
+    ///     the source text; their Data is only made into a string when it's asked for.</para>
+    ///   <para>
+    ///     Text can be tokenized from a TextReader as well; the tokens are returned as they are found, and
+    ///     only a window of the text is kept in memory.</para>
     /// </summary>
     [SuppressMessage("Microsoft.StyleCop.CSharp.DocumentationRules", "SA1600:ElementsMustBeDocumented", Justification = "It's too much work.")]
     public class Tokenizer {
@@ -99,9 +109,55 @@ namespace CoApp.Toolkit.Scripting.Utility {
 
         #endregion
 
+        #region Character Classes
+
+        [Flags]
+        private enum CharacterClass : byte {
+            None = 0,
+            IdentifierStart = 1,
+            IdentifierPart = 2,
+        }
+
+        /// <summary>
+        ///   The classes of the ASCII characters (exactly what the unicode categories say they are).
+        /// </summary>
+        private static readonly CharacterClass[] AsciiCharacterClasses = CreateAsciiCharacterClasses();
+
+        private static CharacterClass[] CreateAsciiCharacterClasses() {
+            var result = new CharacterClass[128];
+            for(var ch = (char)0; ch < 128; ch++) {
+                result[ch] = (IsIdentifierStartCharacter(ch) ? CharacterClass.IdentifierStart : CharacterClass.None) |
+                    (IsIdentifierPartCharacter(ch) ? CharacterClass.IdentifierPart : CharacterClass.None);
+            }
+            return result;
+        }
+
+        #endregion
+
+        /// <summary>
+        ///   While streaming, the tokenizer always has at least this many characters ahead of it when it starts a token.
+        /// </summary>
+        private const int StreamLookahead = 4 * 1024;
+
+        /// <summary>
+        ///   How much is read from a stream at a time.
+        /// </summary>
+        private const int StreamBufferSize = 64 * 1024;
+
         protected char[] Text { get; set; }
 
         protected HashSet<string> Keywords { get; set; }
+
+        /// <summary>
+        ///   the stream being tokenized (null when it's all been read, or when tokenizing an array).
+        /// </summary>
+        private TextReader _reader;
+
+        /// <summary>
+        ///   when streaming, the number of characters of the stream that came before the start of Text.
+        /// </summary>
+        private int _textOffset;
+
         private int _index;
         private int _row = 1;
         private int _column = 1;
@@ -118,29 +174,53 @@ namespace CoApp.Toolkit.Scripting.Utility {
                 }
                 var delta = value - _index;
 
+                if (delta == 1) {
+                    // the usual case.
+                    _index = value;
+                    if (_index < Text.Length) {
+                        switch (Text[_index]) {
+                            case '\n':
+                                _linelengths.Add(_column);
+                                _column = 1;
+                                _row++;
+                                break;
+                            case '\r':
+                                _column = 1;
+                                break;
+                            default:
+                                _column++;
+                                break;
+                        }
+                    }
+                    return;
+                }
+
                 if (delta == 0) {
                     return;
                 }
 
                 while( delta < 0 ) {
-                    _index--;
-                    delta++;
-                    if (Index <= 0 )
+                    if (_index <= 0 )
                         return;
 
-                    switch (Text[_index]) {
-                        case '\n':
-                            _row--;
-                            _column = _linelengths[_row - 1];
-                            _linelengths.Remove(_row - 1);
-                            break;
-                        case '\r':
-                            /* ignore */
-                            break;
-                        default:
-                            _column--;
-                            break;
+                    // undo what moving onto the character we're leaving did (the first character never counted).
+                    if (_index < Text.Length) {
+                        switch (Text[_index]) {
+                            case '\n':
+                                _row--;
+                                _column = _linelengths[_row - 1];
+                                _linelengths.RemoveAt(_row - 1);
+                                break;
+                            case '\r':
+                                /* ignore */
+                                break;
+                            default:
+                                _column--;
+                                break;
+                        }
                     }
+                    _index--;
+                    delta++;
                 }
                 while(delta > 0) {
                     _index++;
@@ -175,7 +255,9 @@ namespace CoApp.Toolkit.Scripting.Utility {
 
         protected Tokenizer(char[] text) {
             Text = text;
-            Tokens = new List<Token>();
+            // source text runs to about one token every eight characters; sizing the list for that up front
+            // saves most of the copying as it grows.
+            Tokens = new List<Token>(text.Length / 8);
             Keywords = new HashSet<string>();
         }
 
@@ -194,171 +276,274 @@ namespace CoApp.Toolkit.Scripting.Utility {
         protected void AddToken(Token token) {
             token.Row = _row;
             token.Column = _column - 1;
+            token.Offset = _textOffset + _index;
             Tokens.Add(token);
         }
 
+        /// <summary>
+        ///   Adds a token whose data is the given characters of the text (the string isn't created until it's needed).
+        /// </summary>
+        protected void AddToken(TokenType type, int start, int length) {
+            AddToken(new Token {Type = type, Source = Text, Start = start, Length = length});
+        }
+
         protected virtual void Tokenize() {
             for(Index = 0; Index < Text.Length; Index++) {
+                TokenizeCurrentCharacter();
+            }
+        }
+
+        /// <summary>
+        ///   Tokenizes text from a stream, returning the tokens as they are found.
+        /// </summary>
+        /// <remarks>
+        ///   Only a window of the text is kept in memory. Before each token, there are at least <see cref="StreamLookahead"/>
+        ///   characters read ahead; a token that runs into the end of what has been read (a very long comment, say) is
+        ///   thrown away, and tokenized again once more of the stream has been read. Either way, the tokens are exactly the
+        ///   ones that tokenizing all of the text at once would give.
+        /// </remarks>
+        protected IEnumerable<Token> TokenizeStream(TextReader reader) {
+            _reader = reader;
+            Text = new char[0];
+            Index = 0;
+            _textOffset = 0;
+            Read(StreamBufferSize);
+
+            while(Index < Text.Length) {
+                if(_reader != null && Text.Length - Index < StreamLookahead) {
+                    Read(StreamBufferSize);
+                }
+
+                var index = _index;
+                var row = _row;
+                var column = _column;
+                var lines = _linelengths.Count;
+                var truncated = false;
+
+                try {
+                    TokenizeCurrentCharacter();
+                }
+                catch(IndexOutOfRangeException) {
+                    if(_reader == null) {
+                        throw;
+                    }
+                    truncated = true;
+                }
+
+                if(_reader != null && (truncated || Index >= Text.Length - 4)) {
+                    // the token might have gone on past what's been read; back up, read more, and try again.
+                    Tokens.Clear();
+                    _index = index;
+                    _row = row;
+                    _column = column;
+                    _linelengths.RemoveRange(lines, _linelengths.Count - lines);
+                    Read(Math.Max(StreamBufferSize, Text.Length));
+                    continue;
+                }
+
+                foreach(var token in Tokens) {
+                    yield return token;
+                }
+                Tokens.Clear();
+                Index++;
+            }
+        }
+
+        /// <summary>
+        ///   Reads more of the stream into a new Text array, keeping the characters from just before the current one on.
+        /// </summary>
+        /// <remarks>
+        ///   The old array is left as it is, as tokens can still point into it.
+        /// </remarks>
+        private void Read(int count) {
+            // keep one character before the current one, so that stepping back to it works the same as ever.
+            var keepFrom = Math.Max(0, Math.Min(_index - 1, Text.Length));
+            var kept = Text.Length - keepFrom;
+            var text = new char[kept + count];
+            Array.Copy(Text, keepFrom, text, 0, kept);
+
+            var read = 0;
+            while(read < count) {
+                var n = _reader.Read(text, kept + read, count - read);
+                if(n == 0) {
+                    _reader = null;
+                    Array.Resize(ref text, kept + read);
+                    break;
+                }
+                read += n;
+            }
+
+            Text = text;
+            _textOffset += keepFrom;
+            _index -= keepFrom;
+            if(_index < Text.Length) {
                 RecognizeNextCharacter();
+            }
+        }
 
-                if(!PoachParse()) {
-                    switch(CurrentCharacter) {
-                        case '~':
-                            AddToken(Tilde);
-                            break;
+        /// <summary>
+        ///   Tokenizes the text starting at the current character (leaves Index at the last character of what it found).
+        /// </summary>
+        private void TokenizeCurrentCharacter() {
+            RecognizeNextCharacter();
 
-                        case '?':
-                            ParseQuestionMark();
-                            break;
+            if(!PoachParse()) {
+                switch(CurrentCharacter) {
+                    case '~':
+                        AddToken(Tilde);
+                        break;
 
-                        case '{':
-                            AddToken(OpenBrace);
-                            break;
+                    case '?':
+                        ParseQuestionMark();
+                        break;
 
-                        case '}':
-                            AddToken(CloseBrace);
-                            break;
+                    case '{':
+                        AddToken(OpenBrace);
+                        break;
 
-                        case '[':
-                            AddToken(OpenBracket);
-                            break;
+                    case '}':
+                        AddToken(CloseBrace);
+                        break;
 
-                        case ']':
-                            AddToken(CloseBracket);
-                            break;
+                    case '[':
+                        AddToken(OpenBracket);
+                        break;
 
-                        case '(':
-                            AddToken(OpenParenthesis);
-                            break;
+                    case ']':
+                        AddToken(CloseBracket);
+                        break;
 
-                        case ')':
-                            AddToken(CloseParenthesis);
-                            break;
+                    case '(':
+                        AddToken(OpenParenthesis);
+                        break;
 
-                        case '.':
-                            AddToken(Dot);
-                            break;
+                    case ')':
+                        AddToken(CloseParenthesis);
+                        break;
 
-                        case ',':
-                            AddToken(Comma);
-                            break;
+                    case '.':
+                        AddToken(Dot);
+                        break;
 
-                        case ':':
-                            AddToken(Colon);
-                            break;
+                    case ',':
+                        AddToken(Comma);
+                        break;
 
-                        case ';':
-                            AddToken(Semicolon);
-                            break;
+                    case ':':
+                        AddToken(Colon);
+                        break;
 
-                        case '\r':
-                            if(NextCharacter == '\n') {
-                                Index++;
-                            }
+                    case ';':
+                        AddToken(Semicolon);
+                        break;
 
-                            AddToken(Eol);
-                            break;
+                    case '\r':
+                        if(NextCharacter == '\n') {
+                            Index++;
+                        }
 
-                        case '\n':
-                            AddToken(Eol);
-                            break;
+                        AddToken(Eol);
+                        break;
 
-                        case '\t':
-                            AddToken(Tab);
-                            break;
+                    case '\n':
+                        AddToken(Eol);
+                        break;
 
-                        case ' ':
-                            AddToken(Space);
-                            break;
+                    case '\t':
+                        AddToken(Tab);
+                        break;
 
-                        case '+':
-                            ParsePlus();
-                            break;
+                    case ' ':
+                        AddToken(Space);
+                        break;
 
-                        case '-':
-                            ParseMinus();
-                            break;
+                    case '+':
+                        ParsePlus();
+                        break;
 
-                        case '*':
-                            ParseStar();
-                            break;
+                    case '-':
+                        ParseMinus();
+                        break;
 
-                        case '=':
-                            ParseEquals();
-                            break;
+                    case '*':
+                        ParseStar();
+                        break;
 
-                        case '/':
-                            ParseSlash();
-                            break;
+                    case '=':
+                        ParseEquals();
+                        break;
 
-                        case '|':
-                            ParseBar();
-                            break;
+                    case '/':
+                        ParseSlash();
+                        break;
 
-                        case '&':
-                            ParseAmpersand();
-                            break;
+                    case '|':
+                        ParseBar();
+                        break;
 
-                        case '%':
-                            ParsePercent();
-                            break;
+                    case '&':
+                        ParseAmpersand();
+                        break;
 
-                        case '<':
-                            ParseLessThan();
-                            break;
+                    case '%':
+                        ParsePercent();
+                        break;
 
-                        case '>':
-                            ParseGreaterThan();
-                            break;
+                    case '<':
+                        ParseLessThan();
+                        break;
 
-                        case '!':
-                            ParseBang();
-                            break;
+                    case '>':
+                        ParseGreaterThan();
+                        break;
 
-                        case '$':
-                            ParseDollar();
-                            break;
+                    case '!':
+                        ParseBang();
+                        break;
 
-                        case '^':
-                            ParsePower();
-                            break;
+                    case '$':
+                        ParseDollar();
+                        break;
 
-                        case '#':
-                            ParsePound();
-                            break;
+                    case '^':
+                        ParsePower();
+                        break;
 
-                        case '\'':
-                            ParseCharLiteral();
-                            break;
+                    case '#':
+                        ParsePound();
+                        break;
 
-                        case '"':
-                            ParseStringLiteral();
-                            break;
+                    case '\'':
+                        ParseCharLiteral();
+                        break;
 
-                        case '0':
-                            if(NextCharacter == 'x' || NextCharacter == 'X') {
-                                ParseHexadecimalLiteral();
-                                break;
-                            }
+                    case '"':
+                        ParseStringLiteral();
+                        break;
 
-                            ParseNumericLiteral();
-                            break;
-                        case '1':
-                        case '2':
-                        case '3':
-                        case '4':
-                        case '5':
-                        case '6':
-                        case '7':
-                        case '8':
-                        case '9':
-                            ParseNumericLiteral();
+                    case '0':
+                        if(NextCharacter == 'x' || NextCharacter == 'X') {
+                            ParseHexadecimalLiteral();
                             break;
+                        }
 
-                        default:
-                            ParseOther();
-                            break;
-                    }
+                        ParseNumericLiteral();
+                        break;
+                    case '1':
+                    case '2':
+                    case '3':
+                    case '4':
+                    case '5':
+                    case '6':
+                    case '7':
+                    case '8':
+                    case '9':
+                        ParseNumericLiteral();
+                        break;
+
+                    default:
+                        ParseOther();
+                        break;
                 }
             }
         }
@@ -424,8 +609,7 @@ namespace CoApp.Toolkit.Scripting.Utility {
             if (!IsCurrentCharacterNumeric) {
                 Index--;
             }
-            AddToken(new Token {Type = TokenType.NumericLiteral, Data = new string(Text, start, (Index - start) + 1)});
-            
+            AddToken(TokenType.NumericLiteral, start, (Index - start) + 1);
         }
 
         protected virtual void ParseHexadecimalLiteral() {
@@ -457,7 +641,7 @@ namespace CoApp.Toolkit.Scripting.Utility {
                 Index--;
             }
 
-            AddToken(new Token {Type = TokenType.NumericLiteral, Data = new string(Text, start, (Index - start) + 1)});
+            AddToken(TokenType.NumericLiteral, start, (Index - start) + 1);
             Index--;
         }
 
@@ -626,7 +810,7 @@ namespace CoApp.Toolkit.Scripting.Utility {
                 Index += 2;
                 while(Index < (Text.Length - 1)) {
                     if(Text[Index] == '*' && Text[Index + 1] == '/') {
-                        AddToken(new Token {Type = TokenType.MultilineComment, Data = new string(Text, start, (Index - start) + 2)});
+                        AddToken(TokenType.MultilineComment, start, (Index - start) + 2);
                         start = -1;
                         break;
                     }
@@ -637,7 +821,7 @@ namespace CoApp.Toolkit.Scripting.Utility {
                 if(start > -1) {
                     // didn't find the close marker (star slash) 
                     // adding an incomplete comment at the end I guess.
-                    AddToken(new Token {Type = TokenType.MultilineComment, Data = new string(Text, start, (Index - start) + 1)});
+                    AddToken(TokenType.MultilineComment, start, (Index - start) + 1);
                 }
 
                 Index++;
@@ -654,7 +838,7 @@ namespace CoApp.Toolkit.Scripting.Utility {
                             // if this is a CR, is there an LF after it?
                             Index++;
                         }
-                        AddToken(new Token {Type = TokenType.LineComment, Data = new string(Text, start, (Index - start) + 1)});
+                        AddToken(TokenType.LineComment, start, (Index - start) + 1);
                         return;
                         
                     }
@@ -663,7 +847,7 @@ namespace CoApp.Toolkit.Scripting.Utility {
 
                 if(start > -1) {
                     // adding a comment at the end I guess.
-                    AddToken(new Token {Type = TokenType.LineComment, Data = new string(Text, start, (Index - start) + 1)});
+                    AddToken(TokenType.LineComment, start, (Index - start) + 1);
                 }
                 return;
             }
@@ -750,7 +934,7 @@ namespace CoApp.Toolkit.Scripting.Utility {
                 }
 
                 if(Text[Index] == '\r' || Text[Index] == '\n') {
-                    AddToken(new Token {Type = TokenType.Pound, Data = new string(Text, start, (Index - start) + 1)});
+                    AddToken(TokenType.Pound, start, (Index - start) + 1);
                     start = -1;
                     break;
                 }
@@ -760,7 +944,7 @@ namespace CoApp.Toolkit.Scripting.Utility {
 
             if(start > -1) {
                 // adding directive at the end I guess.
-                AddToken(new Token {Type = TokenType.Pound, Data = new string(Text, start, (Index - start) + 1)});
+                AddToken(TokenType.Pound, start, (Index - start) + 1);
             }
 
             Index++;
@@ -782,21 +966,8 @@ namespace CoApp.Toolkit.Scripting.Utility {
         /// </summary>
         protected virtual bool IsCurrentCharacterIdentifierStartCharacter {
             get {
-                if(CurrentCharacter == '_') {
-                    return true;
-                }
-
-                switch(CharUnicodeInfo.GetUnicodeCategory(CurrentCharacter)) {
-                    case UnicodeCategory.UppercaseLetter:
-                    case UnicodeCategory.LowercaseLetter:
-                    case UnicodeCategory.TitlecaseLetter:
-                    case UnicodeCategory.ModifierLetter:
-                    case UnicodeCategory.OtherLetter:
-                    case UnicodeCategory.LetterNumber:
-                        return true;
-                }
-
-                return false;
+                var ch = CurrentCharacter;
+                return ch < 128 ? (AsciiCharacterClasses[ch] & CharacterClass.IdentifierStart) != 0 : IsIdentifierStartCharacter(ch);
             }
         }
 
@@ -805,27 +976,50 @@ namespace CoApp.Toolkit.Scripting.Utility {
         /// </summary>
         protected virtual bool IsCurrentCharacterIdentifierPartCharacter {
             get {
-                if(CurrentCharacter == '_') {
+                var ch = CurrentCharacter;
+                return ch < 128 ? (AsciiCharacterClasses[ch] & CharacterClass.IdentifierPart) != 0 : IsIdentifierPartCharacter(ch);
+            }
+        }
+
+        private static bool IsIdentifierStartCharacter(char ch) {
+            if(ch == '_') {
+                return true;
+            }
+
+            switch(CharUnicodeInfo.GetUnicodeCategory(ch)) {
+                case UnicodeCategory.UppercaseLetter:
+                case UnicodeCategory.LowercaseLetter:
+                case UnicodeCategory.TitlecaseLetter:
+                case UnicodeCategory.ModifierLetter:
+                case UnicodeCategory.OtherLetter:
+                case UnicodeCategory.LetterNumber:
                     return true;
-                }
+            }
 
-                switch(CharUnicodeInfo.GetUnicodeCategory(CurrentCharacter)) {
-                    case UnicodeCategory.UppercaseLetter:
-                    case UnicodeCategory.LowercaseLetter:
-                    case UnicodeCategory.TitlecaseLetter:
-                    case UnicodeCategory.ModifierLetter:
-                    case UnicodeCategory.OtherLetter:
-                    case UnicodeCategory.LetterNumber:
-                    case UnicodeCategory.DecimalDigitNumber:
-                    case UnicodeCategory.ConnectorPunctuation:
-                    case UnicodeCategory.Format:
-                    case UnicodeCategory.NonSpacingMark:
-                    case UnicodeCategory.SpacingCombiningMark:
-                        return true;
-                }
+            return false;
+        }
+
+        private static bool IsIdentifierPartCharacter(char ch) {
+            if(ch == '_') {
+                return true;
+            }
 
-                return false;
+            switch(CharUnicodeInfo.GetUnicodeCategory(ch)) {
+                case UnicodeCategory.UppercaseLetter:
+                case UnicodeCategory.LowercaseLetter:
+                case UnicodeCategory.TitlecaseLetter:
+                case UnicodeCategory.ModifierLetter:
+                case UnicodeCategory.OtherLetter:
+                case UnicodeCategory.LetterNumber:
+                case UnicodeCategory.DecimalDigitNumber:
+                case UnicodeCategory.ConnectorPunctuation:
+                case UnicodeCategory.Format:
+                case UnicodeCategory.NonSpacingMark:
+                case UnicodeCategory.SpacingCombiningMark:
+                    return true;
             }
+
+            return false;
         }
 
         protected virtual void ParseOther() {
@@ -847,6 +1041,11 @@ namespace CoApp.Toolkit.Scripting.Utility {
                     }
                 }
 
+                if(Keywords.Count == 0) {
+                    AddToken(TokenType.Identifier, start, (Index - start) + 1);
+                    return;
+                }
+
                 var identifier = new string(Text, start, (Index - start) + 1);
                 AddToken(new Token {Type = Keywords.Contains(identifier) ? TokenType.Keyword : TokenType.Identifier, Data = identifier});
                 return;
@@ -864,5 +1063,9 @@ namespace CoApp.Toolkit.Scripting.Utility {
             tokenizer.Tokenize();
             return tokenizer.Tokens;
         }
+
+        public static IEnumerable<Token> Tokenize(TextReader reader) {
+            return new Tokenizer(new char[0]).TokenizeStream(reader);
+        }
     }
 }
\ No newline at end of file
@@ -13,6 +13,7 @@
 namespace CoApp.Toolkit.Text.Sgml {
     using System;
     using System.Collections;
+    using System.Collections.Concurrent;
     using System.Collections.Generic;
     using System.Diagnostics.CodeAnalysis;
     using System.Globalization;
@@ -150,6 +151,11 @@ namespace CoApp.Toolkit.Text.Sgml {
         private int m_lineStart;
         private int m_absolutePos;
 
+        // the stream is read a block at a time into this buffer (a pooled one), rather than a character at a time.
+        private char[] m_buffer;
+        private int m_bufferPos;
+        private int m_bufferUsed;
+
         /// <summary>
         ///   Initialises a new instance of an Entity declared in a DTD.
         /// </summary>
@@ -307,7 +313,14 @@ namespace CoApp.Toolkit.Text.Sgml {
         /// </summary>
         /// <returns>The next character from the DTD stream.</returns>
         public char ReadChar() {
-            var ch = (char) this.m_stm.Read();
+            char ch;
+            if(this.m_bufferPos < this.m_bufferUsed || FillBuffer()) {
+                ch = this.m_buffer[this.m_bufferPos++];
+            }
+            else {
+                ch = EOF;
+            }
+
             if(ch == 0) {
                 // convert nulls to whitespace, since they are not valid in XML anyway.
                 ch = ' ';
@@ -340,6 +353,22 @@ namespace CoApp.Toolkit.Text.Sgml {
             return ch;
         }
 
+        private bool FillBuffer() {
+            if(this.m_buffer == null) {
+                this.m_buffer = SgmlBufferPool<char>.Rent();
+            }
+
+            this.m_bufferPos = 0;
+            this.m_bufferUsed = Math.Max(0, this.m_stm.Read(this.m_buffer, 0, this.m_buffer.Length));
+            return this.m_bufferUsed > 0;
+        }
+
+        private void ReleaseBuffer() {
+            SgmlBufferPool<char>.Return(this.m_buffer);
+            this.m_buffer = null;
+            this.m_bufferPos = this.m_bufferUsed = 0;
+        }
+
         /// <summary>
         ///   Begins processing an entity.
         /// </summary>
@@ -350,6 +379,7 @@ namespace CoApp.Toolkit.Text.Sgml {
             if(parent != null) {
                 this.m_isHtml = parent.IsHtml;
             }
+            this.m_bufferPos = this.m_bufferUsed = 0;
             this.m_line = 1;
             if(m_isInternal) {
                 if(this.m_literal != null) {
@@ -448,6 +478,7 @@ namespace CoApp.Toolkit.Text.Sgml {
             if(this.m_weOwnTheStream) {
                 this.m_stm.Close();
             }
+            ReleaseBuffer();
         }
 
         /// <summary>
@@ -498,6 +529,27 @@ namespace CoApp.Toolkit.Text.Sgml {
             return sb.ToString();
         }
 
+        /// <summary>
+        ///   Scans a token from the input stream onto the end of a <see cref = "StringBuilder" />, without making a string of it.
+        /// </summary>
+        /// <param name = "sb">The <see cref = "StringBuilder" /> to append the token to.</param>
+        /// <param name = "term">A set of characters to look for as terminators for the token.</param>
+        public void AppendToken(StringBuilder sb, string term) {
+            if(sb == null) {
+                throw new ArgumentNullException("sb");
+            }
+
+            if(term == null) {
+                throw new ArgumentNullException("term");
+            }
+
+            var ch = m_lastchar;
+            while(ch != Entity.EOF && term.IndexOf(ch) < 0) {
+                sb.Append(ch);
+                ch = ReadChar();
+            }
+        }
+
         /// <summary>
         ///   Read a literal from the input stream.
         /// </summary>
@@ -814,6 +866,7 @@ namespace CoApp.Toolkit.Text.Sgml {
                     m_stm.Dispose();
                     m_stm = null;
                 }
+                ReleaseBuffer();
             }
         }
 
@@ -831,63 +884,56 @@ namespace CoApp.Toolkit.Text.Sgml {
         private char[] m_buffer;
         private int used;
         private int pos;
-        private const int BUFSIZE = 16384;
+        private const int BUFSIZE = SgmlBufferPool<byte>.BufferSize;
         private const int EOF = -1;
 
         public HtmlStream(Stream stm, Encoding defaultEncoding) {
             if(defaultEncoding == null) {
                 defaultEncoding = Encoding.UTF8; // default is UTF8
             }
-            if(!stm.CanSeek) {
-                // Need to be able to seek to sniff correctly.
-                stm = CopyToMemoryStream(stm);
-            }
             this.stm = stm;
-            rawBuffer = new Byte[BUFSIZE];
-            rawUsed = stm.Read(rawBuffer, 0, 4); // maximum byte order mark
-            this.m_buffer = new char[BUFSIZE];
+            rawBuffer = SgmlBufferPool<byte>.Rent();
+            rawUsed = ReadFully(0, 4); // maximum byte order mark
+            this.m_buffer = SgmlBufferPool<char>.Rent();
 
             // Check byte order marks
             this.m_decoder = AutoDetectEncoding(rawBuffer, ref rawPos, rawUsed);
             var bom = rawPos;
             if(this.m_decoder == null) {
                 this.m_decoder = defaultEncoding.GetDecoder();
-                rawUsed += stm.Read(rawBuffer, 4, BUFSIZE - 4);
+                rawUsed += ReadFully(rawUsed, BUFSIZE - rawUsed);
                 DecodeBlock();
                 // Now sniff to see if there is an XML declaration or HTML <META> tag.
                 var sd = SniffEncoding();
                 if(sd != null) {
                     this.m_decoder = sd;
                 }
+                else {
+                    this.m_decoder.Reset();
+                }
             }
 
-            // Reset to get ready for Read()
-            this.stm.Seek(0, SeekOrigin.Begin);
+            // Reset to get ready for Read(); the bytes sniffed are still in the raw buffer, so
+            // they are decoded again from there (after the bom), rather than seeking back to
+            // read them again (or copying a stream that can't seek).
             this.pos = this.used = 0;
-            // skip bom
-            if(bom > 0) {
-                stm.Read(this.rawBuffer, 0, bom);
+            this.rawPos = bom;
+        }
+
+        // reads until the count is read or the stream ends, since the stream (a network stream, say) may return less.
+        private int ReadFully(int offset, int count) {
+            var total = 0;
+            int len;
+            while(total < count && (len = stm.Read(rawBuffer, offset + total, count - total)) > 0) {
+                total += len;
             }
-            this.rawPos = this.rawUsed = 0;
+            return total;
         }
 
         public Encoding Encoding {
             get { return this.m_encoding; }
         }
 
-        private static Stream CopyToMemoryStream(Stream s) {
-            var size = 100000; // large heap is more efficient
-            var copyBuff = new byte[size];
-            int len;
-            var r = new MemoryStream();
-            while((len = s.Read(copyBuff, 0, size)) > 0)
-                r.Write(copyBuff, 0, len);
-
-            r.Seek(0, SeekOrigin.Begin);
-            s.Close();
-            return r;
-        }
-
         internal void DecodeBlock() {
             // shift current chars to beginning.
             if(pos > 0) {
@@ -1183,6 +1229,22 @@ namespace CoApp.Toolkit.Text.Sgml {
             return null;
         }
 
+        // decodes more of the stream if all the characters decoded so far have been read; false at the end of the stream.
+        private bool Fill() {
+            while(pos == used) {
+                if(rawPos == rawUsed) {
+                    rawUsed = stm.Read(rawBuffer, 0, rawBuffer.Length);
+                    rawPos = 0;
+                    if(rawUsed == 0) {
+                        return false;
+                    }
+                }
+                // (a block can decode to no characters at all, when it ends part way into one.)
+                DecodeBlock();
+            }
+            return true;
+        }
+
         public override int Peek() {
             var result = Read();
             if(result != EOF) {
@@ -1192,36 +1254,20 @@ namespace CoApp.Toolkit.Text.Sgml {
         }
 
         public override int Read() {
-            if(pos == used) {
-                rawUsed = stm.Read(rawBuffer, 0, rawBuffer.Length);
-                rawPos = 0;
-                if(rawUsed == 0) {
-                    return EOF;
-                }
-                DecodeBlock();
-            }
-            if(pos < used) {
-                return m_buffer[pos++];
+            if(!Fill()) {
+                return EOF;
             }
-            return -1;
+            return m_buffer[pos++];
         }
 
         public override int Read(char[] buffer, int start, int length) {
-            if(pos == used) {
-                rawUsed = stm.Read(rawBuffer, 0, rawBuffer.Length);
-                rawPos = 0;
-                if(rawUsed == 0) {
-                    return -1;
-                }
-                DecodeBlock();
-            }
-            if(pos < used) {
-                length = Math.Min(used - pos, length);
-                Array.Copy(this.m_buffer, pos, buffer, start, length);
-                pos += length;
-                return length;
+            if(!Fill()) {
+                return -1;
             }
-            return 0;
+            length = Math.Min(used - pos, length);
+            Array.Copy(this.m_buffer, pos, buffer, start, length);
+            pos += length;
+            return length;
         }
 
         public override int ReadBlock(char[] data, int index, int count) {
@@ -1266,8 +1312,42 @@ namespace CoApp.Toolkit.Text.Sgml {
             return sb.ToString();
         }
 
-        public override void Close() {
-            stm.Close();
+        protected override void Dispose(bool disposing) {
+            if(disposing && stm != null) {
+                stm.Close();
+                stm = null;
+                SgmlBufferPool<byte>.Return(rawBuffer);
+                SgmlBufferPool<char>.Return(m_buffer);
+                rawBuffer = null;
+                m_buffer = null;
+            }
+            base.Dispose(disposing);
+        }
+    }
+
+    /// <summary>
+    ///   A pool of the buffers that entities and streams read through, so reading one document
+    ///   after another (scraping a set of pages, say) doesn't allocate new ones for each.
+    /// </summary>
+    internal static class SgmlBufferPool<T> {
+        internal const int BufferSize = 16384;
+        private static readonly int MaxBuffers = 4*Environment.ProcessorCount + 4;
+        private static readonly ConcurrentStack<T[]> Buffers = new ConcurrentStack<T[]>();
+
+        public static T[] Rent() {
+            T[] buffer;
+            return Buffers.TryPop(out buffer) ? buffer : new T[BufferSize];
+        }
+
+        /// <summary>
+        ///   Gives a buffer back to the pool; it must not be used afterwards. Does nothing with null, or a
+        ///   buffer that isn't the pool's size (one that has been grown).
+        /// </summary>
+        public static void Return(T[] buffer) {
+            // (the count is only approximate, with other threads at it; that's fine.)
+            if(buffer != null && buffer.Length == BufferSize && Buffers.Count < MaxBuffers) {
+                Buffers.Push(buffer);
+            }
         }
     }
 
@@ -1451,7 +1531,8 @@ namespace CoApp.Toolkit.Text.Sgml {
             }
 
             AttDef a;
-            m_attList.TryGetValue(name.ToUpperInvariant(), out a);
+            // (the lists the DTD parser makes ignore case, so the name needn't be upper-cased to look it up.)
+            m_attList.TryGetValue(m_attList.Comparer == StringComparer.OrdinalIgnoreCase ? name : name.ToUpperInvariant(), out a);
             return a;
         }
 
@@ -2170,7 +2251,7 @@ namespace CoApp.Toolkit.Text.Sgml {
         /// <param name = "nt">The <see cref = "XmlNameTable" /> is NOT used.</param>
         public SgmlDtd(string name, XmlNameTable nt) {
             this.m_name = name;
-            this.m_elements = new Dictionary<string, ElementDecl>();
+            this.m_elements = new Dictionary<string, ElementDecl>(StringComparer.OrdinalIgnoreCase);
             this.m_pentities = new Dictionary<string, Entity>();
             this.m_entities = new Dictionary<string, Entity>();
             this.m_sb = new StringBuilder();
@@ -2268,7 +2349,7 @@ namespace CoApp.Toolkit.Text.Sgml {
         /// <returns>The <see cref = "ElementDecl" /> matching the specified name.</returns>
         public ElementDecl FindElement(string name) {
             ElementDecl el;
-            m_elements.TryGetValue(name.ToUpperInvariant(), out el);
+            m_elements.TryGetValue(name, out el);
             return el;
         }
 
@@ -2759,7 +2840,7 @@ namespace CoApp.Toolkit.Text.Sgml {
         private void ParseAttList() {
             var ch = this.m_current.SkipWhitespace();
             var names = ParseNameGroup(ch, true);
-            var attlist = new Dictionary<string, AttDef>();
+            var attlist = new Dictionary<string, AttDef>(StringComparer.OrdinalIgnoreCase);
             ParseAttList(attlist, '>');
             foreach(string name in names) {
                 ElementDecl e;
@@ -142,6 +142,97 @@ namespace CoApp.Toolkit.Text.Sgml {
         }
     }
 
+    /// <summary>
+    ///   The value of a node or attribute, kept as characters in a buffer that is reused from one
+    ///   value to the next, and only made into a string if the string is asked for (most text in
+    ///   a page never is).
+    /// </summary>
+    internal class ValueBuffer {
+        private char[] m_chars;
+        private int m_length; // the number of characters in the buffer, or -1 if the value is only a string.
+        private string m_string;
+        private bool m_hasValue;
+
+        public void Reset(string value) {
+            this.m_string = value;
+            this.m_hasValue = value != null;
+            this.m_length = -1;
+        }
+
+        public void Reset(StringBuilder value) {
+            this.m_length = Copy(value);
+            this.m_string = null;
+            this.m_hasValue = true;
+        }
+
+        public void Reset(ValueBuffer value) {
+            if(value.m_length < 0) {
+                Reset(value.m_string);
+            }
+            else {
+                this.m_length = Copy(value.m_chars, value.m_length);
+                this.m_string = value.m_string;
+                this.m_hasValue = true;
+            }
+        }
+
+        public bool HasValue {
+            get { return this.m_hasValue; }
+        }
+
+        public string Value {
+            get {
+                if(this.m_string == null && this.m_hasValue) {
+                    this.m_string = new string(this.m_chars, 0, this.m_length);
+                }
+                return this.m_string;
+            }
+        }
+
+        /// <summary>
+        ///   Gets the characters of the value (or of the fallback, if there's no value); the segment
+        ///   has no array if there's neither.
+        /// </summary>
+        public ArraySegment<char> GetSegment(string fallback) {
+            if(!this.m_hasValue) {
+                if(fallback == null) {
+                    return new ArraySegment<char>();
+                }
+                var length = Copy(fallback);
+                return new ArraySegment<char>(this.m_chars, 0, length);
+            }
+
+            if(this.m_length < 0) {
+                this.m_length = Copy(this.m_string);
+            }
+            return new ArraySegment<char>(this.m_chars, 0, this.m_length);
+        }
+
+        private int Copy(StringBuilder value) {
+            Reserve(value.Length);
+            value.CopyTo(0, this.m_chars, 0, value.Length);
+            return value.Length;
+        }
+
+        private int Copy(char[] value, int length) {
+            Reserve(length);
+            Array.Copy(value, this.m_chars, length);
+            return length;
+        }
+
+        private int Copy(string value) {
+            Reserve(value.Length);
+            value.CopyTo(0, this.m_chars, 0, value.Length);
+            return value.Length;
+        }
+
+        private void Reserve(int length) {
+            if(this.m_chars == null || this.m_chars.Length < length) {
+                this.m_chars = new char[Math.Max(length, this.m_chars == null ? 32 : this.m_chars.Length*2)];
+            }
+        }
+    }
+
     /// <summary>
     ///   This class represents an attribute.  The AttDef is assigned
     ///   from a validation process, and is used to provide default values.
@@ -150,7 +241,7 @@ namespace CoApp.Toolkit.Text.Sgml {
         internal string Name; // the atomized name.
         internal AttDef DtdType; // the AttDef of the attribute from the SGML DTD.
         internal char QuoteChar; // the quote character used for the attribute value.
-        private string m_literalValue; // the attribute value
+        private readonly ValueBuffer m_literalValue = new ValueBuffer(); // the attribute value
 
         /// <summary>
         ///   Attribute objects are reused during parsing to reduce memory allocations, 
@@ -158,29 +249,43 @@ namespace CoApp.Toolkit.Text.Sgml {
         /// </summary>
         public void Reset(string name, string value, char quote) {
             this.Name = name;
-            this.m_literalValue = value;
+            this.m_literalValue.Reset(value);
             this.QuoteChar = quote;
             this.DtdType = null;
         }
 
+        public void Reset(string name, StringBuilder value, char quote) {
+            this.Name = name;
+            this.m_literalValue.Reset(value);
+            this.QuoteChar = quote;
+            this.DtdType = null;
+        }
+
+        public void CopyValue(Attribute a) {
+            this.m_literalValue.Reset(a.m_literalValue);
+        }
+
         public string Value {
             get {
-                if(this.m_literalValue != null) {
-                    return this.m_literalValue;
+                if(this.m_literalValue.HasValue) {
+                    return this.m_literalValue.Value;
                 }
                 if(this.DtdType != null) {
                     return this.DtdType.Default;
                 }
                 return null;
             }
-            /*            set
-                        {
-                            this.m_literalValue = value;
-                        }*/
+        }
+
+        /// <summary>
+        ///   The characters of the <see cref = "Value" />, without making a string of them.
+        /// </summary>
+        public ArraySegment<char> Segment {
+            get { return this.m_literalValue.GetSegment(this.DtdType != null ? this.DtdType.Default : null); }
         }
 
         public bool IsDefault {
-            get { return (this.m_literalValue == null); }
+            get { return !this.m_literalValue.HasValue; }
         }
     }
 
@@ -191,7 +296,7 @@ namespace CoApp.Toolkit.Text.Sgml {
     /// </summary>
     internal class Node {
         internal XmlNodeType NodeType;
-        internal string Value;
+        private readonly ValueBuffer m_value = new ValueBuffer();
         internal XmlSpace Space;
         internal string XmlLang;
         internal bool IsEmpty;
@@ -206,7 +311,7 @@ namespace CoApp.Toolkit.Text.Sgml {
         ///   hence the Reset method.
         /// </summary>
         public void Reset(string name, XmlNodeType nt, string value) {
-            this.Value = value;
+            this.m_value.Reset(value);
             this.Name = name;
             this.NodeType = nt;
             this.Space = XmlSpace.None;
@@ -216,7 +321,32 @@ namespace CoApp.Toolkit.Text.Sgml {
             this.DtdType = null;
         }
 
+        public string Value {
+            get { return this.m_value.Value; }
+            set { this.m_value.Reset(value); }
+        }
+
+        public void SetValue(StringBuilder value) {
+            this.m_value.Reset(value);
+        }
+
         public Attribute AddAttribute(string name, string value, char quotechar, bool caseInsensitive) {
+            var a = AddAttribute(name, caseInsensitive);
+            if(a != null) {
+                a.Reset(name, value, quotechar);
+            }
+            return a;
+        }
+
+        public Attribute AddAttribute(string name, StringBuilder value, char quotechar, bool caseInsensitive) {
+            var a = AddAttribute(name, caseInsensitive);
+            if(a != null) {
+                a.Reset(name, value, quotechar);
+            }
+            return a;
+        }
+
+        private Attribute AddAttribute(string name, bool caseInsensitive) {
             Attribute a;
             // check for duplicates!
             for(int i = 0, n = this.attributes.Count; i < n; i++) {
@@ -232,7 +362,6 @@ namespace CoApp.Toolkit.Text.Sgml {
                 a = new Attribute();
                 this.attributes[this.attributes.Count - 1] = a;
             }
-            a.Reset(name, value, quotechar);
             return a;
         }
 
@@ -250,7 +379,8 @@ namespace CoApp.Toolkit.Text.Sgml {
         public void CopyAttributes(Node n) {
             for(int i = 0, len = n.attributes.Count; i < len; i++) {
                 var a = (Attribute) n.attributes[i];
-                var na = this.AddAttribute(a.Name, a.Value, a.QuoteChar, false);
+                var na = this.AddAttribute(a.Name, (string) null, a.QuoteChar, false);
+                na.CopyValue(a);
                 na.DtdType = a.DtdType;
             }
         }
@@ -318,6 +448,10 @@ namespace CoApp.Toolkit.Text.Sgml {
         private Uri m_baseUri;
         private StringBuilder m_sb;
         private StringBuilder m_name;
+        private NameTable m_names = new NameTable(); // the tag, attribute and entity names seen, so each one is only made into a string once.
+        private int m_nameCount;
+        private char[] m_nameChars = new char[32];
+        private int m_skipDepth = int.MaxValue; // the depth of the element Skip is skipping.
         private TextWriter m_log;
         private bool m_foundRoot;
         private bool m_ignoreDtd;
@@ -993,6 +1127,43 @@ namespace CoApp.Toolkit.Text.Sgml {
             throw new ArgumentOutOfRangeException("i");
         }
 
+        /// <summary>
+        ///   Gets the value of the attribute with the specified index as a range of characters, without making a string of it.
+        /// </summary>
+        /// <param name = "i">The index of the attribute.</param>
+        /// <returns>
+        ///   The characters of the value, in a buffer that belongs to the reader; they are only good until the reader
+        ///   moves on to another node. The segment has no array if the attribute has no value.
+        /// </returns>
+        public ArraySegment<char> GetAttributeSegment(int i) {
+            if(this.m_state != State.Attr && this.m_state != State.AttrValue) {
+                var a = this.m_node.GetAttribute(i);
+                if(a != null) {
+                    return a.Segment;
+                }
+            }
+
+            throw new ArgumentOutOfRangeException("i");
+        }
+
+        /// <summary>
+        ///   Gets the value of an attribute with the specified <see cref = "Name" /> as a range of characters, without making a string of it.
+        /// </summary>
+        /// <param name = "name">The name of the attribute to retrieve.</param>
+        /// <param name = "value">The characters of the value, in a buffer that belongs to the reader; they are only good until the reader moves on to another node.</param>
+        /// <returns>true if the attribute is found and has a value; otherwise, false.</returns>
+        public bool TryGetAttributeSegment(string name, out ArraySegment<char> value) {
+            value = new ArraySegment<char>();
+            if(this.m_state != State.Attr && this.m_state != State.AttrValue) {
+                var i = this.m_node.GetAttribute(name);
+                if(i >= 0) {
+                    value = this.m_node.GetAttribute(i).Segment;
+                }
+            }
+
+            return value.Array != null;
+        }
+
         /// <summary>
         ///   Gets the value of the attribute with the specified index.
         /// </summary>
@@ -1376,16 +1547,56 @@ namespace CoApp.Toolkit.Text.Sgml {
         }
 
         private string ScanName(string terminators) {
-            var name = this.m_current.ScanToken(this.m_sb, terminators, false);
-            switch(this.m_folding) {
-                case CaseFolding.ToUpper:
-                    name = name.ToUpperInvariant();
-                    break;
-                case CaseFolding.ToLower:
-                    name = name.ToLowerInvariant();
-                    break;
+            this.m_name.Length = 0;
+            this.m_current.AppendToken(this.m_name, terminators);
+            return Atomize(this.m_name, this.m_folding);
+        }
+
+        // Most names in a document are ones it has used before, so rather than making a new string
+        // for each, the (case folded) characters are looked up in the name table. A document can't
+        // make the table grow without bound, though; past MaxNames, new names are just strings.
+        private const int MaxNames = 4096;
+
+        private string Atomize(StringBuilder name, CaseFolding folding) {
+            var length = name.Length;
+            if(this.m_nameChars.Length < length) {
+                this.m_nameChars = new char[Math.Max(length, this.m_nameChars.Length*2)];
+            }
+            name.CopyTo(0, this.m_nameChars, 0, length);
+
+            for(var i = 0; i < length; i++) {
+                var ch = this.m_nameChars[i];
+                if(ch >= 0x80) {
+                    // leave anything but ASCII for the string methods to fold.
+                    var value = name.ToString();
+                    switch(folding) {
+                        case CaseFolding.ToUpper:
+                            value = value.ToUpperInvariant();
+                            break;
+                        case CaseFolding.ToLower:
+                            value = value.ToLowerInvariant();
+                            break;
+                    }
+                    return this.m_nameCount < MaxNames ? this.m_names.Add(value) : value;
+                }
+
+                if(folding == CaseFolding.ToUpper && ch >= 'a' && ch <= 'z') {
+                    this.m_nameChars[i] = (char) (ch - 'a' + 'A');
+                }
+                else if(folding == CaseFolding.ToLower && ch >= 'A' && ch <= 'Z') {
+                    this.m_nameChars[i] = (char) (ch - 'A' + 'a');
+                }
+            }
+
+            var atom = this.m_names.Get(this.m_nameChars, 0, length);
+            if(atom == null) {
+                if(this.m_nameCount >= MaxNames) {
+                    return new string(this.m_nameChars, 0, length);
+                }
+                this.m_nameCount++;
+                atom = this.m_names.Add(this.m_nameChars, 0, length);
             }
-            return name;
+            return atom;
         }
 
         private static bool VerifyName(string name) {
@@ -1450,7 +1661,8 @@ namespace CoApp.Toolkit.Text.Sgml {
                     continue;
                 }
 
-                string value = null;
+                // the value is left in the string builder (rather than made into a string) for the attribute to copy.
+                var hasValue = false;
                 var quote = '\0';
                 if(ch == '=' || ch == '"' || ch == '\'') {
                     if(ch == '=') {
@@ -1460,16 +1672,20 @@ namespace CoApp.Toolkit.Text.Sgml {
 
                     if(ch == '\'' || ch == '\"') {
                         quote = ch;
-                        value = ScanLiteral(this.m_sb, ch);
+                        ScanLiteral(this.m_sb, ch);
+                        hasValue = true;
                     }
                     else if(ch != '>') {
-                        var term = SgmlReader.avterm;
-                        value = this.m_current.ScanToken(this.m_sb, term, false);
+                        this.m_sb.Length = 0;
+                        this.m_current.AppendToken(this.m_sb, SgmlReader.avterm);
+                        hasValue = true;
                     }
                 }
 
                 if(ValidAttributeName(aname)) {
-                    var a = n.AddAttribute(aname, value ?? aname, quote, this.m_folding == CaseFolding.None);
+                    var a = hasValue
+                        ? n.AddAttribute(aname, this.m_sb, quote, this.m_folding == CaseFolding.None)
+                        : n.AddAttribute(aname, aname, quote, this.m_folding == CaseFolding.None);
                     if(a == null) {
                         Log("Duplicate attribute '{0}' ignored", aname);
                     }
@@ -1546,7 +1762,7 @@ namespace CoApp.Toolkit.Text.Sgml {
                 return false;
             }
 
-            var value = this.m_current.ScanToEnd(this.m_sb, "Comment", "-->");
+            var value = this.m_current.ScanToEnd(Skipping ? null : this.m_sb, "Comment", "-->");
 
             // Make sure it's a valid comment!
             var i = value.IndexOf("--");
@@ -1700,6 +1916,8 @@ namespace CoApp.Toolkit.Text.Sgml {
                 this.m_sb.Length = 0;
             }
 
+            var skipping = Skipping;
+
             //this.sb.Append(ch);
             //ch = this.current.ReadChar();
             this.m_state = State.Text;
@@ -1715,8 +1933,10 @@ namespace CoApp.Toolkit.Text.Sgml {
                     }
                     else {
                         // not a tag, so just proceed.
-                        this.m_sb.Append('<');
-                        this.m_sb.Append(ch);
+                        if(!skipping) {
+                            this.m_sb.Append('<');
+                            this.m_sb.Append(ch);
+                        }
                         ws = false;
                         ch = this.m_current.ReadChar();
                     }
@@ -1730,27 +1950,35 @@ namespace CoApp.Toolkit.Text.Sgml {
                     if(!this.m_current.IsWhitespace) {
                         ws = false;
                     }
-                    this.m_sb.Append(ch);
+                    if(!skipping) {
+                        this.m_sb.Append(ch);
+                    }
                     ch = this.m_current.ReadChar();
                 }
             }
 
-            var value = this.m_sb.ToString();
-            Push(null, XmlNodeType.Text, value);
+            var node = Push(null, XmlNodeType.Text, null);
+            if(!skipping) {
+                node.SetValue(this.m_sb);
+            }
             return ws;
         }
 
+        // whether the node about to be pushed is inside the subtree Skip is skipping, so its value won't be wanted.
+        private bool Skipping {
+            get { return this.m_stack.Count > this.m_skipDepth; }
+        }
+
         /// <summary>
-        ///   Consumes and returns a literal block of text, expanding entities as it does so.
+        ///   Consumes a literal block of text into a string builder, expanding entities as it does so.
         /// </summary>
         /// <param name = "sb">The string builder to use.</param>
         /// <param name = "quote">The delimiter for the literal.</param>
-        /// <returns>The consumed literal.</returns>
         /// <remarks>
         ///   This version is slightly different from <see cref = "Entity.ScanLiteral" /> in that
         ///   it also expands entities.
         /// </remarks>
-        private string ScanLiteral(StringBuilder sb, char quote) {
+        private void ScanLiteral(StringBuilder sb, char quote) {
             sb.Length = 0;
             var ch = this.m_current.ReadChar();
             while(ch != Entity.EOF && ch != quote && ch != '>') {
@@ -1766,7 +1994,6 @@ namespace CoApp.Toolkit.Text.Sgml {
             if(ch == quote) {
                 this.m_current.ReadChar(); // consume end quote.
             }
-            return sb.ToString();
         }
 
         private bool ParseCData() {
@@ -1928,7 +2155,7 @@ namespace CoApp.Toolkit.Text.Sgml {
                     this.m_name.Append(ch);
                     ch = this.m_current.ReadChar();
                 }
-                var name = this.m_name.ToString();
+                var name = Atomize(this.m_name, CaseFolding.None);
 
 
  // TODO (steveb): don't lookup amp, gt, lt, quote
@@ -2061,6 +2288,39 @@ namespace CoApp.Toolkit.Text.Sgml {
             return this.m_node.Value;
         }
 
+        /// <summary>
+        ///   Skips the children of the current node.
+        /// </summary>
+        /// <remarks>
+        ///   This moves the reader exactly where <see cref = "XmlReader.Skip" /> does, but the text and comments in the
+        ///   subtree are only scanned past, and never copied into values that nothing will read.
+        /// </remarks>
+        public override void Skip() {
+            if(this.ReadState != ReadState.Interactive) {
+                return;
+            }
+
+            MoveToElement();
+            if(this.NodeType == XmlNodeType.Element && !this.IsEmptyElement) {
+                var depth = this.Depth;
+                this.m_skipDepth = depth;
+                try {
+                    while(Read() && depth < this.Depth) {
+                    }
+                }
+                finally {
+                    this.m_skipDepth = int.MaxValue;
+                }
+
+                if(this.NodeType == XmlNodeType.EndElement) {
+                    Read();
+                }
+            }
+            else {
+                Read();
+            }
+        }
+
         /// <summary>
         ///   Reads all the content, including markup, as a string.
         /// </summary>
@@ -2208,7 +2468,8 @@ namespace CoApp.Toolkit.Text.Sgml {
                 // See if this element is allowed inside the current element.
                 // If it isn't, then auto-close elements until we find one
                 // that it is allowed to be in.                                  
-                var name = node.Name.ToUpperInvariant(); // DTD is in upper case
+                // (the DTD is in upper case, but every comparison with it ignores case.)
+                var name = node.Name;
                 var i = 0;
                 var top = this.m_stack.Count - 2;
                 if(node.DtdType != null) {
@@ -2266,7 +2527,7 @@ namespace CoApp.Toolkit.Text.Sgml {
                             var n2 = (Node) this.m_stack[k];
                             closing += "<" + n2.Name + ">";
                         }
-                        Log("Element '{0}' not allowed inside '{1}', closing {2}.", name, n.Name, closing);
+                        Log("Element '{0}' not allowed inside '{1}', closing {2}.", name.ToUpperInvariant(), n.Name, closing);
 #endif
                     }
 
@@ -171,6 +171,25 @@ namespace Microsoft.Deployment.Compression.Cab
             this.Unpacker.Unpack(streamContext, fileFilter);
         }
 
+        /// <summary>
+        /// Gets the time taken to extract each folder by the last
+        /// <see cref="Unpack"/>.
+        /// </summary>
+        /// <value>One entry per folder, in folder order; empty if the folders
+        /// were not extracted in parallel.</value>
+        /// <remarks>
+        /// The folders of a single cabinet are extracted in parallel, each
+        /// with its own decompression context, unless
+        /// <see cref="CompressionEngine.MaxDegreeOfParallelism"/> is 1.
+        /// </remarks>
+        internal IList<CabFolderStatistics> FolderStatistics
+        {
+            get
+            {
+                return this.unpacker != null ? this.unpacker.FolderStatistics : new List<CabFolderStatistics>().AsReadOnly();
+            }
+        }
+
         internal void ReportProgress(ArchiveProgressEventArgs e)
         {
             base.OnProgress(e);
@@ -0,0 +1,121 @@
+//---------------------------------------------------------------------
+// <copyright file="CabFolderStatistics.cs" company="Microsoft">
+//    Copyright (c) Microsoft Corporation.  All rights reserved.
+//
+//    The use and distribution terms for this software are covered by the
+//    Common Public License 1.0 (http://opensource.org/licenses/cpl1.0.php)
+//    which can be found in the file CPL.TXT at the root of this distribution.
+//    By using this software in any fashion, you are agreeing to be bound by
+//    the terms of this license.
+//
+//    You must not remove this notice, or any other, from this software.
+// </copyright>
+// <summary>
+// Part of the Deployment Tools Foundation project.
+// </summary>
+//---------------------------------------------------------------------
+
+namespace Microsoft.Deployment.Compression.Cab
+{
+    using System;
+    using System.Globalization;
+
+    /// <summary>
+    /// How long it took to extract one folder of a cabinet.
+    /// </summary>
+    /// <remarks>
+    /// A folder is a run of files compressed together as one block; the
+    /// folders of a cabinet can be extracted independently of each other.
+    /// </remarks>
+    internal class CabFolderStatistics
+    {
+        private int folderNumber;
+        private int fileCount;
+        private long uncompressedBytes;
+        private TimeSpan elapsed;
+
+        internal CabFolderStatistics(
+            int folderNumber,
+            int fileCount,
+            long uncompressedBytes,
+            TimeSpan elapsed)
+        {
+            this.folderNumber = folderNumber;
+            this.fileCount = fileCount;
+            this.uncompressedBytes = uncompressedBytes;
+            this.elapsed = elapsed;
+        }
+
+        /// <summary>
+        /// Gets the number of the folder within the cabinet.
+        /// </summary>
+        internal int FolderNumber
+        {
+            get
+            {
+                return this.folderNumber;
+            }
+        }
+
+        /// <summary>
+        /// Gets the number of files extracted from the folder.
+        /// </summary>
+        internal int FileCount
+        {
+            get
+            {
+                return this.fileCount;
+            }
+        }
+
+        /// <summary>
+        /// Gets the total uncompressed size of the files extracted from the folder.
+        /// </summary>
+        internal long UncompressedBytes
+        {
+            get
+            {
+                return this.uncompressedBytes;
+            }
+        }
+
+        /// <summary>
+        /// Gets the time spent decompressing the folder.
+        /// </summary>
+        internal TimeSpan Elapsed
+        {
+            get
+            {
+                return this.elapsed;
+            }
+        }
+
+        /// <summary>
+        /// Gets the rate the folder was decompressed at, in uncompressed
+        /// bytes per second.
+        /// </summary>
+        internal double BytesPerSecond
+        {
+            get
+            {
+                return this.elapsed.Ticks > 0 ? this.uncompressedBytes / this.elapsed.TotalSeconds : 0;
+            }
+        }
+
+        /// <summary>
+        /// Gets a string representation of the statistics.
+        /// </summary>
+        /// <returns>The folder number, size, and throughput.</returns>
+        public override string ToString()
+        {
+            return String.Format(
+                CultureInfo.InvariantCulture,
+                "Folder {0}: {1} files, {2} bytes in {3:F3}s ({4:F1} MB/s)",
+                this.folderNumber,
+                this.fileCount,
+                this.uncompressedBytes,
+                this.elapsed.TotalSeconds,
+                this.BytesPerSecond / (1024 * 1024));
+        }
+    }
+}
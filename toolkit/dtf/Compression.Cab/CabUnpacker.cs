@@ -24,10 +24,25 @@ namespace Microsoft.Deployment.Compression.Cab
     using System.Collections.Generic;
     using System.Globalization;
     using System.Runtime.InteropServices;
+    using System.Diagnostics;
     using System.Diagnostics.CodeAnalysis;
+    using System.Threading.Tasks;
 
     internal class CabUnpacker : CabWorker
     {
+        /// <summary>
+        /// Files bigger than this are buffered in temporary files, rather
+        /// than in memory, while their folder is extracted in parallel.
+        /// </summary>
+        private const long MaxInMemoryUnpackedFileSize = 16 * 1024 * 1024;
+
+        /// <summary>
+        /// Once a folder being extracted in parallel has this much buffered
+        /// in memory, the rest of its files go to temporary files, so at most
+        /// this much is held for each folder in flight.
+        /// </summary>
+        private const long MaxInMemoryUnpackedFolderSize = 32 * 1024 * 1024;
+
         private NativeMethods.FDI.Handle fdiHandle;
 
         // These delegates need to be saved as member variables
@@ -48,6 +63,11 @@ namespace Microsoft.Deployment.Compression.Cab
 
         private Predicate<string> filter;
 
+        // When not -1, only the files in this folder are extracted.
+        private int extractFolder = -1;
+
+        private List<CabFolderStatistics> folderStatistics = new List<CabFolderStatistics>();
+
         [SuppressMessage("Microsoft.Security", "CA2106:SecureAsserts")]
         [SuppressMessage("Microsoft.Security", "CA2122:DoNotIndirectlyExposeMethodsWithLinkDemands")]
         [SecurityPermission(SecurityAction.Assert, UnmanagedCode = true)]
@@ -174,6 +194,7 @@ namespace Microsoft.Deployment.Compression.Cab
                     this.GetFileInfo(streamContext, fileFilter);
 
                 this.ResetProgressData();
+                this.folderStatistics = new List<CabFolderStatistics>();
 
                 if (files != null)
                 {
@@ -188,6 +209,16 @@ namespace Microsoft.Deployment.Compression.Cab
                             this.totalArchives = (short) totalArchives;
                         }
                     }
+
+                    if (this.CabEngine.MaxDegreeOfParallelism > 1 && this.totalArchives <= 1)
+                    {
+                        IList<int> folders = CabUnpacker.GetFolderNumbers(files);
+                        if (folders.Count > 1)
+                        {
+                            this.UnpackFoldersInParallel(streamContext, folders, fileFilter);
+                            return;
+                        }
+                    }
                 }
 
                 this.context = streamContext;
@@ -218,26 +249,239 @@ namespace Microsoft.Deployment.Compression.Cab
                 }
                 finally
                 {
-                    if (this.CabStream != null)
+                    this.CloseUnpackStreams();
+                }
+            }
+        }
+
+        /// <summary>
+        /// Gets the time taken to extract each folder by the last
+        /// <see cref="Unpack"/>.
+        /// </summary>
+        /// <value>One entry per folder, in folder order; empty if the
+        /// folders were not extracted in parallel.</value>
+        internal IList<CabFolderStatistics> FolderStatistics
+        {
+            get
+            {
+                return this.folderStatistics.AsReadOnly();
+            }
+        }
+
+        private static IList<int> GetFolderNumbers(IList<ArchiveFileInfo> files)
+        {
+            List<int> folders = new List<int>();
+            foreach (CabFileInfo file in files)
+            {
+                if (!folders.Contains(file.CabinetFolderNumber))
+                {
+                    folders.Add(file.CabinetFolderNumber);
+                }
+            }
+            return folders;
+        }
+
+        /// <summary>
+        /// Extracts the folders of a single cabinet several at once on
+        /// other threads, finishing them in order.
+        /// </summary>
+        /// <remarks>
+        /// The folders in a cabinet are compressed independently, so each
+        /// one is given its own decompression context, which skips straight
+        /// past the other folders. They all read the one archive stream, each
+        /// thru its own <see cref="DuplicateStream"/>. The extracted files
+        /// are held (in memory, or in temporary files if they are large or
+        /// their folder already has enough in memory) until their folder's
+        /// turn comes, and only then handed to the stream context, from this
+        /// thread and in the same order as a sequential unpack.
+        /// </remarks>
+        private void UnpackFoldersInParallel(
+            IUnpackStreamContext streamContext,
+            IList<int> folders,
+            Predicate<string> fileFilter)
+        {
+            Stream archiveStream = streamContext.OpenArchiveReadStream(0, String.Empty, this.CabEngine);
+            if (archiveStream == null)
+            {
+                throw new FileNotFoundException(String.Format(CultureInfo.InvariantCulture, "Cabinet {0} not provided.", 0));
+            }
+
+            this.currentArchiveName = String.Empty;
+            this.currentArchiveNumber = 0;
+            this.totalArchives = 1;
+            this.currentArchiveTotalBytes = archiveStream.Length;
+            this.currentArchiveBytesProcessed = 0;
+            this.currentFileNumber = -1;
+            this.OnProgress(ArchiveProgressType.StartArchive);
+
+            int maxFoldersInFlight = this.CabEngine.MaxDegreeOfParallelism;
+            Queue<UnpackedFolder> foldersInFlight = new Queue<UnpackedFolder>();
+            try
+            {
+                foreach (int folderNumber in folders)
+                {
+                    if (foldersInFlight.Count >= maxFoldersInFlight)
                     {
-                        this.context.CloseArchiveReadStream(
-                            this.currentArchiveNumber,
-                            this.currentArchiveName,
-                            this.CabStream);
-                        this.CabStream = null;
+                        this.FinishUnpackedFolder(streamContext, foldersInFlight.Dequeue());
                     }
 
-                    if (this.FileStream != null)
+                    foldersInFlight.Enqueue(new UnpackedFolder(
+                        this.CabEngine, archiveStream, folderNumber, fileFilter));
+                }
+
+                while (foldersInFlight.Count > 0)
+                {
+                    this.FinishUnpackedFolder(streamContext, foldersInFlight.Dequeue());
+                }
+
+                this.currentArchiveBytesProcessed = this.currentArchiveTotalBytes;
+                this.OnProgress(ArchiveProgressType.FinishArchive);
+            }
+            finally
+            {
+                // Something failed; let the rest finish (they're still reading
+                // the archive stream), and throw away what they extracted.
+                while (foldersInFlight.Count > 0)
+                {
+                    UnpackedFolder unpackedFolder = foldersInFlight.Dequeue();
+                    try
+                    {
+                        unpackedFolder.Wait();
+                    }
+                    catch (Exception)
                     {
-                        this.context.CloseFileWriteStream(this.currentFileName, this.FileStream, FileAttributes.Normal, DateTime.Now);
-                        this.FileStream = null;
                     }
 
-                    this.context = null;
+                    unpackedFolder.Dispose();
+                }
+
+                streamContext.CloseArchiveReadStream(0, String.Empty, archiveStream);
+            }
+        }
+
+        /// <summary>
+        /// Waits for a folder to be extracted, and writes out its files.
+        /// </summary>
+        private void FinishUnpackedFolder(
+            IUnpackStreamContext streamContext,
+            UnpackedFolder unpackedFolder)
+        {
+            try
+            {
+                unpackedFolder.Wait();
+
+                byte[] buf = new byte[32768];
+                foreach (UnpackedFile unpackedFile in unpackedFolder.Files)
+                {
+                    this.currentFileNumber++;
+                    this.currentFileName = unpackedFile.Name;
+                    this.currentFileBytesProcessed = 0;
+                    this.currentFileTotalBytes = unpackedFile.Length;
+                    this.OnProgress(ArchiveProgressType.StartFile);
+
+                    Stream stream = streamContext.OpenFileWriteStream(
+                        unpackedFile.Name, unpackedFile.Length, unpackedFile.LastWriteTime);
+                    if (stream != null)
+                    {
+                        try
+                        {
+                            unpackedFile.Data.Position = 0;
+                            int count;
+                            while ((count = unpackedFile.Data.Read(buf, 0, buf.Length)) > 0)
+                            {
+                                stream.Write(buf, 0, count);
+                                this.currentFileBytesProcessed += count;
+                                this.fileBytesProcessed += count;
+                                this.OnProgress(ArchiveProgressType.PartialFile);
+                            }
+
+                            stream.Flush();
+                        }
+                        finally
+                        {
+                            streamContext.CloseFileWriteStream(
+                                unpackedFile.Name, stream, unpackedFile.Attributes, unpackedFile.LastWriteTime);
+                        }
+                    }
+
+                    long remainder = this.currentFileTotalBytes - this.currentFileBytesProcessed;
+                    this.currentFileBytesProcessed += remainder;
+                    this.fileBytesProcessed += remainder;
+                    this.OnProgress(ArchiveProgressType.FinishFile);
+                    this.currentFileName = null;
                 }
+
+                this.folderStatistics.Add(unpackedFolder.Statistics);
+            }
+            finally
+            {
+                unpackedFolder.Dispose();
             }
         }
 
+        /// <summary>
+        /// Extracts just the files in one folder of a single cabinet.
+        /// </summary>
+        [SuppressMessage("Microsoft.Security", "CA2106:SecureAsserts")]
+        [SecurityPermission(SecurityAction.Assert, UnmanagedCode = true)]
+        private void UnpackFolder(
+            IUnpackStreamContext streamContext,
+            Predicate<string> fileFilter,
+            int folderNumber)
+        {
+            lock (this)
+            {
+                this.context = streamContext;
+                this.filter = fileFilter;
+                this.fileList = null;
+                this.NextCabinetName = String.Empty;
+                this.folderId = -1;
+                this.currentFileNumber = -1;
+                this.extractFolder = folderNumber;
+
+                try
+                {
+                    this.Erf.Clear();
+                    this.CabNumbers[this.NextCabinetName] = 0;
+
+                    NativeMethods.FDI.Copy(
+                        this.fdiHandle,
+                        this.NextCabinetName,
+                        String.Empty,
+                        0,
+                        this.CabExtractNotify,
+                        IntPtr.Zero,
+                        IntPtr.Zero);
+                    this.CheckError(true);
+                }
+                finally
+                {
+                    this.extractFolder = -1;
+                    this.CloseUnpackStreams();
+                }
+            }
+        }
+
+        private void CloseUnpackStreams()
+        {
+            if (this.CabStream != null)
+            {
+                this.context.CloseArchiveReadStream(
+                    this.currentArchiveNumber,
+                    this.currentArchiveName,
+                    this.CabStream);
+                this.CabStream = null;
+            }
+
+            if (this.FileStream != null)
+            {
+                this.context.CloseFileWriteStream(this.currentFileName, this.FileStream, FileAttributes.Normal, DateTime.Now);
+                this.FileStream = null;
+            }
+
+            this.context = null;
+        }
+
         internal override int CabOpenStreamEx(string path, int openFlags, int shareMode, out int err, IntPtr pv)
         {
             if (this.CabNumbers.ContainsKey(path))
@@ -524,6 +768,11 @@ namespace Microsoft.Deployment.Compression.Cab
                 this.folderId = notification.iFolder;
             }
 
+            if (this.extractFolder != -1 && notification.iFolder != this.extractFolder)
+            {
+                return 0;  // Skip; another context is extracting that folder
+            }
+
             //bool execute = (notification.attribs & (ushort) FileAttributes.Device) != 0;  // _A_EXEC
 
             string name = CabUnpacker.GetFileName(notification);
@@ -587,5 +836,163 @@ namespace Microsoft.Deployment.Compression.Cab
 
             return 1;  // Continue
         }
+
+        /// <summary>
+        /// A file extracted by an <see cref="UnpackedFolder"/>, waiting to be
+        /// written out.
+        /// </summary>
+        private sealed class UnpackedFile
+        {
+            internal UnpackedFile(string name, long length, DateTime lastWriteTime, Stream data)
+            {
+                this.Name = name;
+                this.Length = length;
+                this.LastWriteTime = lastWriteTime;
+                this.Attributes = FileAttributes.Normal;
+                this.Data = data;
+            }
+
+            internal string Name { get; private set; }
+
+            internal long Length { get; private set; }
+
+            internal DateTime LastWriteTime { get; set; }
+
+            internal FileAttributes Attributes { get; set; }
+
+            internal Stream Data { get; private set; }
+        }
+
+        /// <summary>
+        /// A cabinet folder being extracted on another thread, with its own
+        /// decompression context, for <see cref="UnpackFoldersInParallel"/>.
+        /// </summary>
+        /// <remarks>
+        /// This is the stream context of that decompression context: the
+        /// archive is read thru a duplicate of the shared stream, and the
+        /// files are captured rather than written.
+        /// </remarks>
+        private sealed class UnpackedFolder : IUnpackStreamContext, IDisposable
+        {
+            private readonly Task task;
+            private readonly Stream archiveStream;
+            private readonly bool useTempFiles;
+            private readonly List<UnpackedFile> files = new List<UnpackedFile>();
+            private long bytesInMemory;
+
+            internal UnpackedFolder(
+                CabEngine cabEngine,
+                Stream archiveStream,
+                int folderNumber,
+                Predicate<string> fileFilter)
+            {
+                this.archiveStream = archiveStream;
+                this.useTempFiles = cabEngine.UseTempFiles;
+                this.FolderNumber = folderNumber;
+                this.task = Task.Factory.StartNew(
+                    delegate { this.Unpack(cabEngine, fileFilter); });
+            }
+
+            internal int FolderNumber { get; private set; }
+
+            internal IList<UnpackedFile> Files
+            {
+                get
+                {
+                    return this.files;
+                }
+            }
+
+            internal CabFolderStatistics Statistics { get; private set; }
+
+            /// <summary>
+            /// Waits for the folder to be extracted, throwing anything
+            /// that went wrong.
+            /// </summary>
+            internal void Wait()
+            {
+                try
+                {
+                    this.task.Wait();
+                }
+                catch (AggregateException ex)
+                {
+                    throw ex.InnerException;
+                }
+            }
+
+            public void Dispose()
+            {
+                foreach (UnpackedFile file in this.files)
+                {
+                    file.Data.Close();
+                }
+                this.files.Clear();
+            }
+
+            private void Unpack(CabEngine cabEngine, Predicate<string> fileFilter)
+            {
+                Stopwatch stopwatch = Stopwatch.StartNew();
+                using (CabUnpacker unpacker = new CabUnpacker(cabEngine))
+                {
+                    unpacker.SuppressProgressEvents = true;
+                    unpacker.UnpackFolder(this, fileFilter, this.FolderNumber);
+                }
+                stopwatch.Stop();
+
+                long uncompressedBytes = 0;
+                foreach (UnpackedFile file in this.files)
+                {
+                    uncompressedBytes += file.Data.Length;
+                }
+
+                this.Statistics = new CabFolderStatistics(
+                    this.FolderNumber, this.files.Count, uncompressedBytes, stopwatch.Elapsed);
+            }
+
+            Stream IUnpackStreamContext.OpenArchiveReadStream(int archiveNumber, string archiveName, CompressionEngine compressionEngine)
+            {
+                return new DuplicateStream(this.archiveStream);
+            }
+
+            void IUnpackStreamContext.CloseArchiveReadStream(int archiveNumber, string archiveName, Stream stream)
+            {
+                // The archive stream is shared; it's closed when all the folders are done.
+            }
+
+            Stream IUnpackStreamContext.OpenFileWriteStream(string path, long fileSize, DateTime lastWriteTime)
+            {
+                Stream data;
+                if (this.useTempFiles &&
+                    (fileSize > MaxInMemoryUnpackedFileSize ||
+                     this.bytesInMemory + fileSize > MaxInMemoryUnpackedFolderSize))
+                {
+                    data = new FileStream(
+                        Path.GetTempFileName(),
+                        FileMode.Create,
+                        FileAccess.ReadWrite,
+                        FileShare.None,
+                        4096,
+                        FileOptions.DeleteOnClose);
+                }
+                else
+                {
+                    // (the size is only a hint; the stream still grows if it's wrong.)
+                    data = new MemoryStream((int) Math.Min(Math.Max(fileSize, 0), MaxInMemoryUnpackedFileSize));
+                    this.bytesInMemory += fileSize;
+                }
+
+                this.files.Add(new UnpackedFile(path, fileSize, lastWriteTime, data));
+                return data;
+            }
+
+            void IUnpackStreamContext.CloseFileWriteStream(string path, Stream stream, FileAttributes attributes, DateTime lastWriteTime)
+            {
+                // Keep the data until the file is written out.
+                UnpackedFile file = this.files[this.files.Count - 1];
+                file.Attributes = attributes;
+                file.LastWriteTime = lastWriteTime;
+            }
+        }
     }
 }
@@ -212,55 +212,13 @@ namespace Microsoft.Deployment.Compression.Zip
         /// <summary>
         /// Updates the CRC with a range of bytes that were read or written.
         /// </summary>
+        /// <remarks>
+        /// This is the same CRC-32 as the toolkit's CRC32 class, which does it
+        /// many bytes at a time.
+        /// </remarks>
         private void UpdateCrc(byte[] buffer, int offset, int count)
         {
-            this.crc = ~this.crc;
-            for( ; count > 0; count--, offset++)
-            {
-                this.crc = (this.crc >> 8) ^
-                    CrcStream.crcTable[(this.crc  & 0xFF) ^ buffer[offset]];
-            }
-            this.crc = ~this.crc;
-        }
-
-        private static uint[] crcTable = MakeCrcTable();
-
-        /// <summary>
-        /// Computes a table that speeds up calculation of the CRC.
-        /// </summary>
-        private static uint[] MakeCrcTable()
-        {
-            const uint poly = 0x04C11DB7u;
-            uint[] crcTable = new uint[256];
-            for(uint n = 0; n < 256; n++)
-            {
-                uint c = CrcStream.Reflect(n, 8);
-                c = c << 24;
-                for(uint k = 0; k < 8; k++)
-                {
-                    c = (c << 1) ^ ((c & 0x80000000u) != 0 ? poly : 0);
-                }
-                crcTable[n] = CrcStream.Reflect(c, 32);
-            }
-            return crcTable;
-        }
-
-        /// <summary>
-        /// Reflects the ordering of certain number of bits. For exmample when reflecting
-        /// one byte, bit one is swapped with bit eight, bit two with bit seven, etc.
-        /// </summary>
-        private static uint Reflect(uint value, int bits)
-        {
-            for (int i = 0; i < bits / 2; i++)
-            {
-                uint leftBit = 1u << (bits - 1 - i);
-                uint rightBit = 1u << i;
-                if (((value & leftBit) != 0) != ((value & rightBit) != 0))
-                {
-                    value ^= leftBit | rightBit;
-                }
-            }
-            return value;
+            this.crc = Ionic.Crc.CRC32.Update(this.crc, buffer, offset, count);
         }
     }
 }
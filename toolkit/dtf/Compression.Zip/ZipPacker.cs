@@ -22,9 +22,17 @@ namespace Microsoft.Deployment.Compression.Zip
     using System.IO.Compression;
     using System.Collections.Generic;
     using System.Globalization;
+    using System.Threading.Tasks;
 
     internal partial class ZipEngine
     {
+        /// <summary>
+        /// Files whose compressed data is bigger than this are buffered in
+        /// temporary files rather than memory while packing in parallel,
+        /// if temporary files are allowed.
+        /// </summary>
+        private const long MaxInMemoryPackedFileSize = 1024 * 1024;
+
         /// <summary>
         /// Creates a zip archive or chain of zip archives.
         /// </summary>
@@ -101,24 +109,38 @@ namespace Microsoft.Deployment.Compression.Zip
 
                     this.OnProgress(ArchiveProgressType.StartArchive);
 
-                    // Compress files one by one, saving header info for each.
-                    foreach (string file in files)
+                    if (this.MaxDegreeOfParallelism > 1 && this.totalFiles > 1)
+                    {
+                        this.PackFilesInParallel(
+                            streamContext,
+                            files,
+                            maxArchiveSize,
+                            forceZip64,
+                            fileHeaders,
+                            ref archiveStream);
+                    }
+                    else
                     {
-                        ZipFileHeader fileHeader = this.PackOneFile(
-                                streamContext,
-                                file,
-                                maxArchiveSize,
-                                forceZip64,
-                                ref archiveStream);
-
-                        if (fileHeader != null)
+                        // Compress files one by one, saving header info for each.
+                        foreach (string file in files)
                         {
-                            fileHeaders.Add(fileHeader);
+                            ZipFileHeader fileHeader = this.PackOneFile(
+                                    streamContext,
+                                    file,
+                                    maxArchiveSize,
+                                    forceZip64,
+                                    null,
+                                    ref archiveStream);
+
+                            if (fileHeader != null)
+                            {
+                                fileHeaders.Add(fileHeader);
+                            }
+
+                            this.currentArchiveTotalBytes = (archiveStream != null ?
+                                archiveStream.Position : 0);
+                            this.currentArchiveBytesProcessed = this.currentArchiveTotalBytes;
                         }
-
-                        this.currentArchiveTotalBytes = (archiveStream != null ?
-                            archiveStream.Position : 0);
-                        this.currentArchiveBytesProcessed = this.currentArchiveTotalBytes;
                     }
 
                     bool zip64 = forceZip64 || this.totalFiles > UInt16.MaxValue;
@@ -277,14 +299,153 @@ namespace Microsoft.Deployment.Compression.Zip
             }
         }
 
+        /// <summary>
+        /// Compresses several files at once on other threads, and adds them
+        /// to the archive in order as they're finished.
+        /// </summary>
+        /// <remarks>
+        /// Each file is compressed into a buffer of its own, the same way
+        /// <see cref="PackFileBytes"/> would have compressed it, and the buffer
+        /// is then written by <see cref="PackOneFile"/> just as if the file had
+        /// been compressed there; so the archive is identical to one made one
+        /// file at a time (including any splitting into a chain of archives).
+        /// The stream context is only called from this thread.
+        /// </remarks>
+        private void PackFilesInParallel(
+            IPackStreamContext streamContext,
+            IEnumerable<string> files,
+            long maxArchiveSize,
+            bool forceZip64,
+            List<ZipFileHeader> fileHeaders,
+            ref Stream archiveStream)
+        {
+            ZipCompressionMethod compressionMethod = ZipCompressionMethod.Deflate;
+            if (this.CompressionLevel == CompressionLevel.None)
+            {
+                compressionMethod = ZipCompressionMethod.Store;
+            }
+
+            Converter<Stream, Stream> compressionStreamCreator;
+            if (!ZipEngine.compressionStreamCreators.TryGetValue(
+                compressionMethod, out compressionStreamCreator))
+            {
+                throw new ZipException(
+                    "No compression stream available for method: " + compressionMethod);
+            }
+
+            int maxFilesInFlight = 2 * this.MaxDegreeOfParallelism;
+            Queue<PackedFile> filesInFlight = new Queue<PackedFile>();
+            try
+            {
+                foreach (string file in files)
+                {
+                    FileAttributes attributes;
+                    DateTime lastWriteTime;
+                    Stream fileStream = streamContext.OpenFileReadStream(
+                        file, out attributes, out lastWriteTime);
+                    if (fileStream == null)
+                    {
+                        continue;
+                    }
+
+                    filesInFlight.Enqueue(new PackedFile(
+                        file,
+                        fileStream,
+                        attributes,
+                        lastWriteTime,
+                        compressionStreamCreator,
+                        this.UseTempFiles));
+
+                    if (filesInFlight.Count >= maxFilesInFlight)
+                    {
+                        this.WritePackedFile(streamContext, filesInFlight.Dequeue(),
+                            maxArchiveSize, forceZip64, fileHeaders, ref archiveStream);
+                    }
+                }
+
+                while (filesInFlight.Count > 0)
+                {
+                    this.WritePackedFile(streamContext, filesInFlight.Dequeue(),
+                        maxArchiveSize, forceZip64, fileHeaders, ref archiveStream);
+                }
+            }
+            finally
+            {
+                // Something failed; let the rest finish, and throw them away.
+                while (filesInFlight.Count > 0)
+                {
+                    PackedFile packedFile = filesInFlight.Dequeue();
+                    try
+                    {
+                        packedFile.Wait();
+                    }
+                    catch (Exception)
+                    {
+                    }
+
+                    streamContext.CloseFileReadStream(packedFile.Name, packedFile.FileStream);
+                    packedFile.Dispose();
+                }
+            }
+        }
+
+        private void WritePackedFile(
+            IPackStreamContext streamContext,
+            PackedFile packedFile,
+            long maxArchiveSize,
+            bool forceZip64,
+            List<ZipFileHeader> fileHeaders,
+            ref Stream archiveStream)
+        {
+            try
+            {
+                try
+                {
+                    packedFile.Wait();
+                }
+                catch (Exception)
+                {
+                    streamContext.CloseFileReadStream(packedFile.Name, packedFile.FileStream);
+                    throw;
+                }
+
+                ZipFileHeader fileHeader = this.PackOneFile(
+                        streamContext,
+                        packedFile.Name,
+                        maxArchiveSize,
+                        forceZip64,
+                        packedFile,
+                        ref archiveStream);
+
+                if (fileHeader != null)
+                {
+                    fileHeaders.Add(fileHeader);
+                }
+
+                this.currentArchiveTotalBytes = (archiveStream != null ?
+                    archiveStream.Position : 0);
+                this.currentArchiveBytesProcessed = this.currentArchiveTotalBytes;
+            }
+            finally
+            {
+                packedFile.Dispose();
+            }
+        }
+
         /// <summary>
         /// Adds one file to a zip archive in the process of being created.
         /// </summary>
+        /// <remarks>
+        /// If <paramref name="packedFile"/> is not null, the file has already
+        /// been opened and compressed, and its compressed bytes are copied
+        /// into the archive as they are.
+        /// </remarks>
         private ZipFileHeader PackOneFile(
             IPackStreamContext streamContext,
             string file,
             long maxArchiveSize,
             bool forceZip64,
+            PackedFile packedFile,
             ref Stream archiveStream)
         {
             Stream fileStream = null;
@@ -302,16 +463,26 @@ namespace Microsoft.Deployment.Compression.Zip
                 if (!ZipEngine.compressionStreamCreators.TryGetValue(
                     compressionMethod, out compressionStreamCreator))
                 {
-                    return null;
+                    throw new ZipException(
+                        "No compression stream available for method: " + compressionMethod);
                 }
 
                 FileAttributes attributes;
                 DateTime lastWriteTime;
-                fileStream = streamContext.OpenFileReadStream(
-                    file, out attributes, out lastWriteTime);
-                if (fileStream == null)
+                if (packedFile != null)
+                {
+                    fileStream = packedFile.FileStream;
+                    attributes = packedFile.Attributes;
+                    lastWriteTime = packedFile.LastWriteTime;
+                }
+                else
                 {
-                    return null;
+                    fileStream = streamContext.OpenFileReadStream(
+                        file, out attributes, out lastWriteTime);
+                    if (fileStream == null)
+                    {
+                        return null;
+                    }
                 }
 
                 this.currentFileName = file;
@@ -347,6 +518,7 @@ namespace Microsoft.Deployment.Compression.Zip
                 long bytesWritten = this.PackFileBytes(
                     streamContext,
                     fileStream,
+                    packedFile,
                     maxArchiveSize,
                     compressionStreamCreator,
                     ref archiveStream,
@@ -412,9 +584,14 @@ namespace Microsoft.Deployment.Compression.Zip
         /// Writes compressed bytes of one file to the archive,
         /// keeping track of the CRC and number of bytes written.
         /// </summary>
+        /// <remarks>
+        /// If <paramref name="packedFile"/> is not null, its bytes are
+        /// already compressed, and its CRC already known.
+        /// </remarks>
         private long PackFileBytes(
             IPackStreamContext streamContext,
             Stream fileStream,
+            PackedFile packedFile,
             long maxArchiveSize,
             Converter<Stream, Stream> compressionStreamCreator,
             ref Stream archiveStream,
@@ -422,7 +599,17 @@ namespace Microsoft.Deployment.Compression.Zip
         {
             long writeStartPosition = archiveStream.Position;
             long bytesWritten = 0;
-            CrcStream fileCrcStream = new CrcStream(fileStream);
+            CrcStream fileCrcStream = null;
+            Stream readStream;
+            if (packedFile != null)
+            {
+                readStream = packedFile.CompressedStream;
+            }
+            else
+            {
+                fileCrcStream = new CrcStream(fileStream);
+                readStream = fileCrcStream;
+            }
 
             ConcatStream concatStream = new ConcatStream(
                 delegate(ConcatStream s)
@@ -447,19 +634,20 @@ namespace Microsoft.Deployment.Compression.Zip
                 concatStream.SetLength(maxArchiveSize);
             }
 
-            Stream compressionStream = compressionStreamCreator(concatStream);
+            Stream compressionStream = (packedFile != null ? concatStream :
+                compressionStreamCreator(concatStream));
 
             try
             {
                 byte[] buf = new byte[4096];
-                long bytesRemaining = fileStream.Length;
+                long bytesRemaining = readStream.Length;
                 int counter = 0;
                 while (bytesRemaining > 0)
                 {
                     int count = (int) Math.Min(
                         bytesRemaining, (long) buf.Length);
 
-                    count = fileCrcStream.Read(buf, 0, count);
+                    count = readStream.Read(buf, 0, count);
                     if (count <= 0)
                     {
                         throw new ZipException(
@@ -496,9 +684,136 @@ namespace Microsoft.Deployment.Compression.Zip
 
             bytesWritten += archiveStream.Position - writeStartPosition;
 
-            crc = fileCrcStream.Crc;
+            if (packedFile != null)
+            {
+                // (progress was counted in compressed bytes.)
+                this.fileBytesProcessed += fileStream.Length - readStream.Length;
+                this.currentFileBytesProcessed = fileStream.Length;
+                crc = packedFile.Crc;
+            }
+            else
+            {
+                crc = fileCrcStream.Crc;
+            }
 
             return bytesWritten;
         }
+
+        /// <summary>
+        /// A file being compressed into a buffer on another thread,
+        /// for <see cref="PackFilesInParallel"/>.
+        /// </summary>
+        private sealed class PackedFile : IDisposable
+        {
+            private readonly Task task;
+
+            internal PackedFile(
+                string name,
+                Stream fileStream,
+                FileAttributes attributes,
+                DateTime lastWriteTime,
+                Converter<Stream, Stream> compressionStreamCreator,
+                bool useTempFiles)
+            {
+                this.Name = name;
+                this.FileStream = fileStream;
+                this.Attributes = attributes;
+                this.LastWriteTime = lastWriteTime;
+                this.task = Task.Factory.StartNew(
+                    delegate { this.Compress(compressionStreamCreator, useTempFiles); });
+            }
+
+            internal string Name { get; private set; }
+
+            internal Stream FileStream { get; private set; }
+
+            internal FileAttributes Attributes { get; private set; }
+
+            internal DateTime LastWriteTime { get; private set; }
+
+            internal Stream CompressedStream { get; private set; }
+
+            internal uint Crc { get; private set; }
+
+            /// <summary>
+            /// Waits for the compression to finish, throwing anything
+            /// that went wrong.
+            /// </summary>
+            internal void Wait()
+            {
+                try
+                {
+                    this.task.Wait();
+                }
+                catch (AggregateException ex)
+                {
+                    throw ex.InnerException;
+                }
+            }
+
+            public void Dispose()
+            {
+                if (this.CompressedStream != null)
+                {
+                    this.CompressedStream.Close();
+                    this.CompressedStream = null;
+                }
+            }
+
+            // Reads and compresses the file exactly as PackFileBytes does,
+            // so that the compressed bytes come out the same.
+            private void Compress(
+                Converter<Stream, Stream> compressionStreamCreator,
+                bool useTempFiles)
+            {
+                if (useTempFiles && this.FileStream.Length > MaxInMemoryPackedFileSize)
+                {
+                    this.CompressedStream = new FileStream(
+                        Path.GetTempFileName(),
+                        FileMode.Create,
+                        FileAccess.ReadWrite,
+                        FileShare.None,
+                        4096,
+                        FileOptions.DeleteOnClose);
+                }
+                else
+                {
+                    this.CompressedStream = new MemoryStream();
+                }
+
+                CrcStream fileCrcStream = new CrcStream(this.FileStream);
+                Stream compressionStream = compressionStreamCreator(this.CompressedStream);
+
+                byte[] buf = new byte[4096];
+                long bytesRemaining = this.FileStream.Length;
+                while (bytesRemaining > 0)
+                {
+                    int count = (int) Math.Min(
+                        bytesRemaining, (long) buf.Length);
+
+                    count = fileCrcStream.Read(buf, 0, count);
+                    if (count <= 0)
+                    {
+                        throw new ZipException(
+                            "Failed to read file: " + this.Name);
+                    }
+
+                    compressionStream.Write(buf, 0, count);
+                    bytesRemaining -= count;
+                }
+
+                if (compressionStream is DeflateStream)
+                {
+                    compressionStream.Close();
+                }
+                else
+                {
+                    compressionStream.Flush();
+                }
+
+                this.Crc = fileCrcStream.Crc;
+                this.CompressedStream.Seek(0, SeekOrigin.Begin);
+            }
+        }
     }
 }
@@ -21,9 +21,17 @@ namespace Microsoft.Deployment.Compression.Zip
     using System.IO;
     using System.IO.Compression;
     using System.Collections.Generic;
+    using System.Threading.Tasks;
 
     internal partial class ZipEngine
     {
+        /// <summary>
+        /// Files with more compressed data than this are extracted
+        /// on their own, rather than read into memory to be extracted
+        /// in parallel.
+        /// </summary>
+        private const long MaxInMemoryUnpackedFileSize = 16 * 1024 * 1024;
+
         /// <summary>
         /// Extracts files from a zip archive or archive chain.
         /// </summary>
@@ -94,10 +102,18 @@ namespace Microsoft.Deployment.Compression.Zip
                 Stream archiveStream = null;
                 try
                 {
-                    foreach (ZipFileHeader header in headers)
+                    if (this.MaxDegreeOfParallelism > 1 && this.totalArchives <= 1 &&
+                        headers.Count > 1)
                     {
-                        this.currentFileNumber++;
-                        this.UnpackOneFile(streamContext, header, ref archiveStream);
+                        this.UnpackFilesInParallel(streamContext, headers, ref archiveStream);
+                    }
+                    else
+                    {
+                        foreach (ZipFileHeader header in headers)
+                        {
+                            this.currentFileNumber++;
+                            this.UnpackOneFile(streamContext, header, ref archiveStream);
+                        }
                     }
                 }
                 finally
@@ -145,36 +161,7 @@ namespace Microsoft.Deployment.Compression.Zip
                     out archiveNumber,
                     out crc);
 
-                if (this.currentArchiveNumber != archiveNumber + 1)
-                {
-                    if (archiveStream != null)
-                    {
-                        streamContext.CloseArchiveReadStream(
-                            this.currentArchiveNumber,
-                            String.Empty,
-                            archiveStream);
-                        archiveStream = null;
-
-                        this.OnProgress(ArchiveProgressType.FinishArchive);
-                        this.currentArchiveName = null;
-                    }
-
-                    this.currentArchiveNumber = (short) (archiveNumber + 1);
-                    this.currentArchiveBytesProcessed = 0;
-                    this.currentArchiveTotalBytes = 0;
-
-                    archiveStream = this.OpenArchive(
-                        streamContext, this.currentArchiveNumber);
-
-                    FileStream archiveFileStream = archiveStream as FileStream;
-                    this.currentArchiveName = (archiveFileStream != null ?
-                        Path.GetFileName(archiveFileStream.Name) : null);
-
-                    this.currentArchiveTotalBytes = archiveStream.Length;
-                    this.currentArchiveNumber--;
-                    this.OnProgress(ArchiveProgressType.StartArchive);
-                    this.currentArchiveNumber++;
-                }
+                this.CheckArchiveReadStream(streamContext, archiveNumber, ref archiveStream);
 
                 archiveStream.Seek(localHeaderOffset, SeekOrigin.Begin);
 
@@ -230,6 +217,257 @@ namespace Microsoft.Deployment.Compression.Zip
             }
         }
 
+        /// <summary>
+        /// Extracts several files at once on other threads, finishing them in order.
+        /// </summary>
+        /// <remarks>
+        /// Only used for a single archive. The compressed bytes of each file are
+        /// read from the archive in order on this thread, and decompressed (and
+        /// checked against their CRC) on others, so the archive stream is never
+        /// shared. The stream context is only called from this thread. Files too
+        /// big to hold in memory are extracted one at a time as usual.
+        /// </remarks>
+        private void UnpackFilesInParallel(
+            IUnpackStreamContext streamContext,
+            IList<ZipFileHeader> headers,
+            ref Stream archiveStream)
+        {
+            int maxFilesInFlight = 2 * this.MaxDegreeOfParallelism;
+            Queue<UnpackedFile> filesInFlight = new Queue<UnpackedFile>();
+            int fileNumber = this.currentFileNumber;
+            try
+            {
+                foreach (ZipFileHeader header in headers)
+                {
+                    fileNumber++;
+
+                    long compressedSize;
+                    long uncompressedSize;
+                    long localHeaderOffset;
+                    int archiveNumber;
+                    uint crc;
+                    header.GetZip64Fields(
+                        out compressedSize,
+                        out uncompressedSize,
+                        out localHeaderOffset,
+                        out archiveNumber,
+                        out crc);
+
+                    if (compressedSize > MaxInMemoryUnpackedFileSize)
+                    {
+                        while (filesInFlight.Count > 0)
+                        {
+                            this.FinishUnpackedFile(streamContext, filesInFlight.Dequeue());
+                        }
+
+                        this.currentFileNumber = fileNumber;
+                        this.UnpackOneFile(streamContext, header, ref archiveStream);
+                        continue;
+                    }
+
+                    UnpackedFile unpackedFile = this.StartUnpackedFile(
+                        streamContext, header, fileNumber, ref archiveStream);
+                    if (unpackedFile != null)
+                    {
+                        filesInFlight.Enqueue(unpackedFile);
+                        if (filesInFlight.Count >= maxFilesInFlight)
+                        {
+                            this.FinishUnpackedFile(streamContext, filesInFlight.Dequeue());
+                        }
+                    }
+                }
+
+                while (filesInFlight.Count > 0)
+                {
+                    this.FinishUnpackedFile(streamContext, filesInFlight.Dequeue());
+                }
+            }
+            finally
+            {
+                // Something failed; let the rest finish, and close them.
+                while (filesInFlight.Count > 0)
+                {
+                    UnpackedFile unpackedFile = filesInFlight.Dequeue();
+                    try
+                    {
+                        unpackedFile.Wait();
+                    }
+                    catch (Exception)
+                    {
+                    }
+
+                    streamContext.CloseFileWriteStream(
+                        unpackedFile.FileInfo.FullName,
+                        unpackedFile.FileStream,
+                        unpackedFile.FileInfo.Attributes,
+                        unpackedFile.FileInfo.LastWriteTime);
+                }
+
+                this.currentFileNumber = fileNumber;
+            }
+        }
+
+        /// <summary>
+        /// Reads the compressed bytes of a file, opens the file, and starts
+        /// decompressing it on another thread.
+        /// </summary>
+        /// <returns>The file being extracted, or null if it is skipped.</returns>
+        private UnpackedFile StartUnpackedFile(
+            IUnpackStreamContext streamContext,
+            ZipFileHeader header,
+            int fileNumber,
+            ref Stream archiveStream)
+        {
+            Converter<Stream, Stream> compressionStreamCreator;
+            if (!ZipEngine.decompressionStreamCreators.TryGetValue(
+                header.compressionMethod, out compressionStreamCreator))
+            {
+                // Silently skip files of an unsupported compression method.
+                return null;
+            }
+
+            long compressedSize;
+            long uncompressedSize;
+            long localHeaderOffset;
+            int archiveNumber;
+            uint crc;
+            header.GetZip64Fields(
+                out compressedSize,
+                out uncompressedSize,
+                out localHeaderOffset,
+                out archiveNumber,
+                out crc);
+
+            this.CheckArchiveReadStream(streamContext, archiveNumber, ref archiveStream);
+
+            archiveStream.Seek(localHeaderOffset, SeekOrigin.Begin);
+
+            ZipFileHeader localHeader = new ZipFileHeader();
+            if (!localHeader.Read(archiveStream, false) ||
+                !ZipEngine.AreFilePathsEqual(localHeader.fileName, header.fileName))
+            {
+                string msg = "Could not read file: " + header.fileName;
+                throw new ZipException(msg);
+            }
+
+            ZipFileInfo fileInfo = header.ToZipFileInfo();
+
+            byte[] compressedBytes = new byte[fileInfo.CompressedLength];
+            int offset = 0;
+            while (offset < compressedBytes.Length)
+            {
+                int count = archiveStream.Read(
+                    compressedBytes, offset, compressedBytes.Length - offset);
+                if (count <= 0)
+                {
+                    throw new ZipException("Could not read file: " + header.fileName);
+                }
+
+                offset += count;
+            }
+
+            this.currentArchiveBytesProcessed = archiveStream.Position;
+
+            Stream fileStream = streamContext.OpenFileWriteStream(
+                fileInfo.FullName,
+                fileInfo.Length,
+                fileInfo.LastWriteTime);
+            if (fileStream == null)
+            {
+                return null;
+            }
+
+            return new UnpackedFile(
+                fileNumber,
+                header.fileName,
+                fileInfo,
+                header.crc32,
+                compressedBytes,
+                fileStream,
+                compressionStreamCreator);
+        }
+
+        /// <summary>
+        /// Waits for a file to be decompressed, and closes it.
+        /// </summary>
+        /// <remarks>
+        /// Files are finished in order, so the StartFile and FinishFile
+        /// progress events of each file are raised here, together, just
+        /// as the sequential path raises them.
+        /// </remarks>
+        private void FinishUnpackedFile(
+            IUnpackStreamContext streamContext,
+            UnpackedFile unpackedFile)
+        {
+            this.currentFileNumber = unpackedFile.FileNumber;
+            this.currentFileName = unpackedFile.Name;
+            this.currentFileBytesProcessed = 0;
+            this.currentFileTotalBytes = unpackedFile.FileInfo.Length;
+            this.currentArchiveNumber--;
+            this.OnProgress(ArchiveProgressType.StartFile);
+            this.currentArchiveNumber++;
+
+            try
+            {
+                unpackedFile.Wait();
+            }
+            finally
+            {
+                streamContext.CloseFileWriteStream(
+                    unpackedFile.FileInfo.FullName,
+                    unpackedFile.FileStream,
+                    unpackedFile.FileInfo.Attributes,
+                    unpackedFile.FileInfo.LastWriteTime);
+            }
+
+            this.currentFileBytesProcessed = unpackedFile.FileInfo.Length;
+            this.fileBytesProcessed += unpackedFile.FileInfo.Length;
+
+            this.currentArchiveNumber--;
+            this.OnProgress(ArchiveProgressType.FinishFile);
+            this.currentArchiveNumber++;
+        }
+
+        /// <summary>
+        /// Moves to the archive holding a file if necessary.
+        /// </summary>
+        private void CheckArchiveReadStream(
+            IUnpackStreamContext streamContext,
+            int archiveNumber,
+            ref Stream archiveStream)
+        {
+            if (this.currentArchiveNumber != archiveNumber + 1)
+            {
+                if (archiveStream != null)
+                {
+                    streamContext.CloseArchiveReadStream(
+                        this.currentArchiveNumber,
+                        String.Empty,
+                        archiveStream);
+                    archiveStream = null;
+
+                    this.OnProgress(ArchiveProgressType.FinishArchive);
+                    this.currentArchiveName = null;
+                }
+
+                this.currentArchiveNumber = (short) (archiveNumber + 1);
+                this.currentArchiveBytesProcessed = 0;
+                this.currentArchiveTotalBytes = 0;
+
+                archiveStream = this.OpenArchive(
+                    streamContext, this.currentArchiveNumber);
+
+                FileStream archiveFileStream = archiveStream as FileStream;
+                this.currentArchiveName = (archiveFileStream != null ?
+                    Path.GetFileName(archiveFileStream.Name) : null);
+
+                this.currentArchiveTotalBytes = archiveStream.Length;
+                this.currentArchiveNumber--;
+                this.OnProgress(ArchiveProgressType.StartArchive);
+                this.currentArchiveNumber++;
+            }
+        }
+
         /// <summary>
         /// Compares two internal file paths while ignoring case and slash differences.
         /// </summary>
@@ -346,6 +584,88 @@ namespace Microsoft.Deployment.Compression.Zip
                 throw new ZipException("CRC check failed for file: " + fileName);
             }
         }
+
+        /// <summary>
+        /// A file being decompressed on another thread,
+        /// for <see cref="UnpackFilesInParallel"/>.
+        /// </summary>
+        private sealed class UnpackedFile
+        {
+            private readonly Task task;
+
+            internal UnpackedFile(
+                int fileNumber,
+                string name,
+                ZipFileInfo fileInfo,
+                uint crc,
+                byte[] compressedBytes,
+                Stream fileStream,
+                Converter<Stream, Stream> compressionStreamCreator)
+            {
+                this.FileNumber = fileNumber;
+                this.Name = name;
+                this.FileInfo = fileInfo;
+                this.FileStream = fileStream;
+                this.task = Task.Factory.StartNew(
+                    delegate { this.Decompress(compressedBytes, crc, compressionStreamCreator); });
+            }
+
+            internal int FileNumber { get; private set; }
+
+            internal string Name { get; private set; }
+
+            internal ZipFileInfo FileInfo { get; private set; }
+
+            internal Stream FileStream { get; private set; }
+
+            /// <summary>
+            /// Waits for the decompression to finish, throwing anything
+            /// that went wrong.
+            /// </summary>
+            internal void Wait()
+            {
+                try
+                {
+                    this.task.Wait();
+                }
+                catch (AggregateException ex)
+                {
+                    throw ex.InnerException;
+                }
+            }
+
+            private void Decompress(
+                byte[] compressedBytes,
+                uint crc,
+                Converter<Stream, Stream> compressionStreamCreator)
+            {
+                CrcStream crcStream = new CrcStream(this.FileStream);
+                Stream decompressionStream = compressionStreamCreator(
+                    new MemoryStream(compressedBytes, false));
+
+                byte[] buf = new byte[4096];
+                long bytesRemaining = this.FileInfo.Length;
+                while (bytesRemaining > 0)
+                {
+                    int count = (int) Math.Min(buf.Length, bytesRemaining);
+                    count = decompressionStream.Read(buf, 0, count);
+                    if (count <= 0)
+                    {
+                        throw new ZipException("Could not read file: " + this.Name);
+                    }
+
+                    crcStream.Write(buf, 0, count);
+                    bytesRemaining -= count;
+                }
+
+                crcStream.Flush();
+
+                if (crcStream.Crc != crc)
+                {
+                    throw new ZipException("CRC check failed for file: " + this.Name);
+                }
+            }
+        }
     }
 }
 
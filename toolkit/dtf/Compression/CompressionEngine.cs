@@ -30,6 +30,7 @@ using System.Globalization;
     {
         private CompressionLevel compressionLevel;
         private bool dontUseTempFiles;
+        private int maxDegreeOfParallelism;
 
         /// <summary>
         /// Creates a new instance of the compression engine base class.
@@ -37,6 +38,7 @@ using System.Globalization;
         internal CompressionEngine()
         {
             this.compressionLevel = CompressionLevel.Normal;
+            this.maxDegreeOfParallelism = Environment.ProcessorCount;
         }
 
         /// <summary>
@@ -79,6 +81,30 @@ using System.Globalization;
             }
         }
 
+        /// <summary>
+        /// Gets or sets the most files that may be compressed or extracted
+        /// at the same time.
+        /// </summary>
+        /// <value>The number of files to work on at once, or 1 to work on
+        /// one file at a time.</value>
+        /// <remarks>The default is the number of processors. Whatever the
+        /// setting, the stream context is only ever called from the thread
+        /// that started the operation, and in the same order, and archives
+        /// come out the same. Engines that can only work on one file at a
+        /// time ignore this.</remarks>
+        internal int MaxDegreeOfParallelism
+        {
+            get
+            {
+                return this.maxDegreeOfParallelism;
+            }
+
+            set
+            {
+                this.maxDegreeOfParallelism = Math.Max(1, value);
+            }
+        }
+
         /// <summary>
         /// Compression level to use when compressing files.
         /// </summary>
@@ -358,16 +384,28 @@ using System.Globalization;
         internal static void DosDateAndTimeToDateTime(
             short dosDate, short dosTime, out DateTime dateTime)
         {
-            if (dosDate == 0 && dosTime == 0)
+            // The date is packed as yyyyyyym mmmddddd (years since 1980),
+            // and the time as hhhhhmmm mmmsssss (seconds / 2). This is done
+            // here rather than by the Win32 functions so that it works on
+            // any platform.
+            int year = 1980 + ((dosDate >> 9) & 0x7F);
+            int month = (dosDate >> 5) & 0x0F;
+            int day = dosDate & 0x1F;
+            int hour = (dosTime >> 11) & 0x1F;
+            int minute = (dosTime >> 5) & 0x3F;
+            int second = (dosTime & 0x1F) * 2;
+
+            if ((dosDate == 0 && dosTime == 0) ||
+                month < 1 || month > 12 || day < 1 ||
+                day > DateTime.DaysInMonth(year, month) ||
+                hour > 23 || minute > 59 || second > 59)
             {
                 dateTime = DateTime.MinValue;
             }
             else
             {
-                long fileTime;
-                SafeNativeMethods.DosDateTimeToFileTime(dosDate, dosTime, out fileTime);
-                dateTime = DateTime.FromFileTimeUtc(fileTime);
-                dateTime = new DateTime(dateTime.Ticks, DateTimeKind.Local);
+                dateTime = new DateTime(
+                    year, month, day, hour, minute, second, DateTimeKind.Local);
             }
         }
 
@@ -375,12 +413,27 @@ using System.Globalization;
         /// Compresion utility function for converting a DateTime structure
         /// to old-style date and time values.
         /// </summary>
+        /// <remarks>
+        /// Times are truncated to an even number of seconds, and dates
+        /// outside of the range that can be represented (1980 to 2107)
+        /// are clamped to it.
+        /// </remarks>
         internal static void DateTimeToDosDateAndTime(
             DateTime dateTime, out short dosDate, out short dosTime)
         {
-            dateTime = new DateTime(dateTime.Ticks, DateTimeKind.Utc);
-            long filetime = dateTime.ToFileTimeUtc();
-            SafeNativeMethods.FileTimeToDosDateTime(ref filetime, out dosDate, out dosTime);
+            if (dateTime.Year < 1980)
+            {
+                dateTime = new DateTime(1980, 1, 1);
+            }
+            else if (dateTime.Year > 2107)
+            {
+                dateTime = new DateTime(2107, 12, 31, 23, 59, 58);
+            }
+
+            dosDate = unchecked((short) (((dateTime.Year - 1980) << 9) |
+                (dateTime.Month << 5) | dateTime.Day));
+            dosTime = unchecked((short) ((dateTime.Hour << 11) |
+                (dateTime.Minute << 5) | (dateTime.Second / 2)));
         }
     }
 }
@@ -24,8 +24,9 @@ namespace Microsoft.Deployment.Compression
     /// Duplicates a source stream by maintaining a separate position.
     /// </summary>
     /// <remarks>
-    /// WARNING: duplicate streams are not thread-safe with respect to each other or the original stream.
-    /// If multiple threads use duplicate copies of the same stream, they must synchronize for any operations.
+    /// Reads and writes lock the source stream, so duplicates of the same stream can each be read
+    /// or written from a different thread. WARNING: other operations, and anything done directly
+    /// to the original stream, are not synchronized.
     /// </remarks>
     internal class DuplicateStream : Stream
     {
@@ -173,12 +174,15 @@ namespace Microsoft.Deployment.Compression
         /// or zero (0) if the end of the stream has been reached.</returns>
         public override int Read(byte[] buffer, int offset, int count)
         {
-            long saveSourcePosition = this.source.Position;
-            this.source.Position = this.position;
-            int read = this.source.Read(buffer, offset, count);
-            this.position = this.source.Position;
-            this.source.Position = saveSourcePosition;
-            return read;
+            lock (this.source)
+            {
+                long saveSourcePosition = this.source.Position;
+                this.source.Position = this.position;
+                int read = this.source.Read(buffer, offset, count);
+                this.position = this.source.Position;
+                this.source.Position = saveSourcePosition;
+                return read;
+            }
         }
 
         /// <summary>
@@ -193,11 +197,14 @@ namespace Microsoft.Deployment.Compression
         /// current stream.</param>
         public override void Write(byte[] buffer, int offset, int count)
         {
-            long saveSourcePosition = this.source.Position;
-            this.source.Position = this.position;
-            this.source.Write(buffer, offset, count);
-            this.position = this.source.Position;
-            this.source.Position = saveSourcePosition;
+            lock (this.source)
+            {
+                long saveSourcePosition = this.source.Position;
+                this.source.Position = this.position;
+                this.source.Write(buffer, offset, count);
+                this.position = this.source.Position;
+                this.source.Position = saveSourcePosition;
+            }
         }
 
         /// <summary>
@@ -1,37 +0,0 @@
-﻿//---------------------------------------------------------------------
-// <copyright file="SafeNativeMethods.cs" company="Microsoft">
-//    Copyright (c) Microsoft Corporation.  All rights reserved.
-//    
-//    The use and distribution terms for this software are covered by the
-//    Common Public License 1.0 (http://opensource.org/licenses/cpl1.0.php)
-//    which can be found in the file CPL.TXT at the root of this distribution.
-//    By using this software in any fashion, you are agreeing to be bound by
-//    the terms of this license.
-//    
-//    You must not remove this notice, or any other, from this software.
-// </copyright>
-// <summary>
-// Part of the Deployment Tools Foundation project.
-// </summary>
-//---------------------------------------------------------------------
-
-namespace Microsoft.Deployment.Compression
-{
-    using System;
-    using System.Security;
-    using System.Runtime.InteropServices;
-
-    [SuppressUnmanagedCodeSecurity]
-    internal static class SafeNativeMethods
-    {
-        [DllImport("kernel32.dll", SetLastError = true)]
-        [return: MarshalAs(UnmanagedType.Bool)]
-        internal static extern bool DosDateTimeToFileTime(
-            short wFatDate, short wFatTime, out long fileTime);
-
-        [DllImport("kernel32.dll", SetLastError = true)]
-        [return: MarshalAs(UnmanagedType.Bool)]
-        internal static extern bool FileTimeToDosDateTime(
-            ref long fileTime, out short wFatDate, out short wFatTime);
-    }
-}